@@ -20,6 +20,7 @@
 #include <linux/init.h>
 #include <linux/device.h>
 #include <linux/bootmem.h>
+#include <linux/cma.h>
 #include <mach/setup.h>
 #include <asm/setup.h>
 #include <linux/dma-mapping.h>
@@ -169,6 +170,8 @@ void bcm21553_mm_mem_init(void)
 	bmem_mempool_base = phys_to_virt(bmem_phys_base);
 	pr_info("bmem phys[0x%08x] virt[0x%08x] size[0x%08x] \n",
 		bmem_phys_base, (uint32_t)bmem_mempool_base, BMEM_SIZE);
+	/* lend the pool to the page allocator while it is idle */
+	cma_declare_area(bmem_phys_base, BMEM_SIZE);
 #else
 #ifdef CONFIG_GE_WRAP
 	ret = reserve_bootmem(ge_mem_phys_base, gememalloc_SIZE, BOOTMEM_EXCLUSIVE);
@@ -180,6 +183,7 @@ void bcm21553_mm_mem_init(void)
 	ge_mempool_base = phys_to_virt(ge_mem_phys_base);
 	pr_info("ge phys[0x%08x] virt[0x%08x] size[0x%08x] \n",
 		ge_mem_phys_base, (uint32_t)ge_mempool_base, gememalloc_SIZE);
+	cma_declare_area(ge_mem_phys_base, gememalloc_SIZE);
 #endif
 #endif
 
@@ -199,6 +203,7 @@ void bcm21553_mm_mem_init(void)
 	memalloc_mempool_base = alloc_bootmem_low_pages(MEMALLOC_SIZE + SZ_2M);
 #endif
 	cam_mempool_base = alloc_bootmem_low_pages(1024 * 1024 * 8);
+	cma_declare_area(virt_to_phys(cam_mempool_base), 1024 * 1024 * 8);
 #endif
 }
 
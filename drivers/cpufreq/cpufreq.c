@@ -29,6 +29,12 @@
 #include <linux/completion.h>
 #include <linux/mutex.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/cpufreq_gov.h>
+
+EXPORT_TRACEPOINT_SYMBOL_GPL(cpufreq_gov_sample);
+EXPORT_TRACEPOINT_SYMBOL_GPL(cpufreq_gov_target);
+
 #define dprintk(msg...) cpufreq_debug_printk(CPUFREQ_DEBUG_CORE, \
 						"cpufreq-core", msg)
 
@@ -1687,6 +1693,58 @@ void cpufreq_unregister_governor(struct cpufreq_governor *governor)
 EXPORT_SYMBOL_GPL(cpufreq_unregister_governor);
 
 
+static LIST_HEAD(cpufreq_gov_model_list);
+static DEFINE_MUTEX(cpufreq_gov_model_mutex);
+
+int cpufreq_register_gov_model(struct cpufreq_gov_model *model)
+{
+	if (!model || !model->init || !model->sample)
+		return -EINVAL;
+
+	mutex_lock(&cpufreq_gov_model_mutex);
+	list_add_tail(&model->model_list, &cpufreq_gov_model_list);
+	mutex_unlock(&cpufreq_gov_model_mutex);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(cpufreq_register_gov_model);
+
+
+void cpufreq_unregister_gov_model(struct cpufreq_gov_model *model)
+{
+	if (!model)
+		return;
+
+	mutex_lock(&cpufreq_gov_model_mutex);
+	list_del(&model->model_list);
+	mutex_unlock(&cpufreq_gov_model_mutex);
+}
+EXPORT_SYMBOL_GPL(cpufreq_unregister_gov_model);
+
+
+/**
+ * cpufreq_for_each_gov_model - call @fn for every registered governor model
+ *
+ * Models cannot be unregistered while @fn runs. Stops at and returns the
+ * first non-zero return value of @fn.
+ */
+int cpufreq_for_each_gov_model(int (*fn)(struct cpufreq_gov_model *model,
+					 void *data), void *data)
+{
+	struct cpufreq_gov_model *model;
+	int ret = 0;
+
+	mutex_lock(&cpufreq_gov_model_mutex);
+	list_for_each_entry(model, &cpufreq_gov_model_list, model_list) {
+		ret = fn(model, data);
+		if (ret)
+			break;
+	}
+	mutex_unlock(&cpufreq_gov_model_mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(cpufreq_for_each_gov_model);
+
+
 
 /*********************************************************************
  *                          POLICY INTERFACE                         *
@@ -23,6 +23,7 @@
 #include <linux/tick.h>
 #include <linux/ktime.h>
 #include <linux/sched.h>
+#include <trace/events/cpufreq_gov.h>
 
 /*
  * dbs is used in this file as a shortform for demandbased switching
@@ -491,6 +492,9 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 			max_load = load;
 	}
 
+	trace_cpufreq_gov_sample("conservative", policy->cpu, max_load,
+				 policy->cur);
+
 	/*
 	 * break out if we 'cannot' reduce the speed as the user might
 	 * want freq_step to be zero
@@ -516,6 +520,9 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 		if (this_dbs_info->requested_freq > policy->max)
 			this_dbs_info->requested_freq = policy->max;
 
+		trace_cpufreq_gov_target("conservative", policy->cpu,
+					 policy->cur,
+					 this_dbs_info->requested_freq);
 		__cpufreq_driver_target(policy, this_dbs_info->requested_freq,
 			CPUFREQ_RELATION_H);
 		return;
@@ -539,6 +546,9 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 		if (policy->cur == policy->min)
 			return;
 
+		trace_cpufreq_gov_target("conservative", policy->cpu,
+					 policy->cur,
+					 this_dbs_info->requested_freq);
 		__cpufreq_driver_target(policy, this_dbs_info->requested_freq,
 				CPUFREQ_RELATION_H);
 		return;
@@ -27,6 +27,7 @@
 #include <linux/earlysuspend.h>
 
 #include <asm/cputime.h>
+#include <trace/events/cpufreq_gov.h>
 
 static void (*pm_idle_old)(void);
 static atomic_t active_count = ATOMIC_INIT(0);
@@ -110,6 +111,8 @@ static void cpufreq_interactivex_timer(unsigned long data)
 		if (nr_running() < 1)
 			return;
 
+		trace_cpufreq_gov_sample("interactiveX", data, 100, policy->cur);
+
 		target_freq = policy->max;
 
 		cpumask_set_cpu(data, &work_cpumask);
@@ -173,6 +176,15 @@ static void cpufreq_idle(void)
  * Choose the cpu frequency based off the load. For now choose the minimum
  * frequency that will satisfy the load, which is not always the lower power.
  */
+static unsigned int cpufreq_interactivex_load_freq(struct cpufreq_policy *pol,
+						   unsigned int cpu_load)
+{
+	if (cpu_load > 98)
+		return pol->max;
+
+	return pol->cur * cpu_load / 100;
+}
+
 static unsigned int cpufreq_interactivex_calc_freq(unsigned int cpu)
 {
 	unsigned int delta_time;
@@ -189,8 +201,9 @@ static unsigned int cpufreq_interactivex_calc_freq(unsigned int cpu)
 
 	cpu_load = 100 * (delta_time - idle_time) / delta_time;
 
-	if (cpu_load > 98) newfreq = policy->max;
-	else newfreq = policy->cur * cpu_load / 100;	
+	trace_cpufreq_gov_sample("interactiveX", cpu, cpu_load, policy->cur);
+
+	newfreq = cpufreq_interactivex_load_freq(policy, cpu_load);
 
 	return newfreq;
 }
@@ -212,9 +225,13 @@ static void cpufreq_interactivex_freq_change_time_work(struct work_struct *work)
 				return;
 			}
 //			__cpufreq_driver_target(policy, target_freq, CPUFREQ_RELATION_H);
+			trace_cpufreq_gov_target("interactiveX", cpu,
+						 policy->cur, newtarget);
 			__cpufreq_driver_target(policy, newtarget, CPUFREQ_RELATION_H);
 		} else {
 			target_freq = cpufreq_interactivex_calc_freq(cpu);
+			trace_cpufreq_gov_target("interactiveX", cpu,
+						 policy->cur, target_freq);
 			__cpufreq_driver_target(policy, target_freq,
 							CPUFREQ_RELATION_L);
 		}
@@ -356,9 +373,71 @@ static int cpufreq_governor_interactivex(struct cpufreq_policy *new_policy,
 	return 0;
 }
 
+/*
+ * Replay model. A sample without idle time stands for the idle-exit timer
+ * seeing no idle and ramping up; otherwise the load since the last change
+ * is used once min_sample_time has passed. The single-runnable-task check
+ * of the ramp up can't be modelled and is left out.
+ */
+struct cpufreq_interactivex_model {
+	unsigned int period_us;
+	unsigned int since_change_us;
+	unsigned int busy_us;
+};
+
+static unsigned int cpufreq_interactivex_model_init(void *state,
+						    struct cpufreq_policy *pol)
+{
+	struct cpufreq_interactivex_model *m = state;
+
+	m->period_us = jiffies_to_usecs(2);
+	m->since_change_us = 0;
+	m->busy_us = 0;
+	return m->period_us;
+}
+
+static unsigned int cpufreq_interactivex_model_sample(void *state,
+						      struct cpufreq_policy *pol,
+						      unsigned int load,
+						      unsigned int *relation)
+{
+	struct cpufreq_interactivex_model *m = state;
+	unsigned int freq;
+
+	m->since_change_us += m->period_us;
+	m->busy_us += m->period_us * load / 100;
+
+	if (load >= 100) {
+		if (pol->cur == pol->max)
+			return 0;
+		*relation = CPUFREQ_RELATION_H;
+		freq = freq_threshld;
+	} else {
+		if (pol->cur == pol->min)
+			return 0;
+		if (m->since_change_us < min_sample_time)
+			return 0;
+		*relation = CPUFREQ_RELATION_L;
+		freq = cpufreq_interactivex_load_freq(pol,
+				100 * m->busy_us / m->since_change_us);
+	}
+
+	m->since_change_us = 0;
+	m->busy_us = 0;
+	return freq;
+}
+
+static struct cpufreq_gov_model cpufreq_interactivex_model = {
+	.name		= "interactiveX",
+	.state_size	= sizeof(struct cpufreq_interactivex_model),
+	.init		= cpufreq_interactivex_model_init,
+	.sample		= cpufreq_interactivex_model_sample,
+};
+
 static int __init cpufreq_interactivex_init(void)
 {
 	unsigned int i;
+	int err;
 	struct timer_list *t;
 	min_sample_time = DEFAULT_MIN_SAMPLE_TIME;
 	resum_speed = RESUME_SPEED;
@@ -379,7 +458,12 @@ static int __init cpufreq_interactivex_init(void)
 	INIT_WORK(&freq_scale_work, cpufreq_interactivex_freq_change_time_work);
 
         pr_info("[imoseyon] interactiveX enter\n");
-	return cpufreq_register_governor(&cpufreq_gov_interactivex);
+	err = cpufreq_register_governor(&cpufreq_gov_interactivex);
+	if (err)
+		return err;
+
+	cpufreq_register_gov_model(&cpufreq_interactivex_model);
+	return 0;
 }
 
 #ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_INTERACTIVEX
@@ -391,6 +475,7 @@ module_init(cpufreq_interactivex_init);
 static void __exit cpufreq_interactivex_exit(void)
 {
         pr_info("[imoseyon] interactiveX exit\n");
+	cpufreq_unregister_gov_model(&cpufreq_interactivex_model);
 	cpufreq_unregister_governor(&cpufreq_gov_interactivex);
 	destroy_workqueue(up_wq);
 	destroy_workqueue(down_wq);
@@ -33,6 +33,7 @@
 #include <linux/tick.h>
 #include <linux/ktime.h>
 #include <linux/sched.h>
+#include <trace/events/cpufreq_gov.h>
 
 #define DEF_FREQUENCY_UP_THRESHOLD		(70)
 #define DEF_FREQUENCY_DOWN_THRESHOLD		(30)
@@ -42,6 +43,7 @@ static unsigned int min_sampling_rate;
 
 #define LATENCY_MULTIPLIER			(1000)
 #define MIN_LATENCY_MULTIPLIER			(100)
+#define DEF_SAMPLING_RATE			(10000)
 #define DEF_SAMPLING_DOWN_FACTOR		(1)
 #define MAX_SAMPLING_DOWN_FACTOR		(10)
 #define TRANSITION_LATENCY_LIMIT		(10 * 1000 * 1000)
@@ -293,6 +295,51 @@ static struct attribute_group dbs_attr_group = {
 	.name = "Lionheart",
 };
 
+/*
+ * Step *@requested_freq by freq_step for a load of @max_load percent.
+ * Returns the frequency to request with CPUFREQ_RELATION_H, or 0 to stay.
+ */
+static unsigned int dbs_next_freq(struct cpufreq_policy *policy,
+				  unsigned int *requested_freq,
+				  unsigned int max_load)
+{
+	unsigned int freq_target;
+
+	if (dbs_tuners_ins.freq_step == 0)
+		return 0;
+
+	freq_target = (dbs_tuners_ins.freq_step * policy->max) / 100;
+
+	if (max_load > dbs_tuners_ins.up_threshold) {
+		if (*requested_freq == policy->max)
+			return 0;
+
+		if (unlikely(freq_target == 0))
+			freq_target = 5;
+
+		*requested_freq += freq_target;
+		if (*requested_freq > policy->max)
+			*requested_freq = policy->max;
+
+		return *requested_freq;
+	}
+
+	if (max_load < (dbs_tuners_ins.down_threshold - 10)) {
+		/* don't wrap below zero, that would ask for policy->max */
+		if (*requested_freq < policy->min + freq_target)
+			*requested_freq = policy->min;
+		else
+			*requested_freq -= freq_target;
+
+		if (policy->cur == policy->min)
+			return 0;
+
+		return *requested_freq;
+	}
+
+	return 0;
+}
+
 static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 {
 	unsigned int load = 0;
@@ -344,43 +391,21 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 			max_load = load;
 	}
 
-	if (dbs_tuners_ins.freq_step == 0)
-		return;
+	trace_cpufreq_gov_sample("Lionheart", policy->cpu, max_load,
+				 policy->cur);
 
-	if (max_load > dbs_tuners_ins.up_threshold) {
+	if (max_load > dbs_tuners_ins.up_threshold)
 		this_dbs_info->down_skip = 0;
 
-		if (this_dbs_info->requested_freq == policy->max)
-			return;
-
-		freq_target = (dbs_tuners_ins.freq_step * policy->max) / 100;
-
-		if (unlikely(freq_target == 0))
-			freq_target = 5;
-
-		this_dbs_info->requested_freq += freq_target;
-		if (this_dbs_info->requested_freq > policy->max)
-			this_dbs_info->requested_freq = policy->max;
-
-		__cpufreq_driver_target(policy, this_dbs_info->requested_freq,
-			CPUFREQ_RELATION_H);
+	freq_target = dbs_next_freq(policy, &this_dbs_info->requested_freq,
+				    max_load);
+	if (!freq_target)
 		return;
-	}
-
-	if (max_load < (dbs_tuners_ins.down_threshold - 10)) {
-		freq_target = (dbs_tuners_ins.freq_step * policy->max) / 100;
-
-		this_dbs_info->requested_freq -= freq_target;
-		if (this_dbs_info->requested_freq < policy->min)
-			this_dbs_info->requested_freq = policy->min;
 
-		if (policy->cur == policy->min)
-			return;
+	trace_cpufreq_gov_target("Lionheart", policy->cpu, policy->cur,
+				 freq_target);
 
-		__cpufreq_driver_target(policy, this_dbs_info->requested_freq,
-				CPUFREQ_RELATION_H);
-		return;
-	}
+	__cpufreq_driver_target(policy, freq_target, CPUFREQ_RELATION_H);
 }
 
 static void do_dbs_timer(struct work_struct *work)
@@ -466,8 +491,8 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 				return rc;
 			}
 
-			min_sampling_rate = 10000;
-			dbs_tuners_ins.sampling_rate = 10000;
+			min_sampling_rate = DEF_SAMPLING_RATE;
+			dbs_tuners_ins.sampling_rate = DEF_SAMPLING_RATE;
 
 			cpufreq_register_notifier(
 					&dbs_cpufreq_notifier_block,
@@ -525,13 +550,42 @@ struct cpufreq_governor cpufreq_gov_lionheart = {
 	.owner			= THIS_MODULE,
 };
 
+/* replay model, the state is the requested frequency */
+static unsigned int dbs_model_init(void *state, struct cpufreq_policy *policy)
+{
+	*(unsigned int *)state = policy->cur;
+	return dbs_tuners_ins.sampling_rate ? : DEF_SAMPLING_RATE;
+}
+
+static unsigned int dbs_model_sample(void *state, struct cpufreq_policy *policy,
+				     unsigned int load, unsigned int *relation)
+{
+	*relation = CPUFREQ_RELATION_H;
+	return dbs_next_freq(policy, state, load);
+}
+
+static struct cpufreq_gov_model dbs_model = {
+	.name		= "Lionheart",
+	.state_size	= sizeof(unsigned int),
+	.init		= dbs_model_init,
+	.sample		= dbs_model_sample,
+};
+
 static int __init cpufreq_gov_dbs_init(void)
 {
-	return cpufreq_register_governor(&cpufreq_gov_lionheart);
+	int err;
+
+	err = cpufreq_register_governor(&cpufreq_gov_lionheart);
+	if (err)
+		return err;
+
+	cpufreq_register_gov_model(&dbs_model);
+	return 0;
 }
 
 static void __exit cpufreq_gov_dbs_exit(void)
 {
+	cpufreq_unregister_gov_model(&dbs_model);
 	cpufreq_unregister_governor(&cpufreq_gov_lionheart);
 }
 
@@ -22,6 +22,7 @@
 #include <linux/tick.h>
 #include <linux/ktime.h>
 #include <linux/sched.h>
+#include <trace/events/cpufreq_gov.h>
 
 /*
  * dbs is used in this file as a shortform for demandbased switching
@@ -459,9 +460,57 @@ static struct attribute_group dbs_attr_group_old = {
 
 /************************** sysfs end ************************/
 
+/*
+ * Frequency to go to for a load of @max_load_freq (load in percent times
+ * frequency), or 0 to stay. Powersave bias is applied by the caller.
+ */
+static unsigned int dbs_next_freq(struct cpufreq_policy *policy,
+				  unsigned int max_load_freq,
+				  unsigned int *relation)
+{
+	unsigned int freq_next;
+
+	/* Check for frequency increase */
+	if (max_load_freq > dbs_tuners_ins.up_threshold * policy->cur) {
+		/* if we are already at full speed then break out early */
+		if (!dbs_tuners_ins.powersave_bias && policy->cur == policy->max)
+			return 0;
+
+		*relation = CPUFREQ_RELATION_H;
+		return policy->max;
+	}
+
+	/* Check for frequency decrease */
+	/* if we cannot reduce the frequency anymore, break out early */
+	if (policy->cur == policy->min)
+		return 0;
+
+	/*
+	 * The optimal frequency is the frequency that is the lowest that
+	 * can support the current CPU usage without triggering the up
+	 * policy. To be safe, we focus 10 points under the threshold.
+	 */
+	if (max_load_freq <
+	    (dbs_tuners_ins.up_threshold - dbs_tuners_ins.down_differential) *
+	     policy->cur) {
+		freq_next = max_load_freq /
+				(dbs_tuners_ins.up_threshold -
+				 dbs_tuners_ins.down_differential);
+
+		if (freq_next < policy->min)
+			freq_next = policy->min;
+
+		*relation = CPUFREQ_RELATION_L;
+		return freq_next;
+	}
+
+	return 0;
+}
+
 static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 {
 	unsigned int max_load_freq;
+	unsigned int freq_next, relation;
 
 	struct cpufreq_policy *policy;
 	unsigned int j;
@@ -549,54 +598,21 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 			max_load_freq = load_freq;
 	}
 
-	/* Check for frequency increase */
-	if (max_load_freq > dbs_tuners_ins.up_threshold * policy->cur) {
-		/* if we are already at full speed then break out early */
-		if (!dbs_tuners_ins.powersave_bias) {
-			if (policy->cur == policy->max)
-				return;
-
-			__cpufreq_driver_target(policy, policy->max,
-				CPUFREQ_RELATION_H);
-		} else {
-			int freq = powersave_bias_target(policy, policy->max,
-					CPUFREQ_RELATION_H);
-			__cpufreq_driver_target(policy, freq,
-				CPUFREQ_RELATION_L);
-		}
-		return;
-	}
+	trace_cpufreq_gov_sample("ondemand", policy->cpu,
+				 max_load_freq / policy->cur, policy->cur);
 
-	/* Check for frequency decrease */
-	/* if we cannot reduce the frequency anymore, break out early */
-	if (policy->cur == policy->min)
+	freq_next = dbs_next_freq(policy, max_load_freq, &relation);
+	if (!freq_next)
 		return;
 
-	/*
-	 * The optimal frequency is the frequency that is the lowest that
-	 * can support the current CPU usage without triggering the up
-	 * policy. To be safe, we focus 10 points under the threshold.
-	 */
-	if (max_load_freq <
-	    (dbs_tuners_ins.up_threshold - dbs_tuners_ins.down_differential) *
-	     policy->cur) {
-		unsigned int freq_next;
-		freq_next = max_load_freq /
-				(dbs_tuners_ins.up_threshold -
-				 dbs_tuners_ins.down_differential);
-
-		if (freq_next < policy->min)
-			freq_next = policy->min;
+	trace_cpufreq_gov_target("ondemand", policy->cpu, policy->cur,
+				 freq_next);
 
-		if (!dbs_tuners_ins.powersave_bias) {
-			__cpufreq_driver_target(policy, freq_next,
-					CPUFREQ_RELATION_L);
-		} else {
-			int freq = powersave_bias_target(policy, freq_next,
-					CPUFREQ_RELATION_L);
-			__cpufreq_driver_target(policy, freq,
-				CPUFREQ_RELATION_L);
-		}
+	if (!dbs_tuners_ins.powersave_bias) {
+		__cpufreq_driver_target(policy, freq_next, relation);
+	} else {
+		int freq = powersave_bias_target(policy, freq_next, relation);
+		__cpufreq_driver_target(policy, freq, CPUFREQ_RELATION_L);
 	}
 }
 
@@ -771,6 +787,24 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 	return 0;
 }
 
+/* replay model, the per-cpu averaging frequency is taken to be policy->cur */
+static unsigned int dbs_model_init(void *state, struct cpufreq_policy *policy)
+{
+	return dbs_tuners_ins.sampling_rate ? : min_sampling_rate;
+}
+
+static unsigned int dbs_model_sample(void *state, struct cpufreq_policy *policy,
+				     unsigned int load, unsigned int *relation)
+{
+	return dbs_next_freq(policy, load * policy->cur, relation);
+}
+
+static struct cpufreq_gov_model dbs_model = {
+	.name		= "ondemand",
+	.init		= dbs_model_init,
+	.sample		= dbs_model_sample,
+};
+
 static int __init cpufreq_gov_dbs_init(void)
 {
 	int err;
@@ -803,14 +837,18 @@ static int __init cpufreq_gov_dbs_init(void)
 		return -EFAULT;
 	}
 	err = cpufreq_register_governor(&cpufreq_gov_ondemand);
-	if (err)
+	if (err) {
 		destroy_workqueue(kondemand_wq);
+		return err;
+	}
 
-	return err;
+	cpufreq_register_gov_model(&dbs_model);
+	return 0;
 }
 
 static void __exit cpufreq_gov_dbs_exit(void)
 {
+	cpufreq_unregister_gov_model(&dbs_model);
 	cpufreq_unregister_governor(&cpufreq_gov_ondemand);
 	destroy_workqueue(kondemand_wq);
 }
@@ -0,0 +1,499 @@
+/*
+ * drivers/cpufreq/cpufreq_replay.c
+ *
+ * Replays load traces through the decision logic of every governor that
+ * registered a struct cpufreq_gov_model, on a simulated cpu with its own
+ * frequency table, so governors can be compared on the same workload
+ * without a cpufreq driver and without waiting for the trace to play out
+ * in real time. It runs as a self-test when loaded (UML or QEMU will do)
+ * and replays user supplied traces through debugfs.
+ *
+ * A trace is a list of steps of "<duration in us> <demand in percent>",
+ * where the demand is the share of the cpu's capacity at its highest
+ * frequency that work arrives at during the step. A cpufreq_gov_sample
+ * trace recorded on a device converts as demand = load * cur / max_freq.
+ * Work the simulated cpu can't do at its current frequency is carried
+ * over, and is what the latency figures report.
+ *
+ *  echo "16000 40" > /sys/kernel/debug/cpufreq_replay/trace
+ *  cat /sys/kernel/debug/cpufreq_replay/results
+ *
+ * Writing "clear" to the trace file empties it; with an empty trace the
+ * built-in traces are replayed.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpumask.h>
+#include <linux/debugfs.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#define REPLAY_MAX_FREQS		(16)
+#define REPLAY_MAX_STEPS		(65536)
+#define REPLAY_DEF_PERIOD_US		(10000)
+#define REPLAY_UI_FRAMES		(60)
+
+struct replay_step {
+	unsigned int duration_us;
+	unsigned int demand;
+};
+
+struct replay_result {
+	u64 energy;		/* work done times V^2, in us * V^2 */
+	u64 freq_time;		/* frequency times time, for the average */
+	u64 total_us;
+	u64 late_us;		/* time during which work was waiting */
+	unsigned int max_backlog_us;
+	unsigned int transitions;
+	unsigned int final_freq;
+	unsigned int bad_targets;
+};
+
+/* The BCM21553 operating points by default */
+static unsigned int freqs[REPLAY_MAX_FREQS] = {
+	156000, 312000, 468000, 624000, 832000,
+};
+static int nr_freqs = 5;
+module_param_array(freqs, uint, &nr_freqs, S_IRUGO);
+MODULE_PARM_DESC(freqs, "Frequency table of the simulated cpu in kHz");
+
+static unsigned int volts[REPLAY_MAX_FREQS] = {
+	1160, 1200, 1200, 1220, 1300,
+};
+static int nr_volts = 5;
+module_param_array(volts, uint, &nr_volts, S_IRUGO);
+MODULE_PARM_DESC(volts, "Voltage of each frequency in mV, for the energy proxy");
+
+static struct cpufreq_frequency_table replay_table[REPLAY_MAX_FREQS + 1];
+static unsigned int replay_min_freq, replay_max_freq;
+
+static struct replay_step *user_trace;
+static unsigned int user_trace_len;
+static DEFINE_MUTEX(replay_mutex);
+
+static struct dentry *replay_dir;
+
+/************************** built-in traces ************************/
+
+static const struct replay_step replay_idle[] = {
+	{ 2000000, 2 },
+};
+
+static const struct replay_step replay_full[] = {
+	{ 1000000, 100 },
+};
+
+static const struct replay_step replay_ramp[] = {
+	{ 200000, 10 }, { 200000, 30 }, { 200000, 50 }, { 200000, 70 },
+	{ 200000, 90 }, { 200000, 100 }, { 200000, 50 }, { 200000, 10 },
+};
+
+/* one second of 60 fps UI, 6 ms of work at the top frequency per frame */
+static struct replay_step replay_ui[2 * REPLAY_UI_FRAMES];
+
+struct replay_trace {
+	const char *name;
+	const struct replay_step *steps;
+	unsigned int len;
+	unsigned int expect_freq;	/* frequency it must end at, or 0 */
+};
+
+static struct replay_trace replay_builtin[] = {
+	{ "idle", replay_idle, ARRAY_SIZE(replay_idle) },
+	{ "full", replay_full, ARRAY_SIZE(replay_full) },
+	{ "ramp", replay_ramp, ARRAY_SIZE(replay_ramp) },
+	{ "ui", replay_ui, ARRAY_SIZE(replay_ui) },
+};
+
+/************************** simulation ************************/
+
+static unsigned int replay_volt(unsigned int freq)
+{
+	int i;
+
+	for (i = 0; i < nr_freqs; i++)
+		if (freqs[i] == freq)
+			break;
+
+	/* without a voltage table assume voltage scales with frequency */
+	if (nr_volts != nr_freqs || i == nr_freqs)
+		return freq / 1000;
+
+	return volts[i];
+}
+
+/*
+ * Run @trace through @model. Work is accounted in percent-microseconds
+ * of the capacity at the highest frequency, so 100 of it is one
+ * microsecond of work at replay_max_freq.
+ */
+static int replay_one(struct cpufreq_gov_model *model,
+		      const struct replay_trace *trace,
+		      struct replay_result *res)
+{
+	struct cpufreq_policy *policy;
+	void *state = NULL;
+	unsigned int period, in_period = 0;
+	unsigned int freq, relation, index, load, volt;
+	u64 backlog = 0, busy = 0, cap_period = 0;
+	u64 cap, pending, served;
+	unsigned int i, left, dt;
+
+	memset(res, 0, sizeof(*res));
+
+	policy = kzalloc(sizeof(*policy), GFP_KERNEL);
+	if (!policy)
+		return -ENOMEM;
+
+	if (model->state_size) {
+		state = kzalloc(model->state_size, GFP_KERNEL);
+		if (!state) {
+			kfree(policy);
+			return -ENOMEM;
+		}
+	}
+
+	/* frequency table lookups want an online cpu */
+	policy->cpu = cpumask_first(cpu_online_mask);
+	policy->cpuinfo.min_freq = policy->min = replay_min_freq;
+	policy->cpuinfo.max_freq = policy->max = replay_max_freq;
+	policy->cur = replay_min_freq;
+
+	period = model->init(state, policy);
+	if (!period)
+		period = REPLAY_DEF_PERIOD_US;
+
+	for (i = 0; i < trace->len; i++) {
+		left = trace->steps[i].duration_us;
+
+		while (left) {
+			dt = min(left, period - in_period);
+
+			cap = (u64)dt * 100 * policy->cur;
+			do_div(cap, replay_max_freq);
+			pending = backlog + (u64)trace->steps[i].demand * dt;
+			served = min(pending, cap);
+			backlog = pending - served;
+
+			if (backlog) {
+				u64 backlog_us = backlog;
+
+				do_div(backlog_us, 100);
+				res->late_us += dt;
+				if (backlog_us > res->max_backlog_us)
+					res->max_backlog_us = backlog_us;
+			}
+
+			volt = replay_volt(policy->cur);
+			res->energy += served * volt * volt;
+			res->freq_time += (u64)policy->cur * dt;
+			res->total_us += dt;
+
+			busy += served;
+			cap_period += cap;
+			in_period += dt;
+			left -= dt;
+
+			if (in_period < period)
+				continue;
+
+			load = 0;
+			if (cap_period) {
+				u64 tmp = busy * 100;
+
+				do_div(tmp, cap_period);
+				load = tmp;
+			}
+
+			relation = CPUFREQ_RELATION_L;
+			freq = model->sample(state, policy, load, &relation);
+			if (freq) {
+				if (cpufreq_frequency_table_target(policy,
+						replay_table, freq, relation,
+						&index)) {
+					res->bad_targets++;
+				} else if (replay_table[index].frequency !=
+					   policy->cur) {
+					policy->cur = replay_table[index].frequency;
+					res->transitions++;
+				}
+			}
+
+			busy = cap_period = 0;
+			in_period = 0;
+		}
+	}
+
+	/* percent-us * mV^2 to us * V^2 */
+	do_div(res->energy, 100 * 1000 * 1000);
+	res->final_freq = policy->cur;
+
+	kfree(state);
+	kfree(policy);
+	return 0;
+}
+
+struct replay_run {
+	struct seq_file *m;
+	const struct replay_trace *trace;
+	unsigned int failures;
+};
+
+static int replay_model(struct cpufreq_gov_model *model, void *data)
+{
+	struct replay_run *run = data;
+	const struct replay_trace *trace = run->trace;
+	struct replay_result res;
+	u64 avg_freq;
+	int ret;
+
+	ret = replay_one(model, trace, &res);
+	if (ret)
+		return ret;
+
+	avg_freq = res.freq_time;
+	if (res.total_us)
+		do_div(avg_freq, res.total_us);
+
+	if (run->m)
+		seq_printf(run->m, "%-14s %-6s %10llu %8llu %8llu %8u %6u %8u\n",
+			   model->name, trace->name, res.energy, avg_freq,
+			   div_u64(res.late_us, 1000), res.max_backlog_us,
+			   res.transitions, res.final_freq);
+	else
+		printk(KERN_INFO "cpufreq_replay: %s %s: energy %llu "
+		       "avg_khz %llu late_ms %llu max_backlog_us %u "
+		       "transitions %u final_khz %u\n",
+		       model->name, trace->name, res.energy, avg_freq,
+		       div_u64(res.late_us, 1000), res.max_backlog_us,
+		       res.transitions, res.final_freq);
+
+	if (res.bad_targets ||
+	    (trace->expect_freq && res.final_freq != trace->expect_freq)) {
+		printk(KERN_ERR "cpufreq_replay: %s %s: FAIL, %u bad targets, "
+		       "ended at %u kHz, expected %u kHz\n", model->name,
+		       trace->name, res.bad_targets, res.final_freq,
+		       trace->expect_freq);
+		run->failures++;
+	}
+
+	return 0;
+}
+
+static int replay_all(struct seq_file *m, unsigned int *failures)
+{
+	struct replay_run run = { .m = m };
+	struct replay_trace user = { .name = "user" };
+	int i, ret;
+
+	if (m)
+		seq_printf(m, "%-14s %-6s %10s %8s %8s %8s %6s %8s\n",
+			   "governor", "trace", "energy", "avg_khz",
+			   "late_ms", "backlog", "trans", "final");
+
+	if (user_trace_len) {
+		user.steps = user_trace;
+		user.len = user_trace_len;
+		run.trace = &user;
+		ret = cpufreq_for_each_gov_model(replay_model, &run);
+	} else {
+		for (i = 0, ret = 0; i < ARRAY_SIZE(replay_builtin) && !ret;
+		     i++) {
+			run.trace = &replay_builtin[i];
+			ret = cpufreq_for_each_gov_model(replay_model, &run);
+		}
+	}
+
+	if (failures)
+		*failures = run.failures;
+	return ret;
+}
+
+/************************** debugfs interface ************************/
+
+static int replay_results_show(struct seq_file *m, void *unused)
+{
+	int ret;
+
+	mutex_lock(&replay_mutex);
+	ret = replay_all(m, NULL);
+	mutex_unlock(&replay_mutex);
+
+	return ret;
+}
+
+static int replay_results_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, replay_results_show, NULL);
+}
+
+static const struct file_operations replay_results_fops = {
+	.owner		= THIS_MODULE,
+	.open		= replay_results_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * Append whole lines of "<duration_us> <demand>" to the user trace. A
+ * line cut off at the end of the buffer is left for the next write.
+ */
+static ssize_t replay_trace_write(struct file *file, const char __user *ubuf,
+				  size_t count, loff_t *ppos)
+{
+	char *buf, *line, *next, *end;
+	unsigned int duration, demand;
+	ssize_t consumed;
+	int ret = 0;
+
+	count = min_t(size_t, count, PAGE_SIZE - 1);
+	buf = kmalloc(count + 1, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	if (copy_from_user(buf, ubuf, count)) {
+		kfree(buf);
+		return -EFAULT;
+	}
+	buf[count] = '\0';
+
+	/* keep a partial last line for the next write */
+	end = strrchr(buf, '\n');
+	if (end && end != buf + count - 1 && count == PAGE_SIZE - 1)
+		end[1] = '\0';
+	consumed = strlen(buf);
+
+	mutex_lock(&replay_mutex);
+	for (next = buf; (line = strsep(&next, "\n")) != NULL; ) {
+		line = strstrip(line);
+		if (!*line)
+			continue;
+
+		if (!strcmp(line, "clear")) {
+			user_trace_len = 0;
+			continue;
+		}
+
+		if (sscanf(line, "%u %u", &duration, &demand) != 2 ||
+		    !duration || demand > 100) {
+			ret = -EINVAL;
+			break;
+		}
+
+		if (user_trace_len == REPLAY_MAX_STEPS) {
+			ret = -ENOSPC;
+			break;
+		}
+
+		user_trace[user_trace_len].duration_us = duration;
+		user_trace[user_trace_len].demand = demand;
+		user_trace_len++;
+	}
+	mutex_unlock(&replay_mutex);
+
+	kfree(buf);
+	return ret ? ret : consumed;
+}
+
+static const struct file_operations replay_trace_fops = {
+	.owner		= THIS_MODULE,
+	.write		= replay_trace_write,
+};
+
+/************************** debugfs end ************************/
+
+static int __init cpufreq_replay_build_table(void)
+{
+	int i;
+
+	if (nr_freqs <= 0)
+		return -EINVAL;
+
+	replay_min_freq = ~0;
+	replay_max_freq = 0;
+	for (i = 0; i < nr_freqs; i++) {
+		if (!freqs[i])
+			return -EINVAL;
+		replay_table[i].index = i;
+		replay_table[i].frequency = freqs[i];
+		replay_min_freq = min(replay_min_freq, freqs[i]);
+		replay_max_freq = max(replay_max_freq, freqs[i]);
+	}
+	replay_table[i].frequency = CPUFREQ_TABLE_END;
+
+	return 0;
+}
+
+static int __init cpufreq_replay_init(void)
+{
+	unsigned int failures;
+	int i, ret;
+
+	ret = cpufreq_replay_build_table();
+	if (ret) {
+		printk(KERN_ERR "cpufreq_replay: invalid frequency table\n");
+		return ret;
+	}
+
+	for (i = 0; i < REPLAY_UI_FRAMES; i++) {
+		replay_ui[2 * i].duration_us = 6000;
+		replay_ui[2 * i].demand = 100;
+		replay_ui[2 * i + 1].duration_us = 10667;
+		replay_ui[2 * i + 1].demand = 3;
+	}
+	replay_builtin[0].expect_freq = replay_min_freq;
+	replay_builtin[1].expect_freq = replay_max_freq;
+
+	user_trace = vmalloc(REPLAY_MAX_STEPS * sizeof(*user_trace));
+	if (!user_trace)
+		return -ENOMEM;
+
+	ret = replay_all(NULL, &failures);
+	if (ret)
+		printk(KERN_ERR "cpufreq_replay: replay failed: %d\n", ret);
+	else
+		printk(KERN_INFO "cpufreq_replay: self-test %s, %u failures\n",
+		       failures ? "FAILED" : "passed", failures);
+
+	replay_dir = debugfs_create_dir("cpufreq_replay", NULL);
+	if (replay_dir) {
+		debugfs_create_file("trace", S_IWUSR, replay_dir, NULL,
+				    &replay_trace_fops);
+		debugfs_create_file("results", S_IRUSR, replay_dir, NULL,
+				    &replay_results_fops);
+	}
+
+	return 0;
+}
+
+static void __exit cpufreq_replay_exit(void)
+{
+	debugfs_remove_recursive(replay_dir);
+	vfree(user_trace);
+}
+
+MODULE_DESCRIPTION("'cpufreq_replay' - replay load traces through cpufreq "
+		   "governors");
+MODULE_LICENSE("GPL");
+
+late_initcall(cpufreq_replay_init);
+module_exit(cpufreq_replay_exit);
@@ -0,0 +1,635 @@
+/*
+ * drivers/cpufreq/cpufreq_schedutil.c
+ *
+ * A cpufreq governor driven by the scheduler's utilization of each cpu.
+ *
+ * Instead of sampling idle time from a timer it is called by the
+ * scheduler from the tick and from wakeups whenever a new busy average
+ * is available (see update_rq_util() in kernel/sched.c), and picks the
+ * frequency from the driver's table right away. The frequency change
+ * itself is done by a per-policy real-time thread, since the callback
+ * runs in scheduler context and drivers may sleep.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpu.h>
+#include <linux/input.h>
+#include <linux/jiffies.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <trace/events/cpufreq_gov.h>
+
+#define DEF_RATE_LIMIT_US			(10000)
+#define DEF_INPUT_BOOST_MS			(40)
+#define MAX_INPUT_BOOST_MS			(5000)
+#define TRANSITION_LATENCY_LIMIT		(10 * 1000 * 1000)
+
+struct sugov_policy {
+	struct cpufreq_policy *policy;
+	struct cpufreq_frequency_table *table;
+	struct list_head node;
+
+	spinlock_t update_lock;		/* protects the fields below */
+	u64 last_freq_update_time;
+	unsigned int next_freq;
+	unsigned int work_in_progress:1;
+
+	struct task_struct *thread;
+	struct mutex work_lock;		/* serializes frequency changes */
+};
+
+struct sugov_cpu {
+	struct update_util_data update_util;
+	struct sugov_policy *sg_policy;
+	unsigned long util;
+	unsigned long max;
+};
+static DEFINE_PER_CPU(struct sugov_cpu, sugov_cpu);
+
+/* active policies, walked by the input boost */
+static LIST_HEAD(sugov_policy_list);
+static DEFINE_SPINLOCK(sugov_list_lock);
+
+static DEFINE_MUTEX(sugov_mutex);
+static unsigned int sugov_enable;
+
+/* jiffies starts out below 0, so 0 would boost right after boot */
+static unsigned long sugov_boost_until = INITIAL_JIFFIES;
+
+static struct sugov_tuners {
+	unsigned int rate_limit_us;
+	unsigned int input_boost_freq;
+	unsigned int input_boost_ms;
+} sugov_tuners_ins = {
+	.rate_limit_us = DEF_RATE_LIMIT_US,
+	.input_boost_freq = 0,
+	.input_boost_ms = DEF_INPUT_BOOST_MS,
+};
+
+/*
+ * The frequency that runs @util out of @max with 25% headroom. The busy
+ * average is not frequency invariant, it is the share of time the cpu
+ * was busy at the current frequency, so scale that rather than the
+ * maximum: otherwise a light load keeps the cpu well above the lowest
+ * frequency that can carry it.
+ */
+static unsigned int sugov_util_freq(struct cpufreq_policy *policy,
+				    unsigned long util, unsigned long max)
+{
+	unsigned int cur = policy->cur;
+
+	return (cur + (cur >> 2)) * util / max;
+}
+
+/*
+ * Pick the lowest table frequency that leaves 25% headroom above the
+ * busiest cpu of the policy, raised to the input boost frequency while
+ * a boost is running. Called with update_lock held.
+ */
+static unsigned int sugov_next_freq(struct sugov_policy *sg_policy)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned long util = 0, max = 1;
+	unsigned int freq, boost, index;
+	unsigned int j;
+
+	for_each_cpu(j, policy->cpus) {
+		struct sugov_cpu *j_sg_cpu = &per_cpu(sugov_cpu, j);
+
+		if (j_sg_cpu->util * max > util * j_sg_cpu->max) {
+			util = j_sg_cpu->util;
+			max = j_sg_cpu->max;
+		}
+	}
+
+	freq = sugov_util_freq(policy, util, max);
+
+	if (time_before(jiffies, sugov_boost_until)) {
+		boost = sugov_tuners_ins.input_boost_freq;
+		if (!boost)
+			boost = policy->max;
+		freq = max(freq, boost);
+	}
+
+	freq = clamp_val(freq, policy->min, policy->max);
+
+	if (sg_policy->table &&
+	    !cpufreq_frequency_table_target(policy, sg_policy->table, freq,
+					    CPUFREQ_RELATION_L, &index))
+		freq = sg_policy->table[index].frequency;
+
+	return freq;
+}
+
+/*
+ * Re-evaluate the frequency of @sg_policy. Called with update_lock held;
+ * returns true if the caller has to wake the thread once it dropped the
+ * lock (the wakeup re-enters the scheduler, and with it this governor).
+ */
+static bool sugov_update_freq(struct sugov_policy *sg_policy, bool boost)
+{
+	u64 now = ktime_to_ns(ktime_get());
+	unsigned int freq;
+
+	if (!boost && now - sg_policy->last_freq_update_time <
+			(u64)sugov_tuners_ins.rate_limit_us * NSEC_PER_USEC)
+		return false;
+
+	freq = sugov_next_freq(sg_policy);
+	if (freq == sg_policy->next_freq)
+		return false;
+
+	/* a boost only ever raises the frequency */
+	if (boost && freq < sg_policy->next_freq)
+		return false;
+
+	trace_cpufreq_gov_target("schedutil", sg_policy->policy->cpu,
+				 sg_policy->policy->cur, freq);
+
+	sg_policy->next_freq = freq;
+	sg_policy->last_freq_update_time = now;
+
+	if (sg_policy->work_in_progress)
+		return false;
+
+	sg_policy->work_in_progress = 1;
+	return true;
+}
+
+static void sugov_update_util(struct update_util_data *data, int cpu,
+			      unsigned long util, unsigned long max)
+{
+	struct sugov_cpu *sg_cpu = container_of(data, struct sugov_cpu,
+						update_util);
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+	unsigned long flags;
+	bool wake;
+
+	trace_cpufreq_gov_sample("schedutil", cpu, util * 100 / max,
+				 sg_policy->policy->cur);
+
+	spin_lock_irqsave(&sg_policy->update_lock, flags);
+	sg_cpu->util = util;
+	sg_cpu->max = max;
+	wake = sugov_update_freq(sg_policy, false);
+	spin_unlock_irqrestore(&sg_policy->update_lock, flags);
+
+	if (wake)
+		wake_up_process(sg_policy->thread);
+}
+
+static int sugov_thread(void *data)
+{
+	struct sugov_policy *sg_policy = data;
+	unsigned long flags;
+	unsigned int freq;
+
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+
+		spin_lock_irqsave(&sg_policy->update_lock, flags);
+		if (!sg_policy->work_in_progress) {
+			spin_unlock_irqrestore(&sg_policy->update_lock, flags);
+			schedule();
+			continue;
+		}
+		sg_policy->work_in_progress = 0;
+		freq = sg_policy->next_freq;
+		spin_unlock_irqrestore(&sg_policy->update_lock, flags);
+
+		__set_current_state(TASK_RUNNING);
+
+		mutex_lock(&sg_policy->work_lock);
+		if (freq != sg_policy->policy->cur)
+			__cpufreq_driver_target(sg_policy->policy, freq,
+						CPUFREQ_RELATION_L);
+		mutex_unlock(&sg_policy->work_lock);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+/************************** input boost ************************/
+
+static void sugov_input_event(struct input_handle *handle, unsigned int type,
+			      unsigned int code, int value)
+{
+	struct sugov_policy *sg_policy;
+	unsigned long flags;
+	bool wake;
+
+	if (!sugov_tuners_ins.input_boost_ms)
+		return;
+
+	sugov_boost_until = jiffies +
+		msecs_to_jiffies(sugov_tuners_ins.input_boost_ms);
+
+	spin_lock_irqsave(&sugov_list_lock, flags);
+	list_for_each_entry(sg_policy, &sugov_policy_list, node) {
+		spin_lock(&sg_policy->update_lock);
+		wake = sugov_update_freq(sg_policy, true);
+		spin_unlock(&sg_policy->update_lock);
+
+		if (wake)
+			wake_up_process(sg_policy->thread);
+	}
+	spin_unlock_irqrestore(&sugov_list_lock, flags);
+}
+
+static int sugov_input_connect(struct input_handler *handler,
+			       struct input_dev *dev,
+			       const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_schedutil";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_free;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_unregister;
+
+	return 0;
+
+err_unregister:
+	input_unregister_handle(handle);
+err_free:
+	kfree(handle);
+	return error;
+}
+
+static void sugov_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id sugov_input_ids[] = {
+	/* multi-touch touchscreens */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			    BIT_MASK(ABS_MT_POSITION_X) |
+			    BIT_MASK(ABS_MT_POSITION_Y) },
+	},
+	/* single-touch touchscreens */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_KEYBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+		.absbit = { [BIT_WORD(ABS_X)] =
+			    BIT_MASK(ABS_X) | BIT_MASK(ABS_Y) },
+	},
+	/* keypads */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+	},
+	{ },
+};
+
+static struct input_handler sugov_input_handler = {
+	.event		= sugov_input_event,
+	.connect	= sugov_input_connect,
+	.disconnect	= sugov_input_disconnect,
+	.name		= "cpufreq_schedutil",
+	.id_table	= sugov_input_ids,
+};
+
+/************************** sysfs interface ************************/
+
+#define show_one(file_name, object)					\
+static ssize_t show_##file_name						\
+(struct kobject *kobj, struct attribute *attr, char *buf)		\
+{									\
+	return sprintf(buf, "%u\n", sugov_tuners_ins.object);		\
+}
+show_one(rate_limit_us, rate_limit_us);
+show_one(input_boost_freq, input_boost_freq);
+show_one(input_boost_ms, input_boost_ms);
+
+static ssize_t store_rate_limit_us(struct kobject *a, struct attribute *b,
+				   const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+
+	if (ret != 1)
+		return -EINVAL;
+
+	sugov_tuners_ins.rate_limit_us = input;
+	return count;
+}
+
+static ssize_t store_input_boost_freq(struct kobject *a, struct attribute *b,
+				      const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+
+	if (ret != 1)
+		return -EINVAL;
+
+	sugov_tuners_ins.input_boost_freq = input;
+	return count;
+}
+
+static ssize_t store_input_boost_ms(struct kobject *a, struct attribute *b,
+				    const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+
+	if (ret != 1 || input > MAX_INPUT_BOOST_MS)
+		return -EINVAL;
+
+	sugov_tuners_ins.input_boost_ms = input;
+	return count;
+}
+
+define_one_global_rw(rate_limit_us);
+define_one_global_rw(input_boost_freq);
+define_one_global_rw(input_boost_ms);
+
+static struct attribute *sugov_attributes[] = {
+	&rate_limit_us.attr,
+	&input_boost_freq.attr,
+	&input_boost_ms.attr,
+	NULL
+};
+
+static struct attribute_group sugov_attr_group = {
+	.attrs = sugov_attributes,
+	.name = "schedutil",
+};
+
+/************************** sysfs end ************************/
+
+static int sugov_start(struct cpufreq_policy *policy)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO - 1 };
+	struct sugov_policy *sg_policy;
+	unsigned long flags;
+	unsigned int j;
+	int rc;
+
+	sg_policy = kzalloc(sizeof(*sg_policy), GFP_KERNEL);
+	if (!sg_policy)
+		return -ENOMEM;
+
+	sg_policy->policy = policy;
+	sg_policy->table = cpufreq_frequency_get_table(policy->cpu);
+	sg_policy->next_freq = policy->cur;
+	spin_lock_init(&sg_policy->update_lock);
+	mutex_init(&sg_policy->work_lock);
+
+	sg_policy->thread = kthread_create(sugov_thread, sg_policy,
+					   "sugov:%u", policy->cpu);
+	if (IS_ERR(sg_policy->thread)) {
+		rc = PTR_ERR(sg_policy->thread);
+		goto err_free;
+	}
+	sched_setscheduler(sg_policy->thread, SCHED_FIFO, &param);
+	wake_up_process(sg_policy->thread);
+
+	mutex_lock(&sugov_mutex);
+	sugov_enable++;
+	if (sugov_enable == 1) {
+		rc = sysfs_create_group(cpufreq_global_kobject,
+					&sugov_attr_group);
+		if (rc)
+			goto err_unlock;
+
+		/* boosting is optional, run without it if this fails */
+		if (input_register_handler(&sugov_input_handler))
+			printk(KERN_WARNING "cpufreq_schedutil: no input boost\n");
+	}
+	mutex_unlock(&sugov_mutex);
+
+	spin_lock_irqsave(&sugov_list_lock, flags);
+	list_add(&sg_policy->node, &sugov_policy_list);
+	spin_unlock_irqrestore(&sugov_list_lock, flags);
+
+	for_each_cpu(j, policy->cpus) {
+		struct sugov_cpu *j_sg_cpu = &per_cpu(sugov_cpu, j);
+
+		j_sg_cpu->sg_policy = sg_policy;
+		j_sg_cpu->util = 0;
+		j_sg_cpu->max = SCHED_LOAD_SCALE;
+		j_sg_cpu->update_util.func = sugov_update_util;
+		cpufreq_set_update_util_data(j, &j_sg_cpu->update_util);
+	}
+
+	return 0;
+
+err_unlock:
+	sugov_enable--;
+	mutex_unlock(&sugov_mutex);
+	kthread_stop(sg_policy->thread);
+err_free:
+	kfree(sg_policy);
+	return rc;
+}
+
+static void sugov_stop(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = per_cpu(sugov_cpu, policy->cpu).sg_policy;
+	unsigned long flags;
+	unsigned int j;
+
+	for_each_cpu(j, policy->cpus)
+		cpufreq_set_update_util_data(j, NULL);
+	synchronize_sched();
+
+	spin_lock_irqsave(&sugov_list_lock, flags);
+	list_del(&sg_policy->node);
+	spin_unlock_irqrestore(&sugov_list_lock, flags);
+
+	mutex_lock(&sugov_mutex);
+	sugov_enable--;
+	if (!sugov_enable) {
+		input_unregister_handler(&sugov_input_handler);
+		sysfs_remove_group(cpufreq_global_kobject, &sugov_attr_group);
+	}
+	mutex_unlock(&sugov_mutex);
+
+	kthread_stop(sg_policy->thread);
+	mutex_destroy(&sg_policy->work_lock);
+
+	for_each_cpu(j, policy->cpus)
+		per_cpu(sugov_cpu, j).sg_policy = NULL;
+	kfree(sg_policy);
+}
+
+static void sugov_limits(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = per_cpu(sugov_cpu, policy->cpu).sg_policy;
+	unsigned long flags;
+
+	if (!sg_policy)
+		return;
+
+	mutex_lock(&sg_policy->work_lock);
+	if (policy->max < policy->cur)
+		__cpufreq_driver_target(policy, policy->max,
+					CPUFREQ_RELATION_H);
+	else if (policy->min > policy->cur)
+		__cpufreq_driver_target(policy, policy->min,
+					CPUFREQ_RELATION_L);
+	mutex_unlock(&sg_policy->work_lock);
+
+	/* let the next utilization update re-evaluate within the new limits */
+	spin_lock_irqsave(&sg_policy->update_lock, flags);
+	sg_policy->next_freq = policy->cur;
+	sg_policy->last_freq_update_time = 0;
+	spin_unlock_irqrestore(&sg_policy->update_lock, flags);
+}
+
+static int cpufreq_governor_schedutil(struct cpufreq_policy *policy,
+				      unsigned int event)
+{
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		if ((!cpu_online(policy->cpu)) || (!policy->cur))
+			return -EINVAL;
+
+		return sugov_start(policy);
+
+	case CPUFREQ_GOV_STOP:
+		sugov_stop(policy);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		sugov_limits(policy);
+		break;
+	}
+	return 0;
+}
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL
+static
+#endif
+struct cpufreq_governor cpufreq_gov_schedutil = {
+	.name			= "schedutil",
+	.governor		= cpufreq_governor_schedutil,
+	.max_transition_latency	= TRANSITION_LATENCY_LIMIT,
+	.owner			= THIS_MODULE,
+};
+
+/*
+ * Replay model. Each sample is one scheduler window; the busy average is
+ * kept the way update_rq_util() in kernel/sched.c keeps rq->util_avg.
+ * Input boost is not modelled.
+ */
+struct sugov_model {
+	unsigned int period_us;
+	unsigned int since_change_us;
+	unsigned int next_freq;
+	unsigned long util_avg;
+};
+
+static unsigned int sugov_model_init(void *state, struct cpufreq_policy *policy)
+{
+	struct sugov_model *m = state;
+
+	m->period_us = jiffies_to_usecs(1);
+	m->since_change_us = 0;
+	m->next_freq = policy->cur;
+	m->util_avg = 0;
+	return m->period_us;
+}
+
+static unsigned int sugov_model_sample(void *state, struct cpufreq_policy *policy,
+				       unsigned int load, unsigned int *relation)
+{
+	struct sugov_model *m = state;
+	unsigned long util = load * SCHED_LOAD_SCALE / 100;
+	unsigned int freq;
+
+	if (util >= m->util_avg)
+		m->util_avg = util;
+	else
+		m->util_avg = (m->util_avg + util) >> 1;
+
+	m->since_change_us += m->period_us;
+	if (m->since_change_us < sugov_tuners_ins.rate_limit_us)
+		return 0;
+
+	freq = sugov_util_freq(policy, m->util_avg, SCHED_LOAD_SCALE);
+	if (freq == m->next_freq)
+		return 0;
+
+	m->next_freq = freq;
+	m->since_change_us = 0;
+	*relation = CPUFREQ_RELATION_L;
+	return freq;
+}
+
+static struct cpufreq_gov_model sugov_model = {
+	.name		= "schedutil",
+	.state_size	= sizeof(struct sugov_model),
+	.init		= sugov_model_init,
+	.sample		= sugov_model_sample,
+};
+
+static int __init cpufreq_gov_schedutil_init(void)
+{
+	int err;
+
+	err = cpufreq_register_governor(&cpufreq_gov_schedutil);
+	if (err)
+		return err;
+
+	cpufreq_register_gov_model(&sugov_model);
+	return 0;
+}
+
+static void __exit cpufreq_gov_schedutil_exit(void)
+{
+	cpufreq_unregister_gov_model(&sugov_model);
+	cpufreq_unregister_governor(&cpufreq_gov_schedutil);
+}
+
+MODULE_DESCRIPTION("'cpufreq_schedutil' - A cpufreq governor driven by "
+		   "scheduler utilization");
+MODULE_LICENSE("GPL");
+
+fs_initcall(cpufreq_gov_schedutil_init);
+module_exit(cpufreq_gov_schedutil_exit);
@@ -23,6 +23,7 @@
 #include <linux/android_pmem.h>
 #include <linux/mempolicy.h>
 #include <linux/sched.h>
+#include <linux/cma.h>
 #include <asm/io.h>
 #include <asm/uaccess.h>
 #include <asm/cacheflush.h>
@@ -232,6 +233,25 @@ static int is_master_owner(struct file *file)
 	return ret;
 }
 
+/* the region may be lent to the page allocator, see mm/cma.c */
+static int pmem_claim(int id, unsigned long start, unsigned long len)
+{
+	int ret;
+
+	ret = cma_claim(start, len);
+	if (ret) {
+		printk(KERN_ERR "pmem: %lx-%lx still in use by the system\n",
+		       start, start + len);
+		return ret;
+	}
+#ifdef CONFIG_CMA
+	/* drop what the previous users left in the kernel's mapping */
+	dmac_flush_range(__va(start), __va(start) + len);
+	outer_flush_range(start, start + len);
+#endif
+	return 0;
+}
+
 static int pmem_free(int id, int index)
 {
 	/* caller should hold the write lock on pmem_sem! */
@@ -239,9 +259,11 @@ static int pmem_free(int id, int index)
 	DLOG("index %d\n", index);
 
 	if (pmem[id].no_allocator) {
+		cma_release(pmem[id].base, pmem[id].size);
 		pmem[id].allocated = 0;
 		return 0;
 	}
+	cma_release(PMEM_START_ADDR(id, curr), PMEM_LEN(id, curr));
 	/* clean up the bitmap, merging any buddies */
 	pmem[id].bitmap[curr].allocated = 0;
 	/* find a slots buddy Buddy# = Slot# ^ (1 << order)
@@ -389,6 +411,8 @@ static int pmem_allocate(int id, unsigned long len)
 		DLOG("no allocator");
 		if ((len > pmem[id].size) || pmem[id].allocated)
 			return -1;
+		if (pmem_claim(id, pmem[id].base, pmem[id].size))
+			return -1;
 		pmem[id].allocated = 1;
 		return len;
 	}
@@ -424,6 +448,11 @@ static int pmem_allocate(int id, unsigned long len)
 		return -1;
 	}
 
+	/* the slot stays at best_fit when it is split down to order */
+	if (pmem_claim(id, PMEM_START_ADDR(id, best_fit),
+		       (1 << order) * PMEM_MIN_ALLOC))
+		return -1;
+
 	/* now partition the best fit:
 	 * 	split the slot into 2 buddies of order - 1
 	 * 	repeat until the slot is of the correct order
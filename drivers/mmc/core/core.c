@@ -223,6 +223,79 @@ void mmc_wait_for_req(struct mmc_host *host, struct mmc_request *mrq)
 
 EXPORT_SYMBOL(mmc_wait_for_req);
 
+static void __mmc_start_req(struct mmc_host *host, struct mmc_request *mrq)
+{
+	init_completion(&mrq->completion);
+	mrq->done_data = &mrq->completion;
+	mrq->done = mmc_wait_done;
+
+	mmc_start_request(host, mrq);
+}
+
+static void mmc_pre_req(struct mmc_host *host, struct mmc_request *mrq,
+		 bool is_first_req)
+{
+	if (host->ops->pre_req)
+		host->ops->pre_req(host, mrq, is_first_req);
+}
+
+static void mmc_post_req(struct mmc_host *host, struct mmc_request *mrq,
+			 int err)
+{
+	if (host->ops->post_req)
+		host->ops->post_req(host, mrq, err);
+}
+
+/**
+ *	mmc_start_req - start a request without waiting for it
+ *	@host: MMC host to start the request on
+ *	@areq: request to start, or NULL to only finish the running one
+ *	@error: where to store the result of the running request's err_check
+ *
+ *	Prepares @areq while the previously started request is still
+ *	running, then waits for that request, checks it and starts @areq.
+ *	Returns the request that completed, or NULL if there was none.
+ *	If the completed request failed, @areq is not started, the error
+ *	is stored in @error and the caller has to start @areq again once
+ *	it has dealt with the error.
+ */
+struct mmc_async_req *mmc_start_req(struct mmc_host *host,
+				    struct mmc_async_req *areq, int *error)
+{
+	int err = 0;
+	struct mmc_async_req *data = host->areq;
+
+	/* Get the new request ready while the old one is on the bus */
+	if (areq)
+		mmc_pre_req(host, areq->mrq, !host->areq);
+
+	if (host->areq) {
+		wait_for_completion(&host->areq->mrq->completion);
+		err = host->areq->err_check(host->card, host->areq);
+		if (err) {
+			mmc_post_req(host, host->areq->mrq, 0);
+			if (areq)
+				mmc_post_req(host, areq->mrq, -EINVAL);
+			host->areq = NULL;
+			goto out;
+		}
+	}
+
+	if (areq)
+		__mmc_start_req(host, areq->mrq);
+
+	if (host->areq)
+		mmc_post_req(host, host->areq->mrq, 0);
+
+	host->areq = areq;
+ out:
+	if (error)
+		*error = err;
+	return data;
+}
+
+EXPORT_SYMBOL(mmc_start_req);
+
 /**
  *	mmc_wait_for_cmd - start a command and wait for completion
  *	@host: MMC host to start command
@@ -45,6 +45,7 @@
 #define DBG(f, x...) \
 	pr_debug(DRIVER_NAME " [%s()]: " f, __func__, ## x)
 static void bcmsdhc_prepare_data(struct bcmsdhc_host *, struct mmc_data *);
+static void bcmsdhc_post_req(struct mmc_host *, struct mmc_request *, int);
 static void bcmsdhc_finish_data(struct bcmsdhc_host *);
 
 static void bcmsdhc_send_command(struct bcmsdhc_host *, struct mmc_command *);
@@ -387,13 +388,17 @@ static void bcmsdhc_transfer_pio(struct bcmsdhc_host *host)
 
 /* *************************************************************************************************** */
 /* Function Name: bcmsdhc_kmap_atomic */
-/* Description: */
+/* Description: map the page holding byte @skip of an sg entry */
 /* ************************************************************************************************** */
 
-static char *bcmsdhc_kmap_atomic(struct scatterlist *sg, unsigned long *flags)
+static char *bcmsdhc_kmap_atomic(struct scatterlist *sg, unsigned int skip,
+				 unsigned long *flags)
 {
+	unsigned int offset = sg->offset + skip;
+
 	local_irq_save(*flags);
-	return kmap_atomic(sg_page(sg), KM_BIO_SRC_IRQ) + sg->offset;
+	return kmap_atomic(nth_page(sg_page(sg), offset >> PAGE_SHIFT),
+			   KM_BIO_SRC_IRQ) + (offset & ~PAGE_MASK);
 }
 
 /* *************************************************************************************************** */
@@ -407,6 +412,51 @@ static void bcmsdhc_kunmap_atomic(void *buffer, unsigned long *flags)
 	local_irq_restore(*flags);
 }
 
+/* *************************************************************************************************** */
+/* Function Name: bcmsdhc_adma_split */
+/* Description: work out the unaligned head and tail of an sg entry */
+/* ************************************************************************************************** */
+
+static void bcmsdhc_adma_split(struct scatterlist *sg, int *head, int *tail)
+{
+	int len = sg_dma_len(sg);
+
+	/*
+	 * The SDHCI specification states that ADMA addresses must be
+	 * 32-bit aligned, and the controller moves whole words. The
+	 * (up to three) bytes before the first aligned address and the
+	 * ones after the last whole word go through the align buffer,
+	 * everything in between is transferred in place.
+	 */
+	*head = (4 - (sg_dma_address(sg) & 0x3)) & 0x3;
+	if (*head > len)
+		*head = len;
+	*tail = (len - *head) & 0x3;
+}
+
+/* *************************************************************************************************** */
+/* Function Name: bcmsdhc_adma_set_desc */
+/* Description: */
+/* ************************************************************************************************** */
+
+static u8 *bcmsdhc_adma_set_desc(u8 *desc, dma_addr_t addr, int len, u8 cmd)
+{
+	BUG_ON(len <= 0 || len > 65535);
+
+	desc[7] = (addr >> 24) & 0xff;
+	desc[6] = (addr >> 16) & 0xff;
+	desc[5] = (addr >> 8) & 0xff;
+	desc[4] = (addr >> 0) & 0xff;
+
+	desc[3] = (len >> 8) & 0xff;
+	desc[2] = (len >> 0) & 0xff;
+
+	desc[1] = 0x00;
+	desc[0] = cmd;
+
+	return desc + 8;
+}
+
 /* *************************************************************************************************** */
 /* Function Name: bcmsdhc_adma_table_pre */
 /* Description: */
@@ -421,7 +471,7 @@ static int bcmsdhc_adma_table_pre(struct bcmsdhc_host *host,
 	u8 *align;
 	dma_addr_t addr;
 	dma_addr_t align_addr;
-	int len, offset;
+	int len, head, tail;
 
 	struct scatterlist *sg;
 	int i;
@@ -444,16 +494,22 @@ static int bcmsdhc_adma_table_pre(struct bcmsdhc_host *host,
 	 */
 
 	host->align_addr = dma_map_single(mmc_dev(host->mmc),
-					  host->align_buffer, 128 * 4,
-					  direction);
+					  host->align_buffer,
+					  BCMSDHC_ALIGN_SIZE, direction);
 	if (dma_mapping_error(mmc_dev(host->mmc), host->align_addr))
 		goto fail;
 	BUG_ON(host->align_addr & 0x3);
 
-	host->sg_count = dma_map_sg(mmc_dev(host->mmc),
-				    data->sg, data->sg_len, direction);
+	/* The sg list may already have been mapped by bcmsdhc_pre_req() */
+	if (data->host_cookie)
+		host->sg_count = data->host_cookie;
+	else
+		host->sg_count = dma_map_sg(mmc_dev(host->mmc),
+					    data->sg, data->sg_len, direction);
 	if (host->sg_count == 0)
 		goto unmap_align;
+	if (host->sg_count > BCMSDHC_MAX_SEGS)
+		goto unmap_entries;
 
 	desc = host->adma_desc;
 	align = host->align_buffer;
@@ -464,81 +520,61 @@ static int bcmsdhc_adma_table_pre(struct bcmsdhc_host *host,
 		addr = sg_dma_address(sg);
 		len = sg_dma_len(sg);
 
-		/*
-		 * The SDHCI specification states that ADMA
-		 * addresses must be 32-bit aligned. If they
-		 * aren't, then we use a bounce buffer for
-		 * the (up to three) bytes that screw up the
-		 * alignment.
-		 */
-		offset = (4 - (addr & 0x3)) & 0x3;
-		if (offset) {
+		bcmsdhc_adma_split(sg, &head, &tail);
+
+		if (head) {
 			if (data->flags & MMC_DATA_WRITE) {
-				buffer = bcmsdhc_kmap_atomic(sg, &flags);
-				WARN_ON(((long)buffer & PAGE_MASK) >
-					(PAGE_SIZE - 3));
-				memcpy(align, buffer, offset);
-				pr_info("memcpy of size %d\n", offset);
+				buffer = bcmsdhc_kmap_atomic(sg, 0, &flags);
+				memcpy(align, buffer, head);
 				bcmsdhc_kunmap_atomic(buffer, &flags);
 			}
 
-			desc[7] = (align_addr >> 24) & 0xff;
-			desc[6] = (align_addr >> 16) & 0xff;
-			desc[5] = (align_addr >> 8) & 0xff;
-			desc[4] = (align_addr >> 0) & 0xff;
-
-			BUG_ON(offset > 65536);
-
-			desc[3] = (offset >> 8) & 0xff;
-			desc[2] = (offset >> 0) & 0xff;
-
-			desc[1] = 0x00;
-			desc[0] = 0x21;	/* tran, valid */
+			desc = bcmsdhc_adma_set_desc(desc, align_addr, head,
+						     0x21);	/* tran, valid */
 
 			align += 4;
 			align_addr += 4;
 
-			desc += 8;
-
-			addr += offset;
-			len -= offset;
+			addr += head;
+			len -= head;
 		}
 
-		desc[7] = (addr >> 24) & 0xff;
-		desc[6] = (addr >> 16) & 0xff;
-		desc[5] = (addr >> 8) & 0xff;
-		desc[4] = (addr >> 0) & 0xff;
+		len -= tail;
+		if (len)
+			desc = bcmsdhc_adma_set_desc(desc, addr, len,
+						     0x21);	/* tran, valid */
 
-		BUG_ON(len > 65536);
+		if (tail) {
+			if (data->flags & MMC_DATA_WRITE) {
+				buffer = bcmsdhc_kmap_atomic(sg,
+						sg_dma_len(sg) - tail, &flags);
+				memcpy(align, buffer, tail);
+				bcmsdhc_kunmap_atomic(buffer, &flags);
+			}
 
-		desc[3] = (len >> 8) & 0xff;
-		desc[2] = (len >> 0) & 0xff;
+			desc = bcmsdhc_adma_set_desc(desc, align_addr, tail,
+						     0x21);	/* tran, valid */
 
-		desc[1] = 0x00;
-#ifdef CONFIG_MMC_ARASAN_HOST_FIX
-		/*
-		 * When doing hardware scatter/gather, can not use nop in any entry.
-		 * so add an "end" here if this is the last entry and do not add
-		 * an extra terminating entry.
-		 */
-		if (host->sg_count == i + 1) {
-			desc[0] = 0x23;	/* tran, end, valid */
-		} else {
-			desc[0] = 0x21;	/* tran, valid */
+			align += 4;
+			align_addr += 4;
 		}
-#else
-		desc[0] = 0x21;	/* tran, valid */
-#endif
-		desc += 8;
 
 		/*
 		 * If this triggers then we have a calculation bug
 		 * somewhere. :/
 		 */
-		WARN_ON((desc - host->adma_desc) > (128 * 2 + 1) * 4);
+		WARN_ON((desc - host->adma_desc) > BCMSDHC_ADMA_SIZE - 8);
 	}
 
-#ifndef CONFIG_MMC_ARASAN_HOST_FIX
+#ifdef CONFIG_MMC_ARASAN_HOST_FIX
+	/*
+	 * When doing hardware scatter/gather, can not use nop in any entry,
+	 * so mark the last transfer as the end instead of adding an extra
+	 * terminating entry.
+	 */
+	desc -= 8;
+	desc[0] |= 0x02;	/* end */
+#else
 	/*
 	 * Add a terminating entry.
 	 */
@@ -559,12 +595,12 @@ static int bcmsdhc_adma_table_pre(struct bcmsdhc_host *host,
 	 */
 	if (data->flags & MMC_DATA_WRITE) {
 		dma_sync_single_for_device(mmc_dev(host->mmc),
-					   host->align_addr, 128 * 4,
-					   direction);
+					   host->align_addr,
+					   BCMSDHC_ALIGN_SIZE, direction);
 	}
 
 	host->adma_addr = dma_map_single(mmc_dev(host->mmc),
-					 host->adma_desc, (128 * 2 + 1) * 4,
+					 host->adma_desc, BCMSDHC_ADMA_SIZE,
 					 DMA_TO_DEVICE);
 	if (dma_mapping_error(mmc_dev(host->mmc), host->adma_addr))
 		goto unmap_entries;
@@ -573,10 +609,12 @@ static int bcmsdhc_adma_table_pre(struct bcmsdhc_host *host,
 	return 0;
 
 unmap_entries:
-	dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len, direction);
+	if (!data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+			     direction);
 unmap_align:
 	dma_unmap_single(mmc_dev(host->mmc), host->align_addr,
-			 128 * 4, direction);
+			 BCMSDHC_ALIGN_SIZE, direction);
 fail:
 	return -EINVAL;
 }
@@ -592,7 +630,7 @@ static void bcmsdhc_adma_table_post(struct bcmsdhc_host *host,
 	int direction;
 
 	struct scatterlist *sg;
-	int i, size;
+	int i, head, tail;
 	u8 *align;
 	char *buffer;
 	unsigned long flags;
@@ -602,11 +640,11 @@ static void bcmsdhc_adma_table_post(struct bcmsdhc_host *host,
 	else
 		direction = DMA_TO_DEVICE;
 
-	dma_unmap_single(mmc_dev(host->mmc), host->adma_addr, (128 * 2 + 1) * 4,
-			 DMA_TO_DEVICE);
+	dma_unmap_single(mmc_dev(host->mmc), host->adma_addr,
+			 BCMSDHC_ADMA_SIZE, DMA_TO_DEVICE);
 
-	dma_unmap_single(mmc_dev(host->mmc), host->align_addr, 128 * 4,
-			 direction);
+	dma_unmap_single(mmc_dev(host->mmc), host->align_addr,
+			 BCMSDHC_ALIGN_SIZE, direction);
 
 	if (data->flags & MMC_DATA_READ) {
 		dma_sync_sg_for_cpu(mmc_dev(host->mmc), data->sg, data->sg_len,
@@ -615,13 +653,20 @@ static void bcmsdhc_adma_table_post(struct bcmsdhc_host *host,
 		align = host->align_buffer;
 
 		for_each_sg(data->sg, sg, host->sg_count, i) {
-			if (sg_dma_address(sg) & 0x3) {
-				size = 4 - (sg_dma_address(sg) & 0x3);
+			bcmsdhc_adma_split(sg, &head, &tail);
+
+			if (head) {
+				buffer = bcmsdhc_kmap_atomic(sg, 0, &flags);
+				memcpy(buffer, align, head);
+				bcmsdhc_kunmap_atomic(buffer, &flags);
 
-				buffer = bcmsdhc_kmap_atomic(sg, &flags);
-				WARN_ON(((long)buffer & PAGE_MASK) >
-					(PAGE_SIZE - 3));
-				memcpy(buffer, align, size);
+				align += 4;
+			}
+
+			if (tail) {
+				buffer = bcmsdhc_kmap_atomic(sg,
+						sg_dma_len(sg) - tail, &flags);
+				memcpy(buffer, align, tail);
 				bcmsdhc_kunmap_atomic(buffer, &flags);
 
 				align += 4;
@@ -629,7 +674,10 @@ static void bcmsdhc_adma_table_post(struct bcmsdhc_host *host,
 		}
 	}
 
-	dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len, direction);
+	/* Left to bcmsdhc_post_req() if it was mapped by bcmsdhc_pre_req() */
+	if (!data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+			     direction);
 }
 
 /* *************************************************************************************************** */
@@ -736,6 +784,8 @@ static void bcmsdhc_prepare_data(struct bcmsdhc_host *host,
 				 */
 				WARN_ON(1);
 				host->flags &= ~SDHCI_REQ_USE_DMA;
+				/* PIO must not run on mapped buffers */
+				bcmsdhc_post_req(host->mmc, data->mrq, -EINVAL);
 			} else {
 				writel(host->adma_addr,
 				       host->ioaddr + SDHC_ADMA_ADDRESS);
@@ -743,10 +793,13 @@ static void bcmsdhc_prepare_data(struct bcmsdhc_host *host,
 		} else {
 			int sg_cnt;
 
-			sg_cnt = dma_map_sg(mmc_dev(host->mmc),
-					    data->sg, data->sg_len,
-					    (data->flags & MMC_DATA_READ) ?
-					    DMA_FROM_DEVICE : DMA_TO_DEVICE);
+			if (data->host_cookie)
+				sg_cnt = data->host_cookie;
+			else
+				sg_cnt = dma_map_sg(mmc_dev(host->mmc),
+						    data->sg, data->sg_len,
+						    (data->flags & MMC_DATA_READ) ?
+						    DMA_FROM_DEVICE : DMA_TO_DEVICE);
 			if (sg_cnt == 0) {
 				/*
 				 * This only happens when someone fed
@@ -867,7 +920,7 @@ static void bcmsdhc_finish_data(struct bcmsdhc_host *host)
 	if (host->flags & SDHCI_REQ_USE_DMA) {
 		if (host->flags & SDHCI_USE_ADMA) {
 			bcmsdhc_adma_table_post(host, data);
-		} else {
+		} else if (!data->host_cookie) {
 			dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
 				     (data->flags & MMC_DATA_READ) ?
 				     DMA_FROM_DEVICE : DMA_TO_DEVICE);
@@ -1264,6 +1317,50 @@ static void bcmsdhc_request(struct mmc_host *mmc, struct mmc_request *mrq)
 	spin_unlock_irqrestore(&host->lock, flags);
 }
 
+/* *************************************************************************************************** */
+/* Function Name: bcmsdhc_pre_req */
+/* Description: MMC callback, map the buffers of a request for DMA while */
+/*              the previous request is still running */
+/* *************************************************************************************************** */
+
+static void bcmsdhc_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			    bool is_first_req)
+{
+	struct bcmsdhc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (!data)
+		return;
+
+	data->host_cookie = 0;
+
+	if (!(host->flags & SDHCI_USE_DMA))
+		return;
+
+	data->host_cookie = dma_map_sg(mmc_dev(mmc), data->sg, data->sg_len,
+				       (data->flags & MMC_DATA_READ) ?
+				       DMA_FROM_DEVICE : DMA_TO_DEVICE);
+}
+
+/* *************************************************************************************************** */
+/* Function Name: bcmsdhc_post_req */
+/* Description: MMC callback, undo bcmsdhc_pre_req() */
+/* *************************************************************************************************** */
+
+static void bcmsdhc_post_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			     int err)
+{
+	struct mmc_data *data = mrq->data;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	dma_unmap_sg(mmc_dev(mmc), data->sg, data->sg_len,
+		     (data->flags & MMC_DATA_READ) ?
+		     DMA_FROM_DEVICE : DMA_TO_DEVICE);
+	data->host_cookie = 0;
+}
+
 /* *************************************************************************************************** */
 /* Function Name: bcmsdhc_set_ios */
 /* Description:MMC callback */
@@ -1462,6 +1559,8 @@ int bcmsdhc_get_cd(struct mmc_host *mmc_host)
 }
 
 static const struct mmc_host_ops bcmsdhc_ops = {
+	.pre_req = bcmsdhc_pre_req,
+	.post_req = bcmsdhc_post_req,
 	.request = bcmsdhc_request,
 	.set_ios = bcmsdhc_set_ios,
 	.get_ro = bcmsdhc_get_ro,
@@ -2142,11 +2241,11 @@ static int __init bcmsdhc_probe(struct platform_device *pdev)
 	if (host->flags & SDHCI_USE_ADMA) {
 		/*
 		 * We need to allocate descriptors for all sg entries
-		 * (128) and potentially one alignment transfer for
-		 * each of those entries.
+		 * and potentially two alignment transfers for each of
+		 * those entries.
 		 */
-		host->adma_desc = kmalloc((128 * 2 + 1) * 4, GFP_KERNEL);
-		host->align_buffer = kmalloc(128 * 4, GFP_KERNEL);
+		host->adma_desc = kmalloc(BCMSDHC_ADMA_SIZE, GFP_KERNEL);
+		host->align_buffer = kmalloc(BCMSDHC_ALIGN_SIZE, GFP_KERNEL);
 		if (!host->adma_desc || !host->align_buffer) {
 			kfree(host->adma_desc);
 			kfree(host->align_buffer);
@@ -2165,6 +2264,15 @@ static int __init bcmsdhc_probe(struct platform_device *pdev)
 	if (!(host->flags & SDHCI_USE_DMA)) {
 		host->dma_mask = DMA_BIT_MASK(64);
 		mmc_dev(host->mmc)->dma_mask = &host->dma_mask;
+	} else if (!mmc_dev(host->mmc)->dma_mask) {
+		/*
+		 * The board files don't give us one, and without it the
+		 * block layer copies every highmem page to a lowmem
+		 * bounce page. The (A)DMA engine reaches the whole 32-bit
+		 * bus, so let it work on the page cache pages directly.
+		 */
+		host->dma_mask = DMA_BIT_MASK(32);
+		mmc_dev(host->mmc)->dma_mask = &host->dma_mask;
 	}
 	host->max_clk = host->bcm_plat->base_clk;
 /*
@@ -2247,15 +2355,14 @@ static int __init bcmsdhc_probe(struct platform_device *pdev)
 	 * can do scatter/gather or not.
 	 */
 	if (host->flags & SDHCI_USE_ADMA) {
-		mmc->max_hw_segs = 128;
+		mmc->max_hw_segs = BCMSDHC_MAX_SEGS;
 	} else if (host->flags & SDHCI_USE_DMA) {
 		mmc->max_hw_segs = 1;
-		/* mmc->max_hw_segs = 128; */
 	} else {		/* PIO */
 
-		mmc->max_hw_segs = 128;
+		mmc->max_hw_segs = BCMSDHC_MAX_SEGS;
 	}
-	mmc->max_phys_segs = 128;
+	mmc->max_phys_segs = BCMSDHC_MAX_SEGS;
 
 	/*
 	 * Maximum number of sectors in one transfer. Limited by DMA boundary
@@ -320,6 +320,16 @@ struct bcmsdhc_host {
 #define SDHCI_REQ_USE_DMA	(1<<2)	/* Use DMA for this req. */
 #define SD_AUTO_ISSUE_CMD12	(1<<3)	/* Use Auto CMD12 */
 
+/*
+ * Every sg entry can need an alignment descriptor for its unaligned
+ * head and one for its unaligned tail besides the transfer itself,
+ * plus one terminating entry. Descriptors are 8 bytes, alignment
+ * slots 4 bytes.
+ */
+#define BCMSDHC_MAX_SEGS	128
+#define BCMSDHC_ADMA_SIZE	((BCMSDHC_MAX_SEGS * 3 + 1) * 8)
+#define BCMSDHC_ALIGN_SIZE	(BCMSDHC_MAX_SEGS * 2 * 4)
+
 	unsigned int version;	/* SDHCI spec. version */
 	unsigned int max_clk;	/* Max possible freq (MHz) */
 	unsigned int timeout_clk;	/* Timeout freq (KHz) */
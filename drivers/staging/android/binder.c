@@ -20,6 +20,7 @@
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
@@ -36,9 +37,48 @@
 #include <linux/vmalloc.h>
 
 #include "binder.h"
+#include "binder_trace.h"
 
-static DEFINE_MUTEX(binder_lock);
+/*
+ * There is no global lock around the driver. Each binder_proc carries
+ * its own locks, so transactions between unrelated processes do not
+ * serialize against each other:
+ *
+ * 1) proc->outer_lock protects the proc's binder_refs (both trees and
+ *    the strong/weak counts of each ref). ref->death is only changed
+ *    with the node lock held as well.
+ * 2) node->lock protects node->proc, node->refs and
+ *    node->has_async_transaction, and all of a node's fields once the
+ *    owning proc has died and node->proc is NULL.
+ * 3) proc->inner_lock protects the proc's thread and node trees, every
+ *    todo list that belongs to the proc (proc->todo, thread->todo,
+ *    node->async_todo and proc->delivered_death), the thread state
+ *    (looper, return_error and transaction_stack) and the reference
+ *    counts of the nodes the proc owns.
+ *
+ * The locks nest in that order, and no lock of one proc is ever taken
+ * while a lock of the same level or below is held on another proc.
+ * The buffer allocator has a separate mutex, proc->alloc_lock, and
+ * proc->files_lock guards the files_struct used to install fds; both
+ * may sleep and are never taken with any of the spinlocks held.
+ * binder_lru_lock nests inside proc->alloc_lock; binder_shrink(), which
+ * starts from the lru, only ever trylocks alloc_lock and mmap_sem.
+ * proc->perf_lock only guards the IPC statistics and nests inside
+ * everything else.
+ *
+ * Functions that expect a lock to be held on entry say so in their
+ * suffix: _olocked (proc->outer_lock), _ilocked (proc->inner_lock),
+ * _nilocked (node->lock and, for a live node, node->proc->inner_lock)
+ * and _locked (proc->alloc_lock).
+ *
+ * Objects that may be reached from another proc are kept alive with
+ * temporary references while no lock is held: proc->tmp_ref,
+ * thread->tmp_ref and node->tmp_refs.
+ */
 static DEFINE_MUTEX(binder_deferred_lock);
+static DEFINE_MUTEX(binder_procs_lock);
+static DEFINE_MUTEX(binder_context_mgr_node_lock);
+static DEFINE_SPINLOCK(binder_dead_nodes_lock);
 
 static HLIST_HEAD(binder_procs);
 static HLIST_HEAD(binder_deferred_list);
@@ -46,9 +86,10 @@ static HLIST_HEAD(binder_dead_nodes);
 
 static struct dentry *binder_debugfs_dir_entry_root;
 static struct dentry *binder_debugfs_dir_entry_proc;
+static struct dentry *binder_debugfs_dir_entry_proc_stats;
 static struct binder_node *binder_context_mgr_node;
 static uid_t binder_context_mgr_uid = -1;
-static int binder_last_id;
+static atomic_t binder_last_id;
 static struct workqueue_struct *binder_deferred_workqueue;
 
 #define BINDER_DEBUG_ENTRY(name) \
@@ -67,6 +108,8 @@ static const struct file_operations binder_##name##_fops = { \
 
 static int binder_proc_show(struct seq_file *m, void *unused);
 BINDER_DEBUG_ENTRY(proc);
+static int binder_proc_stats_show(struct seq_file *m, void *unused);
+BINDER_DEBUG_ENTRY(proc_stats);
 
 /* This is only defined in include/asm-arm/sizes.h */
 #ifndef SZ_1K
@@ -81,6 +124,15 @@ BINDER_DEBUG_ENTRY(proc);
 
 #define BINDER_SMALL_BUF_SIZE (PAGE_SIZE * 64)
 
+/*
+ * Free buffers are kept on segregated lists, class n holding the
+ * buffers of 2^n to 2^(n+1) - 1 bytes; the last class covers SZ_4M.
+ */
+#define BINDER_FREE_CLASSES 23
+
+/* pages allocated and mapped in one go when populating a buffer */
+#define BINDER_PAGE_BATCH 8
+
 enum {
 	BINDER_DEBUG_USER_ERROR             = 1U << 0,
 	BINDER_DEBUG_FAILED_TRANSACTION     = 1U << 1,
@@ -103,9 +155,6 @@ enum {
 static uint32_t binder_debug_mask;
 module_param_named(debug_mask, binder_debug_mask, uint, S_IWUSR | S_IRUGO);
 
-static int binder_debug_no_lock;
-module_param_named(proc_no_lock, binder_debug_no_lock, bool, S_IWUSR | S_IRUGO);
-
 static DECLARE_WAIT_QUEUE_HEAD(binder_user_error_wait);
 static int binder_stop_on_user_error;
 
@@ -147,22 +196,22 @@ enum binder_stat_types {
 };
 
 struct binder_stats {
-	int br[_IOC_NR(BR_FAILED_REPLY) + 1];
-	int bc[_IOC_NR(BC_DEAD_BINDER_DONE) + 1];
-	int obj_created[BINDER_STAT_COUNT];
-	int obj_deleted[BINDER_STAT_COUNT];
+	atomic_t br[_IOC_NR(BR_FAILED_REPLY) + 1];
+	atomic_t bc[_IOC_NR(BC_DEAD_BINDER_DONE) + 1];
+	atomic_t obj_created[BINDER_STAT_COUNT];
+	atomic_t obj_deleted[BINDER_STAT_COUNT];
 };
 
 static struct binder_stats binder_stats;
 
 static inline void binder_stats_deleted(enum binder_stat_types type)
 {
-	binder_stats.obj_deleted[type]++;
+	atomic_inc(&binder_stats.obj_deleted[type]);
 }
 
 static inline void binder_stats_created(enum binder_stat_types type)
 {
-	binder_stats.obj_created[type]++;
+	atomic_inc(&binder_stats.obj_created[type]);
 }
 
 struct binder_transaction_log_entry {
@@ -184,11 +233,14 @@ struct binder_transaction_log {
 };
 static struct binder_transaction_log binder_transaction_log;
 static struct binder_transaction_log binder_transaction_log_failed;
+static DEFINE_SPINLOCK(binder_transaction_log_lock);
 
 static struct binder_transaction_log_entry *binder_transaction_log_add(
 	struct binder_transaction_log *log)
 {
 	struct binder_transaction_log_entry *e;
+
+	spin_lock(&binder_transaction_log_lock);
 	e = &log->entry[log->next];
 	memset(e, 0, sizeof(*e));
 	log->next++;
@@ -196,6 +248,7 @@ static struct binder_transaction_log_entry *binder_transaction_log_add(
 		log->next = 0;
 		log->full = 1;
 	}
+	spin_unlock(&binder_transaction_log_lock);
 	return e;
 }
 
@@ -213,6 +266,7 @@ struct binder_work {
 
 struct binder_node {
 	int debug_id;
+	spinlock_t lock;
 	struct binder_work work;
 	union {
 		struct rb_node rb_node;
@@ -223,6 +277,7 @@ struct binder_node {
 	int internal_strong_refs;
 	int local_weak_refs;
 	int local_strong_refs;
+	int tmp_refs;
 	void __user *ptr;
 	void __user *cookie;
 	unsigned has_strong_ref:1;
@@ -257,10 +312,20 @@ struct binder_ref {
 	struct binder_ref_death *death;
 };
 
+/* snapshot of a ref, for reporting it after proc->outer_lock is dropped */
+struct binder_ref_data {
+	int debug_id;
+	uint32_t desc;
+	int strong;
+	int weak;
+};
+
 struct binder_buffer {
 	struct list_head entry; /* free and allocated entries by addesss */
-	struct rb_node rb_node; /* free entry by size or allocated entry */
-				/* by address */
+	union {
+		struct rb_node rb_node; /* allocated entry by address */
+		struct list_head free_entry; /* free entry in its size class */
+	};
 	unsigned free:1;
 	unsigned allow_user_free:1;
 	unsigned async_transaction:1;
@@ -280,6 +345,40 @@ enum binder_deferred_state {
 	BINDER_DEFERRED_RELEASE      = 0x04,
 };
 
+/*
+ * Per-proc IPC timing, exported in debugfs as binder/proc_stats/<pid>.
+ * "sent" counts transactions and replies issued by the proc, "received"
+ * the ones delivered to it, with the time each spent queued between
+ * BC_TRANSACTION/BC_REPLY and the matching BR_TRANSACTION/BR_REPLY.
+ * Lock waits are only counted when the trylock fast path fails.
+ * Protected by proc->perf_lock.
+ */
+struct binder_perf_stats {
+	u64 sent;
+	u64 sent_bytes;
+	u64 received;
+	u64 received_bytes;
+	size_t max_bytes;
+	u64 delay_ns;
+	u64 max_delay_ns;
+	u64 lock_waits;
+	u64 lock_wait_ns;
+	u64 max_lock_wait_ns;
+	u32 alloc_failures;
+};
+
+/*
+ * One per page of a proc's buffer area. A page that is populated but
+ * not covered by any buffer sits on binder_lru, where the next
+ * allocation can take it back without mapping anything, or
+ * binder_shrinker gives it back to the system.
+ */
+struct binder_lru_page {
+	struct list_head lru;
+	struct page *page_ptr;
+	struct binder_proc *proc;
+};
+
 struct binder_proc {
 	struct hlist_node proc_node;
 	struct rb_root threads;
@@ -289,23 +388,34 @@ struct binder_proc {
 	int pid;
 	struct vm_area_struct *vma;
 	struct task_struct *tsk;
+	struct mutex files_lock;
 	struct files_struct *files;
 	struct hlist_node deferred_work_node;
 	int deferred_work;
+	bool is_dead;
+	int tmp_ref;
+	spinlock_t outer_lock;
+	spinlock_t inner_lock;
+
+	/* buffer allocator, protected by alloc_lock */
+	struct mutex alloc_lock;
 	void *buffer;
 	ptrdiff_t user_buffer_offset;
 
 	struct list_head buffers;
-	struct rb_root free_buffers;
+	struct list_head free_buffers[BINDER_FREE_CLASSES];
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
 
-	struct page **pages;
+	struct binder_lru_page *pages;
 	size_t buffer_size;
 	uint32_t buffer_free;
+
 	struct list_head todo;
 	wait_queue_head_t wait;
 	struct binder_stats stats;
+	spinlock_t perf_lock;
+	struct binder_perf_stats perf;
 	struct list_head delivered_death;
 	int max_threads;
 	int requested_threads;
@@ -313,6 +423,7 @@ struct binder_proc {
 	int ready_threads;
 	long default_priority;
 	struct dentry *debugfs_entry;
+	struct dentry *debugfs_stats_entry;
 };
 
 enum {
@@ -337,6 +448,8 @@ struct binder_thread {
 		/* we are also waiting on */
 	wait_queue_head_t wait;
 	struct binder_stats stats;
+	atomic_t tmp_ref;
+	bool is_dead;
 };
 
 struct binder_transaction {
@@ -356,24 +469,146 @@ struct binder_transaction {
 	long	priority;
 	long	saved_priority;
 	uid_t	sender_euid;
+	ktime_t	start;
+	/* protects from, to_proc and to_thread, cleared on thread exit */
+	spinlock_t lock;
 };
 
 static void
 binder_defer_work(struct binder_proc *proc, enum binder_deferred_state defer);
 
+static void binder_perf_lock_wait(struct binder_proc *proc,
+				  const char *lock, ktime_t start)
+{
+	s64 wait_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	trace_binder_lock_contended(proc, lock, wait_ns);
+	spin_lock(&proc->perf_lock);
+	proc->perf.lock_waits++;
+	proc->perf.lock_wait_ns += wait_ns;
+	if (wait_ns > proc->perf.max_lock_wait_ns)
+		proc->perf.max_lock_wait_ns = wait_ns;
+	spin_unlock(&proc->perf_lock);
+}
+
+/*
+ * The slow paths are kept out of line so that the uncontended case
+ * stays a single trylock.
+ */
+static noinline void binder_spin_lock_contended(struct binder_proc *proc,
+						spinlock_t *lock,
+						const char *name)
+{
+	ktime_t start = ktime_get();
+
+	spin_lock(lock);
+	binder_perf_lock_wait(proc, name, start);
+}
+
+static noinline void binder_mutex_lock_contended(struct binder_proc *proc,
+						 struct mutex *lock,
+						 const char *name)
+{
+	ktime_t start = ktime_get();
+
+	mutex_lock(lock);
+	binder_perf_lock_wait(proc, name, start);
+}
+
+static inline void binder_proc_lock(struct binder_proc *proc)
+{
+	if (!spin_trylock(&proc->outer_lock))
+		binder_spin_lock_contended(proc, &proc->outer_lock, "outer");
+}
+
+static inline void binder_proc_unlock(struct binder_proc *proc)
+{
+	spin_unlock(&proc->outer_lock);
+}
+
+static inline void binder_inner_proc_lock(struct binder_proc *proc)
+{
+	if (!spin_trylock(&proc->inner_lock))
+		binder_spin_lock_contended(proc, &proc->inner_lock, "inner");
+}
+
+static inline void binder_inner_proc_unlock(struct binder_proc *proc)
+{
+	spin_unlock(&proc->inner_lock);
+}
+
+static inline void binder_alloc_lock(struct binder_proc *proc)
+{
+	if (!mutex_trylock(&proc->alloc_lock))
+		binder_mutex_lock_contended(proc, &proc->alloc_lock, "alloc");
+}
+
+static inline void binder_alloc_unlock(struct binder_proc *proc)
+{
+	mutex_unlock(&proc->alloc_lock);
+}
+
+static inline void binder_node_lock(struct binder_node *node)
+{
+	spin_lock(&node->lock);
+}
+
+static inline void binder_node_unlock(struct binder_node *node)
+{
+	spin_unlock(&node->lock);
+}
+
+/*
+ * Take node->lock and, while the node is alive, the inner lock of the
+ * proc that owns it. node->proc only changes with both held.
+ */
+static void binder_node_inner_lock(struct binder_node *node)
+{
+	spin_lock(&node->lock);
+	if (node->proc)
+		binder_inner_proc_lock(node->proc);
+}
+
+static void binder_node_inner_unlock(struct binder_node *node)
+{
+	struct binder_proc *proc = node->proc;
+
+	if (proc)
+		binder_inner_proc_unlock(proc);
+	spin_unlock(&node->lock);
+}
+
+static struct binder_work *binder_dequeue_work_head(struct binder_proc *proc,
+						    struct list_head *list)
+{
+	struct binder_work *w = NULL;
+
+	binder_inner_proc_lock(proc);
+	if (!list_empty(list)) {
+		w = list_first_entry(list, struct binder_work, entry);
+		list_del_init(&w->entry);
+	}
+	binder_inner_proc_unlock(proc);
+	return w;
+}
+
 /*
  * copied from get_unused_fd_flags
  */
 int task_get_unused_fd_flags(struct binder_proc *proc, int flags)
 {
-	struct files_struct *files = proc->files;
+	struct files_struct *files;
 	int fd, error;
 	struct fdtable *fdt;
 	unsigned long rlim_cur;
 	unsigned long irqs;
 
-	if (files == NULL)
+	mutex_lock(&proc->files_lock);
+	files = proc->files;
+	if (files == NULL) {
+		mutex_unlock(&proc->files_lock);
 		return -ESRCH;
+	}
 
 	error = -EMFILE;
 	spin_lock(&files->file_lock);
@@ -426,6 +661,7 @@ repeat:
 
 out:
 	spin_unlock(&files->file_lock);
+	mutex_unlock(&proc->files_lock);
 	return error;
 }
 
@@ -435,17 +671,22 @@ out:
 static void task_fd_install(
 	struct binder_proc *proc, unsigned int fd, struct file *file)
 {
-	struct files_struct *files = proc->files;
+	struct files_struct *files;
 	struct fdtable *fdt;
 
-	if (files == NULL)
+	mutex_lock(&proc->files_lock);
+	files = proc->files;
+	if (files == NULL) {
+		mutex_unlock(&proc->files_lock);
 		return;
+	}
 
 	spin_lock(&files->file_lock);
 	fdt = files_fdtable(files);
 	BUG_ON(fdt->fd[fd] != NULL);
 	rcu_assign_pointer(fdt->fd[fd], file);
 	spin_unlock(&files->file_lock);
+	mutex_unlock(&proc->files_lock);
 }
 
 /*
@@ -465,12 +706,16 @@ static void __put_unused_fd(struct files_struct *files, unsigned int fd)
 static long task_close_fd(struct binder_proc *proc, unsigned int fd)
 {
 	struct file *filp;
-	struct files_struct *files = proc->files;
+	struct files_struct *files;
 	struct fdtable *fdt;
 	int retval;
 
-	if (files == NULL)
+	mutex_lock(&proc->files_lock);
+	files = proc->files;
+	if (files == NULL) {
+		mutex_unlock(&proc->files_lock);
 		return -ESRCH;
+	}
 
 	spin_lock(&files->file_lock);
 	fdt = files_fdtable(files);
@@ -484,6 +729,7 @@ static long task_close_fd(struct binder_proc *proc, unsigned int fd)
 	__put_unused_fd(files, fd);
 	spin_unlock(&files->file_lock);
 	retval = filp_close(filp, files);
+	mutex_unlock(&proc->files_lock);
 
 	/* can't restart close syscall because file table entry was cleared */
 	if (unlikely(retval == -ERESTARTSYS ||
@@ -496,6 +742,7 @@ static long task_close_fd(struct binder_proc *proc, unsigned int fd)
 
 out_unlock:
 	spin_unlock(&files->file_lock);
+	mutex_unlock(&proc->files_lock);
 	return -EBADF;
 }
 
@@ -516,6 +763,11 @@ static void binder_set_nice(long nice)
 	binder_user_error("binder: %d RLIMIT_NICE not set\n", current->pid);
 }
 
+/*
+ * The buffer allocator below runs under proc->alloc_lock. Only
+ * binder_mmap() touches the buffer list without it, before proc->vma
+ * is published.
+ */
 static size_t binder_buffer_size(struct binder_proc *proc,
 				 struct binder_buffer *buffer)
 {
@@ -526,13 +778,18 @@ static size_t binder_buffer_size(struct binder_proc *proc,
 			struct binder_buffer, entry) - (size_t)buffer->data;
 }
 
+static int binder_free_class(size_t size)
+{
+	int class = fls(size) - 1;
+
+	if (class < 0)
+		return 0;
+	return min(class, BINDER_FREE_CLASSES - 1);
+}
+
 static void binder_insert_free_buffer(struct binder_proc *proc,
 				      struct binder_buffer *new_buffer)
 {
-	struct rb_node **p = &proc->free_buffers.rb_node;
-	struct rb_node *parent = NULL;
-	struct binder_buffer *buffer;
-	size_t buffer_size;
 	size_t new_buffer_size;
 
 	BUG_ON(!new_buffer->free);
@@ -543,20 +800,33 @@ static void binder_insert_free_buffer(struct binder_proc *proc,
 		     "binder: %d: add free buffer, size %zd, "
 		     "at %p\n", proc->pid, new_buffer_size, new_buffer);
 
-	while (*p) {
-		parent = *p;
-		buffer = rb_entry(parent, struct binder_buffer, rb_node);
-		BUG_ON(!buffer->free);
+	list_add(&new_buffer->free_entry,
+		 &proc->free_buffers[binder_free_class(new_buffer_size)]);
+}
 
-		buffer_size = binder_buffer_size(proc, buffer);
+/*
+ * Find a free buffer of at least size bytes: the first one that fits
+ * in size's own class, or else the head of the next non-empty class,
+ * where every buffer fits.
+ */
+static struct binder_buffer *binder_find_free_buffer(struct binder_proc *proc,
+						     size_t size)
+{
+	struct binder_buffer *buffer;
+	int class = binder_free_class(size);
 
-		if (new_buffer_size < buffer_size)
-			p = &parent->rb_left;
-		else
-			p = &parent->rb_right;
+	list_for_each_entry(buffer, &proc->free_buffers[class], free_entry) {
+		BUG_ON(!buffer->free);
+		if (binder_buffer_size(proc, buffer) >= size)
+			return buffer;
 	}
-	rb_link_node(&new_buffer->rb_node, parent, p);
-	rb_insert_color(&new_buffer->rb_node, &proc->free_buffers);
+	for (class++; class < BINDER_FREE_CLASSES; class++) {
+		if (!list_empty(&proc->free_buffers[class]))
+			return list_first_entry(&proc->free_buffers[class],
+						struct binder_buffer,
+						free_entry);
+	}
+	return NULL;
 }
 
 static void binder_insert_allocated_buffer(struct binder_proc *proc,
@@ -608,15 +878,105 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 	return NULL;
 }
 
+static LIST_HEAD(binder_lru);
+static DEFINE_SPINLOCK(binder_lru_lock);
+static int binder_lru_count;
+
+/*
+ * Allocate and map nr_pages pages at page_addr, all of them kernel
+ * side in one map_vm_area() call. The pages only become visible in
+ * proc->pages once every mapping is in place.
+ */
+static int binder_map_pages(struct binder_proc *proc,
+			    struct vm_area_struct *vma, void *page_addr,
+			    struct binder_lru_page *page, int nr_pages)
+{
+	struct page *pages[BINDER_PAGE_BATCH];
+	struct page **page_array_ptr = pages;
+	unsigned long user_page_addr;
+	struct vm_struct tmp_area;
+	int ret, i, mapped = 0;
+
+	for (i = 0; i < nr_pages; i++) {
+		pages[i] = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (pages[i] == NULL) {
+			binder_debug(BINDER_DEBUG_TOP_ERRORS,
+			       "binder: %d: binder_alloc_buf failed "
+			       "for page at %p\n", proc->pid,
+			       page_addr + i * PAGE_SIZE);
+			goto err_alloc_page_failed;
+		}
+	}
+	tmp_area.addr = page_addr;
+	tmp_area.size = (nr_pages + 1) * PAGE_SIZE /* guard page? */;
+	ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
+	if (ret) {
+		binder_debug(BINDER_DEBUG_TOP_ERRORS,
+		       "binder: %d: binder_alloc_buf failed "
+		       "to map pages at %p in kernel\n",
+		       proc->pid, page_addr);
+		goto err_map_kernel_failed;
+	}
+	user_page_addr = (uintptr_t)page_addr + proc->user_buffer_offset;
+	for (mapped = 0; mapped < nr_pages; mapped++) {
+		ret = vm_insert_page(vma, user_page_addr + mapped * PAGE_SIZE,
+				     pages[mapped]);
+		if (ret) {
+			binder_debug(BINDER_DEBUG_TOP_ERRORS,
+			       "binder: %d: binder_alloc_buf failed "
+			       "to map page at %lx in userspace\n",
+			       proc->pid, user_page_addr + mapped * PAGE_SIZE);
+			goto err_vm_insert_page_failed;
+		}
+		/* vm_insert_page does not seem to increment the refcount */
+	}
+	for (i = 0; i < nr_pages; i++)
+		page[i].page_ptr = pages[i];
+	return 0;
+
+err_vm_insert_page_failed:
+	if (mapped)
+		zap_page_range(vma, user_page_addr, mapped * PAGE_SIZE, NULL);
+	unmap_kernel_range((unsigned long)page_addr, nr_pages * PAGE_SIZE);
+err_map_kernel_failed:
+err_alloc_page_failed:
+	while (i--)
+		__free_page(pages[i]);
+	return -ENOMEM;
+}
+
+static void binder_lru_add_range(struct binder_proc *proc,
+				 void *start, void *end)
+{
+	struct binder_lru_page *page;
+	void *page_addr;
+
+	spin_lock(&binder_lru_lock);
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		if (!page->page_ptr || !list_empty(&page->lru))
+			continue;
+		list_add_tail(&page->lru, &binder_lru);
+		binder_lru_count++;
+	}
+	spin_unlock(&binder_lru_lock);
+}
+
+/*
+ * Make start..end usable by a buffer (allocate) or give it up. Pages
+ * that are given up stay mapped on binder_lru, so that populating a
+ * range mostly means taking its pages back off the lru; only pages
+ * the shrinker has reclaimed, or that were never used, are allocated
+ * and mapped again, in batches of up to BINDER_PAGE_BATCH.
+ */
 static int binder_update_page_range(struct binder_proc *proc, int allocate,
 				    void *start, void *end,
 				    struct vm_area_struct *vma)
 {
 	void *page_addr;
-	unsigned long user_page_addr;
-	struct vm_struct tmp_area;
-	struct page **page;
+	struct binder_lru_page *page;
 	struct mm_struct *mm;
+	bool need_map = false;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: %s pages %p-%p\n", proc->pid,
@@ -625,6 +985,26 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	if (end <= start)
 		return 0;
 
+	if (allocate == 0) {
+		binder_lru_add_range(proc, start, end);
+		return 0;
+	}
+
+	spin_lock(&binder_lru_lock);
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		if (!page->page_ptr) {
+			need_map = true;
+			continue;
+		}
+		BUG_ON(list_empty(&page->lru));
+		list_del_init(&page->lru);
+		binder_lru_count--;
+	}
+	spin_unlock(&binder_lru_lock);
+	if (!need_map)
+		return 0;
+
 	if (vma)
 		mm = NULL;
 	else
@@ -635,51 +1015,29 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		vma = proc->vma;
 	}
 
-	if (allocate == 0)
-		goto free_range;
-
 	if (vma == NULL) {
 		binder_debug(BINDER_DEBUG_TOP_ERRORS,
 		       "binder: %d: binder_alloc_buf failed to "
 		       "map pages in userspace, no vma\n", proc->pid);
-		goto err_no_vma;
+		goto err_map_failed;
 	}
 
-	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
-		int ret;
-		struct page **page_array_ptr;
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+	page_addr = start;
+	while (page_addr < end) {
+		int nr_pages = 0;
 
-		BUG_ON(*page);
-		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
-		if (*page == NULL) {
-			binder_debug(BINDER_DEBUG_TOP_ERRORS,
-			       "binder: %d: binder_alloc_buf failed "
-			       "for page at %p\n", proc->pid, page_addr);
-			goto err_alloc_page_failed;
-		}
-		tmp_area.addr = page_addr;
-		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
-		page_array_ptr = page;
-		ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
-		if (ret) {
-			binder_debug(BINDER_DEBUG_TOP_ERRORS,
-			       "binder: %d: binder_alloc_buf failed "
-			       "to map page at %p in kernel\n",
-			       proc->pid, page_addr);
-			goto err_map_kernel_failed;
-		}
-		user_page_addr =
-			(uintptr_t)page_addr + proc->user_buffer_offset;
-		ret = vm_insert_page(vma, user_page_addr, page[0]);
-		if (ret) {
-			binder_debug(BINDER_DEBUG_TOP_ERRORS,
-			       "binder: %d: binder_alloc_buf failed "
-			       "to map page at %lx in userspace\n",
-			       proc->pid, user_page_addr);
-			goto err_vm_insert_page_failed;
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		while (nr_pages < BINDER_PAGE_BATCH &&
+		       page_addr + nr_pages * PAGE_SIZE < end &&
+		       !page[nr_pages].page_ptr)
+			nr_pages++;
+		if (nr_pages == 0) {
+			page_addr += PAGE_SIZE;
+			continue;
 		}
-		/* vm_insert_page does not seem to increment the refcount */
+		if (binder_map_pages(proc, vma, page_addr, page, nr_pages))
+			goto err_map_failed;
+		page_addr += nr_pages * PAGE_SIZE;
 	}
 	if (mm) {
 		up_write(&mm->mmap_sem);
@@ -687,22 +1045,9 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	}
 	return 0;
 
-free_range:
-	for (page_addr = end - PAGE_SIZE; page_addr >= start;
-	     page_addr -= PAGE_SIZE) {
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-		if (vma)
-			zap_page_range(vma, (uintptr_t)page_addr +
-				proc->user_buffer_offset, PAGE_SIZE, NULL);
-err_vm_insert_page_failed:
-		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
-err_map_kernel_failed:
-		__free_page(*page);
-		*page = NULL;
-err_alloc_page_failed:
-		;
-	}
-err_no_vma:
+err_map_failed:
+	/* whatever got populated is not in use, leave it to the shrinker */
+	binder_lru_add_range(proc, start, end);
 	if (mm) {
 		up_write(&mm->mmap_sem);
 		mmput(mm);
@@ -710,14 +1055,95 @@ err_no_vma:
 	return -ENOMEM;
 }
 
-static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
-					      size_t data_size,
-					      size_t offsets_size, int is_async)
+/*
+ * Called with binder_lru_lock held, which is dropped while the page is
+ * unmapped. Pages of a proc that is allocating right now, or whose mm
+ * is busy, are moved to the tail of the lru instead: that is also what
+ * keeps the shrinker from deadlocking when it runs from
+ * binder_map_pages() itself.
+ */
+static bool binder_lru_free_page(struct binder_lru_page *page)
+{
+	struct binder_proc *proc = page->proc;
+	struct mm_struct *mm;
+	void *page_addr;
+
+	if (!mutex_trylock(&proc->alloc_lock))
+		goto err_busy;
+	mm = get_task_mm(proc->tsk);
+	if (mm && !down_read_trylock(&mm->mmap_sem)) {
+		list_move_tail(&page->lru, &binder_lru);
+		mutex_unlock(&proc->alloc_lock);
+		spin_unlock(&binder_lru_lock);
+		mmput(mm);
+		spin_lock(&binder_lru_lock);
+		return false;
+	}
+	list_del_init(&page->lru);
+	binder_lru_count--;
+	spin_unlock(&binder_lru_lock);
+
+	page_addr = proc->buffer + (page - proc->pages) * PAGE_SIZE;
+	if (mm) {
+		if (proc->vma)
+			zap_page_range(proc->vma, (uintptr_t)page_addr +
+				proc->user_buffer_offset, PAGE_SIZE, NULL);
+		up_read(&mm->mmap_sem);
+	}
+	unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+	__free_page(page->page_ptr);
+	page->page_ptr = NULL;
+	mutex_unlock(&proc->alloc_lock);
+	if (mm)
+		mmput(mm);
+
+	spin_lock(&binder_lru_lock);
+	return true;
+
+err_busy:
+	list_move_tail(&page->lru, &binder_lru);
+	return false;
+}
+
+static int binder_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
+{
+	struct binder_lru_page *page;
+
+	if (nr_to_scan == 0)
+		return binder_lru_count;
+
+	spin_lock(&binder_lru_lock);
+	while (nr_to_scan-- > 0 && !list_empty(&binder_lru)) {
+		page = list_first_entry(&binder_lru, struct binder_lru_page,
+					lru);
+		binder_lru_free_page(page);
+	}
+	nr_to_scan = binder_lru_count;
+	spin_unlock(&binder_lru_lock);
+	return nr_to_scan;
+}
+
+static struct shrinker binder_shrinker = {
+	.shrink = binder_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static void binder_alloc_failed(struct binder_proc *proc, size_t size,
+				int is_async, const char *reason)
+{
+	trace_binder_alloc_buf_failed(proc, size, is_async, reason);
+	spin_lock(&proc->perf_lock);
+	proc->perf.alloc_failures++;
+	spin_unlock(&proc->perf_lock);
+}
+
+static struct binder_buffer *binder_alloc_buf_locked(struct binder_proc *proc,
+						     size_t data_size,
+						     size_t offsets_size,
+						     int is_async)
 {
-	struct rb_node *n = proc->free_buffers.rb_node;
 	struct binder_buffer *buffer;
 	size_t buffer_size;
-	struct rb_node *best_fit = NULL;
 	void *has_page_addr;
 	void *end_page_addr;
 	size_t size;
@@ -726,6 +1152,7 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		binder_debug(BINDER_DEBUG_TOP_ERRORS,
 		       "binder: %d: binder_alloc_buf, no vma\n",
 		       proc->pid);
+		binder_alloc_failed(proc, data_size, is_async, "no vma");
 		return NULL;
 	}
 
@@ -735,6 +1162,7 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	if (size < data_size || size < offsets_size) {
 		binder_user_error("binder: %d: got transaction with invalid "
 			"size %zd-%zd\n", proc->pid, data_size, offsets_size);
+		binder_alloc_failed(proc, data_size, is_async, "invalid size");
 		return NULL;
 	}
 
@@ -743,34 +1171,19 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 			     "binder: %d: binder_alloc_buf size %zd"
 			     "failed, no async space left\n", proc->pid, size);
+		binder_alloc_failed(proc, size, is_async, "no async space");
 		return NULL;
 	}
 
-	while (n) {
-		buffer = rb_entry(n, struct binder_buffer, rb_node);
-		BUG_ON(!buffer->free);
-		buffer_size = binder_buffer_size(proc, buffer);
-
-		if (size < buffer_size) {
-			best_fit = n;
-			n = n->rb_left;
-		} else if (size > buffer_size)
-			n = n->rb_right;
-		else {
-			best_fit = n;
-			break;
-		}
-	}
-	if (best_fit == NULL) {
+	buffer = binder_find_free_buffer(proc, size);
+	if (buffer == NULL) {
 		binder_debug(BINDER_DEBUG_TOP_ERRORS,
 		       "binder: %d: binder_alloc_buf size %zd failed, "
 		       "no address space\n", proc->pid, size);
+		binder_alloc_failed(proc, size, is_async, "no address space");
 		return NULL;
 	}
-	if (n == NULL) {
-		buffer = rb_entry(best_fit, struct binder_buffer, rb_node);
-		buffer_size = binder_buffer_size(proc, buffer);
-	}
+	buffer_size = binder_buffer_size(proc, buffer);
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: binder_alloc_buf size %zd got buff"
@@ -778,21 +1191,21 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 
 	has_page_addr =
 		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK);
-	if (n == NULL) {
-		if (size + sizeof(struct binder_buffer) + 4 >= buffer_size)
-			buffer_size = size; /* no room for other buffers */
-		else
-			buffer_size = size + sizeof(struct binder_buffer);
-	}
+	if (size + sizeof(struct binder_buffer) + 4 >= buffer_size)
+		buffer_size = size; /* no room for other buffers */
+	else
+		buffer_size = size + sizeof(struct binder_buffer);
 	end_page_addr =
 		(void *)PAGE_ALIGN((uintptr_t)buffer->data + buffer_size);
 	if (end_page_addr > has_page_addr)
 		end_page_addr = has_page_addr;
 	if (binder_update_page_range(proc, 1,
-	    (void *)PAGE_ALIGN((uintptr_t)buffer->data), end_page_addr, NULL))
+	    (void *)PAGE_ALIGN((uintptr_t)buffer->data), end_page_addr, NULL)) {
+		binder_alloc_failed(proc, size, is_async, "no pages");
 		return NULL;
+	}
 
-	rb_erase(best_fit, &proc->free_buffers);
+	list_del(&buffer->free_entry);
 	buffer->free = 0;
 	binder_insert_allocated_buffer(proc, buffer);
 	if (buffer_size != size) {
@@ -818,6 +1231,19 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	return buffer;
 }
 
+static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
+					      size_t data_size,
+					      size_t offsets_size, int is_async)
+{
+	struct binder_buffer *buffer;
+
+	binder_alloc_lock(proc);
+	buffer = binder_alloc_buf_locked(proc, data_size, offsets_size,
+					 is_async);
+	binder_alloc_unlock(proc);
+	return buffer;
+}
+
 static void *buffer_start_page(struct binder_buffer *buffer)
 {
 	return (void *)((uintptr_t)buffer & PAGE_MASK);
@@ -875,8 +1301,8 @@ static void binder_delete_free_buffer(struct binder_proc *proc,
 	}
 }
 
-static void binder_free_buf(struct binder_proc *proc,
-			    struct binder_buffer *buffer)
+static void binder_free_buf_locked(struct binder_proc *proc,
+				   struct binder_buffer *buffer)
 {
 	size_t size, buffer_size;
 
@@ -914,7 +1340,7 @@ static void binder_free_buf(struct binder_proc *proc,
 		struct binder_buffer *next = list_entry(buffer->entry.next,
 						struct binder_buffer, entry);
 		if (next->free) {
-			rb_erase(&next->rb_node, &proc->free_buffers);
+			list_del(&next->free_entry);
 			binder_delete_free_buffer(proc, next);
 		}
 	}
@@ -923,15 +1349,29 @@ static void binder_free_buf(struct binder_proc *proc,
 						struct binder_buffer, entry);
 		if (prev->free) {
 			binder_delete_free_buffer(proc, buffer);
-			rb_erase(&prev->rb_node, &proc->free_buffers);
+			list_del(&prev->free_entry);
 			buffer = prev;
 		}
 	}
 	binder_insert_free_buffer(proc, buffer);
 }
 
-static struct binder_node *binder_get_node(struct binder_proc *proc,
-					   void __user *ptr)
+static void binder_free_buf(struct binder_proc *proc,
+			    struct binder_buffer *buffer)
+{
+	binder_alloc_lock(proc);
+	binder_free_buf_locked(proc, buffer);
+	binder_alloc_unlock(proc);
+}
+
+static void binder_free_node(struct binder_node *node)
+{
+	kfree(node);
+	binder_stats_deleted(BINDER_STAT_NODE);
+}
+
+static struct binder_node *binder_get_node_ilocked(struct binder_proc *proc,
+						   void __user *ptr)
 {
 	struct rb_node *n = proc->nodes.rb_node;
 	struct binder_node *node;
@@ -943,19 +1383,39 @@ static struct binder_node *binder_get_node(struct binder_proc *proc,
 			n = n->rb_left;
 		else if (ptr > node->ptr)
 			n = n->rb_right;
-		else
+		else {
+			node->tmp_refs++;
 			return node;
+		}
 	}
 	return NULL;
 }
 
-static struct binder_node *binder_new_node(struct binder_proc *proc,
-					   void __user *ptr,
-					   void __user *cookie)
+/*
+ * The node is returned with a temporary ref that keeps it alive after
+ * the lock is dropped; release it with binder_put_node().
+ */
+static struct binder_node *binder_get_node(struct binder_proc *proc,
+					   void __user *ptr)
+{
+	struct binder_node *node;
+
+	binder_inner_proc_lock(proc);
+	node = binder_get_node_ilocked(proc, ptr);
+	binder_inner_proc_unlock(proc);
+	return node;
+}
+
+static struct binder_node *binder_init_node_ilocked(
+						struct binder_proc *proc,
+						struct binder_node *new_node,
+						struct flat_binder_object *fp)
 {
 	struct rb_node **p = &proc->nodes.rb_node;
 	struct rb_node *parent = NULL;
 	struct binder_node *node;
+	void __user *ptr = fp ? fp->binder : NULL;
+	void __user *cookie = fp ? fp->cookie : NULL;
 
 	while (*p) {
 		parent = *p;
@@ -965,20 +1425,27 @@ static struct binder_node *binder_new_node(struct binder_proc *proc,
 			p = &(*p)->rb_left;
 		else if (ptr > node->ptr)
 			p = &(*p)->rb_right;
-		else
-			return NULL;
+		else {
+			/* another thread created it while we allocated */
+			node->tmp_refs++;
+			return node;
+		}
 	}
 
-	node = kzalloc(sizeof(*node), GFP_KERNEL);
-	if (node == NULL)
-		return NULL;
+	node = new_node;
 	binder_stats_created(BINDER_STAT_NODE);
+	node->tmp_refs++;
 	rb_link_node(&node->rb_node, parent, p);
 	rb_insert_color(&node->rb_node, &proc->nodes);
-	node->debug_id = ++binder_last_id;
+	node->debug_id = atomic_inc_return(&binder_last_id);
+	spin_lock_init(&node->lock);
 	node->proc = proc;
 	node->ptr = ptr;
 	node->cookie = cookie;
+	if (fp) {
+		node->min_priority = fp->flags & FLAT_BINDER_FLAG_PRIORITY_MASK;
+		node->accept_fds = !!(fp->flags & FLAT_BINDER_FLAG_ACCEPTS_FDS);
+	}
 	node->work.type = BINDER_WORK_NODE;
 	INIT_LIST_HEAD(&node->work.entry);
 	INIT_LIST_HEAD(&node->async_todo);
@@ -989,8 +1456,30 @@ static struct binder_node *binder_new_node(struct binder_proc *proc,
 	return node;
 }
 
-static int binder_inc_node(struct binder_node *node, int strong, int internal,
-			   struct list_head *target_list)
+/*
+ * Look up or create the node described by fp (the context manager
+ * node when fp is NULL). Like binder_get_node(), the node is returned
+ * with a temporary ref.
+ */
+static struct binder_node *binder_new_node(struct binder_proc *proc,
+					   struct flat_binder_object *fp)
+{
+	struct binder_node *node;
+	struct binder_node *new_node = kzalloc(sizeof(*node), GFP_KERNEL);
+
+	if (new_node == NULL)
+		return NULL;
+	binder_inner_proc_lock(proc);
+	node = binder_init_node_ilocked(proc, new_node, fp);
+	binder_inner_proc_unlock(proc);
+	if (node != new_node)
+		kfree(new_node);
+	return node;
+}
+
+static int binder_inc_node_nilocked(struct binder_node *node, int strong,
+				    int internal,
+				    struct list_head *target_list)
 {
 	if (strong) {
 		if (internal) {
@@ -1026,52 +1515,125 @@ static int binder_inc_node(struct binder_node *node, int strong, int internal,
 	return 0;
 }
 
-static int binder_dec_node(struct binder_node *node, int strong, int internal)
+static int binder_inc_node(struct binder_node *node, int strong, int internal,
+			   struct list_head *target_list)
+{
+	int ret;
+
+	binder_node_inner_lock(node);
+	ret = binder_inc_node_nilocked(node, strong, internal, target_list);
+	binder_node_inner_unlock(node);
+	return ret;
+}
+
+/*
+ * Returns true when the node lost its last reference and has been
+ * unlinked. The caller frees it with binder_free_node() after dropping
+ * the locks.
+ */
+static bool binder_dec_node_nilocked(struct binder_node *node,
+				     int strong, int internal)
 {
+	struct binder_proc *proc = node->proc;
+
 	if (strong) {
 		if (internal)
 			node->internal_strong_refs--;
 		else
 			node->local_strong_refs--;
 		if (node->local_strong_refs || node->internal_strong_refs)
-			return 0;
+			return false;
 	} else {
 		if (!internal)
 			node->local_weak_refs--;
-		if (node->local_weak_refs || !hlist_empty(&node->refs))
-			return 0;
+		if (node->local_weak_refs || node->tmp_refs ||
+		    !hlist_empty(&node->refs))
+			return false;
 	}
-	if (node->proc && (node->has_strong_ref || node->has_weak_ref)) {
+	if (proc && (node->has_strong_ref || node->has_weak_ref)) {
 		if (list_empty(&node->work.entry)) {
-			list_add_tail(&node->work.entry, &node->proc->todo);
-			wake_up_interruptible(&node->proc->wait);
+			list_add_tail(&node->work.entry, &proc->todo);
+			wake_up_interruptible(&proc->wait);
 		}
 	} else {
 		if (hlist_empty(&node->refs) && !node->local_strong_refs &&
-		    !node->local_weak_refs) {
-			list_del_init(&node->work.entry);
-			if (node->proc) {
-				rb_erase(&node->rb_node, &node->proc->nodes);
+		    !node->local_weak_refs && !node->tmp_refs) {
+			if (proc) {
+				list_del_init(&node->work.entry);
+				rb_erase(&node->rb_node, &proc->nodes);
 				binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 					    "binder: refless node %d deleted\n",
 					     node->debug_id);
 			} else {
+				BUG_ON(!list_empty(&node->work.entry));
+				spin_lock(&binder_dead_nodes_lock);
+				/* the state dump may have taken a tmp ref */
+				if (node->tmp_refs) {
+					spin_unlock(&binder_dead_nodes_lock);
+					return false;
+				}
 				hlist_del(&node->dead_node);
+				spin_unlock(&binder_dead_nodes_lock);
 				binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 					     "binder: dead node %d deleted\n",
 					     node->debug_id);
 			}
-			kfree(node);
-			binder_stats_deleted(BINDER_STAT_NODE);
+			return true;
 		}
 	}
 
-	return 0;
+	return false;
+}
+
+static void binder_dec_node(struct binder_node *node, int strong, int internal)
+{
+	bool free_node;
+
+	binder_node_inner_lock(node);
+	free_node = binder_dec_node_nilocked(node, strong, internal);
+	binder_node_inner_unlock(node);
+	if (free_node)
+		binder_free_node(node);
+}
+
+static void binder_inc_node_tmpref(struct binder_node *node)
+{
+	binder_node_lock(node);
+	if (node->proc)
+		binder_inner_proc_lock(node->proc);
+	else
+		spin_lock(&binder_dead_nodes_lock);
+	node->tmp_refs++;
+	if (node->proc)
+		binder_inner_proc_unlock(node->proc);
+	else
+		spin_unlock(&binder_dead_nodes_lock);
+	binder_node_unlock(node);
 }
 
+static void binder_put_node(struct binder_node *node)
+{
+	bool free_node;
+
+	binder_node_inner_lock(node);
+	if (!node->proc)
+		spin_lock(&binder_dead_nodes_lock);
+	node->tmp_refs--;
+	BUG_ON(node->tmp_refs < 0);
+	if (!node->proc)
+		spin_unlock(&binder_dead_nodes_lock);
+	/*
+	 * An internal weak dec releases nothing by itself, it only frees
+	 * the node if the temporary ref was all that kept it around.
+	 */
+	free_node = binder_dec_node_nilocked(node, 0, 1);
+	binder_node_inner_unlock(node);
+	if (free_node)
+		binder_free_node(node);
+}
 
-static struct binder_ref *binder_get_ref(struct binder_proc *proc,
-					 uint32_t desc)
+static struct binder_ref *binder_get_ref_olocked(struct binder_proc *proc,
+						 uint32_t desc)
 {
 	struct rb_node *n = proc->refs_by_desc.rb_node;
 	struct binder_ref *ref;
@@ -1089,13 +1651,20 @@ static struct binder_ref *binder_get_ref(struct binder_proc *proc,
 	return NULL;
 }
 
-static struct binder_ref *binder_get_ref_for_node(struct binder_proc *proc,
-						  struct binder_node *node)
+/*
+ * Find the ref proc holds on node. If there is none, new_ref is
+ * initialized and inserted, unless it is NULL. The allocation is left
+ * to the caller because proc->outer_lock is a spinlock.
+ */
+static struct binder_ref *binder_get_ref_for_node_olocked(
+						struct binder_proc *proc,
+						struct binder_node *node,
+						struct binder_ref *new_ref)
 {
 	struct rb_node *n;
 	struct rb_node **p = &proc->refs_by_node.rb_node;
 	struct rb_node *parent = NULL;
-	struct binder_ref *ref, *new_ref;
+	struct binder_ref *ref;
 
 	while (*p) {
 		parent = *p;
@@ -1108,11 +1677,10 @@ static struct binder_ref *binder_get_ref_for_node(struct binder_proc *proc,
 		else
 			return ref;
 	}
-	new_ref = kzalloc(sizeof(*ref), GFP_KERNEL);
 	if (new_ref == NULL)
 		return NULL;
 	binder_stats_created(BINDER_STAT_REF);
-	new_ref->debug_id = ++binder_last_id;
+	new_ref->debug_id = atomic_inc_return(&binder_last_id);
 	new_ref->proc = proc;
 	new_ref->node = node;
 	rb_link_node(&new_ref->rb_node_node, parent, p);
@@ -1140,24 +1708,27 @@ static struct binder_ref *binder_get_ref_for_node(struct binder_proc *proc,
 	}
 	rb_link_node(&new_ref->rb_node_desc, parent, p);
 	rb_insert_color(&new_ref->rb_node_desc, &proc->refs_by_desc);
-	if (node) {
-		hlist_add_head(&new_ref->node_entry, &node->refs);
 
-		binder_debug(BINDER_DEBUG_INTERNAL_REFS,
-			     "binder: %d new ref %d desc %d for "
-			     "node %d\n", proc->pid, new_ref->debug_id,
-			     new_ref->desc, node->debug_id);
-	} else {
-		binder_debug(BINDER_DEBUG_INTERNAL_REFS,
-			     "binder: %d new ref %d desc %d for "
-			     "dead node\n", proc->pid, new_ref->debug_id,
-			      new_ref->desc);
-	}
+	binder_node_lock(node);
+	hlist_add_head(&new_ref->node_entry, &node->refs);
+	binder_node_unlock(node);
+
+	binder_debug(BINDER_DEBUG_INTERNAL_REFS,
+		     "binder: %d new ref %d desc %d for "
+		     "node %d\n", proc->pid, new_ref->debug_id,
+		     new_ref->desc, node->debug_id);
 	return new_ref;
 }
 
-static void binder_delete_ref(struct binder_ref *ref)
+/*
+ * Unlink ref and drop the node references it held. ref->node is left
+ * set only if the node went away with it, so that binder_free_ref()
+ * can free both once proc->outer_lock is released.
+ */
+static void binder_cleanup_ref_olocked(struct binder_ref *ref)
 {
+	bool delete_node;
+
 	binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 		     "binder: %d delete ref %d desc %d for "
 		     "node %d\n", ref->proc->pid, ref->debug_id,
@@ -1165,25 +1736,39 @@ static void binder_delete_ref(struct binder_ref *ref)
 
 	rb_erase(&ref->rb_node_desc, &ref->proc->refs_by_desc);
 	rb_erase(&ref->rb_node_node, &ref->proc->refs_by_node);
+
+	binder_node_inner_lock(ref->node);
 	if (ref->strong)
-		binder_dec_node(ref->node, 1, 1);
+		binder_dec_node_nilocked(ref->node, 1, 1);
 	hlist_del(&ref->node_entry);
-	binder_dec_node(ref->node, 0, 1);
+	delete_node = binder_dec_node_nilocked(ref->node, 0, 1);
+	binder_node_inner_unlock(ref->node);
+	if (!delete_node)
+		ref->node = NULL;
+
 	if (ref->death) {
 		binder_debug(BINDER_DEBUG_DEAD_BINDER,
 			     "binder: %d delete ref %d desc %d "
 			     "has death notification\n", ref->proc->pid,
 			     ref->debug_id, ref->desc);
-		list_del(&ref->death->work.entry);
-		kfree(ref->death);
+		binder_inner_proc_lock(ref->proc);
+		list_del_init(&ref->death->work.entry);
+		binder_inner_proc_unlock(ref->proc);
 		binder_stats_deleted(BINDER_STAT_DEATH);
 	}
-	kfree(ref);
 	binder_stats_deleted(BINDER_STAT_REF);
 }
 
-static int binder_inc_ref(struct binder_ref *ref, int strong,
-			  struct list_head *target_list)
+static void binder_free_ref(struct binder_ref *ref)
+{
+	if (ref->node)
+		binder_free_node(ref->node);
+	kfree(ref->death);
+	kfree(ref);
+}
+
+static int binder_inc_ref_olocked(struct binder_ref *ref, int strong,
+				  struct list_head *target_list)
 {
 	int ret;
 	if (strong) {
@@ -1204,8 +1789,11 @@ static int binder_inc_ref(struct binder_ref *ref, int strong,
 	return 0;
 }
 
-
-static int binder_dec_ref(struct binder_ref *ref, int strong)
+/*
+ * Returns true when both counts dropped to zero and the ref has been
+ * unlinked; the caller frees it with binder_free_ref().
+ */
+static bool binder_dec_ref_olocked(struct binder_ref *ref, int strong)
 {
 	if (strong) {
 		if (ref->strong == 0) {
@@ -1213,43 +1801,288 @@ static int binder_dec_ref(struct binder_ref *ref, int strong)
 					  "ref %d desc %d s %d w %d\n",
 					  ref->proc->pid, ref->debug_id,
 					  ref->desc, ref->strong, ref->weak);
-			return -EINVAL;
+			return false;
 		}
 		ref->strong--;
-		if (ref->strong == 0) {
-			int ret;
-			ret = binder_dec_node(ref->node, strong, 1);
-			if (ret)
-				return ret;
-		}
+		if (ref->strong == 0)
+			binder_dec_node(ref->node, strong, 1);
 	} else {
 		if (ref->weak == 0) {
 			binder_user_error("binder: %d invalid dec weak, "
 					  "ref %d desc %d s %d w %d\n",
 					  ref->proc->pid, ref->debug_id,
 					  ref->desc, ref->strong, ref->weak);
-			return -EINVAL;
+			return false;
 		}
 		ref->weak--;
 	}
-	if (ref->strong == 0 && ref->weak == 0)
-		binder_delete_ref(ref);
-	return 0;
+	if (ref->strong == 0 && ref->weak == 0) {
+		binder_cleanup_ref_olocked(ref);
+		return true;
+	}
+	return false;
 }
 
-static void binder_pop_transaction(struct binder_thread *target_thread,
-				   struct binder_transaction *t)
+static void binder_get_ref_data(struct binder_ref *ref,
+				struct binder_ref_data *rdata)
 {
-	if (target_thread) {
-		BUG_ON(target_thread->transaction_stack != t);
-		BUG_ON(target_thread->transaction_stack->from != target_thread);
-		target_thread->transaction_stack =
-			target_thread->transaction_stack->from_parent;
-		t->from = NULL;
+	if (rdata == NULL)
+		return;
+	rdata->debug_id = ref->debug_id;
+	rdata->desc = ref->desc;
+	rdata->strong = ref->strong;
+	rdata->weak = ref->weak;
+}
+
+/* take a strong or weak ref on node for proc, creating the ref if needed */
+static int binder_inc_ref_for_node(struct binder_proc *proc,
+				   struct binder_node *node, int strong,
+				   struct list_head *target_list,
+				   struct binder_ref_data *rdata)
+{
+	struct binder_ref *ref;
+	struct binder_ref *new_ref = NULL;
+	int ret;
+
+	binder_proc_lock(proc);
+	ref = binder_get_ref_for_node_olocked(proc, node, NULL);
+	if (ref == NULL) {
+		binder_proc_unlock(proc);
+		new_ref = kzalloc(sizeof(*ref), GFP_KERNEL);
+		if (new_ref == NULL)
+			return -ENOMEM;
+		binder_proc_lock(proc);
+		ref = binder_get_ref_for_node_olocked(proc, node, new_ref);
+	}
+	ret = binder_inc_ref_olocked(ref, strong, target_list);
+	binder_get_ref_data(ref, rdata);
+	binder_proc_unlock(proc);
+	if (new_ref && ref != new_ref)
+		kfree(new_ref);
+	return ret;
+}
+
+/* inc or dec the ref proc holds under handle desc */
+static int binder_update_ref_for_handle(struct binder_proc *proc,
+					uint32_t desc, int increment,
+					int strong,
+					struct binder_ref_data *rdata)
+{
+	struct binder_ref *ref;
+	bool delete_ref = false;
+	int ret = 0;
+
+	binder_proc_lock(proc);
+	ref = binder_get_ref_olocked(proc, desc);
+	if (ref == NULL) {
+		binder_proc_unlock(proc);
+		return -EINVAL;
+	}
+	if (increment)
+		ret = binder_inc_ref_olocked(ref, strong, NULL);
+	else
+		delete_ref = binder_dec_ref_olocked(ref, strong);
+	binder_get_ref_data(ref, rdata);
+	binder_proc_unlock(proc);
+
+	if (delete_ref)
+		binder_free_ref(ref);
+	return ret;
+}
+
+/*
+ * Look up the node behind handle desc and take a temporary ref on it,
+ * so the caller may use it after proc->outer_lock is dropped.
+ */
+static struct binder_node *binder_get_node_from_ref(struct binder_proc *proc,
+						    uint32_t desc,
+						    struct binder_ref_data *rdata)
+{
+	struct binder_node *node;
+	struct binder_ref *ref;
+
+	binder_proc_lock(proc);
+	ref = binder_get_ref_olocked(proc, desc);
+	if (ref == NULL) {
+		binder_proc_unlock(proc);
+		return NULL;
+	}
+	node = ref->node;
+	binder_inc_node_tmpref(node);
+	binder_get_ref_data(ref, rdata);
+	binder_proc_unlock(proc);
+	return node;
+}
+
+static void binder_free_proc(struct binder_proc *proc)
+{
+	struct binder_transaction *t;
+	struct rb_node *n;
+	int buffers, page_count;
+
+	BUG_ON(!list_empty(&proc->todo));
+	BUG_ON(!list_empty(&proc->delivered_death));
+
+	buffers = 0;
+	mutex_lock(&proc->alloc_lock);
+	while ((n = rb_first(&proc->allocated_buffers))) {
+		struct binder_buffer *buffer = rb_entry(n, struct binder_buffer,
+							rb_node);
+		t = buffer->transaction;
+		if (t) {
+			t->buffer = NULL;
+			buffer->transaction = NULL;
+			binder_debug(BINDER_DEBUG_TOP_ERRORS,
+				"binder: release proc %d, "
+			       "transaction %d, not freed\n",
+			       proc->pid, t->debug_id);
+			/*BUG();*/
+		}
+		binder_free_buf_locked(proc, buffer);
+		buffers++;
+	}
+
+	page_count = 0;
+	if (proc->pages) {
+		int i;
+		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
+			struct binder_lru_page *page = &proc->pages[i];
+			void *page_addr = proc->buffer + i * PAGE_SIZE;
+			bool on_lru;
+
+			if (!page->page_ptr)
+				continue;
+			spin_lock(&binder_lru_lock);
+			on_lru = !list_empty(&page->lru);
+			if (on_lru) {
+				list_del_init(&page->lru);
+				binder_lru_count--;
+			}
+			spin_unlock(&binder_lru_lock);
+			if (!on_lru)
+				binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+					     "binder_release: %d: "
+					     "page %d at %p not freed\n",
+					     proc->pid, i,
+					     page_addr);
+			unmap_kernel_range((unsigned long)page_addr,
+				PAGE_SIZE);
+			__free_page(page->page_ptr);
+			page_count++;
+		}
+		kfree(proc->pages);
+		vfree(proc->buffer);
+	}
+	mutex_unlock(&proc->alloc_lock);
+
+	binder_debug(BINDER_DEBUG_OPEN_CLOSE,
+		     "binder_release: %d buffers %d, pages %d\n",
+		     proc->pid, buffers, page_count);
+
+	put_task_struct(proc->tsk);
+	binder_stats_deleted(BINDER_STAT_PROC);
+	kfree(proc);
+}
+
+/*
+ * A dead proc is freed once its threads are gone and nobody holds a
+ * temporary ref on it.
+ */
+static void binder_proc_dec_tmpref(struct binder_proc *proc)
+{
+	binder_inner_proc_lock(proc);
+	proc->tmp_ref--;
+	if (proc->is_dead && RB_EMPTY_ROOT(&proc->threads) &&
+	    !proc->tmp_ref) {
+		binder_inner_proc_unlock(proc);
+		binder_free_proc(proc);
+		return;
+	}
+	binder_inner_proc_unlock(proc);
+}
+
+static void binder_free_thread(struct binder_thread *thread)
+{
+	BUG_ON(!list_empty(&thread->todo));
+	binder_stats_deleted(BINDER_STAT_THREAD);
+	binder_proc_dec_tmpref(thread->proc);
+	kfree(thread);
+}
+
+static void binder_thread_dec_tmpref(struct binder_thread *thread)
+{
+	/*
+	 * tmp_ref is atomic so it can be raised without the inner lock,
+	 * but it only drops to zero for a dead thread under the lock.
+	 */
+	binder_inner_proc_lock(thread->proc);
+	atomic_dec(&thread->tmp_ref);
+	if (thread->is_dead && !atomic_read(&thread->tmp_ref)) {
+		binder_inner_proc_unlock(thread->proc);
+		binder_free_thread(thread);
+		return;
+	}
+	binder_inner_proc_unlock(thread->proc);
+}
+
+/* t->from with a temporary ref, or NULL if the sender has exited */
+static struct binder_thread *binder_get_txn_from(
+		struct binder_transaction *t)
+{
+	struct binder_thread *from;
+
+	spin_lock(&t->lock);
+	from = t->from;
+	if (from)
+		atomic_inc(&from->tmp_ref);
+	spin_unlock(&t->lock);
+	return from;
+}
+
+/*
+ * Like binder_get_txn_from(), but also takes the inner lock of the
+ * sender's proc and rechecks t->from under it. On success the caller
+ * must drop both the lock and the thread ref.
+ */
+static struct binder_thread *binder_get_txn_from_and_acq_inner(
+		struct binder_transaction *t)
+{
+	struct binder_thread *from;
+
+	from = binder_get_txn_from(t);
+	if (from == NULL)
+		return NULL;
+	binder_inner_proc_lock(from->proc);
+	if (t->from) {
+		BUG_ON(from != t->from);
+		return from;
+	}
+	binder_inner_proc_unlock(from->proc);
+	binder_thread_dec_tmpref(from);
+	return NULL;
+}
+
+static void binder_pop_transaction_ilocked(struct binder_thread *target_thread,
+					   struct binder_transaction *t)
+{
+	BUG_ON(target_thread->transaction_stack != t);
+	BUG_ON(target_thread->transaction_stack->from != target_thread);
+	target_thread->transaction_stack =
+		target_thread->transaction_stack->from_parent;
+	t->from = NULL;
+}
+
+static void binder_free_transaction(struct binder_transaction *t)
+{
+	struct binder_proc *target_proc = t->to_proc;
+
+	/* t->buffer and buffer->transaction belong to the target proc */
+	if (target_proc) {
+		binder_inner_proc_lock(target_proc);
+		if (t->buffer)
+			t->buffer->transaction = NULL;
+		binder_inner_proc_unlock(target_proc);
 	}
-	t->need_reply = 0;
-	if (t->buffer)
-		t->buffer->transaction = NULL;
 	kfree(t);
 	binder_stats_deleted(BINDER_STAT_TRANSACTION);
 }
@@ -1258,10 +2091,14 @@ static void binder_send_failed_reply(struct binder_transaction *t,
 				     uint32_t error_code)
 {
 	struct binder_thread *target_thread;
+	struct binder_transaction *next;
+
 	BUG_ON(t->flags & TF_ONE_WAY);
 	while (1) {
-		target_thread = t->from;
+		target_thread = binder_get_txn_from_and_acq_inner(t);
 		if (target_thread) {
+			bool popped = false;
+
 			if (target_thread->return_error != BR_OK &&
 			   target_thread->return_error2 == BR_OK) {
 				target_thread->return_error2 =
@@ -1276,9 +2113,10 @@ static void binder_send_failed_reply(struct binder_transaction *t,
 					      target_thread->proc->pid,
 					      target_thread->pid);
 
-				binder_pop_transaction(target_thread, t);
+				binder_pop_transaction_ilocked(target_thread, t);
 				target_thread->return_error = error_code;
 				wake_up_interruptible(&target_thread->wait);
+				popped = true;
 			} else {
 				binder_debug(BINDER_DEBUG_TOP_ERRORS,
 					"binder: reply failed, target "
@@ -1287,27 +2125,30 @@ static void binder_send_failed_reply(struct binder_transaction *t,
 					target_thread->pid,
 					target_thread->return_error);
 			}
+			binder_inner_proc_unlock(target_thread->proc);
+			binder_thread_dec_tmpref(target_thread);
+			if (popped)
+				binder_free_transaction(t);
 			return;
-		} else {
-			struct binder_transaction *next = t->from_parent;
-
-			binder_debug(BINDER_DEBUG_FAILED_TRANSACTION,
-				     "binder: send failed reply "
-				     "for transaction %d, target dead\n",
-				     t->debug_id);
-
-			binder_pop_transaction(target_thread, t);
-			if (next == NULL) {
-				binder_debug(BINDER_DEBUG_DEAD_BINDER,
-					     "binder: reply failed,"
-					     " no target thread at root\n");
-				return;
-			}
-			t = next;
+		}
+		next = t->from_parent;
+
+		binder_debug(BINDER_DEBUG_FAILED_TRANSACTION,
+			     "binder: send failed reply "
+			     "for transaction %d, target dead\n",
+			     t->debug_id);
+
+		binder_free_transaction(t);
+		if (next == NULL) {
 			binder_debug(BINDER_DEBUG_DEAD_BINDER,
-				     "binder: reply failed, no target "
-				     "thread -- retry %d\n", t->debug_id);
+				     "binder: reply failed,"
+				     " no target thread at root\n");
+			return;
 		}
+		t = next;
+		binder_debug(BINDER_DEBUG_DEAD_BINDER,
+			     "binder: reply failed, no target "
+			     "thread -- retry %d\n", t->debug_id);
 	}
 }
 
@@ -1360,23 +2201,26 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 				     node->debug_id, node->ptr);
 			binder_dec_node(node, fp->type == BINDER_TYPE_BINDER,
 									0);
+			binder_put_node(node);
 		} break;
 		case BINDER_TYPE_HANDLE:
 		case BINDER_TYPE_WEAK_HANDLE: {
-			struct binder_ref *ref = binder_get_ref(proc,
-								fp->handle);
-			if (ref == NULL) {
+			struct binder_ref_data rdata;
+			int ret;
+
+			ret = binder_update_ref_for_handle(proc, fp->handle,
+					0, fp->type == BINDER_TYPE_HANDLE,
+					&rdata);
+			if (ret) {
 				binder_debug(BINDER_DEBUG_TOP_ERRORS,
 					"binder: transaction release %d"
-				       " bad handle %ld\n", debug_id,
-				       fp->handle);
+				       " bad handle %ld, ret = %d\n",
+				       debug_id, fp->handle, ret);
 				break;
 			}
 			binder_debug(BINDER_DEBUG_TRANSACTION,
-				     "        ref %d desc %d (node %d)\n",
-				     ref->debug_id, ref->desc,
-				     ref->node->debug_id);
-			binder_dec_ref(ref, fp->type == BINDER_TYPE_HANDLE);
+				     "        ref %d desc %d\n",
+				     rdata.debug_id, rdata.desc);
 		} break;
 
 		case BINDER_TYPE_FD:
@@ -1395,6 +2239,84 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 	}
 }
 
+/*
+ * Pin the target of a new transaction: a strong local ref keeps the
+ * node from being released, handed over to the buffer once it is
+ * allocated, and a tmp ref keeps its proc from being freed. Fails with
+ * BR_DEAD_REPLY if the node's proc has already died.
+ */
+static struct binder_node *binder_get_node_refs_for_txn(
+		struct binder_node *node,
+		struct binder_proc **procp,
+		uint32_t *error)
+{
+	struct binder_node *target_node = NULL;
+
+	binder_node_inner_lock(node);
+	if (node->proc) {
+		target_node = node;
+		binder_inc_node_nilocked(node, 1, 0, NULL);
+		node->tmp_refs++;
+		node->proc->tmp_ref++;
+		*procp = node->proc;
+	} else
+		*error = BR_DEAD_REPLY;
+	binder_node_inner_unlock(node);
+
+	return target_node;
+}
+
+/*
+ * Queue t for proc: on thread if one is given, behind an async
+ * transaction already in flight for the target node, or on the proc's
+ * own todo list. Returns false if the target has died.
+ */
+static bool binder_proc_transaction(struct binder_transaction *t,
+				    struct binder_proc *proc,
+				    struct binder_thread *thread)
+{
+	struct binder_node *node = t->buffer->target_node;
+	struct list_head *target_list;
+	wait_queue_head_t *target_wait;
+	bool oneway = !!(t->flags & TF_ONE_WAY);
+	bool pending_async = false;
+
+	BUG_ON(node == NULL);
+	binder_node_lock(node);
+	if (oneway) {
+		BUG_ON(thread);
+		if (node->has_async_transaction)
+			pending_async = true;
+		else
+			node->has_async_transaction = 1;
+	}
+
+	binder_inner_proc_lock(proc);
+	if (proc->is_dead || (thread && thread->is_dead)) {
+		binder_inner_proc_unlock(proc);
+		binder_node_unlock(node);
+		return false;
+	}
+
+	if (thread) {
+		target_list = &thread->todo;
+		target_wait = &thread->wait;
+	} else if (pending_async) {
+		target_list = &node->async_todo;
+		target_wait = NULL;
+	} else {
+		target_list = &proc->todo;
+		target_wait = &proc->wait;
+	}
+	list_add_tail(&t->work.entry, target_list);
+	if (target_wait)
+		wake_up_interruptible(target_wait);
+	binder_inner_proc_unlock(proc);
+	binder_node_unlock(node);
+
+	return true;
+}
+
 static void binder_transaction(struct binder_proc *proc,
 			       struct binder_thread *thread,
 			       struct binder_transaction_data *tr, int reply)
@@ -1402,14 +2324,13 @@ static void binder_transaction(struct binder_proc *proc,
 	struct binder_transaction *t;
 	struct binder_work *tcomplete;
 	size_t *offp, *off_end;
-	struct binder_proc *target_proc;
+	size_t size;
+	struct binder_proc *target_proc = NULL;
 	struct binder_thread *target_thread = NULL;
 	struct binder_node *target_node = NULL;
-	struct list_head *target_list;
-	wait_queue_head_t *target_wait;
 	struct binder_transaction *in_reply_to = NULL;
 	struct binder_transaction_log_entry *e;
-	uint32_t return_error;
+	uint32_t return_error = BR_OK;
 
 	e = binder_transaction_log_add(&binder_transaction_log);
 	e->call_type = reply ? 2 : !!(tr->flags & TF_ONE_WAY);
@@ -1420,16 +2341,18 @@ static void binder_transaction(struct binder_proc *proc,
 	e->offsets_size = tr->offsets_size;
 
 	if (reply) {
+		binder_inner_proc_lock(proc);
 		in_reply_to = thread->transaction_stack;
 		if (in_reply_to == NULL) {
+			binder_inner_proc_unlock(proc);
 			binder_user_error("binder: %d:%d got reply transaction "
 					  "with no transaction stack\n",
 					  proc->pid, thread->pid);
 			return_error = BR_FAILED_REPLY;
 			goto err_empty_call_stack;
 		}
-		binder_set_nice(in_reply_to->saved_priority);
 		if (in_reply_to->to_thread != thread) {
+			spin_lock(&in_reply_to->lock);
 			binder_user_error("binder: %d:%d got reply transaction "
 				"with bad transaction stack,"
 				" transaction %d has target %d:%d\n",
@@ -1438,12 +2361,16 @@ static void binder_transaction(struct binder_proc *proc,
 				in_reply_to->to_proc->pid : 0,
 				in_reply_to->to_thread ?
 				in_reply_to->to_thread->pid : 0);
+			spin_unlock(&in_reply_to->lock);
+			binder_inner_proc_unlock(proc);
 			return_error = BR_FAILED_REPLY;
 			in_reply_to = NULL;
 			goto err_bad_call_stack;
 		}
 		thread->transaction_stack = in_reply_to->to_parent;
-		target_thread = in_reply_to->from;
+		binder_inner_proc_unlock(proc);
+		binder_set_nice(in_reply_to->saved_priority);
+		target_thread = binder_get_txn_from_and_acq_inner(in_reply_to);
 		if (target_thread == NULL) {
 			return_error = BR_DEAD_REPLY;
 			goto err_dead_binder;
@@ -1456,41 +2383,52 @@ static void binder_transaction(struct binder_proc *proc,
 				target_thread->transaction_stack ?
 				target_thread->transaction_stack->debug_id : 0,
 				in_reply_to->debug_id);
+			binder_inner_proc_unlock(target_thread->proc);
 			return_error = BR_FAILED_REPLY;
 			in_reply_to = NULL;
-			target_thread = NULL;
 			goto err_dead_binder;
 		}
 		target_proc = target_thread->proc;
+		target_proc->tmp_ref++;
+		binder_inner_proc_unlock(target_thread->proc);
 	} else {
 		if (tr->target.handle) {
 			struct binder_ref *ref;
-			ref = binder_get_ref(proc, tr->target.handle);
-			if (ref == NULL) {
+
+			binder_proc_lock(proc);
+			ref = binder_get_ref_olocked(proc, tr->target.handle);
+			if (ref) {
+				target_node = binder_get_node_refs_for_txn(
+						ref->node, &target_proc,
+						&return_error);
+			} else {
 				binder_user_error("binder: %d:%d got "
 					"transaction to invalid handle\n",
 					proc->pid, thread->pid);
 				return_error = BR_FAILED_REPLY;
-				goto err_invalid_target_handle;
 			}
-			target_node = ref->node;
+			binder_proc_unlock(proc);
 		} else {
+			mutex_lock(&binder_context_mgr_node_lock);
 			target_node = binder_context_mgr_node;
-			if (target_node == NULL) {
+			if (target_node)
+				target_node = binder_get_node_refs_for_txn(
+						target_node, &target_proc,
+						&return_error);
+			else
 				return_error = BR_DEAD_REPLY;
-				goto err_no_context_mgr_node;
-			}
+			mutex_unlock(&binder_context_mgr_node_lock);
 		}
-		e->to_node = target_node->debug_id;
-		target_proc = target_node->proc;
-		if (target_proc == NULL) {
-			return_error = BR_DEAD_REPLY;
+		if (target_node == NULL)
 			goto err_dead_binder;
-		}
+		e->to_node = target_node->debug_id;
+		binder_inner_proc_lock(proc);
 		if (!(tr->flags & TF_ONE_WAY) && thread->transaction_stack) {
-			struct binder_transaction *tmp;
+			struct binder_transaction *tmp, *last = NULL;
+
 			tmp = thread->transaction_stack;
 			if (tmp->to_thread != thread) {
+				spin_lock(&tmp->lock);
 				binder_user_error("binder: %d:%d got new "
 					"transaction with bad transaction stack"
 					", transaction %d has target %d:%d\n",
@@ -1498,24 +2436,26 @@ static void binder_transaction(struct binder_proc *proc,
 					tmp->to_proc ? tmp->to_proc->pid : 0,
 					tmp->to_thread ?
 					tmp->to_thread->pid : 0);
+				spin_unlock(&tmp->lock);
+				binder_inner_proc_unlock(proc);
 				return_error = BR_FAILED_REPLY;
 				goto err_bad_call_stack;
 			}
 			while (tmp) {
+				spin_lock(&tmp->lock);
 				if (tmp->from && tmp->from->proc == target_proc)
-					target_thread = tmp->from;
+					last = tmp;
+				spin_unlock(&tmp->lock);
 				tmp = tmp->from_parent;
 			}
+			/* NULL if that thread exited in the meantime */
+			if (last)
+				target_thread = binder_get_txn_from(last);
 		}
+		binder_inner_proc_unlock(proc);
 	}
-	if (target_thread) {
+	if (target_thread)
 		e->to_thread = target_thread->pid;
-		target_list = &target_thread->todo;
-		target_wait = &target_thread->wait;
-	} else {
-		target_list = &target_proc->todo;
-		target_wait = &target_proc->wait;
-	}
 	e->to_proc = target_proc->pid;
 
 	/* TODO: reuse incoming transaction for reply */
@@ -1525,6 +2465,7 @@ static void binder_transaction(struct binder_proc *proc,
 		goto err_alloc_t_failed;
 	}
 	binder_stats_created(BINDER_STAT_TRANSACTION);
+	spin_lock_init(&t->lock);
 
 	tcomplete = kzalloc(sizeof(*tcomplete), GFP_KERNEL);
 	if (tcomplete == NULL) {
@@ -1533,7 +2474,7 @@ static void binder_transaction(struct binder_proc *proc,
 	}
 	binder_stats_created(BINDER_STAT_TRANSACTION_COMPLETE);
 
-	t->debug_id = ++binder_last_id;
+	t->debug_id = atomic_inc_return(&binder_last_id);
 	e->debug_id = t->debug_id;
 
 	if (reply)
@@ -1572,9 +2513,8 @@ static void binder_transaction(struct binder_proc *proc,
 	t->buffer->allow_user_free = 0;
 	t->buffer->debug_id = t->debug_id;
 	t->buffer->transaction = t;
+	/* the strong ref taken on target_node now belongs to the buffer */
 	t->buffer->target_node = target_node;
-	if (target_node)
-		binder_inc_node(target_node, 1, 0, NULL);
 
 	offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
 
@@ -1613,20 +2553,17 @@ static void binder_transaction(struct binder_proc *proc,
 		switch (fp->type) {
 		case BINDER_TYPE_BINDER:
 		case BINDER_TYPE_WEAK_BINDER: {
-			struct binder_ref *ref;
-			struct binder_node *node = binder_get_node(proc,
-								fp->binder);
+			struct binder_ref_data rdata;
+			struct binder_node *node;
+			int ret;
+
+			node = binder_get_node(proc, fp->binder);
 			if (node == NULL) {
-				node = binder_new_node(proc, fp->binder,
-								fp->cookie);
+				node = binder_new_node(proc, fp);
 				if (node == NULL) {
 					return_error = BR_FAILED_REPLY;
 					goto err_binder_new_node_failed;
 				}
-				node->min_priority = fp->flags &
-						FLAT_BINDER_FLAG_PRIORITY_MASK;
-				node->accept_fds = !!(fp->flags &
-						FLAT_BINDER_FLAG_ACCEPTS_FDS);
 			}
 			if (fp->cookie != node->cookie) {
 				binder_user_error("binder: %d:%d sending u%p "
@@ -1634,11 +2571,15 @@ static void binder_transaction(struct binder_proc *proc,
 					proc->pid, thread->pid,
 					fp->binder, node->debug_id,
 					fp->cookie, node->cookie);
+				binder_put_node(node);
 				return_error = BR_FAILED_REPLY;
 				goto err_binder_get_ref_for_node_failed;
 			}
-			ref = binder_get_ref_for_node(target_proc, node);
-			if (ref == NULL) {
+			ret = binder_inc_ref_for_node(target_proc, node,
+					fp->type == BINDER_TYPE_BINDER,
+					&thread->todo, &rdata);
+			if (ret) {
+				binder_put_node(node);
 				return_error = BR_FAILED_REPLY;
 				goto err_binder_get_ref_for_node_failed;
 			}
@@ -1646,20 +2587,22 @@ static void binder_transaction(struct binder_proc *proc,
 				fp->type = BINDER_TYPE_HANDLE;
 			else
 				fp->type = BINDER_TYPE_WEAK_HANDLE;
-			fp->handle = ref->desc;
-			binder_inc_ref(ref, fp->type == BINDER_TYPE_HANDLE,
-				       &thread->todo);
+			fp->handle = rdata.desc;
 
 			binder_debug(BINDER_DEBUG_TRANSACTION,
 				     "        node %d u%p -> ref %d desc %d\n",
-				     node->debug_id, node->ptr, ref->debug_id,
-				     ref->desc);
+				     node->debug_id, node->ptr, rdata.debug_id,
+				     rdata.desc);
+			binder_put_node(node);
 		} break;
 		case BINDER_TYPE_HANDLE:
 		case BINDER_TYPE_WEAK_HANDLE: {
-			struct binder_ref *ref = binder_get_ref(proc,
-								fp->handle);
-			if (ref == NULL) {
+			struct binder_ref_data src_rdata;
+			struct binder_node *node;
+
+			node = binder_get_node_from_ref(proc, fp->handle,
+							&src_rdata);
+			if (node == NULL) {
 				binder_user_error("binder: %d:%d got "
 					"transaction with invalid "
 					"handle, %ld\n", proc->pid,
@@ -1667,39 +2610,46 @@ static void binder_transaction(struct binder_proc *proc,
 				return_error = BR_FAILED_REPLY;
 				goto err_binder_get_ref_failed;
 			}
-			if (ref->node->proc == target_proc) {
+			binder_node_lock(node);
+			if (node->proc == target_proc) {
 				if (fp->type == BINDER_TYPE_HANDLE)
 					fp->type = BINDER_TYPE_BINDER;
 				else
 					fp->type = BINDER_TYPE_WEAK_BINDER;
-				fp->binder = ref->node->ptr;
-				fp->cookie = ref->node->cookie;
-				binder_inc_node(ref->node, fp->type ==
+				fp->binder = node->ptr;
+				fp->cookie = node->cookie;
+				binder_inner_proc_lock(node->proc);
+				binder_inc_node_nilocked(node, fp->type ==
 						BINDER_TYPE_BINDER, 0, NULL);
+				binder_inner_proc_unlock(node->proc);
 				binder_debug(BINDER_DEBUG_TRANSACTION,
 				      "        ref %d desc %d -> node %d u%p\n",
-				     ref->debug_id, ref->desc,
-				    ref->node->debug_id,
-				     ref->node->ptr);
+				     src_rdata.debug_id, src_rdata.desc,
+				     node->debug_id, node->ptr);
+				binder_node_unlock(node);
 			} else {
-				struct binder_ref *new_ref;
-				new_ref = binder_get_ref_for_node(target_proc,
-								ref->node);
-				if (new_ref == NULL) {
+				struct binder_ref_data dest_rdata;
+				int ret;
+
+				binder_node_unlock(node);
+				ret = binder_inc_ref_for_node(target_proc, node,
+						fp->type == BINDER_TYPE_HANDLE,
+						NULL, &dest_rdata);
+				if (ret) {
+					binder_put_node(node);
 					return_error = BR_FAILED_REPLY;
 					goto err_binder_get_ref_for_node_failed;
 				}
-				fp->handle = new_ref->desc;
-				binder_inc_ref(new_ref, fp->type ==
-						BINDER_TYPE_HANDLE, NULL);
+				fp->handle = dest_rdata.desc;
 				binder_debug(BINDER_DEBUG_TRANSACTION,
 					     "        ref %d desc %d -> ref %d"
 					     " desc %d (node %d)\n",
-					     ref->debug_id, ref->desc,
-					     new_ref->debug_id,
-					     new_ref->desc,
-					     ref->node->debug_id);
+					     src_rdata.debug_id, src_rdata.desc,
+					     dest_rdata.debug_id,
+					     dest_rdata.desc,
+					     node->debug_id);
 			}
+			binder_put_node(node);
 		} break;
 
 		case BINDER_TYPE_FD: {
@@ -1758,31 +2708,73 @@ static void binder_transaction(struct binder_proc *proc,
 			goto err_bad_object_type;
 		}
 	}
+	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
+	t->work.type = BINDER_WORK_TRANSACTION;
+
+	trace_binder_transaction(reply, t, target_node);
+	size = tr->data_size + tr->offsets_size;
+	spin_lock(&proc->perf_lock);
+	proc->perf.sent++;
+	proc->perf.sent_bytes += size;
+	if (size > proc->perf.max_bytes)
+		proc->perf.max_bytes = size;
+	spin_unlock(&proc->perf_lock);
+	t->start = ktime_get();
+
+	/*
+	 * tcomplete is queued before t becomes visible to the target, so
+	 * that it is always read ahead of the reply to t.
+	 */
 	if (reply) {
+		binder_inner_proc_lock(proc);
+		list_add_tail(&tcomplete->entry, &thread->todo);
+		binder_inner_proc_unlock(proc);
+		binder_inner_proc_lock(target_proc);
+		if (target_thread->is_dead) {
+			binder_inner_proc_unlock(target_proc);
+			goto err_dead_proc_or_thread;
+		}
 		BUG_ON(t->buffer->async_transaction != 0);
-		binder_pop_transaction(target_thread, in_reply_to);
+		binder_pop_transaction_ilocked(target_thread, in_reply_to);
+		list_add_tail(&t->work.entry, &target_thread->todo);
+		wake_up_interruptible(&target_thread->wait);
+		binder_inner_proc_unlock(target_proc);
+		binder_free_transaction(in_reply_to);
 	} else if (!(t->flags & TF_ONE_WAY)) {
 		BUG_ON(t->buffer->async_transaction != 0);
+		binder_inner_proc_lock(proc);
+		list_add_tail(&tcomplete->entry, &thread->todo);
 		t->need_reply = 1;
 		t->from_parent = thread->transaction_stack;
 		thread->transaction_stack = t;
+		binder_inner_proc_unlock(proc);
+		if (!binder_proc_transaction(t, target_proc, target_thread)) {
+			binder_inner_proc_lock(proc);
+			binder_pop_transaction_ilocked(thread, t);
+			binder_inner_proc_unlock(proc);
+			goto err_dead_proc_or_thread;
+		}
 	} else {
 		BUG_ON(target_node == NULL);
 		BUG_ON(t->buffer->async_transaction != 1);
-		if (target_node->has_async_transaction) {
-			target_list = &target_node->async_todo;
-			target_wait = NULL;
-		} else
-			target_node->has_async_transaction = 1;
+		binder_inner_proc_lock(proc);
+		list_add_tail(&tcomplete->entry, &thread->todo);
+		binder_inner_proc_unlock(proc);
+		if (!binder_proc_transaction(t, target_proc, NULL))
+			goto err_dead_proc_or_thread;
 	}
-	t->work.type = BINDER_WORK_TRANSACTION;
-	list_add_tail(&t->work.entry, target_list);
-	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
-	list_add_tail(&tcomplete->entry, &thread->todo);
-	if (target_wait)
-		wake_up_interruptible(target_wait);
+	if (target_thread)
+		binder_thread_dec_tmpref(target_thread);
+	binder_proc_dec_tmpref(target_proc);
+	if (target_node)
+		binder_put_node(target_node);
 	return;
 
+err_dead_proc_or_thread:
+	return_error = BR_DEAD_REPLY;
+	binder_inner_proc_lock(proc);
+	list_del_init(&tcomplete->entry);
+	binder_inner_proc_unlock(proc);
 err_get_unused_fd_failed:
 err_fget_failed:
 err_fd_not_allowed:
@@ -1793,6 +2785,10 @@ err_bad_object_type:
 err_bad_offset:
 err_copy_data_failed:
 	binder_transaction_buffer_release(target_proc, t->buffer, offp);
+	/* the buffer dropped the strong ref, only the tmp ref is left */
+	if (target_node)
+		binder_put_node(target_node);
+	target_node = NULL;
 	t->buffer->transaction = NULL;
 	binder_free_buf(target_proc, t->buffer);
 err_binder_alloc_buf_failed:
@@ -1805,8 +2801,15 @@ err_alloc_t_failed:
 err_bad_call_stack:
 err_empty_call_stack:
 err_dead_binder:
-err_invalid_target_handle:
-err_no_context_mgr_node:
+	if (target_node) {
+		binder_dec_node(target_node, 1, 0);
+		binder_put_node(target_node);
+	}
+	if (target_thread)
+		binder_thread_dec_tmpref(target_thread);
+	if (target_proc)
+		binder_proc_dec_tmpref(target_proc);
+
 	binder_debug(BINDER_DEBUG_FAILED_TRANSACTION,
 		     "binder: %d:%d transaction failed %d, size %zd-%zd\n",
 		     proc->pid, thread->pid, return_error,
@@ -1818,12 +2821,16 @@ err_no_context_mgr_node:
 		*fe = *e;
 	}
 
+	binder_inner_proc_lock(proc);
 	BUG_ON(thread->return_error != BR_OK);
 	if (in_reply_to) {
 		thread->return_error = BR_TRANSACTION_COMPLETE;
+		binder_inner_proc_unlock(proc);
 		binder_send_failed_reply(in_reply_to, return_error);
-	} else
+	} else {
 		thread->return_error = return_error;
+		binder_inner_proc_unlock(proc);
+	}
 }
 
 int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
@@ -1838,9 +2845,9 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			return -EFAULT;
 		ptr += sizeof(uint32_t);
 		if (_IOC_NR(cmd) < ARRAY_SIZE(binder_stats.bc)) {
-			binder_stats.bc[_IOC_NR(cmd)]++;
-			proc->stats.bc[_IOC_NR(cmd)]++;
-			thread->stats.bc[_IOC_NR(cmd)]++;
+			atomic_inc(&binder_stats.bc[_IOC_NR(cmd)]);
+			atomic_inc(&proc->stats.bc[_IOC_NR(cmd)]);
+			atomic_inc(&thread->stats.bc[_IOC_NR(cmd)]);
 		}
 		switch (cmd) {
 		case BC_INCREFS:
@@ -1848,27 +2855,38 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 		case BC_RELEASE:
 		case BC_DECREFS: {
 			uint32_t target;
-			struct binder_ref *ref;
 			const char *debug_string;
+			int strong = cmd == BC_ACQUIRE || cmd == BC_RELEASE;
+			int increment = cmd == BC_INCREFS || cmd == BC_ACQUIRE;
+			struct binder_ref_data rdata;
+			int ret = -EINVAL;
 
 			if (get_user(target, (uint32_t __user *)ptr))
 				return -EFAULT;
 			ptr += sizeof(uint32_t);
-			if (target == 0 && binder_context_mgr_node &&
-			    (cmd == BC_INCREFS || cmd == BC_ACQUIRE)) {
-				ref = binder_get_ref_for_node(proc,
-					       binder_context_mgr_node);
-				if (ref->desc != target) {
+			if (increment && target == 0) {
+				struct binder_node *ctx_mgr_node;
+
+				mutex_lock(&binder_context_mgr_node_lock);
+				ctx_mgr_node = binder_context_mgr_node;
+				if (ctx_mgr_node)
+					ret = binder_inc_ref_for_node(proc,
+							ctx_mgr_node, strong,
+							NULL, &rdata);
+				mutex_unlock(&binder_context_mgr_node_lock);
+				if (ret == 0 && rdata.desc != target) {
 					binder_user_error("binder: %d:"
 						"%d tried to acquire "
 						"reference to desc 0, "
 						"got %d instead\n",
 						proc->pid, thread->pid,
-						ref->desc);
+						rdata.desc);
 				}
-			} else
-				ref = binder_get_ref(proc, target);
-			if (ref == NULL) {
+			}
+			if (ret)
+				ret = binder_update_ref_for_handle(proc, target,
+						increment, strong, &rdata);
+			if (ret) {
 				binder_user_error("binder: %d:%d refcou"
 					"nt change on invalid ref %d\n",
 					proc->pid, thread->pid, target);
@@ -1877,28 +2895,23 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			switch (cmd) {
 			case BC_INCREFS:
 				debug_string = "IncRefs";
-				binder_inc_ref(ref, 0, NULL);
 				break;
 			case BC_ACQUIRE:
 				debug_string = "Acquire";
-				binder_inc_ref(ref, 1, NULL);
 				break;
 			case BC_RELEASE:
 				debug_string = "Release";
-				binder_dec_ref(ref, 1);
 				break;
 			case BC_DECREFS:
 			default:
 				debug_string = "DecRefs";
-				binder_dec_ref(ref, 0);
 				break;
 			}
 			binder_debug(BINDER_DEBUG_USER_REFS,
-				     "binder: %d:%d %s ref %d desc %d s %d w %d"
-				     " for node %d\n", proc->pid, thread->pid,
-				     debug_string, ref->debug_id, ref->desc,
-				     ref->strong, ref->weak,
-				     ref->node->debug_id);
+				     "binder: %d:%d %s ref %d desc %d s %d w %d\n",
+				     proc->pid, thread->pid, debug_string,
+				     rdata.debug_id, rdata.desc, rdata.strong,
+				     rdata.weak);
 			break;
 		}
 		case BC_INCREFS_DONE:
@@ -1932,8 +2945,10 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					"BC_INCREFS_DONE" : "BC_ACQUIRE_DONE",
 					node_ptr, node->debug_id,
 					cookie, node->cookie);
+				binder_put_node(node);
 				break;
 			}
+			binder_node_inner_lock(node);
 			if (cmd == BC_ACQUIRE_DONE) {
 				if (node->pending_strong_ref == 0) {
 					binder_user_error("binder: %d:%d "
@@ -1941,6 +2956,8 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 						"no pending acquire request\n",
 						proc->pid, thread->pid,
 						node->debug_id);
+					binder_node_inner_unlock(node);
+					binder_put_node(node);
 					break;
 				}
 				node->pending_strong_ref = 0;
@@ -1951,10 +2968,13 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 						"no pending increfs request\n",
 						proc->pid, thread->pid,
 						node->debug_id);
+					binder_node_inner_unlock(node);
+					binder_put_node(node);
 					break;
 				}
 				node->pending_weak_ref = 0;
 			}
+			binder_node_inner_unlock(node);
 			binder_dec_node(node, cmd == BC_ACQUIRE_DONE, 0);
 			binder_debug(BINDER_DEBUG_USER_REFS,
 				     "binder: %d:%d %s node %d ls %d lw %d\n",
@@ -1963,6 +2983,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 							: "BC_ACQUIRE_DONE",
 				     node->debug_id, node->local_strong_refs,
 							node->local_weak_refs);
+			binder_put_node(node);
 			break;
 		}
 		case BC_ATTEMPT_ACQUIRE:
@@ -1982,20 +3003,27 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				return -EFAULT;
 			ptr += sizeof(void *);
 
+			binder_alloc_lock(proc);
 			buffer = binder_buffer_lookup(proc, data_ptr);
 			if (buffer == NULL) {
+				binder_alloc_unlock(proc);
 				binder_user_error("binder: %d:%d "
 					"BC_FREE_BUFFER u%p no match\n",
 					proc->pid, thread->pid, data_ptr);
 				break;
 			}
 			if (!buffer->allow_user_free) {
+				binder_alloc_unlock(proc);
 				binder_user_error("binder: %d:%d "
 					"BC_FREE_BUFFER u%p matched "
 					"unreturned buffer\n",
 					proc->pid, thread->pid, data_ptr);
 				break;
 			}
+			/* a second BC_FREE_BUFFER racing with us must fail */
+			buffer->allow_user_free = 0;
+			binder_alloc_unlock(proc);
+
 			binder_debug(BINDER_DEBUG_FREE_BUFFER,
 				     "binder: %d:%d BC_FREE_BUFFER u%p found"
 				     " buffer %d for %s transaction\n",
@@ -2003,16 +3031,22 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				     buffer->debug_id, buffer->transaction ?
 				     "active" : "finished");
 
+			binder_inner_proc_lock(proc);
 			if (buffer->transaction) {
 				buffer->transaction->buffer = NULL;
 				buffer->transaction = NULL;
 			}
+			binder_inner_proc_unlock(proc);
 			if (buffer->async_transaction && buffer->target_node) {
-				BUG_ON(!buffer->target_node->has_async_transaction);
-				if (list_empty(&buffer->target_node->async_todo))
-					buffer->target_node->has_async_transaction = 0;
+				struct binder_node *buf_node = buffer->target_node;
+
+				binder_node_inner_lock(buf_node);
+				BUG_ON(!buf_node->has_async_transaction);
+				if (list_empty(&buf_node->async_todo))
+					buf_node->has_async_transaction = 0;
 				else
-					list_move_tail(buffer->target_node->async_todo.next, &thread->todo);
+					list_move_tail(buf_node->async_todo.next, &thread->todo);
+				binder_node_inner_unlock(buf_node);
 			}
 			binder_transaction_buffer_release(proc, buffer, NULL);
 			binder_free_buf(proc, buffer);
@@ -2034,6 +3068,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			binder_debug(BINDER_DEBUG_THREADS,
 				     "binder: %d:%d BC_REGISTER_LOOPER\n",
 				     proc->pid, thread->pid);
+			binder_inner_proc_lock(proc);
 			if (thread->looper & BINDER_LOOPER_STATE_ENTERED) {
 				thread->looper |= BINDER_LOOPER_STATE_INVALID;
 				binder_user_error("binder: %d:%d ERROR:"
@@ -2051,11 +3086,13 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				proc->requested_threads_started++;
 			}
 			thread->looper |= BINDER_LOOPER_STATE_REGISTERED;
+			binder_inner_proc_unlock(proc);
 			break;
 		case BC_ENTER_LOOPER:
 			binder_debug(BINDER_DEBUG_THREADS,
 				     "binder: %d:%d BC_ENTER_LOOPER\n",
 				     proc->pid, thread->pid);
+			binder_inner_proc_lock(proc);
 			if (thread->looper & BINDER_LOOPER_STATE_REGISTERED) {
 				thread->looper |= BINDER_LOOPER_STATE_INVALID;
 				binder_user_error("binder: %d:%d ERROR:"
@@ -2064,12 +3101,15 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					proc->pid, thread->pid);
 			}
 			thread->looper |= BINDER_LOOPER_STATE_ENTERED;
+			binder_inner_proc_unlock(proc);
 			break;
 		case BC_EXIT_LOOPER:
 			binder_debug(BINDER_DEBUG_THREADS,
 				     "binder: %d:%d BC_EXIT_LOOPER\n",
 				     proc->pid, thread->pid);
+			binder_inner_proc_lock(proc);
 			thread->looper |= BINDER_LOOPER_STATE_EXITED;
+			binder_inner_proc_unlock(proc);
 			break;
 
 		case BC_REQUEST_DEATH_NOTIFICATION:
@@ -2077,7 +3117,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			uint32_t target;
 			void __user *cookie;
 			struct binder_ref *ref;
-			struct binder_ref_death *death;
+			struct binder_ref_death *death = NULL;
 
 			if (get_user(target, (uint32_t __user *)ptr))
 				return -EFAULT;
@@ -2085,7 +3125,24 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			if (get_user(cookie, (void __user * __user *)ptr))
 				return -EFAULT;
 			ptr += sizeof(void *);
-			ref = binder_get_ref(proc, target);
+			if (cmd == BC_REQUEST_DEATH_NOTIFICATION) {
+				/* allocate before taking the spinlocks */
+				death = kzalloc(sizeof(*death), GFP_KERNEL);
+				if (death == NULL) {
+					binder_inner_proc_lock(proc);
+					thread->return_error = BR_ERROR;
+					binder_inner_proc_unlock(proc);
+					binder_debug(
+						BINDER_DEBUG_FAILED_TRANSACTION,
+						"binder: %d:%d "
+						"BC_REQUEST_DEATH_NOTIFICATION"
+						" failed\n",
+						proc->pid, thread->pid);
+					break;
+				}
+			}
+			binder_proc_lock(proc);
+			ref = binder_get_ref_olocked(proc, target);
 			if (ref == NULL) {
 				binder_user_error("binder: %d:%d %s "
 					"invalid ref %d\n",
@@ -2094,6 +3151,8 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					"BC_REQUEST_DEATH_NOTIFICATION" :
 					"BC_CLEAR_DEATH_NOTIFICATION",
 					target);
+				binder_proc_unlock(proc);
+				kfree(death);
 				break;
 			}
 
@@ -2108,6 +3167,8 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				     ref->strong, ref->weak,
 				     ref->node->debug_id);
 
+			/* ref->death is protected by the node lock */
+			binder_node_lock(ref->node);
 			if (cmd == BC_REQUEST_DEATH_NOTIFICATION) {
 				if (ref->death) {
 					binder_user_error("binder: %d:%"
@@ -2115,17 +3176,9 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 						"FICATION death notific"
 						"ation already set\n",
 						proc->pid, thread->pid);
-					break;
-				}
-				death = kzalloc(sizeof(*death), GFP_KERNEL);
-				if (death == NULL) {
-					thread->return_error = BR_ERROR;
-					binder_debug(
-						BINDER_DEBUG_FAILED_TRANSACTION,
-						"binder: %d:%d "
-						"BC_REQUEST_DEATH_NOTIFICATION"
-						" failed\n",
-						proc->pid, thread->pid);
+					binder_node_unlock(ref->node);
+					binder_proc_unlock(proc);
+					kfree(death);
 					break;
 				}
 				binder_stats_created(BINDER_STAT_DEATH);
@@ -2134,12 +3187,14 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				ref->death = death;
 				if (ref->node->proc == NULL) {
 					ref->death->work.type = BINDER_WORK_DEAD_BINDER;
+					binder_inner_proc_lock(proc);
 					if (thread->looper & (BINDER_LOOPER_STATE_REGISTERED | BINDER_LOOPER_STATE_ENTERED)) {
 						list_add_tail(&ref->death->work.entry, &thread->todo);
 					} else {
 						list_add_tail(&ref->death->work.entry, &proc->todo);
 						wake_up_interruptible(&proc->wait);
 					}
+					binder_inner_proc_unlock(proc);
 				}
 			} else {
 				if (ref->death == NULL) {
@@ -2148,6 +3203,8 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 						"CATION death notificat"
 						"ion not active\n",
 						proc->pid, thread->pid);
+					binder_node_unlock(ref->node);
+					binder_proc_unlock(proc);
 					break;
 				}
 				death = ref->death;
@@ -2159,9 +3216,12 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 						"%p != %p\n",
 						proc->pid, thread->pid,
 						death->cookie, cookie);
+					binder_node_unlock(ref->node);
+					binder_proc_unlock(proc);
 					break;
 				}
 				ref->death = NULL;
+				binder_inner_proc_lock(proc);
 				if (list_empty(&death->work.entry)) {
 					death->work.type = BINDER_WORK_CLEAR_DEATH_NOTIFICATION;
 					if (thread->looper & (BINDER_LOOPER_STATE_REGISTERED | BINDER_LOOPER_STATE_ENTERED)) {
@@ -2174,7 +3234,10 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					BUG_ON(death->work.type != BINDER_WORK_DEAD_BINDER);
 					death->work.type = BINDER_WORK_DEAD_BINDER_AND_CLEAR;
 				}
+				binder_inner_proc_unlock(proc);
 			}
+			binder_node_unlock(ref->node);
+			binder_proc_unlock(proc);
 		} break;
 		case BC_DEAD_BINDER_DONE: {
 			struct binder_work *w;
@@ -2184,6 +3247,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				return -EFAULT;
 
 			ptr += sizeof(void *);
+			binder_inner_proc_lock(proc);
 			list_for_each_entry(w, &proc->delivered_death, entry) {
 				struct binder_ref_death *tmp_death = container_of(w, struct binder_ref_death, work);
 				if (tmp_death->cookie == cookie) {
@@ -2198,6 +3262,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				binder_user_error("binder: %d:%d BC_DEAD"
 					"_BINDER_DONE %p not found\n",
 					proc->pid, thread->pid, cookie);
+				binder_inner_proc_unlock(proc);
 				break;
 			}
 
@@ -2211,6 +3276,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					wake_up_interruptible(&proc->wait);
 				}
 			}
+			binder_inner_proc_unlock(proc);
 		} break;
 
 		default:
@@ -2228,23 +3294,96 @@ void binder_stat_br(struct binder_proc *proc, struct binder_thread *thread,
 		    uint32_t cmd)
 {
 	if (_IOC_NR(cmd) < ARRAY_SIZE(binder_stats.br)) {
-		binder_stats.br[_IOC_NR(cmd)]++;
-		proc->stats.br[_IOC_NR(cmd)]++;
-		thread->stats.br[_IOC_NR(cmd)]++;
+		atomic_inc(&binder_stats.br[_IOC_NR(cmd)]);
+		atomic_inc(&proc->stats.br[_IOC_NR(cmd)]);
+		atomic_inc(&thread->stats.br[_IOC_NR(cmd)]);
 	}
 }
 
+/* Account for t being handed to userspace in proc */
+static void binder_perf_received(struct binder_proc *proc,
+				 struct binder_transaction *t)
+{
+	s64 delay_ns = ktime_to_ns(ktime_sub(ktime_get(), t->start));
+	size_t size = t->buffer->data_size + t->buffer->offsets_size;
+
+	trace_binder_transaction_received(t, delay_ns);
+	spin_lock(&proc->perf_lock);
+	proc->perf.received++;
+	proc->perf.received_bytes += size;
+	if (size > proc->perf.max_bytes)
+		proc->perf.max_bytes = size;
+	proc->perf.delay_ns += delay_ns;
+	if (delay_ns > proc->perf.max_delay_ns)
+		proc->perf.max_delay_ns = delay_ns;
+	spin_unlock(&proc->perf_lock);
+}
+
 static int binder_has_proc_work(struct binder_proc *proc,
 				struct binder_thread *thread)
 {
-	return !list_empty(&proc->todo) ||
+	int has_work;
+
+	binder_inner_proc_lock(proc);
+	has_work = !list_empty(&proc->todo) ||
 		(thread->looper & BINDER_LOOPER_STATE_NEED_RETURN);
+	binder_inner_proc_unlock(proc);
+	return has_work;
 }
 
 static int binder_has_thread_work(struct binder_thread *thread)
 {
-	return !list_empty(&thread->todo) || thread->return_error != BR_OK ||
+	int has_work;
+
+	binder_inner_proc_lock(thread->proc);
+	has_work = !list_empty(&thread->todo) ||
+		thread->return_error != BR_OK ||
 		(thread->looper & BINDER_LOOPER_STATE_NEED_RETURN);
+	binder_inner_proc_unlock(thread->proc);
+	return has_work;
+}
+
+static void binder_cleanup_transaction(struct binder_transaction *t,
+				       const char *reason,
+				       uint32_t error_code)
+{
+	if (t->buffer->target_node && !(t->flags & TF_ONE_WAY)) {
+		binder_send_failed_reply(t, error_code);
+	} else {
+		binder_debug(BINDER_DEBUG_DEAD_TRANSACTION,
+			"binder: undelivered transaction %d, %s\n",
+			t->debug_id, reason);
+		binder_free_transaction(t);
+	}
+}
+
+static int binder_put_node_cmd(struct binder_proc *proc,
+			       struct binder_thread *thread,
+			       void __user **ptrp,
+			       void __user *node_ptr, void *node_cookie,
+			       int node_debug_id,
+			       uint32_t cmd, const char *cmd_name)
+{
+	void __user *ptr = *ptrp;
+
+	if (put_user(cmd, (uint32_t __user *)ptr))
+		return -EFAULT;
+	ptr += sizeof(uint32_t);
+	if (put_user(node_ptr, (void * __user *)ptr))
+		return -EFAULT;
+	ptr += sizeof(void *);
+	if (put_user(node_cookie, (void * __user *)ptr))
+		return -EFAULT;
+	ptr += sizeof(void *);
+
+	binder_stat_br(proc, thread, cmd);
+	binder_debug(BINDER_DEBUG_USER_REFS,
+		     "binder: %d:%d %s %d u%p c%p\n",
+		     proc->pid, thread->pid, cmd_name, node_debug_id,
+		     node_ptr, node_cookie);
+
+	*ptrp = ptr;
+	return 0;
 }
 
 static int binder_thread_read(struct binder_proc *proc,
@@ -2265,22 +3404,30 @@ static int binder_thread_read(struct binder_proc *proc,
 	}
 
 retry:
+	binder_inner_proc_lock(proc);
 	wait_for_proc_work = thread->transaction_stack == NULL &&
 				list_empty(&thread->todo);
 
 	if (thread->return_error != BR_OK && ptr < end) {
-		if (thread->return_error2 != BR_OK) {
-			if (put_user(thread->return_error2, (uint32_t __user *)ptr))
+		uint32_t return_error = thread->return_error;
+		uint32_t return_error2 = thread->return_error2;
+
+		/* with room for one word only, return_error stays pending */
+		thread->return_error2 = BR_OK;
+		if (return_error2 == BR_OK || ptr + sizeof(uint32_t) != end)
+			thread->return_error = BR_OK;
+		binder_inner_proc_unlock(proc);
+
+		if (return_error2 != BR_OK) {
+			if (put_user(return_error2, (uint32_t __user *)ptr))
 				return -EFAULT;
 			ptr += sizeof(uint32_t);
 			if (ptr == end)
 				goto done;
-			thread->return_error2 = BR_OK;
 		}
-		if (put_user(thread->return_error, (uint32_t __user *)ptr))
+		if (put_user(return_error, (uint32_t __user *)ptr))
 			return -EFAULT;
 		ptr += sizeof(uint32_t);
-		thread->return_error = BR_OK;
 		goto done;
 	}
 
@@ -2288,7 +3435,7 @@ retry:
 	thread->looper |= BINDER_LOOPER_STATE_WAITING;
 	if (wait_for_proc_work)
 		proc->ready_threads++;
-	mutex_unlock(&binder_lock);
+	binder_inner_proc_unlock(proc);
 	if (wait_for_proc_work) {
 		if (!(thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 					BINDER_LOOPER_STATE_ENTERED))) {
@@ -2312,10 +3459,11 @@ retry:
 		} else
 			ret = wait_event_interruptible(thread->wait, binder_has_thread_work(thread));
 	}
-	mutex_lock(&binder_lock);
+	binder_inner_proc_lock(proc);
 	if (wait_for_proc_work)
 		proc->ready_threads--;
 	thread->looper &= ~BINDER_LOOPER_STATE_WAITING;
+	binder_inner_proc_unlock(proc);
 
 	if (ret)
 		return ret;
@@ -2324,27 +3472,40 @@ retry:
 		uint32_t cmd;
 		struct binder_transaction_data tr;
 		struct binder_work *w;
+		struct list_head *list;
 		struct binder_transaction *t = NULL;
+		struct binder_thread *t_from;
 
+		binder_inner_proc_lock(proc);
 		if (!list_empty(&thread->todo))
-			w = list_first_entry(&thread->todo, struct binder_work, entry);
+			list = &thread->todo;
 		else if (!list_empty(&proc->todo) && wait_for_proc_work)
-			w = list_first_entry(&proc->todo, struct binder_work, entry);
+			list = &proc->todo;
 		else {
+			binder_inner_proc_unlock(proc);
 			if (ptr - buffer == 4 && !(thread->looper & BINDER_LOOPER_STATE_NEED_RETURN)) /* no data added */
 				goto retry;
 			break;
 		}
 
-		if (end - ptr < sizeof(tr) + 4)
+		if (end - ptr < sizeof(tr) + 4) {
+			binder_inner_proc_unlock(proc);
 			break;
+		}
+		/* the work item is ours once it is off the list */
+		w = list_first_entry(list, struct binder_work, entry);
+		list_del_init(&w->entry);
 
 		switch (w->type) {
 		case BINDER_WORK_TRANSACTION: {
+			binder_inner_proc_unlock(proc);
 			t = container_of(w, struct binder_transaction, work);
 		} break;
 		case BINDER_WORK_TRANSACTION_COMPLETE: {
+			binder_inner_proc_unlock(proc);
 			cmd = BR_TRANSACTION_COMPLETE;
+			kfree(w);
+			binder_stats_deleted(BINDER_STAT_TRANSACTION_COMPLETE);
 			if (put_user(cmd, (uint32_t __user *)ptr))
 				return -EFAULT;
 			ptr += sizeof(uint32_t);
@@ -2353,105 +3514,132 @@ retry:
 			binder_debug(BINDER_DEBUG_TRANSACTION_COMPLETE,
 				     "binder: %d:%d BR_TRANSACTION_COMPLETE\n",
 				     proc->pid, thread->pid);
-
-			list_del(&w->entry);
-			kfree(w);
-			binder_stats_deleted(BINDER_STAT_TRANSACTION_COMPLETE);
 		} break;
 		case BINDER_WORK_NODE: {
 			struct binder_node *node = container_of(w, struct binder_node, work);
-			uint32_t cmd = BR_NOOP;
-			const char *cmd_name;
-			int strong = node->internal_strong_refs || node->local_strong_refs;
-			int weak = !hlist_empty(&node->refs) || node->local_weak_refs || strong;
-			if (weak && !node->has_weak_ref) {
-				cmd = BR_INCREFS;
-				cmd_name = "BR_INCREFS";
+			void __user *orig_ptr = ptr;
+			void __user *node_ptr = node->ptr;
+			void *node_cookie = node->cookie;
+			int node_debug_id = node->debug_id;
+			int has_weak_ref, has_strong_ref;
+			int strong, weak;
+
+			/*
+			 * Work out every state change up front so that all
+			 * the commands for this node go out in one pass,
+			 * without holding the lock across put_user().
+			 */
+			BUG_ON(proc != node->proc);
+			strong = node->internal_strong_refs ||
+					node->local_strong_refs;
+			weak = !hlist_empty(&node->refs) ||
+					node->local_weak_refs ||
+					node->tmp_refs || strong;
+			has_strong_ref = node->has_strong_ref;
+			has_weak_ref = node->has_weak_ref;
+
+			if (weak && !has_weak_ref) {
 				node->has_weak_ref = 1;
 				node->pending_weak_ref = 1;
 				node->local_weak_refs++;
-			} else if (strong && !node->has_strong_ref) {
-				cmd = BR_ACQUIRE;
-				cmd_name = "BR_ACQUIRE";
+			}
+			if (strong && !has_strong_ref) {
 				node->has_strong_ref = 1;
 				node->pending_strong_ref = 1;
 				node->local_strong_refs++;
-			} else if (!strong && node->has_strong_ref) {
-				cmd = BR_RELEASE;
-				cmd_name = "BR_RELEASE";
+			}
+			if (!strong && has_strong_ref)
 				node->has_strong_ref = 0;
-			} else if (!weak && node->has_weak_ref) {
-				cmd = BR_DECREFS;
-				cmd_name = "BR_DECREFS";
+			if (!weak && has_weak_ref)
 				node->has_weak_ref = 0;
-			}
-			if (cmd != BR_NOOP) {
-				if (put_user(cmd, (uint32_t __user *)ptr))
-					return -EFAULT;
-				ptr += sizeof(uint32_t);
-				if (put_user(node->ptr, (void * __user *)ptr))
-					return -EFAULT;
-				ptr += sizeof(void *);
-				if (put_user(node->cookie, (void * __user *)ptr))
-					return -EFAULT;
-				ptr += sizeof(void *);
-
-				binder_stat_br(proc, thread, cmd);
-				binder_debug(BINDER_DEBUG_USER_REFS,
-					     "binder: %d:%d %s %d u%p c%p\n",
-					     proc->pid, thread->pid, cmd_name, node->debug_id, node->ptr, node->cookie);
-			} else {
-				list_del_init(&w->entry);
-				if (!weak && !strong) {
-					binder_debug(BINDER_DEBUG_INTERNAL_REFS,
-						     "binder: %d:%d node %d u%p c%p deleted\n",
-						     proc->pid, thread->pid, node->debug_id,
-						     node->ptr, node->cookie);
-					rb_erase(&node->rb_node, &proc->nodes);
-					kfree(node);
-					binder_stats_deleted(BINDER_STAT_NODE);
-				} else {
-					binder_debug(BINDER_DEBUG_INTERNAL_REFS,
-						     "binder: %d:%d node %d u%p c%p state unchanged\n",
-						     proc->pid, thread->pid, node->debug_id, node->ptr,
-						     node->cookie);
-				}
-			}
+			if (!weak && !strong) {
+				binder_debug(BINDER_DEBUG_INTERNAL_REFS,
+					     "binder: %d:%d node %d u%p c%p deleted\n",
+					     proc->pid, thread->pid, node_debug_id,
+					     node_ptr, node_cookie);
+				rb_erase(&node->rb_node, &proc->nodes);
+				binder_inner_proc_unlock(proc);
+				/*
+				 * Wait out anyone still unlocking the node
+				 * after dropping its last reference.
+				 */
+				binder_node_lock(node);
+				binder_node_unlock(node);
+				binder_free_node(node);
+			} else
+				binder_inner_proc_unlock(proc);
+
+			if (weak && !has_weak_ref)
+				ret = binder_put_node_cmd(
+						proc, thread, &ptr, node_ptr,
+						node_cookie, node_debug_id,
+						BR_INCREFS, "BR_INCREFS");
+			if (!ret && strong && !has_strong_ref)
+				ret = binder_put_node_cmd(
+						proc, thread, &ptr, node_ptr,
+						node_cookie, node_debug_id,
+						BR_ACQUIRE, "BR_ACQUIRE");
+			if (!ret && !strong && has_strong_ref)
+				ret = binder_put_node_cmd(
+						proc, thread, &ptr, node_ptr,
+						node_cookie, node_debug_id,
+						BR_RELEASE, "BR_RELEASE");
+			if (!ret && !weak && has_weak_ref)
+				ret = binder_put_node_cmd(
+						proc, thread, &ptr, node_ptr,
+						node_cookie, node_debug_id,
+						BR_DECREFS, "BR_DECREFS");
+			if (orig_ptr == ptr)
+				binder_debug(BINDER_DEBUG_INTERNAL_REFS,
+					     "binder: %d:%d node %d u%p c%p state unchanged\n",
+					     proc->pid, thread->pid, node_debug_id,
+					     node_ptr, node_cookie);
+			if (ret)
+				return ret;
 		} break;
 		case BINDER_WORK_DEAD_BINDER:
 		case BINDER_WORK_DEAD_BINDER_AND_CLEAR:
 		case BINDER_WORK_CLEAR_DEATH_NOTIFICATION: {
 			struct binder_ref_death *death;
-			uint32_t cmd;
+			void __user *cookie;
 
 			death = container_of(w, struct binder_ref_death, work);
 			if (w->type == BINDER_WORK_CLEAR_DEATH_NOTIFICATION)
 				cmd = BR_CLEAR_DEATH_NOTIFICATION_DONE;
 			else
 				cmd = BR_DEAD_BINDER;
+			cookie = death->cookie;
+			if (w->type == BINDER_WORK_CLEAR_DEATH_NOTIFICATION) {
+				binder_inner_proc_unlock(proc);
+				kfree(death);
+				binder_stats_deleted(BINDER_STAT_DEATH);
+			} else {
+				list_add(&w->entry, &proc->delivered_death);
+				binder_inner_proc_unlock(proc);
+			}
 			if (put_user(cmd, (uint32_t __user *)ptr))
 				return -EFAULT;
 			ptr += sizeof(uint32_t);
-			if (put_user(death->cookie, (void * __user *)ptr))
+			if (put_user(cookie, (void * __user *)ptr))
 				return -EFAULT;
 			ptr += sizeof(void *);
+			binder_stat_br(proc, thread, cmd);
 			binder_debug(BINDER_DEBUG_DEATH_NOTIFICATION,
 				     "binder: %d:%d %s %p\n",
 				      proc->pid, thread->pid,
 				      cmd == BR_DEAD_BINDER ?
 				      "BR_DEAD_BINDER" :
 				      "BR_CLEAR_DEATH_NOTIFICATION_DONE",
-				      death->cookie);
+				      cookie);
 
-			if (w->type == BINDER_WORK_CLEAR_DEATH_NOTIFICATION) {
-				list_del(&w->entry);
-				kfree(death);
-				binder_stats_deleted(BINDER_STAT_DEATH);
-			} else
-				list_move(&w->entry, &proc->delivered_death);
 			if (cmd == BR_DEAD_BINDER)
 				goto done; /* DEAD_BINDER notifications can cause transactions */
 		} break;
+		default:
+			binder_inner_proc_unlock(proc);
+			pr_err("binder: %d:%d: bad work type %d\n",
+			       proc->pid, thread->pid, w->type);
+			break;
 		}
 
 		if (!t)
@@ -2479,8 +3667,9 @@ retry:
 		tr.flags = t->flags;
 		tr.sender_euid = t->sender_euid;
 
-		if (t->from) {
-			struct task_struct *sender = t->from->proc->tsk;
+		t_from = binder_get_txn_from(t);
+		if (t_from) {
+			struct task_struct *sender = t_from->proc->tsk;
 			tr.sender_pid = task_tgid_nr_ns(sender,
 							current->nsproxy->pid_ns);
 		} else {
@@ -2495,35 +3684,42 @@ retry:
 					ALIGN(t->buffer->data_size,
 					    sizeof(void *));
 
-		if (put_user(cmd, (uint32_t __user *)ptr))
-			return -EFAULT;
-		ptr += sizeof(uint32_t);
-		if (copy_to_user(ptr, &tr, sizeof(tr)))
+		if (put_user(cmd, (uint32_t __user *)ptr) ||
+		    copy_to_user(ptr + sizeof(uint32_t), &tr, sizeof(tr))) {
+			if (t_from)
+				binder_thread_dec_tmpref(t_from);
+			binder_cleanup_transaction(t, "put_user failed",
+						   BR_FAILED_REPLY);
 			return -EFAULT;
-		ptr += sizeof(tr);
+		}
+		ptr += sizeof(uint32_t) + sizeof(tr);
 
 		binder_stat_br(proc, thread, cmd);
+		binder_perf_received(proc, t);
 		binder_debug(BINDER_DEBUG_TRANSACTION,
 			     "binder: %d:%d %s %d %d:%d, cmd %d"
 			     "size %zd-%zd ptr %p-%p\n",
 			     proc->pid, thread->pid,
 			     (cmd == BR_TRANSACTION) ? "BR_TRANSACTION" :
 			     "BR_REPLY",
-			     t->debug_id, t->from ? t->from->proc->pid : 0,
-			     t->from ? t->from->pid : 0, cmd,
+			     t->debug_id, t_from ? t_from->proc->pid : 0,
+			     t_from ? t_from->pid : 0, cmd,
 			     t->buffer->data_size, t->buffer->offsets_size,
 			     tr.data.ptr.buffer, tr.data.ptr.offsets);
 
-		list_del(&t->work.entry);
+		if (t_from)
+			binder_thread_dec_tmpref(t_from);
 		t->buffer->allow_user_free = 1;
 		if (cmd == BR_TRANSACTION && !(t->flags & TF_ONE_WAY)) {
+			binder_inner_proc_lock(thread->proc);
 			t->to_parent = thread->transaction_stack;
+			spin_lock(&t->lock);
 			t->to_thread = thread;
+			spin_unlock(&t->lock);
 			thread->transaction_stack = t;
+			binder_inner_proc_unlock(thread->proc);
 		} else {
-			t->buffer->transaction = NULL;
-			kfree(t);
-			binder_stats_deleted(BINDER_STAT_TRANSACTION);
+			binder_free_transaction(t);
 		}
 		break;
 	}
@@ -2531,43 +3727,41 @@ retry:
 done:
 
 	*consumed = ptr - buffer;
+	binder_inner_proc_lock(proc);
 	if (proc->requested_threads + proc->ready_threads == 0 &&
 	    proc->requested_threads_started < proc->max_threads &&
 	    (thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 	     BINDER_LOOPER_STATE_ENTERED)) /* the user-space code fails to */
 	     /*spawn a new thread if we leave this out */) {
 		proc->requested_threads++;
+		binder_inner_proc_unlock(proc);
 		binder_debug(BINDER_DEBUG_THREADS,
 			     "binder: %d:%d BR_SPAWN_LOOPER\n",
 			     proc->pid, thread->pid);
 		if (put_user(BR_SPAWN_LOOPER, (uint32_t __user *)buffer))
 			return -EFAULT;
-	}
+	} else
+		binder_inner_proc_unlock(proc);
 	return 0;
 }
 
-static void binder_release_work(struct list_head *list)
+static void binder_release_work(struct binder_proc *proc,
+				struct list_head *list)
 {
 	struct binder_work *w;
-	while (!list_empty(list)) {
-		w = list_first_entry(list, struct binder_work, entry);
-		list_del_init(&w->entry);
+
+	while (1) {
+		w = binder_dequeue_work_head(proc, list);
+		if (w == NULL)
+			return;
+
 		switch (w->type) {
 		case BINDER_WORK_TRANSACTION: {
 			struct binder_transaction *t;
 
 			t = container_of(w, struct binder_transaction, work);
-			if (t->buffer->target_node &&
-			    !(t->flags & TF_ONE_WAY)) {
-				binder_send_failed_reply(t, BR_DEAD_REPLY);
-			} else {
-				binder_debug(BINDER_DEBUG_DEAD_TRANSACTION,
-					"binder: undelivered transaction %d\n",
-					t->debug_id);
-				t->buffer->transaction = NULL;
-				kfree(t);
-				binder_stats_deleted(BINDER_STAT_TRANSACTION);
-			}
+			binder_cleanup_transaction(t, "process died",
+						   BR_DEAD_REPLY);
 		} break;
 		case BINDER_WORK_TRANSACTION_COMPLETE: {
 			binder_debug(BINDER_DEBUG_DEAD_TRANSACTION,
@@ -2586,6 +3780,9 @@ static void binder_release_work(struct list_head *list)
 			kfree(death);
 			binder_stats_deleted(BINDER_STAT_DEATH);
 		} break;
+		case BINDER_WORK_NODE:
+			/* the node itself is released with its proc */
+			break;
 		default:
 			pr_err("binder: unexpected work type, %d, not freed\n",
 			       w->type);
@@ -2595,7 +3792,8 @@ static void binder_release_work(struct list_head *list)
 
 }
 
-static struct binder_thread *binder_get_thread(struct binder_proc *proc)
+static struct binder_thread *binder_get_thread_ilocked(
+		struct binder_proc *proc, struct binder_thread *new_thread)
 {
 	struct binder_thread *thread = NULL;
 	struct rb_node *parent = NULL;
@@ -2610,38 +3808,73 @@ static struct binder_thread *binder_get_thread(struct binder_proc *proc)
 		else if (current->pid > thread->pid)
 			p = &(*p)->rb_right;
 		else
-			break;
+			return thread;
 	}
-	if (*p == NULL) {
-		thread = kzalloc(sizeof(*thread), GFP_KERNEL);
-		if (thread == NULL)
+	if (new_thread == NULL)
+		return NULL;
+	thread = new_thread;
+	binder_stats_created(BINDER_STAT_THREAD);
+	thread->proc = proc;
+	thread->pid = current->pid;
+	atomic_set(&thread->tmp_ref, 0);
+	init_waitqueue_head(&thread->wait);
+	INIT_LIST_HEAD(&thread->todo);
+	rb_link_node(&thread->rb_node, parent, p);
+	rb_insert_color(&thread->rb_node, &proc->threads);
+	thread->looper |= BINDER_LOOPER_STATE_NEED_RETURN;
+	thread->return_error = BR_OK;
+	thread->return_error2 = BR_OK;
+	return thread;
+}
+
+static struct binder_thread *binder_get_thread(struct binder_proc *proc)
+{
+	struct binder_thread *thread;
+	struct binder_thread *new_thread;
+
+	binder_inner_proc_lock(proc);
+	thread = binder_get_thread_ilocked(proc, NULL);
+	binder_inner_proc_unlock(proc);
+	if (thread == NULL) {
+		new_thread = kzalloc(sizeof(*thread), GFP_KERNEL);
+		if (new_thread == NULL)
 			return NULL;
-		binder_stats_created(BINDER_STAT_THREAD);
-		thread->proc = proc;
-		thread->pid = current->pid;
-		init_waitqueue_head(&thread->wait);
-		INIT_LIST_HEAD(&thread->todo);
-		rb_link_node(&thread->rb_node, parent, p);
-		rb_insert_color(&thread->rb_node, &proc->threads);
-		thread->looper |= BINDER_LOOPER_STATE_NEED_RETURN;
-		thread->return_error = BR_OK;
-		thread->return_error2 = BR_OK;
+		binder_inner_proc_lock(proc);
+		thread = binder_get_thread_ilocked(proc, new_thread);
+		binder_inner_proc_unlock(proc);
+		if (thread != new_thread)
+			kfree(new_thread);
 	}
 	return thread;
 }
 
-static int binder_free_thread(struct binder_proc *proc,
-			      struct binder_thread *thread)
+/*
+ * Unlink thread from proc and fail everything still addressed to it.
+ * The thread itself is freed when its last temporary ref is dropped.
+ */
+static int binder_thread_release(struct binder_proc *proc,
+				 struct binder_thread *thread)
 {
 	struct binder_transaction *t;
 	struct binder_transaction *send_reply = NULL;
+	struct binder_transaction *last_t;
 	int active_transactions = 0;
 
+	binder_inner_proc_lock(proc);
+	/* dropped again by binder_free_thread() */
+	proc->tmp_ref++;
+	atomic_inc(&thread->tmp_ref);
 	rb_erase(&thread->rb_node, &proc->threads);
 	t = thread->transaction_stack;
-	if (t && t->to_thread == thread)
-		send_reply = t;
+	if (t) {
+		spin_lock(&t->lock);
+		if (t->to_thread == thread)
+			send_reply = t;
+	}
+	thread->is_dead = true;
+
 	while (t) {
+		last_t = t;
 		active_transactions++;
 		binder_debug(BINDER_DEBUG_DEAD_TRANSACTION,
 			     "binder: release %d:%d transaction %d "
@@ -2662,12 +3895,16 @@ static int binder_free_thread(struct binder_proc *proc,
 			t = t->from_parent;
 		} else
 			BUG();
+		spin_unlock(&last_t->lock);
+		if (t)
+			spin_lock(&t->lock);
 	}
+	binder_inner_proc_unlock(proc);
+
 	if (send_reply)
 		binder_send_failed_reply(send_reply, BR_DEAD_REPLY);
-	binder_release_work(&thread->todo);
-	kfree(thread);
-	binder_stats_deleted(BINDER_STAT_THREAD);
+	binder_release_work(proc, &thread->todo);
+	binder_thread_dec_tmpref(thread);
 	return active_transactions;
 }
 
@@ -2678,12 +3915,14 @@ static unsigned int binder_poll(struct file *filp,
 	struct binder_thread *thread = NULL;
 	int wait_for_proc_work;
 
-	mutex_lock(&binder_lock);
 	thread = binder_get_thread(proc);
+	if (thread == NULL)
+		return POLLERR;
 
+	binder_inner_proc_lock(proc);
 	wait_for_proc_work = thread->transaction_stack == NULL &&
 		list_empty(&thread->todo) && thread->return_error == BR_OK;
-	mutex_unlock(&binder_lock);
+	binder_inner_proc_unlock(proc);
 
 	if (wait_for_proc_work) {
 		if (binder_has_proc_work(proc, thread))
@@ -2701,6 +3940,48 @@ static unsigned int binder_poll(struct file *filp,
 	return 0;
 }
 
+static int binder_ioctl_set_ctx_mgr(struct binder_proc *proc)
+{
+	struct binder_node *new_node;
+	int ret = 0;
+
+	mutex_lock(&binder_context_mgr_node_lock);
+	if (binder_context_mgr_node != NULL) {
+		binder_debug(BINDER_DEBUG_TOP_ERRORS,
+			"binder: BINDER_SET_CONTEXT_MGR already set\n");
+		ret = -EBUSY;
+		goto out;
+	}
+	if (binder_context_mgr_uid != -1) {
+		if (binder_context_mgr_uid != current->cred->euid) {
+			binder_debug(BINDER_DEBUG_TOP_ERRORS,
+			       "binder: BINDER_SET_"
+			       "CONTEXT_MGR bad uid %d != %d\n",
+			       current->cred->euid,
+			       binder_context_mgr_uid);
+			ret = -EPERM;
+			goto out;
+		}
+	} else
+		binder_context_mgr_uid = current->cred->euid;
+	new_node = binder_new_node(proc, NULL);
+	if (new_node == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	binder_node_inner_lock(new_node);
+	new_node->local_weak_refs++;
+	new_node->local_strong_refs++;
+	new_node->has_strong_ref = 1;
+	new_node->has_weak_ref = 1;
+	binder_context_mgr_node = new_node;
+	binder_node_inner_unlock(new_node);
+	binder_put_node(new_node);
+out:
+	mutex_unlock(&binder_context_mgr_node_lock);
+	return ret;
+}
+
 static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
 	int ret;
@@ -2717,7 +3998,6 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	if (ret)
 		return ret;
 
-	mutex_lock(&binder_lock);
 	thread = binder_get_thread(proc);
 	if (thread == NULL) {
 		ret = -ENOMEM;
@@ -2751,8 +4031,10 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		}
 		if (bwr.read_size > 0) {
 			ret = binder_thread_read(proc, thread, (void __user *)bwr.read_buffer, bwr.read_size, &bwr.read_consumed, filp->f_flags & O_NONBLOCK);
+			binder_inner_proc_lock(proc);
 			if (!list_empty(&proc->todo))
 				wake_up_interruptible(&proc->wait);
+			binder_inner_proc_unlock(proc);
 			if (ret < 0) {
 				if (copy_to_user(ubuf, &bwr, sizeof(bwr)))
 					ret = -EFAULT;
@@ -2769,46 +4051,27 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		}
 		break;
 	}
-	case BINDER_SET_MAX_THREADS:
-		if (copy_from_user(&proc->max_threads, ubuf,
-					sizeof(proc->max_threads))) {
+	case BINDER_SET_MAX_THREADS: {
+		int max_threads;
+
+		if (copy_from_user(&max_threads, ubuf, sizeof(max_threads))) {
 			ret = -EINVAL;
 			goto err;
 		}
+		binder_inner_proc_lock(proc);
+		proc->max_threads = max_threads;
+		binder_inner_proc_unlock(proc);
 		break;
+	}
 	case BINDER_SET_CONTEXT_MGR:
-		if (binder_context_mgr_node != NULL) {
-			binder_debug(BINDER_DEBUG_TOP_ERRORS,
-				"binder: BINDER_SET_CONTEXT_MGR already set\n");
-			ret = -EBUSY;
-			goto err;
-		}
-		if (binder_context_mgr_uid != -1) {
-			if (binder_context_mgr_uid != current->cred->euid) {
-				binder_debug(BINDER_DEBUG_TOP_ERRORS,
-				       "binder: BINDER_SET_"
-				       "CONTEXT_MGR bad uid %d != %d\n",
-				       current->cred->euid,
-				       binder_context_mgr_uid);
-				ret = -EPERM;
-				goto err;
-			}
-		} else
-			binder_context_mgr_uid = current->cred->euid;
-		binder_context_mgr_node = binder_new_node(proc, NULL, NULL);
-		if (binder_context_mgr_node == NULL) {
-			ret = -ENOMEM;
+		ret = binder_ioctl_set_ctx_mgr(proc);
+		if (ret)
 			goto err;
-		}
-		binder_context_mgr_node->local_weak_refs++;
-		binder_context_mgr_node->local_strong_refs++;
-		binder_context_mgr_node->has_strong_ref = 1;
-		binder_context_mgr_node->has_weak_ref = 1;
 		break;
 	case BINDER_THREAD_EXIT:
 		binder_debug(BINDER_DEBUG_THREADS, "binder: %d:%d exit\n",
 			     proc->pid, thread->pid);
-		binder_free_thread(proc, thread);
+		binder_thread_release(proc, thread);
 		thread = NULL;
 		break;
 	case BINDER_VERSION:
@@ -2827,9 +4090,11 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	}
 	ret = 0;
 err:
-	if (thread)
+	if (thread) {
+		binder_inner_proc_lock(proc);
 		thread->looper &= ~BINDER_LOOPER_STATE_NEED_RETURN;
-	mutex_unlock(&binder_lock);
+		binder_inner_proc_unlock(proc);
+	}
 	wait_event_interruptible(binder_user_error_wait, binder_stop_on_user_error < 2);
 	if (ret && ret != -ERESTARTSYS)
 		binder_debug(BINDER_DEBUG_TOP_ERRORS,
@@ -2868,7 +4133,7 @@ static struct vm_operations_struct binder_vm_ops = {
 
 static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 {
-	int ret;
+	int ret, i;
 	struct vm_struct *area;
 	struct binder_proc *proc = filp->private_data;
 	const char *failure_string;
@@ -2922,6 +4187,10 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		goto err_alloc_pages_failed;
 	}
 	proc->buffer_size = vma->vm_end - vma->vm_start;
+	for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
+		INIT_LIST_HEAD(&proc->pages[i].lru);
+		proc->pages[i].proc = proc;
+	}
 
 	vma->vm_ops = &binder_vm_ops;
 	vma->vm_private_data = proc;
@@ -2933,12 +4202,16 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	}
 	buffer = proc->buffer;
 	INIT_LIST_HEAD(&proc->buffers);
+	for (i = 0; i < BINDER_FREE_CLASSES; i++)
+		INIT_LIST_HEAD(&proc->free_buffers[i]);
 	list_add(&buffer->entry, &proc->buffers);
 	buffer->free = 1;
 	binder_insert_free_buffer(proc, buffer);
 	proc->free_async_space = proc->buffer_size / 2;
 	barrier();
+	mutex_lock(&proc->files_lock);
 	proc->files = get_files_struct(current);
+	mutex_unlock(&proc->files_lock);
 	proc->vma = vma;
 
 	/*binder_debug(BINDER_DEBUG_TOP_ERRORS,
@@ -2971,18 +4244,24 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	proc = kzalloc(sizeof(*proc), GFP_KERNEL);
 	if (proc == NULL)
 		return -ENOMEM;
+	spin_lock_init(&proc->inner_lock);
+	spin_lock_init(&proc->outer_lock);
+	mutex_init(&proc->files_lock);
+	mutex_init(&proc->alloc_lock);
+	spin_lock_init(&proc->perf_lock);
 	get_task_struct(current);
 	proc->tsk = current;
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
 	proc->default_priority = task_nice(current);
-	mutex_lock(&binder_lock);
 	binder_stats_created(BINDER_STAT_PROC);
-	hlist_add_head(&proc->proc_node, &binder_procs);
 	proc->pid = current->group_leader->pid;
 	INIT_LIST_HEAD(&proc->delivered_death);
 	filp->private_data = proc;
-	mutex_unlock(&binder_lock);
+
+	mutex_lock(&binder_procs_lock);
+	hlist_add_head(&proc->proc_node, &binder_procs);
+	mutex_unlock(&binder_procs_lock);
 
 	if (binder_debugfs_dir_entry_proc) {
 		char strbuf[11];
@@ -2990,6 +4269,13 @@ static int binder_open(struct inode *nodp, struct file *filp)
 		proc->debugfs_entry = debugfs_create_file(strbuf, S_IRUGO,
 			binder_debugfs_dir_entry_proc, proc, &binder_proc_fops);
 	}
+	if (binder_debugfs_dir_entry_proc_stats) {
+		char strbuf[11];
+		snprintf(strbuf, sizeof(strbuf), "%u", proc->pid);
+		proc->debugfs_stats_entry = debugfs_create_file(strbuf,
+			S_IRUGO, binder_debugfs_dir_entry_proc_stats, proc,
+			&binder_proc_stats_fops);
+	}
 
 	return 0;
 }
@@ -3007,6 +4293,8 @@ static void binder_deferred_flush(struct binder_proc *proc)
 {
 	struct rb_node *n;
 	int wake_count = 0;
+
+	binder_inner_proc_lock(proc);
 	for (n = rb_first(&proc->threads); n != NULL; n = rb_next(n)) {
 		struct binder_thread *thread = rb_entry(n, struct binder_thread, rb_node);
 		thread->looper |= BINDER_LOOPER_STATE_NEED_RETURN;
@@ -3015,6 +4303,7 @@ static void binder_deferred_flush(struct binder_proc *proc)
 			wake_count++;
 		}
 	}
+	binder_inner_proc_unlock(proc);
 	wake_up_interruptible_all(&proc->wait);
 
 	binder_debug(BINDER_DEBUG_OPEN_CLOSE,
@@ -3026,136 +4315,151 @@ static int binder_release(struct inode *nodp, struct file *filp)
 {
 	struct binder_proc *proc = filp->private_data;
 	debugfs_remove(proc->debugfs_entry);
+	debugfs_remove(proc->debugfs_stats_entry);
 	binder_defer_work(proc, BINDER_DEFERRED_RELEASE);
 
 	return 0;
 }
 
-static void binder_deferred_release(struct binder_proc *proc)
+/*
+ * Called with a temporary ref on node, which has already been erased
+ * from its proc's tree. The node is freed right away if nothing else
+ * refers to it, otherwise it moves to binder_dead_nodes and death
+ * notifications go out to every proc holding a ref.
+ */
+static int binder_node_release(struct binder_node *node, int refs)
 {
+	struct binder_proc *proc = node->proc;
+	struct binder_ref *ref;
 	struct hlist_node *pos;
-	struct binder_transaction *t;
+	int death = 0;
+
+	binder_release_work(proc, &node->async_todo);
+
+	binder_node_lock(node);
+	binder_inner_proc_lock(proc);
+	list_del_init(&node->work.entry);
+	BUG_ON(!node->tmp_refs);
+	if (hlist_empty(&node->refs) && node->tmp_refs == 1) {
+		binder_inner_proc_unlock(proc);
+		binder_node_unlock(node);
+		binder_free_node(node);
+		return refs;
+	}
+
+	node->proc = NULL;
+	node->local_strong_refs = 0;
+	node->local_weak_refs = 0;
+	binder_inner_proc_unlock(proc);
+
+	spin_lock(&binder_dead_nodes_lock);
+	hlist_add_head(&node->dead_node, &binder_dead_nodes);
+	spin_unlock(&binder_dead_nodes_lock);
+
+	hlist_for_each_entry(ref, pos, &node->refs, node_entry) {
+		refs++;
+		/*
+		 * the node lock keeps ref->death stable, the inner lock
+		 * of the ref's proc covers its todo list
+		 */
+		binder_inner_proc_lock(ref->proc);
+		if (!ref->death) {
+			binder_inner_proc_unlock(ref->proc);
+			continue;
+		}
+		death++;
+		BUG_ON(!list_empty(&ref->death->work.entry));
+		ref->death->work.type = BINDER_WORK_DEAD_BINDER;
+		list_add_tail(&ref->death->work.entry, &ref->proc->todo);
+		wake_up_interruptible(&ref->proc->wait);
+		binder_inner_proc_unlock(ref->proc);
+	}
+
+	binder_debug(BINDER_DEBUG_DEAD_BINDER,
+		     "binder: node %d now dead, "
+		     "refs %d, death %d\n", node->debug_id,
+		     refs, death);
+	binder_node_unlock(node);
+	binder_put_node(node);
+
+	return refs;
+}
+
+static void binder_deferred_release(struct binder_proc *proc)
+{
 	struct rb_node *n;
-	int threads, nodes, incoming_refs, outgoing_refs, buffers, active_transactions, page_count;
+	int threads, nodes, incoming_refs, outgoing_refs, active_transactions;
 
 	BUG_ON(proc->vma);
 	BUG_ON(proc->files);
 
+	mutex_lock(&binder_procs_lock);
 	hlist_del(&proc->proc_node);
+	mutex_unlock(&binder_procs_lock);
+
+	mutex_lock(&binder_context_mgr_node_lock);
 	if (binder_context_mgr_node && binder_context_mgr_node->proc == proc) {
 		binder_debug(BINDER_DEBUG_DEAD_BINDER,
 			     "binder_release: %d context_mgr_node gone\n",
 			     proc->pid);
 		binder_context_mgr_node = NULL;
 	}
+	mutex_unlock(&binder_context_mgr_node_lock);
 
+	binder_inner_proc_lock(proc);
+	/* keep proc around until everything below has let go of it */
+	proc->tmp_ref++;
+	proc->is_dead = true;
 	threads = 0;
 	active_transactions = 0;
 	while ((n = rb_first(&proc->threads))) {
 		struct binder_thread *thread = rb_entry(n, struct binder_thread, rb_node);
+
+		binder_inner_proc_unlock(proc);
 		threads++;
-		active_transactions += binder_free_thread(proc, thread);
+		active_transactions += binder_thread_release(proc, thread);
+		binder_inner_proc_lock(proc);
 	}
+
 	nodes = 0;
 	incoming_refs = 0;
 	while ((n = rb_first(&proc->nodes))) {
 		struct binder_node *node = rb_entry(n, struct binder_node, rb_node);
 
 		nodes++;
+		/* dropped or handed on by binder_node_release() */
+		node->tmp_refs++;
 		rb_erase(&node->rb_node, &proc->nodes);
-		list_del_init(&node->work.entry);
-		binder_release_work(&node->async_todo);
-		if (hlist_empty(&node->refs)) {
-			kfree(node);
-			binder_stats_deleted(BINDER_STAT_NODE);
-		} else {
-			struct binder_ref *ref;
-			int death = 0;
-
-			node->proc = NULL;
-			node->local_strong_refs = 0;
-			node->local_weak_refs = 0;
-			hlist_add_head(&node->dead_node, &binder_dead_nodes);
-
-			hlist_for_each_entry(ref, pos, &node->refs, node_entry) {
-				incoming_refs++;
-				if (ref->death) {
-					death++;
-					if (list_empty(&ref->death->work.entry)) {
-						ref->death->work.type = BINDER_WORK_DEAD_BINDER;
-						list_add_tail(&ref->death->work.entry, &ref->proc->todo);
-						wake_up_interruptible(&ref->proc->wait);
-					} else
-						BUG();
-				}
-			}
-			binder_debug(BINDER_DEBUG_DEAD_BINDER,
-				     "binder: node %d now dead, "
-				     "refs %d, death %d\n", node->debug_id,
-				     incoming_refs, death);
-		}
+		binder_inner_proc_unlock(proc);
+		incoming_refs = binder_node_release(node, incoming_refs);
+		binder_inner_proc_lock(proc);
 	}
+	binder_inner_proc_unlock(proc);
+
 	outgoing_refs = 0;
+	binder_proc_lock(proc);
 	while ((n = rb_first(&proc->refs_by_desc))) {
 		struct binder_ref *ref = rb_entry(n, struct binder_ref,
 						  rb_node_desc);
 		outgoing_refs++;
-		binder_delete_ref(ref);
-	}
-	binder_release_work(&proc->todo);
-	binder_release_work(&proc->delivered_death);
-	buffers = 0;
-
-	while ((n = rb_first(&proc->allocated_buffers))) {
-		struct binder_buffer *buffer = rb_entry(n, struct binder_buffer,
-							rb_node);
-		t = buffer->transaction;
-		if (t) {
-			t->buffer = NULL;
-			buffer->transaction = NULL;
-			binder_debug(BINDER_DEBUG_TOP_ERRORS,
-				"binder: release proc %d, "
-			       "transaction %d, not freed\n",
-			       proc->pid, t->debug_id);
-			/*BUG();*/
-		}
-		binder_free_buf(proc, buffer);
-		buffers++;
-	}
-
-	binder_stats_deleted(BINDER_STAT_PROC);
-
-	page_count = 0;
-	if (proc->pages) {
-		int i;
-		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
-			if (proc->pages[i]) {
-				void *page_addr = proc->buffer + i * PAGE_SIZE;
-				binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
-					     "binder_release: %d: "
-					     "page %d at %p not freed\n",
-					     proc->pid, i,
-					     page_addr);
-				unmap_kernel_range((unsigned long)page_addr,
-					PAGE_SIZE);
-				__free_page(proc->pages[i]);
-				page_count++;
-			}
-		}
-		kfree(proc->pages);
-		vfree(proc->buffer);
+		binder_cleanup_ref_olocked(ref);
+		binder_proc_unlock(proc);
+		binder_free_ref(ref);
+		binder_proc_lock(proc);
 	}
+	binder_proc_unlock(proc);
 
-	put_task_struct(proc->tsk);
+	binder_release_work(proc, &proc->todo);
+	binder_release_work(proc, &proc->delivered_death);
 
 	binder_debug(BINDER_DEBUG_OPEN_CLOSE,
 		     "binder_release: %d threads %d, nodes %d (ref %d), "
-		     "refs %d, active transactions %d, buffers %d, "
-		     "pages %d\n",
+		     "refs %d, active transactions %d\n",
 		     proc->pid, threads, nodes, incoming_refs, outgoing_refs,
-		     active_transactions, buffers, page_count);
+		     active_transactions);
 
-	kfree(proc);
+	/* buffers and pages go with the proc once the last ref drops */
+	binder_proc_dec_tmpref(proc);
 }
 
 static void binder_deferred_func(struct work_struct *work)
@@ -3165,7 +4469,6 @@ static void binder_deferred_func(struct work_struct *work)
 
 	int defer;
 	do {
-		mutex_lock(&binder_lock);
 		mutex_lock(&binder_deferred_lock);
 		if (!hlist_empty(&binder_deferred_list)) {
 			proc = hlist_entry(binder_deferred_list.first,
@@ -3181,18 +4484,19 @@ static void binder_deferred_func(struct work_struct *work)
 
 		files = NULL;
 		if (defer & BINDER_DEFERRED_PUT_FILES) {
+			mutex_lock(&proc->files_lock);
 			files = proc->files;
 			if (files)
 				proc->files = NULL;
+			mutex_unlock(&proc->files_lock);
 		}
 
 		if (defer & BINDER_DEFERRED_FLUSH)
 			binder_deferred_flush(proc);
 
 		if (defer & BINDER_DEFERRED_RELEASE)
-			binder_deferred_release(proc); /* frees proc */
+			binder_deferred_release(proc); /* may free proc */
 
-		mutex_unlock(&binder_lock);
 		if (files)
 			put_files_struct(files);
 	} while (proc);
@@ -3212,27 +4516,40 @@ binder_defer_work(struct binder_proc *proc, enum binder_deferred_state defer)
 	mutex_unlock(&binder_deferred_lock);
 }
 
-static void print_binder_transaction(struct seq_file *m, const char *prefix,
-				     struct binder_transaction *t)
+static void print_binder_transaction_ilocked(struct seq_file *m,
+					     struct binder_proc *proc,
+					     const char *prefix,
+					     struct binder_transaction *t)
 {
+	struct binder_proc *to_proc;
+	struct binder_buffer *buffer = t->buffer;
+
+	spin_lock(&t->lock);
+	to_proc = t->to_proc;
 	seq_printf(m,
 		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %ld r%d",
 		   prefix, t->debug_id, t,
 		   t->from ? t->from->proc->pid : 0,
 		   t->from ? t->from->pid : 0,
-		   t->to_proc ? t->to_proc->pid : 0,
+		   to_proc ? to_proc->pid : 0,
 		   t->to_thread ? t->to_thread->pid : 0,
 		   t->code, t->flags, t->priority, t->need_reply);
-	if (t->buffer == NULL) {
+	spin_unlock(&t->lock);
+
+	/* the buffer is only stable under the target proc's inner lock */
+	if (proc != to_proc) {
+		seq_puts(m, "\n");
+		return;
+	}
+	if (buffer == NULL) {
 		seq_puts(m, " buffer free\n");
 		return;
 	}
-	if (t->buffer->target_node)
-		seq_printf(m, " node %d",
-			   t->buffer->target_node->debug_id);
+	if (buffer->target_node)
+		seq_printf(m, " node %d", buffer->target_node->debug_id);
 	seq_printf(m, " size %zd:%zd data %p\n",
-		   t->buffer->data_size, t->buffer->offsets_size,
-		   t->buffer->data);
+		   buffer->data_size, buffer->offsets_size,
+		   buffer->data);
 }
 
 static void print_binder_buffer(struct seq_file *m, const char *prefix,
@@ -3244,9 +4561,11 @@ static void print_binder_buffer(struct seq_file *m, const char *prefix,
 		   buffer->transaction ? "active" : "delivered");
 }
 
-static void print_binder_work(struct seq_file *m, const char *prefix,
-			      const char *transaction_prefix,
-			      struct binder_work *w)
+static void print_binder_work_ilocked(struct seq_file *m,
+				      struct binder_proc *proc,
+				      const char *prefix,
+				      const char *transaction_prefix,
+				      struct binder_work *w)
 {
 	struct binder_node *node;
 	struct binder_transaction *t;
@@ -3254,7 +4573,8 @@ static void print_binder_work(struct seq_file *m, const char *prefix,
 	switch (w->type) {
 	case BINDER_WORK_TRANSACTION:
 		t = container_of(w, struct binder_transaction, work);
-		print_binder_transaction(m, transaction_prefix, t);
+		print_binder_transaction_ilocked(m, proc, transaction_prefix,
+						 t);
 		break;
 	case BINDER_WORK_TRANSACTION_COMPLETE:
 		seq_printf(m, "%stransaction complete\n", prefix);
@@ -3279,9 +4599,9 @@ static void print_binder_work(struct seq_file *m, const char *prefix,
 	}
 }
 
-static void print_binder_thread(struct seq_file *m,
-				struct binder_thread *thread,
-				int print_always)
+static void print_binder_thread_ilocked(struct seq_file *m,
+					struct binder_thread *thread,
+					int print_always)
 {
 	struct binder_transaction *t;
 	struct binder_work *w;
@@ -3293,26 +4613,29 @@ static void print_binder_thread(struct seq_file *m,
 	t = thread->transaction_stack;
 	while (t) {
 		if (t->from == thread) {
-			print_binder_transaction(m,
-						 "    outgoing transaction", t);
+			print_binder_transaction_ilocked(m, thread->proc,
+					"    outgoing transaction", t);
 			t = t->from_parent;
 		} else if (t->to_thread == thread) {
-			print_binder_transaction(m,
-						 "    incoming transaction", t);
+			print_binder_transaction_ilocked(m, thread->proc,
+					"    incoming transaction", t);
 			t = t->to_parent;
 		} else {
-			print_binder_transaction(m, "    bad transaction", t);
+			print_binder_transaction_ilocked(m, thread->proc,
+					"    bad transaction", t);
 			t = NULL;
 		}
 	}
 	list_for_each_entry(w, &thread->todo, entry) {
-		print_binder_work(m, "    ", "    pending transaction", w);
+		print_binder_work_ilocked(m, thread->proc, "    ",
+					  "    pending transaction", w);
 	}
 	if (!print_always && m->count == header_pos)
 		m->count = start_pos;
 }
 
-static void print_binder_node(struct seq_file *m, struct binder_node *node)
+static void print_binder_node_nilocked(struct seq_file *m,
+				       struct binder_node *node)
 {
 	struct binder_ref *ref;
 	struct hlist_node *pos;
@@ -3323,27 +4646,32 @@ static void print_binder_node(struct seq_file *m, struct binder_node *node)
 	hlist_for_each_entry(ref, pos, &node->refs, node_entry)
 		count++;
 
-	seq_printf(m, "  node %d: u%p c%p hs %d hw %d ls %d lw %d is %d iw %d",
+	seq_printf(m, "  node %d: u%p c%p hs %d hw %d ls %d lw %d is %d iw %d tr %d",
 		   node->debug_id, node->ptr, node->cookie,
 		   node->has_strong_ref, node->has_weak_ref,
 		   node->local_strong_refs, node->local_weak_refs,
-		   node->internal_strong_refs, count);
+		   node->internal_strong_refs, count, node->tmp_refs);
 	if (count) {
 		seq_puts(m, " proc");
 		hlist_for_each_entry(ref, pos, &node->refs, node_entry)
 			seq_printf(m, " %d", ref->proc->pid);
 	}
 	seq_puts(m, "\n");
-	list_for_each_entry(w, &node->async_todo, entry)
-		print_binder_work(m, "    ",
-				  "    pending async transaction", w);
+	if (node->proc) {
+		list_for_each_entry(w, &node->async_todo, entry)
+			print_binder_work_ilocked(m, node->proc, "    ",
+					  "    pending async transaction", w);
+	}
 }
 
-static void print_binder_ref(struct seq_file *m, struct binder_ref *ref)
+static void print_binder_ref_olocked(struct seq_file *m,
+				     struct binder_ref *ref)
 {
+	binder_node_lock(ref->node);
 	seq_printf(m, "  ref %d: desc %d %snode %d s %d w %d d %p\n",
 		   ref->debug_id, ref->desc, ref->node->proc ? "" : "dead ",
 		   ref->node->debug_id, ref->strong, ref->weak, ref->death);
+	binder_node_unlock(ref->node);
 }
 
 static void print_binder_proc(struct seq_file *m,
@@ -3353,35 +4681,65 @@ static void print_binder_proc(struct seq_file *m,
 	struct rb_node *n;
 	size_t start_pos = m->count;
 	size_t header_pos;
+	struct binder_node *last_node = NULL;
 
 	seq_printf(m, "proc %d\n", proc->pid);
 	header_pos = m->count;
 
+	binder_inner_proc_lock(proc);
 	for (n = rb_first(&proc->threads); n != NULL; n = rb_next(n))
-		print_binder_thread(m, rb_entry(n, struct binder_thread,
+		print_binder_thread_ilocked(m, rb_entry(n, struct binder_thread,
 						rb_node), print_all);
+
 	for (n = rb_first(&proc->nodes); n != NULL; n = rb_next(n)) {
 		struct binder_node *node = rb_entry(n, struct binder_node,
 						    rb_node);
-		if (print_all || node->has_async_transaction)
-			print_binder_node(m, node);
+		if (!print_all && !node->has_async_transaction)
+			continue;
+
+		/*
+		 * The node lock ranks above the inner lock: pin the node
+		 * with a tmp ref, which also keeps it in the tree, and
+		 * drop the inner lock while printing it.
+		 */
+		node->tmp_refs++;
+		binder_inner_proc_unlock(proc);
+		if (last_node)
+			binder_put_node(last_node);
+		binder_node_inner_lock(node);
+		print_binder_node_nilocked(m, node);
+		binder_node_inner_unlock(node);
+		last_node = node;
+		binder_inner_proc_lock(proc);
 	}
+	binder_inner_proc_unlock(proc);
+	if (last_node)
+		binder_put_node(last_node);
+
 	if (print_all) {
+		binder_proc_lock(proc);
 		for (n = rb_first(&proc->refs_by_desc);
 		     n != NULL;
 		     n = rb_next(n))
-			print_binder_ref(m, rb_entry(n, struct binder_ref,
-						     rb_node_desc));
+			print_binder_ref_olocked(m, rb_entry(n,
+						 struct binder_ref,
+						 rb_node_desc));
+		binder_proc_unlock(proc);
 	}
+	mutex_lock(&proc->alloc_lock);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		print_binder_buffer(m, "  buffer",
 				    rb_entry(n, struct binder_buffer, rb_node));
+	mutex_unlock(&proc->alloc_lock);
+	binder_inner_proc_lock(proc);
 	list_for_each_entry(w, &proc->todo, entry)
-		print_binder_work(m, "  ", "  pending transaction", w);
+		print_binder_work_ilocked(m, proc, "  ",
+					  "  pending transaction", w);
 	list_for_each_entry(w, &proc->delivered_death, entry) {
 		seq_puts(m, "  has delivered dead binder\n");
 		break;
 	}
+	binder_inner_proc_unlock(proc);
 	if (!print_all && m->count == header_pos)
 		m->count = start_pos;
 }
@@ -3445,17 +4803,21 @@ static void print_binder_stats(struct seq_file *m, const char *prefix,
 	BUILD_BUG_ON(ARRAY_SIZE(stats->bc) !=
 		     ARRAY_SIZE(binder_command_strings));
 	for (i = 0; i < ARRAY_SIZE(stats->bc); i++) {
-		if (stats->bc[i])
+		int temp = atomic_read(&stats->bc[i]);
+
+		if (temp)
 			seq_printf(m, "%s%s: %d\n", prefix,
-				   binder_command_strings[i], stats->bc[i]);
+				   binder_command_strings[i], temp);
 	}
 
 	BUILD_BUG_ON(ARRAY_SIZE(stats->br) !=
 		     ARRAY_SIZE(binder_return_strings));
 	for (i = 0; i < ARRAY_SIZE(stats->br); i++) {
-		if (stats->br[i])
+		int temp = atomic_read(&stats->br[i]);
+
+		if (temp)
 			seq_printf(m, "%s%s: %d\n", prefix,
-				   binder_return_strings[i], stats->br[i]);
+				   binder_return_strings[i], temp);
 	}
 
 	BUILD_BUG_ON(ARRAY_SIZE(stats->obj_created) !=
@@ -3463,11 +4825,13 @@ static void print_binder_stats(struct seq_file *m, const char *prefix,
 	BUILD_BUG_ON(ARRAY_SIZE(stats->obj_created) !=
 		     ARRAY_SIZE(stats->obj_deleted));
 	for (i = 0; i < ARRAY_SIZE(stats->obj_created); i++) {
-		if (stats->obj_created[i] || stats->obj_deleted[i])
+		int created = atomic_read(&stats->obj_created[i]);
+		int deleted = atomic_read(&stats->obj_deleted[i]);
+
+		if (created || deleted)
 			seq_printf(m, "%s%s: active %d total %d\n", prefix,
 				binder_objstat_strings[i],
-				stats->obj_created[i] - stats->obj_deleted[i],
-				stats->obj_created[i]);
+				created - deleted, created);
 	}
 }
 
@@ -3477,24 +4841,43 @@ static void print_binder_proc_stats(struct seq_file *m,
 	struct binder_work *w;
 	struct rb_node *n;
 	int count, strong, weak;
+	int i, pages, lru_pages;
+	size_t free_async_space;
 
 	seq_printf(m, "proc %d\n", proc->pid);
 	count = 0;
+	binder_inner_proc_lock(proc);
 	for (n = rb_first(&proc->threads); n != NULL; n = rb_next(n))
 		count++;
 	seq_printf(m, "  threads: %d\n", count);
 	seq_printf(m, "  requested threads: %d+%d/%d\n"
-			"  ready threads %d\n"
-			"  free async space %zd\n", proc->requested_threads,
+			"  ready threads %d\n", proc->requested_threads,
 			proc->requested_threads_started, proc->max_threads,
-			proc->ready_threads, proc->free_async_space);
+			proc->ready_threads);
 	count = 0;
 	for (n = rb_first(&proc->nodes); n != NULL; n = rb_next(n))
 		count++;
+	binder_inner_proc_unlock(proc);
+	mutex_lock(&proc->alloc_lock);
+	free_async_space = proc->free_async_space;
+	pages = 0;
+	lru_pages = 0;
+	for (i = 0; proc->pages && i < proc->buffer_size / PAGE_SIZE; i++) {
+		if (!proc->pages[i].page_ptr)
+			continue;
+		pages++;
+		if (!list_empty(&proc->pages[i].lru))
+			lru_pages++;
+	}
+	mutex_unlock(&proc->alloc_lock);
+	seq_printf(m, "  free async space %zd\n", free_async_space);
+	seq_printf(m, "  pages: %d active %d lru\n", pages - lru_pages,
+		   lru_pages);
 	seq_printf(m, "  nodes: %d\n", count);
 	count = 0;
 	strong = 0;
 	weak = 0;
+	binder_proc_lock(proc);
 	for (n = rb_first(&proc->refs_by_desc); n != NULL; n = rb_next(n)) {
 		struct binder_ref *ref = rb_entry(n, struct binder_ref,
 						  rb_node_desc);
@@ -3502,14 +4885,18 @@ static void print_binder_proc_stats(struct seq_file *m,
 		strong += ref->strong;
 		weak += ref->weak;
 	}
+	binder_proc_unlock(proc);
 	seq_printf(m, "  refs: %d s %d w %d\n", count, strong, weak);
 
 	count = 0;
+	mutex_lock(&proc->alloc_lock);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
+	mutex_unlock(&proc->alloc_lock);
 	seq_printf(m, "  buffers: %d\n", count);
 
 	count = 0;
+	binder_inner_proc_lock(proc);
 	list_for_each_entry(w, &proc->todo, entry) {
 		switch (w->type) {
 		case BINDER_WORK_TRANSACTION:
@@ -3519,6 +4906,7 @@ static void print_binder_proc_stats(struct seq_file *m,
 			break;
 		}
 	}
+	binder_inner_proc_unlock(proc);
 	seq_printf(m, "  pending transactions: %d\n", count);
 
 	print_binder_stats(m, "  ", &proc->stats);
@@ -3530,22 +4918,33 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	struct binder_proc *proc;
 	struct hlist_node *pos;
 	struct binder_node *node;
-	int do_lock = !binder_debug_no_lock;
-
-	if (do_lock)
-		mutex_lock(&binder_lock);
+	struct binder_node *last_node = NULL;
 
 	seq_puts(m, "binder state:\n");
 
+	spin_lock(&binder_dead_nodes_lock);
 	if (!hlist_empty(&binder_dead_nodes))
 		seq_puts(m, "dead nodes:\n");
-	hlist_for_each_entry(node, pos, &binder_dead_nodes, dead_node)
-		print_binder_node(m, node);
+	hlist_for_each_entry(node, pos, &binder_dead_nodes, dead_node) {
+		/* the tmp ref keeps the node on the list while we print */
+		node->tmp_refs++;
+		spin_unlock(&binder_dead_nodes_lock);
+		if (last_node)
+			binder_put_node(last_node);
+		binder_node_lock(node);
+		print_binder_node_nilocked(m, node);
+		binder_node_unlock(node);
+		last_node = node;
+		spin_lock(&binder_dead_nodes_lock);
+	}
+	spin_unlock(&binder_dead_nodes_lock);
+	if (last_node)
+		binder_put_node(last_node);
 
+	mutex_lock(&binder_procs_lock);
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 1);
-	if (do_lock)
-		mutex_unlock(&binder_lock);
+	mutex_unlock(&binder_procs_lock);
 	return 0;
 }
 
@@ -3553,19 +4952,15 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 {
 	struct binder_proc *proc;
 	struct hlist_node *pos;
-	int do_lock = !binder_debug_no_lock;
-
-	if (do_lock)
-		mutex_lock(&binder_lock);
 
 	seq_puts(m, "binder stats:\n");
 
 	print_binder_stats(m, "", &binder_stats);
 
+	mutex_lock(&binder_procs_lock);
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc_stats(m, proc);
-	if (do_lock)
-		mutex_unlock(&binder_lock);
+	mutex_unlock(&binder_procs_lock);
 	return 0;
 }
 
@@ -3573,30 +4968,67 @@ static int binder_transactions_show(struct seq_file *m, void *unused)
 {
 	struct binder_proc *proc;
 	struct hlist_node *pos;
-	int do_lock = !binder_debug_no_lock;
-
-	if (do_lock)
-		mutex_lock(&binder_lock);
 
 	seq_puts(m, "binder transactions:\n");
+	mutex_lock(&binder_procs_lock);
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 0);
-	if (do_lock)
-		mutex_unlock(&binder_lock);
+	mutex_unlock(&binder_procs_lock);
 	return 0;
 }
 
 static int binder_proc_show(struct seq_file *m, void *unused)
 {
+	struct binder_proc *itr;
 	struct binder_proc *proc = m->private;
-	int do_lock = !binder_debug_no_lock;
+	struct hlist_node *pos;
 
-	if (do_lock)
-		mutex_lock(&binder_lock);
 	seq_puts(m, "binder proc state:\n");
-	print_binder_proc(m, proc, 1);
-	if (do_lock)
-		mutex_unlock(&binder_lock);
+	/* the proc may already be on its way out */
+	mutex_lock(&binder_procs_lock);
+	hlist_for_each_entry(itr, pos, &binder_procs, proc_node) {
+		if (itr == proc) {
+			print_binder_proc(m, itr, 1);
+			break;
+		}
+	}
+	mutex_unlock(&binder_procs_lock);
+	return 0;
+}
+
+static int binder_proc_stats_show(struct seq_file *m, void *unused)
+{
+	struct binder_proc *itr;
+	struct binder_proc *proc = m->private;
+	struct binder_perf_stats perf;
+	struct hlist_node *pos;
+	bool found = false;
+
+	mutex_lock(&binder_procs_lock);
+	hlist_for_each_entry(itr, pos, &binder_procs, proc_node) {
+		if (itr == proc) {
+			spin_lock(&proc->perf_lock);
+			perf = proc->perf;
+			spin_unlock(&proc->perf_lock);
+			found = true;
+			break;
+		}
+	}
+	mutex_unlock(&binder_procs_lock);
+	if (!found)
+		return 0;
+
+	seq_printf(m, "proc %d\n", proc->pid);
+	seq_printf(m, "  sent: %llu bytes %llu\n",
+		   perf.sent, perf.sent_bytes);
+	seq_printf(m, "  received: %llu bytes %llu\n",
+		   perf.received, perf.received_bytes);
+	seq_printf(m, "  max transaction size: %zd\n", perf.max_bytes);
+	seq_printf(m, "  delivery delay: total %llu ns max %llu ns\n",
+		   perf.delay_ns, perf.max_delay_ns);
+	seq_printf(m, "  lock waits: %llu total %llu ns max %llu ns\n",
+		   perf.lock_waits, perf.lock_wait_ns, perf.max_lock_wait_ns);
+	seq_printf(m, "  alloc failures: %u\n", perf.alloc_failures);
 	return 0;
 }
 
@@ -3653,11 +5085,15 @@ static int __init binder_init(void)
 	binder_deferred_workqueue = create_singlethread_workqueue("binder");
 	if (!binder_deferred_workqueue)
 		return -ENOMEM;
+	register_shrinker(&binder_shrinker);
 
 	binder_debugfs_dir_entry_root = debugfs_create_dir("binder", NULL);
-	if (binder_debugfs_dir_entry_root)
+	if (binder_debugfs_dir_entry_root) {
 		binder_debugfs_dir_entry_proc = debugfs_create_dir("proc",
 						 binder_debugfs_dir_entry_root);
+		binder_debugfs_dir_entry_proc_stats = debugfs_create_dir(
+				"proc_stats", binder_debugfs_dir_entry_root);
+	}
 	ret = misc_register(&binder_miscdev);
 	if (binder_debugfs_dir_entry_root) {
 		debugfs_create_file("state",
@@ -3691,4 +5127,7 @@ static int __init binder_init(void)
 
 device_initcall(binder_init);
 
+#define CREATE_TRACE_POINTS
+#include "binder_trace.h"
+
 MODULE_LICENSE("GPL v2");
@@ -0,0 +1,155 @@
+/* binder_trace.h
+ *
+ * Tracepoints for the Android IPC Subsystem
+ *
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#if !defined(_BINDER_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _BINDER_TRACE_H_
+
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM binder
+#define TRACE_INCLUDE_FILE binder_trace
+
+struct binder_buffer;
+struct binder_node;
+struct binder_proc;
+struct binder_transaction;
+
+/*
+ * The events below are only filled in from binder.c, after the
+ * structures they dereference have been defined.
+ */
+
+TRACE_EVENT(binder_transaction,
+
+	    TP_PROTO(bool reply, struct binder_transaction *t,
+		     struct binder_node *target_node),
+
+	    TP_ARGS(reply, t, target_node),
+
+	    TP_STRUCT__entry(
+			     __field(int, debug_id)
+			     __field(int, target_node)
+			     __field(int, from_proc)
+			     __field(int, to_proc)
+			     __field(int, to_thread)
+			     __field(int, reply)
+			     __field(unsigned int, code)
+			     __field(unsigned int, flags)
+			     __field(size_t, data_size)
+			     __field(size_t, offsets_size)
+			     ),
+
+	    TP_fast_assign(
+			   __entry->debug_id = t->debug_id;
+			   __entry->target_node = target_node ?
+						  target_node->debug_id : 0;
+			   __entry->from_proc = current->group_leader->pid;
+			   __entry->to_proc = t->to_proc->pid;
+			   __entry->to_thread = t->to_thread ?
+						t->to_thread->pid : 0;
+			   __entry->reply = reply;
+			   __entry->code = t->code;
+			   __entry->flags = t->flags;
+			   __entry->data_size = t->buffer->data_size;
+			   __entry->offsets_size = t->buffer->offsets_size;
+			   ),
+
+	    TP_printk("transaction=%d from_proc=%d dest_node=%d dest_proc=%d "
+		      "dest_thread=%d reply=%d flags=0x%x code=0x%x "
+		      "size=%zd-%zd",
+		      __entry->debug_id, __entry->from_proc,
+		      __entry->target_node, __entry->to_proc,
+		      __entry->to_thread, __entry->reply, __entry->flags,
+		      __entry->code, __entry->data_size, __entry->offsets_size)
+);
+
+TRACE_EVENT(binder_transaction_received,
+
+	    TP_PROTO(struct binder_transaction *t, s64 delay_ns),
+
+	    TP_ARGS(t, delay_ns),
+
+	    TP_STRUCT__entry(
+			     __field(int, debug_id)
+			     __field(s64, delay_ns)
+			     ),
+
+	    TP_fast_assign(
+			   __entry->debug_id = t->debug_id;
+			   __entry->delay_ns = delay_ns;
+			   ),
+
+	    TP_printk("transaction=%d delay=%lld ns",
+		      __entry->debug_id, __entry->delay_ns)
+);
+
+TRACE_EVENT(binder_alloc_buf_failed,
+
+	    TP_PROTO(struct binder_proc *proc, size_t size, int is_async,
+		     const char *reason),
+
+	    TP_ARGS(proc, size, is_async, reason),
+
+	    TP_STRUCT__entry(
+			     __field(int, proc)
+			     __field(size_t, size)
+			     __field(int, is_async)
+			     __field(const char *, reason)
+			     ),
+
+	    TP_fast_assign(
+			   __entry->proc = proc->pid;
+			   __entry->size = size;
+			   __entry->is_async = is_async;
+			   __entry->reason = reason;
+			   ),
+
+	    TP_printk("proc=%d size=%zd async=%d reason=%s",
+		      __entry->proc, __entry->size, __entry->is_async,
+		      __entry->reason)
+);
+
+TRACE_EVENT(binder_lock_contended,
+
+	    TP_PROTO(struct binder_proc *proc, const char *lock, s64 wait_ns),
+
+	    TP_ARGS(proc, lock, wait_ns),
+
+	    TP_STRUCT__entry(
+			     __field(int, proc)
+			     __field(const char *, lock)
+			     __field(s64, wait_ns)
+			     ),
+
+	    TP_fast_assign(
+			   __entry->proc = proc->pid;
+			   __entry->lock = lock;
+			   __entry->wait_ns = wait_ns;
+			   ),
+
+	    TP_printk("proc=%d lock=%s wait=%lld ns",
+		      __entry->proc, __entry->lock, __entry->wait_ns)
+);
+
+#endif /* _BINDER_TRACE_H_ */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#include <trace/define_trace.h>
@@ -25,14 +25,14 @@
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/lzo.h>
+#include <linux/workqueue.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
 
-//{{ pass platform log to kernel - 1/3
-static char klog_buf[256];
-//}} pass platform log to kernel - 1/3
-
 //{{ Mark for GetLog - 1/2
 struct struct_plat_log_mark  {
 u32 special_mark_1;
@@ -85,39 +85,137 @@ static struct struct_marks_ver_mark marks_ver_mark = {
 };
 //}} Mark for GetLog - 1/2
 
+/*
+ * Per-UID rate limiting. Each UID gets a token bucket that fills at
+ * 'ratelimit_rate' entries per second up to 'ratelimit_burst' entries; writes
+ * with an empty bucket are dropped and counted. The buckets live in a small
+ * set-associative table: a UID hashes to a set of ways, and a UID that is
+ * not in its set takes over the least recently used way, so two busy UIDs
+ * that hash alike still keep their own buckets. Root is never limited. A
+ * rate or a burst of 0 turns the limiting off.
+ */
+static unsigned int ratelimit_rate;
+static unsigned int ratelimit_burst = 200;
+module_param(ratelimit_rate, uint, S_IRUGO | S_IWUSR);
+module_param(ratelimit_burst, uint, S_IRUGO | S_IWUSR);
+
+#define LOGGER_RATELIMIT_SLOTS	32
+#define LOGGER_RATELIMIT_WAYS	4
+
+struct logger_ratelimit {
+	uid_t			uid;
+	unsigned long		stamp;	/* jiffies at the last refill */
+	unsigned long		tokens;	/* in 1/HZ entries */
+	unsigned long		dropped; /* entries dropped for this UID */
+};
+
+#ifdef CONFIG_ANDROID_LOGGER_COMPRESS
+/*
+ * Entries that are overwritten in the ring are collected in a staging
+ * buffer. Once it is full a worker compresses it into a chunk, and the
+ * oldest chunks are freed to stay within the log's archive budget. There
+ * are two staging buffers so the ring never waits for the compression; if
+ * both are busy the entries are lost, and counted.
+ */
+#define LOGGER_CHUNK_SIZE	(16*1024)
+
+struct logger_chunk {
+	struct list_head	list;	/* entry in logger_archive's chunks */
+	unsigned long		seq;	/* chunks are numbered in order */
+	size_t			len;	/* uncompressed length */
+	size_t			clen;	/* compressed length */
+	unsigned char		data[0];
+};
+
+struct logger_archive {
+	struct mutex		mutex;	/* protects the chunks */
+	struct list_head	chunks;	/* oldest first */
+	unsigned long		next_seq; /* seq of the next chunk */
+	size_t			bytes;	/* compressed bytes held */
+	size_t			raw_bytes; /* ... and what they expand to */
+	size_t			budget;	/* max compressed bytes */
+
+	/* the staging buffers are protected by log->lock */
+	unsigned char		*stage[2];
+	size_t			stage_len[2];
+	int			active;	/* stage being filled */
+	bool			busy;	/* the other one is being compressed */
+	unsigned long		lost;	/* entries evicted while busy */
+	struct work_struct	work;
+};
+
+/* One set of LZO scratch buffers, shared by all the logs */
+static DEFINE_MUTEX(logger_compress_mutex);
+static void *logger_compress_wrkmem;
+static unsigned char *logger_compress_buf;
+#endif
+
 /*
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting.
+ *
+ * w_off, head and the readers' r_off are free running byte counts, use
+ * logger_offset() to turn them into an index into the buffer. They are
+ * protected by the spinlock 'lock', which is only ever held to reserve room
+ * for an entry or to move a read head: the payloads are copied from and to
+ * user space without it.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
+	spinlock_t		lock;	/* protects the offsets below */
+	size_t			w_off;	/* end of the last reserved entry */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
+	/* also protected by 'lock' */
+	struct logger_ratelimit	ratelimit[LOGGER_RATELIMIT_SLOTS];
+	unsigned long		dropped; /* all entries dropped by the limit */
+	unsigned long		evicted; /* dropped by UIDs no longer in the table */
+#ifdef CONFIG_ANDROID_LOGGER_COMPRESS
+	struct logger_archive	archive;
+#endif
 };
 
 /*
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. r_off is protected by log->lock, the mutex serializes
+ * reads on the same file and protects the bounce buffer.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
 	size_t			r_off;	/* current read head offset */
+	struct mutex		mutex;	/* one read at a time */
+	unsigned char		*buf;	/* bounce buffer for one entry */
+#ifdef CONFIG_ANDROID_LOGGER_COMPRESS
+	/* the archived chunks [a_seq, a_end) are read before the ring */
+	unsigned long		a_seq;
+	unsigned long		a_end;
+	unsigned char		*a_buf;	/* the current chunk, uncompressed */
+	size_t			a_off;
+	size_t			a_len;
+#endif
 };
 
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
+/*
+ * An entry is reserved with its header already in the log, and becomes
+ * readable once the writer has copied in the payload. The state lives in
+ * the first byte of the header's padding, and is cleared again on the way
+ * out to the reader.
+ */
+#define LOGGER_ENTRY_PENDING	0	/* payload still being copied in */
+#define LOGGER_ENTRY_COMMITTED	1	/* ready to be read */
+#define LOGGER_ENTRY_DISCARDED	2	/* the copy faulted, skip it */
+
 /*
  * file_get_log - Given a file structure, return the associated log
  *
@@ -145,12 +243,13 @@ static inline struct logger_log *file_get_log(struct file *file)
  * get_entry_len - Grabs the length of the payload of the next entry starting
  * from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_len(struct logger_log *log, size_t off)
 {
 	__u16 val;
 
+	off = logger_offset(off);
 	switch (log->size - off) {
 	case 1:
 		memcpy(&val, log->buffer + off, 1);
@@ -164,239 +263,691 @@ static __u32 get_entry_len(struct logger_log *log, size_t off)
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * get_entry_state and set_entry_state - access the state of the entry
+ * starting at 'off'.
+ *
+ * Caller needs to hold log->lock.
+ */
+static int get_entry_state(struct logger_log *log, size_t off)
+{
+	return log->buffer[logger_offset(off +
+			offsetof(struct logger_entry, __pad))];
+}
+
+static void set_entry_state(struct logger_log *log, size_t off, int state)
+{
+	log->buffer[logger_offset(off +
+			offsetof(struct logger_entry, __pad))] = state;
+}
+
+/*
+ * do_read_log - copies 'count' bytes starting at 'off' out of 'log'
  *
- * Caller must hold log->mutex.
+ * The caller must check that the bytes were not overwritten in the
+ * meantime, see logger_copy_entry().
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static void do_read_log(struct logger_log *log, size_t off, void *buf,
+			size_t count)
 {
 	size_t len;
 
 	/*
 	 * We read from the log in two disjoint operations. First, we read from
-	 * the current read head offset up to 'count' bytes or to the end of
-	 * the log, whichever comes first.
-	 */
-	len = min(count, log->size - reader->r_off);
-	if (copy_to_user(buf, log->buffer + reader->r_off, len))
-		return -EFAULT;
-
-	/*
-	 * Second, we read any remaining bytes, starting back at the head of
-	 * the log.
+	 * 'off' up to 'count' bytes or to the end of the log, whichever comes
+	 * first. Second, we read any remaining bytes, starting back at the head
+	 * of the log.
 	 */
+	off = logger_offset(off);
+	len = min(count, log->size - off);
+	memcpy(buf, log->buffer + off, len);
 	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+		memcpy(buf + len, log->buffer, count - len);
+}
 
-	reader->r_off = logger_offset(reader->r_off + count);
+#ifdef CONFIG_ANDROID_LOGGER_COMPRESS
+/*
+ * logger_archive_entry - stages the committed entry at 'off', which is about
+ * to be overwritten, for compression.
+ *
+ * The caller needs to hold log->lock.
+ */
+static void logger_archive_entry(struct logger_log *log, size_t off,
+				 size_t len)
+{
+	struct logger_archive *archive = &log->archive;
+	int active = archive->active;
 
-	return count;
+	if (archive->stage_len[active] + len > LOGGER_CHUNK_SIZE) {
+		if (archive->busy) {
+			archive->lost++;
+			return;
+		}
+		archive->busy = true;
+		active = archive->active = !active;
+		archive->stage_len[active] = 0;
+		schedule_work(&archive->work);
+	}
+
+	do_read_log(log, off, archive->stage[active] +
+		    archive->stage_len[active], len);
+	archive->stage_len[active] += len;
+}
+
+/* logger_archive_work - compresses a full staging buffer into a chunk */
+static void logger_archive_work(struct work_struct *work)
+{
+	struct logger_archive *archive =
+		container_of(work, struct logger_archive, work);
+	struct logger_log *log =
+		container_of(archive, struct logger_log, archive);
+	struct logger_chunk *chunk = NULL, *old;
+	int full = !archive->active;	/* stable while busy */
+	size_t clen;
+	int ret;
+
+	mutex_lock(&logger_compress_mutex);
+	ret = lzo1x_1_compress(archive->stage[full], archive->stage_len[full],
+			       logger_compress_buf, &clen,
+			       logger_compress_wrkmem);
+	if (ret == LZO_E_OK)
+		chunk = kmalloc(sizeof(*chunk) + clen, GFP_KERNEL);
+	if (chunk) {
+		chunk->len = archive->stage_len[full];
+		chunk->clen = clen;
+		memcpy(chunk->data, logger_compress_buf, clen);
+	}
+	mutex_unlock(&logger_compress_mutex);
+
+	spin_lock(&log->lock);
+	archive->busy = false;
+	spin_unlock(&log->lock);
+
+	if (!chunk) {
+		printk(KERN_ERR "logger: failed to archive %zu bytes of '%s'\n",
+		       archive->stage_len[full], log->misc.name);
+		return;
+	}
+
+	mutex_lock(&archive->mutex);
+	chunk->seq = archive->next_seq++;
+	list_add_tail(&chunk->list, &archive->chunks);
+	archive->bytes += chunk->clen;
+	archive->raw_bytes += chunk->len;
+	while (archive->bytes > archive->budget) {
+		old = list_first_entry(&archive->chunks, struct logger_chunk,
+				       list);
+		list_del(&old->list);
+		archive->bytes -= old->clen;
+		archive->raw_bytes -= old->len;
+		kfree(old);
+	}
+	mutex_unlock(&archive->mutex);
+}
+
+/* logger_archive_flush - drops all the archived and staged entries */
+static void logger_archive_flush(struct logger_log *log)
+{
+	struct logger_archive *archive = &log->archive;
+	struct logger_chunk *chunk, *next;
+
+	spin_lock(&log->lock);
+	archive->stage_len[archive->active] = 0;
+	spin_unlock(&log->lock);
+
+	mutex_lock(&archive->mutex);
+	list_for_each_entry_safe(chunk, next, &archive->chunks, list) {
+		list_del(&chunk->list);
+		kfree(chunk);
+	}
+	archive->bytes = 0;
+	archive->raw_bytes = 0;
+	mutex_unlock(&archive->mutex);
 }
 
 /*
- * logger_read - our log's read() method
+ * logger_archive_open - new readers get everything that was archived when
+ * they opened the log. Entries that were still being staged at that point
+ * are only seen by later readers.
+ */
+static void logger_archive_open(struct logger_reader *reader)
+{
+	struct logger_archive *archive = &reader->log->archive;
+
+	reader->a_buf = NULL;
+	reader->a_off = reader->a_len = 0;
+
+	mutex_lock(&archive->mutex);
+	reader->a_end = archive->next_seq;
+	if (list_empty(&archive->chunks))
+		reader->a_seq = reader->a_end;
+	else
+		reader->a_seq = list_first_entry(&archive->chunks,
+					struct logger_chunk, list)->seq;
+	mutex_unlock(&archive->mutex);
+}
+
+static bool logger_archive_readable(struct logger_reader *reader)
+{
+	return reader->a_off < reader->a_len || reader->a_seq != reader->a_end;
+}
+
+/*
+ * logger_archive_load - makes sure the next archived entry for 'reader', if
+ * any, is in its decompressed chunk.
  *
- * Behavior:
+ * Returns 0 or a negative error code.
  *
- * 	- O_NONBLOCK works
- * 	- If there are no log entries to read, blocks until log is written to
- * 	- Atomically reads exactly one log entry
+ * Caller must hold reader->mutex.
+ */
+static int logger_archive_load(struct logger_reader *reader)
+{
+	struct logger_archive *archive = &reader->log->archive;
+	struct logger_chunk *chunk;
+	size_t len;
+	int ret;
+
+	while (reader->a_off >= reader->a_len) {
+		kfree(reader->a_buf);
+		reader->a_buf = NULL;
+		reader->a_off = reader->a_len = 0;
+		if (reader->a_seq == reader->a_end)
+			return 0;
+
+		mutex_lock(&archive->mutex);
+		ret = 0;
+		list_for_each_entry(chunk, &archive->chunks, list) {
+			if ((long) (chunk->seq - reader->a_seq) < 0)
+				continue;
+			if ((long) (chunk->seq - reader->a_end) >= 0)
+				break;
+			reader->a_buf = kmalloc(chunk->len, GFP_KERNEL);
+			if (!reader->a_buf) {
+				ret = -ENOMEM;
+				break;
+			}
+			len = chunk->len;
+			ret = lzo1x_decompress_safe(chunk->data, chunk->clen,
+						    reader->a_buf, &len);
+			reader->a_seq = chunk->seq + 1;
+			if (ret == LZO_E_OK)
+				reader->a_len = len;
+			else
+				ret = -EIO;
+			break;
+		}
+		/* whatever is left was flushed or freed in the meantime */
+		if (&chunk->list == &archive->chunks ||
+		    (long) (chunk->seq - reader->a_end) >= 0)
+			reader->a_seq = reader->a_end;
+		mutex_unlock(&archive->mutex);
+		if (ret == -ENOMEM)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * logger_archive_next_len - the length of the next archived entry for
+ * 'reader', 0 once the archive has been read, or a negative error code.
  *
- * Optimal read size is LOGGER_ENTRY_MAX_LEN. Will set errno to EINVAL if read
- * buffer is insufficient to hold next entry.
+ * Caller must hold reader->mutex.
  */
-static ssize_t logger_read(struct file *file, char __user *buf,
-			   size_t count, loff_t *pos)
+static ssize_t logger_archive_next_len(struct logger_reader *reader)
 {
-	struct logger_reader *reader = file->private_data;
-	struct logger_log *log = reader->log;
-	ssize_t ret;
-	DEFINE_WAIT(wait);
+	struct logger_entry *entry;
+	int ret;
 
-start:
-	while (1) {
-		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
+	ret = logger_archive_load(reader);
+	if (ret)
+		return ret;
+	if (reader->a_off >= reader->a_len)
+		return 0;
+
+	entry = (struct logger_entry *) (reader->a_buf + reader->a_off);
+	return sizeof(struct logger_entry) + entry->len;
+}
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
-		if (!ret)
+/*
+ * logger_archive_pending - the archived bytes 'reader' has yet to read.
+ *
+ * Caller must hold reader->mutex.
+ */
+static size_t logger_archive_pending(struct logger_reader *reader)
+{
+	struct logger_archive *archive = &reader->log->archive;
+	struct logger_chunk *chunk;
+	size_t len = reader->a_len - reader->a_off;
+
+	if (reader->a_seq == reader->a_end)
+		return len;
+
+	mutex_lock(&archive->mutex);
+	list_for_each_entry(chunk, &archive->chunks, list) {
+		if ((long) (chunk->seq - reader->a_seq) < 0)
+			continue;
+		if ((long) (chunk->seq - reader->a_end) >= 0)
 			break;
+		len += chunk->len;
+	}
+	mutex_unlock(&archive->mutex);
+
+	return len;
+}
+
+/*
+ * logger_copy_archived - copies the next archived entry for 'reader' into
+ * its bounce buffer.
+ *
+ * Returns the length of the entry, 0 once the archive has been read, or a
+ * negative error code.
+ *
+ * Caller must hold reader->mutex.
+ */
+static ssize_t logger_copy_archived(struct logger_reader *reader,
+				    size_t count)
+{
+	ssize_t len;
+
+	len = logger_archive_next_len(reader);
+	if (len <= 0)
+		return len;
+	if (count < len)
+		return -EINVAL;
+	memcpy(reader->buf, reader->a_buf + reader->a_off, len);
+	reader->a_off += len;
+
+	return len;
+}
 
-		if (file->f_flags & O_NONBLOCK) {
-			ret = -EAGAIN;
+static int __init logger_archive_init(struct logger_log *log, size_t budget)
+{
+	struct logger_archive *archive = &log->archive;
+
+	archive->stage[0] = kmalloc(LOGGER_CHUNK_SIZE, GFP_KERNEL);
+	archive->stage[1] = kmalloc(LOGGER_CHUNK_SIZE, GFP_KERNEL);
+	if (!archive->stage[0] || !archive->stage[1]) {
+		kfree(archive->stage[0]);
+		kfree(archive->stage[1]);
+		return -ENOMEM;
+	}
+	mutex_init(&archive->mutex);
+	INIT_LIST_HEAD(&archive->chunks);
+	INIT_WORK(&archive->work, logger_archive_work);
+	archive->budget = budget;
+
+	return 0;
+}
+#else
+static inline void logger_archive_entry(struct logger_log *log, size_t off,
+					size_t len)
+{
+}
+
+static inline void logger_archive_flush(struct logger_log *log)
+{
+}
+
+static inline void logger_archive_open(struct logger_reader *reader)
+{
+}
+
+static inline bool logger_archive_readable(struct logger_reader *reader)
+{
+	return false;
+}
+
+static inline ssize_t logger_copy_archived(struct logger_reader *reader,
+					   size_t count)
+{
+	return 0;
+}
+
+static inline ssize_t logger_archive_next_len(struct logger_reader *reader)
+{
+	return 0;
+}
+
+static inline size_t logger_archive_pending(struct logger_reader *reader)
+{
+	return 0;
+}
+#endif
+
+/*
+ * logger_copy_entry - copies the next readable entry for 'reader' into its
+ * bounce buffer and moves it past the entry.
+ *
+ * Returns the length of the entry, 0 if there is nothing to read yet, or
+ * -EINVAL if the entry does not fit in 'count' bytes.
+ *
+ * Caller must hold reader->mutex.
+ */
+static ssize_t logger_copy_entry(struct logger_reader *reader, size_t count)
+{
+	struct logger_log *log = reader->log;
+	size_t off;
+	ssize_t len;
+
+	spin_lock(&log->lock);
+	while (1) {
+		off = reader->r_off;
+		if (off == log->w_off) {
+			len = 0;
 			break;
 		}
-
-		if (signal_pending(current)) {
-			ret = -EINTR;
+		len = get_entry_len(log, off);
+		switch (get_entry_state(log, off)) {
+		case LOGGER_ENTRY_PENDING:
+			len = 0;
+			goto out;
+		case LOGGER_ENTRY_DISCARDED:
+			reader->r_off = off + len;
+			continue;
+		}
+		if (count < len) {
+			len = -EINVAL;
 			break;
 		}
+		spin_unlock(&log->lock);
+
+		do_read_log(log, off, reader->buf, len);
 
-		schedule();
+		spin_lock(&log->lock);
+		/*
+		 * A writer may have lapped us while we were copying, in which
+		 * case it also pulled r_off forward. Otherwise the copy is good.
+		 */
+		if (log->w_off - off <= log->size) {
+			reader->r_off = off + len;
+			break;
+		}
 	}
+out:
+	spin_unlock(&log->lock);
 
-	finish_wait(&log->wq, &wait);
-	if (ret)
-		return ret;
+	return len;
+}
 
-	mutex_lock(&log->mutex);
+/* Is there an entry, committed or discarded, waiting for 'reader'? */
+static int logger_readable(struct logger_reader *reader)
+{
+	struct logger_log *log = reader->log;
+	int ret;
 
-	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
-		goto start;
-	}
+	if (logger_archive_readable(reader))
+		return 1;
 
-	/* get the size of the next entry */
-	ret = get_entry_len(log, reader->r_off);
-	if (count < ret) {
-		ret = -EINVAL;
-		goto out;
+	spin_lock(&log->lock);
+	ret = reader->r_off != log->w_off &&
+		get_entry_state(log, reader->r_off) != LOGGER_ENTRY_PENDING;
+	spin_unlock(&log->lock);
+
+	return ret;
+}
+
+/*
+ * logger_read_one - reads the next entry into the user-space buffer 'buf',
+ * waiting for one if 'block' is set.
+ *
+ * Caller must hold reader->mutex.
+ */
+static ssize_t logger_read_one(struct logger_reader *reader, char __user *buf,
+			       size_t count, bool block)
+{
+	ssize_t ret;
+
+	ret = logger_copy_archived(reader, count);
+	if (ret) {
+		if (ret > 0)
+			goto copy;
+		return ret;
 	}
 
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	while (!(ret = logger_copy_entry(reader, count))) {
+		if (!block)
+			return -EAGAIN;
+		if (wait_event_interruptible(reader->log->wq,
+					     logger_readable(reader)))
+			return -EINTR;
+	}
 
-out:
-	mutex_unlock(&log->mutex);
+copy:
+	((struct logger_entry *) reader->buf)->__pad = 0;
+	if (ret > 0 && copy_to_user(buf, reader->buf, ret))
+		return -EFAULT;
 
 	return ret;
 }
 
 /*
- * get_next_entry - return the offset of the first valid entry at least 'len'
- * bytes after 'off'.
+ * logger_read - our log's read() method
  *
- * Caller must hold log->mutex.
+ * Behavior:
+ *
+ * 	- O_NONBLOCK works
+ * 	- If there are no log entries to read, blocks until log is written to
+ * 	- Atomically reads exactly one log entry
+ *
+ * Optimal read size is LOGGER_ENTRY_MAX_LEN. Will set errno to EINVAL if read
+ * buffer is insufficient to hold next entry.
  */
-static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
+static ssize_t logger_read(struct file *file, char __user *buf,
+			   size_t count, loff_t *pos)
 {
-	size_t count = 0;
+	struct logger_reader *reader = file->private_data;
+	ssize_t ret;
 
-	do {
-		size_t nr = get_entry_len(log, off);
-		off = logger_offset(off + nr);
-		count += nr;
-	} while (count < len);
+	if (mutex_lock_interruptible(&reader->mutex))
+		return -EINTR;
+	ret = logger_read_one(reader, buf, count,
+			      !(file->f_flags & O_NONBLOCK));
+	mutex_unlock(&reader->mutex);
 
-	return off;
+	return ret;
 }
 
 /*
- * clock_interval - is a < c < b in mod-space? Put another way, does the line
- * from a to b cross c?
+ * logger_aio_read - our readv() method, for reading entries in batches
+ *
+ * Each segment receives exactly one entry, so optimal segment size is
+ * LOGGER_ENTRY_MAX_LEN. Only the first segment waits for an entry: the call
+ * returns the bytes read so far as soon as the log runs dry, or the next
+ * entry does not fit in its segment.
  */
-static inline int clock_interval(size_t a, size_t b, size_t c)
-{
-	if (b < a) {
-		if (a < c || b >= c)
-			return 1;
-	} else {
-		if (a < c && b >= c)
-			return 1;
+static ssize_t logger_aio_read(struct kiocb *iocb, const struct iovec *iov,
+			       unsigned long nr_segs, loff_t ppos)
+{
+	struct file *file = iocb->ki_filp;
+	struct logger_reader *reader = file->private_data;
+	bool block = !(file->f_flags & O_NONBLOCK);
+	ssize_t ret = 0;
+
+	if (mutex_lock_interruptible(&reader->mutex))
+		return -EINTR;
+
+	while (nr_segs-- > 0) {
+		ssize_t nr;
+
+		nr = logger_read_one(reader, iov->iov_base, iov->iov_len,
+				     block && !ret);
+		if (nr < 0) {
+			if (!ret)
+				ret = nr;
+			break;
+		}
+
+		iov++;
+		ret += nr;
 	}
 
-	return 0;
+	mutex_unlock(&reader->mutex);
+
+	return ret;
 }
 
 /*
- * fix_up_readers - walk the list of all readers and "fix up" any who were
- * lapped by the writer; also do the same for the default "start head".
- * We do this by "pulling forward" the readers and start head to the first
- * entry after the new write head.
+ * fix_up_readers - make room for an entry of 'len' bytes at the write head.
+ *
+ * The head and any readers that are about to be lapped by the writer are
+ * "pulled forward" to the first entry after what the new entry overwrites.
+ * Entries that are still being copied in are never overwritten: if the new
+ * entry would need their room, -EAGAIN is returned and nothing is changed.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
-static void fix_up_readers(struct logger_log *log, size_t len)
+static int fix_up_readers(struct logger_log *log, size_t len)
 {
-	size_t old = log->w_off;
-	size_t new = logger_offset(old + len);
+	size_t oldest = log->w_off + len - log->size;
+	size_t head = log->head;
 	struct logger_reader *reader;
 
-	if (clock_interval(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
+	if ((long) (oldest - head) <= 0)
+		return 0;
+
+	while ((long) (oldest - head) > 0) {
+		if (get_entry_state(log, head) == LOGGER_ENTRY_PENDING)
+			return -EAGAIN;
+		head += get_entry_len(log, head);
+	}
+
+	/* nothing can fail anymore, hand what we overwrite to the archive */
+	while (log->head != head) {
+		size_t len = get_entry_len(log, log->head);
+
+		if (get_entry_state(log, log->head) == LOGGER_ENTRY_COMMITTED)
+			logger_archive_entry(log, log->head, len);
+		log->head += len;
+	}
 
 	list_for_each_entry(reader, &log->readers, list)
-		if (clock_interval(old, new, reader->r_off))
-			reader->r_off = get_next_entry(log, reader->r_off, len);
+		if ((long) (head - reader->r_off) > 0)
+			reader->r_off = head;
+
+	return 0;
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
+ * do_write_log - writes 'count' bytes from 'buf' to 'log' at 'off'
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to own the room, see logger_aio_write().
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static void do_write_log(struct logger_log *log, size_t off, const void *buf,
+			 size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	off = logger_offset(off);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
 	if (count != len)
 		memcpy(log->buffer, buf + len, count - len);
-
-	log->w_off = logger_offset(log->w_off + count);
-
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
+ * do_write_log_user - writes 'count' bytes from the user-space buffer 'buf'
+ * to the log 'log' at 'off'
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to own the room, see logger_aio_write().
  *
  * Returns 'count' on success, negative error code on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
+static ssize_t do_write_log_from_user(struct logger_log *log, size_t off,
 				      const void __user *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
+	off = logger_offset(off);
+	len = min(count, log->size - off);
+	if (len && copy_from_user(log->buffer + off, buf, len))
 		return -EFAULT;
 
 	if (count != len)
 		if (copy_from_user(log->buffer, buf + len, count - len))
 			return -EFAULT;
-		
-	//{{ pass platform log (!@hello) to kernel - 2/3
-	memset(klog_buf,0,255);
-
-	if(strncmp(log->buffer  + log->w_off,  "!@", 2) == 0) {
-		if (count < 255)
-			memcpy(klog_buf,log->buffer  + log->w_off, count);                        
-		else
-			memcpy(klog_buf,log->buffer  + log->w_off, 255);                        
-		klog_buf[255]=0;
+
+	return count;
+}
+
+/*
+ * logger_ratelimit - charges an entry to 'uid', returns 0 if it has to be
+ * dropped.
+ *
+ * The caller needs to hold log->lock.
+ */
+static int logger_ratelimit(struct logger_log *log, uid_t uid)
+{
+	unsigned int rate = ACCESS_ONCE(ratelimit_rate);
+	unsigned long burst = (unsigned long) ACCESS_ONCE(ratelimit_burst) * HZ;
+	struct logger_ratelimit *set, *rl = NULL;
+	unsigned long elapsed;
+	int i;
+
+	if (!rate || !burst || !uid)
+		return 1;
+
+	set = &log->ratelimit[(uid % (LOGGER_RATELIMIT_SLOTS /
+				      LOGGER_RATELIMIT_WAYS)) *
+			      LOGGER_RATELIMIT_WAYS];
+	for (i = 0; i < LOGGER_RATELIMIT_WAYS; i++) {
+		if (set[i].uid == uid) {
+			rl = &set[i];
+			break;
+		}
+	}
+	if (!rl) {
+		/* an unused way (uid 0), or else the least recently used */
+		rl = &set[0];
+		for (i = 1; i < LOGGER_RATELIMIT_WAYS && rl->uid; i++)
+			if (!set[i].uid ||
+			    time_before(set[i].stamp, rl->stamp))
+				rl = &set[i];
+		log->evicted += rl->dropped;
+		rl->uid = uid;
+		rl->stamp = jiffies;
+		rl->tokens = burst;
+		rl->dropped = 0;
 	}
-	//}} pass platform log (!@hello) to kernel - 2/3
 
-	log->w_off = logger_offset(log->w_off + count);
+	elapsed = jiffies - rl->stamp;
+	rl->stamp = jiffies;
+	if (elapsed >= burst / rate)
+		rl->tokens = burst;
+	else
+		rl->tokens = min(burst, rl->tokens + elapsed * rate);
 
-	return count;
+	if (rl->tokens < HZ) {
+		rl->dropped++;
+		log->dropped++;
+		return 0;
+	}
+	rl->tokens -= HZ;
+	return 1;
 }
 
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
  * them above all else.
+ *
+ * The entry's room and header are reserved under log->lock, the payload is
+ * copied in without it, so concurrent writers and readers only wait for each
+ * other for a few dozen instructions.
  */
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
 	struct timespec now;
+	size_t off, payload;
 	ssize_t ret = 0;
+	//{{ pass platform log to kernel - 1/3
+	char klog_buf[256];
+
+	klog_buf[0] = '\0';
+	//}} pass platform log to kernel - 1/3
 
 	now = current_kernel_time();
 
@@ -405,24 +956,38 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	header.sec = now.tv_sec;
 	header.nsec = now.tv_nsec;
 	header.len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
+	header.__pad = LOGGER_ENTRY_PENDING;
 
 	/* null writes succeed, return zero */
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
+
+	/* dropped entries look written to the writer */
+	if (unlikely(!logger_ratelimit(log, current_uid()))) {
+		spin_unlock(&log->lock);
+		return header.len;
+	}
 
 	/*
 	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
+	 * entry after (what will be) the new write offset.
 	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
+	if (unlikely(fix_up_readers(log,
+				    sizeof(struct logger_entry) + header.len))) {
+		spin_unlock(&log->lock);
+		return -EAGAIN;
+	}
 
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	off = log->w_off;
+	do_write_log(log, off, &header, sizeof(struct logger_entry));
+	log->w_off = off + sizeof(struct logger_entry) + header.len;
 
-	while (nr_segs-- > 0) {
+	spin_unlock(&log->lock);
+
+	payload = off + sizeof(struct logger_entry);
+	while (nr_segs-- > 0 && ret < header.len) {
 		size_t len;
 		ssize_t nr;
 
@@ -430,27 +995,45 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 		len = min_t(size_t, iov->iov_len, header.len - ret);
 
 		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
+		nr = do_write_log_from_user(log, payload + ret, iov->iov_base,
+					    len);
 		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
+			ret = nr;
+			break;
 		}
 
+		//{{ pass platform log (!@hello) to kernel - 2/3
+		if (nr >= 2) {
+			do_read_log(log, payload + ret, klog_buf, 2);
+			if (strncmp(klog_buf, "!@", 2) == 0) {
+				size_t n = min_t(size_t, nr,
+						 sizeof(klog_buf) - 1);
+
+				do_read_log(log, payload + ret, klog_buf, n);
+				klog_buf[n] = '\0';
+			} else
+				klog_buf[0] = '\0';
+		}
+		//}} pass platform log (!@hello) to kernel - 2/3
+
 		iov++;
 		ret += nr;
 	}
 
-	mutex_unlock(&log->mutex);
+	/* the reservation is ours, a writer that needs the room backs off */
+	spin_lock(&log->lock);
+	set_entry_state(log, off, ret < 0 ? LOGGER_ENTRY_DISCARDED :
+					    LOGGER_ENTRY_COMMITTED);
+	spin_unlock(&log->lock);
 
 	/* wake up any blocked readers */
 	wake_up_interruptible(&log->wq);
-	
+
 	//{{ pass platform log (!@hello) to kernel - 3/3
-	if(strncmp(klog_buf, "!@", 2) == 0)
+	if (ret > 0 && strncmp(klog_buf, "!@", 2) == 0)
 	{
 		printk("%s\n",klog_buf);
-	}                
+	}
 	//}} pass platform log (!@hello) to kernel - 3/3
 
 	return ret;
@@ -483,13 +1066,21 @@ static int logger_open(struct inode *inode, struct file *file)
 		if (!reader)
 			return -ENOMEM;
 
+		reader->buf = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+		if (!reader->buf) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
+		mutex_init(&reader->mutex);
 		INIT_LIST_HEAD(&reader->list);
+		logger_archive_open(reader);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
 		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -507,7 +1098,16 @@ static int logger_release(struct inode *ignored, struct file *file)
 {
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
+		struct logger_log *log = reader->log;
+
+		spin_lock(&log->lock);
 		list_del(&reader->list);
+		spin_unlock(&log->lock);
+
+#ifdef CONFIG_ANDROID_LOGGER_COMPRESS
+		kfree(reader->a_buf);
+#endif
+		kfree(reader->buf);
 		kfree(reader);
 	}
 
@@ -537,61 +1137,108 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
-	if (log->w_off != reader->r_off)
+	if (logger_readable(reader))
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
 
 	return ret;
 }
 
+/*
+ * logger_flush_ring - empty the ring for all current and future readers
+ *
+ * Entries still being copied in keep their room, or a writer could reuse it
+ * under them: the head stops at the first of them, and the committed entries
+ * behind it are discarded instead.
+ *
+ * The caller needs to hold log->lock.
+ */
+static void logger_flush_ring(struct logger_log *log)
+{
+	struct logger_reader *reader;
+	size_t off;
+
+	while (log->head != log->w_off &&
+	       get_entry_state(log, log->head) != LOGGER_ENTRY_PENDING)
+		log->head += get_entry_len(log, log->head);
+
+	for (off = log->head; off != log->w_off; off += get_entry_len(log, off))
+		if (get_entry_state(log, off) == LOGGER_ENTRY_COMMITTED)
+			set_entry_state(log, off, LOGGER_ENTRY_DISCARDED);
+
+	list_for_each_entry(reader, &log->readers, list)
+		reader->r_off = log->w_off;
+}
+
 static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
-	struct logger_reader *reader;
+	struct logger_reader *reader = NULL;
 	long ret = -ENOTTY;
 
-	mutex_lock(&log->mutex);
+	/*
+	 * read() returns the archived entries before the ring, so the length
+	 * queries look at the archive first too. That needs reader->mutex,
+	 * which is held across the whole query to keep it consistent.
+	 */
+	if (cmd == LOGGER_GET_LOG_LEN || cmd == LOGGER_GET_NEXT_ENTRY_LEN) {
+		if (!(file->f_mode & FMODE_READ))
+			return -EBADF;
+		reader = file->private_data;
+		if (mutex_lock_interruptible(&reader->mutex))
+			return -EINTR;
+		if (cmd == LOGGER_GET_LOG_LEN) {
+			ret = logger_archive_pending(reader);
+		} else {
+			ret = logger_archive_next_len(reader);
+			if (ret) {
+				mutex_unlock(&reader->mutex);
+				return ret;
+			}
+		}
+	}
+
+	spin_lock(&log->lock);
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
 		ret = log->size;
 		break;
 	case LOGGER_GET_LOG_LEN:
-		if (!(file->f_mode & FMODE_READ)) {
-			ret = -EBADF;
-			break;
-		}
-		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
-		else
-			ret = (log->size - reader->r_off) + log->w_off;
+		ret += log->w_off - reader->r_off;
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
-		if (!(file->f_mode & FMODE_READ)) {
-			ret = -EBADF;
+		ret = 0;
+		/* skip discarded entries like logger_copy_entry() does */
+		while (reader->r_off != log->w_off) {
+			size_t len = get_entry_len(log, reader->r_off);
+			int state = get_entry_state(log, reader->r_off);
+
+			if (state == LOGGER_ENTRY_DISCARDED) {
+				reader->r_off += len;
+				continue;
+			}
+			if (state == LOGGER_ENTRY_COMMITTED)
+				ret = len;
 			break;
 		}
-		reader = file->private_data;
-		if (log->w_off != reader->r_off)
-			ret = get_entry_len(log, reader->r_off);
-		else
-			ret = 0;
 		break;
 	case LOGGER_FLUSH_LOG:
 		if (!(file->f_mode & FMODE_WRITE)) {
 			ret = -EBADF;
 			break;
 		}
-		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+		logger_flush_ring(log);
 		ret = 0;
 		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
+
+	if (reader)
+		mutex_unlock(&reader->mutex);
+
+	if (cmd == LOGGER_FLUSH_LOG && !ret)
+		logger_archive_flush(log);
 
 	return ret;
 }
@@ -599,6 +1246,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 static const struct file_operations logger_fops = {
 	.owner = THIS_MODULE,
 	.read = logger_read,
+	.aio_read = logger_aio_read,
 	.aio_write = logger_aio_write,
 	.poll = logger_poll,
 	.unlocked_ioctl = logger_ioctl,
@@ -607,13 +1255,25 @@ static const struct file_operations logger_fops = {
 	.release = logger_release,
 };
 
+/*
+ * With compression, a quarter of each log's memory is its ring and the
+ * rest, less the staging buffers, holds the archived chunks.
+ */
+#ifdef CONFIG_ANDROID_LOGGER_COMPRESS
+#define LOGGER_RING_SIZE(SIZE)		((SIZE) / 4)
+#define LOGGER_ARCHIVE_BUDGET(log) \
+	(3 * (log)->size - 2 * LOGGER_CHUNK_SIZE)
+#else
+#define LOGGER_RING_SIZE(SIZE)		(SIZE)
+#endif
+
 /*
  * Defines a log structure with name 'NAME' and a size of 'SIZE' bytes, which
  * must be a power of two, greater than LOGGER_ENTRY_MAX_LEN, and less than
- * LONG_MAX minus LOGGER_ENTRY_MAX_LEN.
+ * LONG_MAX minus LOGGER_ENTRY_MAX_LEN. The ring size must satisfy the same.
  */
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
-static unsigned char _buf_ ## VAR[SIZE]; \
+static unsigned char _buf_ ## VAR[LOGGER_RING_SIZE(SIZE)]; \
 static struct logger_log VAR = { \
 	.buffer = _buf_ ## VAR, \
 	.misc = { \
@@ -624,10 +1284,10 @@ static struct logger_log VAR = { \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
 	.w_off = 0, \
 	.head = 0, \
-	.size = SIZE, \
+	.size = LOGGER_RING_SIZE(SIZE), \
 };
 
 DEFINE_LOGGER_DEVICE(log_main, LOGGER_LOG_MAIN, 256*1024)
@@ -648,10 +1308,67 @@ static struct logger_log *get_log_from_minor(int minor)
 	return NULL;
 }
 
+static struct dentry *logger_debugfs_root;
+
+static int logger_stats_show(struct seq_file *m, void *unused)
+{
+	struct logger_log *log = m->private;
+	struct logger_ratelimit ratelimit[LOGGER_RATELIMIT_SLOTS];
+	unsigned long dropped, evicted;
+	int i;
+
+	spin_lock(&log->lock);
+	memcpy(ratelimit, log->ratelimit, sizeof(ratelimit));
+	dropped = log->dropped;
+	evicted = log->evicted;
+	spin_unlock(&log->lock);
+
+	seq_printf(m, "ring: %zu bytes\n", log->size);
+#ifdef CONFIG_ANDROID_LOGGER_COMPRESS
+	mutex_lock(&log->archive.mutex);
+	seq_printf(m, "archive: %zu/%zu bytes holding %zu bytes, "
+		   "%lu entries lost\n",
+		   log->archive.bytes, log->archive.budget,
+		   log->archive.raw_bytes, log->archive.lost);
+	mutex_unlock(&log->archive.mutex);
+#endif
+	seq_printf(m, "dropped: %lu\n", dropped);
+	for (i = 0; i < LOGGER_RATELIMIT_SLOTS; i++)
+		if (ratelimit[i].dropped)
+			seq_printf(m, "  uid %u: %lu\n", ratelimit[i].uid,
+				   ratelimit[i].dropped);
+	if (evicted)
+		seq_printf(m, "  other uids: %lu\n", evicted);
+
+	return 0;
+}
+
+static int logger_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, logger_stats_show, inode->i_private);
+}
+
+static const struct file_operations logger_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = logger_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int __init init_log(struct logger_log *log)
 {
 	int ret;
 
+#ifdef CONFIG_ANDROID_LOGGER_COMPRESS
+	ret = logger_archive_init(log, LOGGER_ARCHIVE_BUDGET(log));
+	if (unlikely(ret)) {
+		printk(KERN_ERR "logger: failed to allocate the archive "
+		       "for log '%s'!\n", log->misc.name);
+		return ret;
+	}
+#endif
+
 	ret = misc_register(&log->misc);
 	if (unlikely(ret)) {
 		printk(KERN_ERR "logger: failed to register misc "
@@ -662,6 +1379,11 @@ static int __init init_log(struct logger_log *log)
 	printk(KERN_INFO "logger: created %luK log '%s'\n",
 	       (unsigned long) log->size >> 10, log->misc.name);
 
+	if (logger_debugfs_root)
+		debugfs_create_file(log->misc.name, S_IRUGO,
+				    logger_debugfs_root, log,
+				    &logger_stats_fops);
+
 	return 0;
 }
 
@@ -677,6 +1399,19 @@ static int __init logger_init(void)
 	marks_ver_mark.log_mark_version = 1; 
 	//}} Mark for GetLog - 2/2
 
+#ifdef CONFIG_ANDROID_LOGGER_COMPRESS
+	logger_compress_wrkmem = kmalloc(LZO1X_1_MEM_COMPRESS, GFP_KERNEL);
+	logger_compress_buf = kmalloc(lzo1x_worst_compress(LOGGER_CHUNK_SIZE),
+				      GFP_KERNEL);
+	if (!logger_compress_wrkmem || !logger_compress_buf) {
+		kfree(logger_compress_wrkmem);
+		kfree(logger_compress_buf);
+		return -ENOMEM;
+	}
+#endif
+
+	logger_debugfs_root = debugfs_create_dir("logger", NULL);
+
 	ret = init_log(&log_main);
 	if (unlikely(ret))
 		goto out;
@@ -119,6 +119,67 @@ struct task_struct *find_lock_task_mm(struct task_struct *p)
 
 static DEFINE_MUTEX(scan_mutex);
 
+/*
+ * Thread group leaders, bucketed by oom_adj, so that picking a victim
+ * only looks at the tasks in the highest non-empty bucket at or above
+ * the adj being killed. Kept up to date on fork, exec, exit and writes
+ * to /proc/<pid>/oom_adj.
+ */
+#define LOWMEM_ADJ_BUCKETS	(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+
+/*
+ * lmk_lock nests inside write_lock_irq(&tasklist_lock) on fork and
+ * inside siglock on oom_adj writes, so it must always be taken with
+ * interrupts off: an interrupt reading tasklist_lock while we hold it
+ * would otherwise deadlock against a writer spinning on it.
+ */
+
+static DEFINE_SPINLOCK(lmk_lock);
+static struct hlist_head lowmem_adj_bucket[LOWMEM_ADJ_BUCKETS];
+
+static struct hlist_head *lowmem_adj_list(int oom_adj)
+{
+	if (oom_adj < OOM_DISABLE)
+		oom_adj = OOM_DISABLE;
+	if (oom_adj > OOM_ADJUST_MAX)
+		oom_adj = OOM_ADJUST_MAX;
+	return &lowmem_adj_bucket[oom_adj - OOM_DISABLE];
+}
+
+void lowmem_adj_add(struct task_struct *task)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lmk_lock, flags);
+	hlist_add_head(&task->adj_node, lowmem_adj_list(task->signal->oom_adj));
+	spin_unlock_irqrestore(&lmk_lock, flags);
+}
+
+void lowmem_adj_del(struct task_struct *task)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lmk_lock, flags);
+	hlist_del_init(&task->adj_node);
+	spin_unlock_irqrestore(&lmk_lock, flags);
+}
+
+/* Called with task->sighand->siglock held after signal->oom_adj changed */
+void lowmem_adj_update(struct task_struct *task)
+{
+	struct task_struct *leader = task->group_leader;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lmk_lock, flags);
+	/* an unhashed node means the group is already gone */
+	if (!hlist_unhashed(&leader->adj_node)) {
+		hlist_del(&leader->adj_node);
+		hlist_add_head(&leader->adj_node,
+			       lowmem_adj_list(leader->signal->oom_adj));
+	}
+	spin_unlock_irqrestore(&lmk_lock, flags);
+}
+
 void tune_lmk_zone_param(struct zonelist *zonelist, int classzone_idx,
 					int *other_free, int *other_file)
 {
@@ -154,10 +215,6 @@ void tune_lmk_zone_param(struct zonelist *zonelist, int classzone_idx,
 	}
 }
 
-static struct task_struct *pick_next_from_adj_tree(struct task_struct *task);
-static struct task_struct *pick_first_task(void);
-static struct task_struct *pick_last_task(void);
-
 void tune_lmk_param(int *other_free, int *other_file, gfp_t gfp_mask)
 {
 	struct zone *preferred_zone;
@@ -204,12 +261,78 @@ void tune_lmk_param(int *other_free, int *other_file, gfp_t gfp_mask)
 	}
 }
 
+/*
+ * Pick the task to kill among the tasks with the highest oom_adj that
+ * is at least min_adj: the one with the largest rss in the first
+ * non-empty bucket, walking down from OOM_ADJUST_MAX. Returns NULL
+ * with *dying set if a previous victim is still exiting.
+ */
+static struct task_struct *lowmem_select(int min_adj, int *selected_oom_adj,
+					 int *selected_tasksize, bool *dying)
+{
+	struct task_struct *selected = NULL;
+	struct task_struct *tsk;
+	struct hlist_node *pos;
+	int tasksize;
+	int adj;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lmk_lock, flags);
+	for (adj = OOM_ADJUST_MAX; adj >= min_adj && !selected; adj--) {
+		hlist_for_each_entry(tsk, pos, lowmem_adj_list(adj), adj_node) {
+			struct task_struct *p;
+
+			if (tsk->flags & PF_KTHREAD)
+				continue;
+
+			/* if task no longer has any memory ignore it */
+			if (test_task_flag(tsk, TIF_MM_RELEASED))
+				continue;
+
+			if (time_before_eq(jiffies, lowmem_deathpending_timeout) &&
+			    test_task_flag(tsk, TIF_MEMDIE)) {
+				if (same_thread_group(current, tsk))
+					set_tsk_thread_flag(current, TIF_MEMDIE);
+				spin_unlock_irqrestore(&lmk_lock, flags);
+				*dying = true;
+				return NULL;
+			}
+
+			p = find_lock_task_mm(tsk);
+			if (!p)
+				continue;
+
+			if (fatal_signal_pending(p) ||
+				((p->flags & PF_EXITING) &&
+				test_tsk_thread_flag(p, TIF_MEMDIE))) {
+				lowmem_print(2, "skip slow dying process %d\n",
+					     p->pid);
+				task_unlock(p);
+				continue;
+			}
+
+			tasksize = get_mm_rss(p->mm);
+			task_unlock(p);
+			if (tasksize <= 0)
+				continue;
+			if (selected && tasksize <= *selected_tasksize)
+				continue;
+			selected = p;
+			*selected_tasksize = tasksize;
+			*selected_oom_adj = adj;
+			lowmem_print(2, "select %d (%s), adj %d, size %d, "
+				     "to kill\n", p->pid, p->comm, adj, tasksize);
+		}
+	}
+	spin_unlock_irqrestore(&lmk_lock, flags);
+	return selected;
+}
+
 static int lowmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 {
 	struct task_struct *tsk;
-	struct task_struct *selected = NULL;
+	struct task_struct *selected;
 	int rem = 0;
-	int tasksize;
 	int i;
 	int min_adj = OOM_SCORE_ADJ_MAX + 1;
 	int selected_tasksize = 0;
@@ -217,18 +340,28 @@ static int lowmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 	int array_size = ARRAY_SIZE(lowmem_adj);
 	int other_free;
 	int other_file;
-	
+	bool dying = false;
+
 	tsk = current->group_leader;
 	if ((tsk->flags & PF_EXITING) && test_task_flag(tsk, TIF_MEMDIE)) {
 		set_tsk_thread_flag(current, TIF_MEMDIE);
 		return 0;
 	}
-	
-	if (nr_to_scan > 0) {
-		if (mutex_lock_interruptible(&scan_mutex) < 0)
-			return 0;
+
+	rem = global_page_state(NR_ACTIVE_ANON) +
+		global_page_state(NR_ACTIVE_FILE) +
+		global_page_state(NR_INACTIVE_ANON) +
+		global_page_state(NR_INACTIVE_FILE);
+	/* a query, which is most calls: the free counts are not needed */
+	if (nr_to_scan <= 0) {
+		lowmem_print(5, "lowmem_shrink %d, %x, return %d\n",
+			     nr_to_scan, gfp_mask, rem);
+		return rem;
 	}
 
+	if (mutex_lock_interruptible(&scan_mutex) < 0)
+		return 0;
+
 	other_free = global_page_state(NR_FREE_PAGES);
 	other_file = global_page_state(NR_FILE_PAGES) -
 						global_page_state(NR_SHMEM);
@@ -246,87 +379,27 @@ static int lowmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 			break;
 		}
 	}
-	if (nr_to_scan > 0)
-		lowmem_print(3, "lowmem_shrink %d, %x, ofree %d %d, ma %d\n",
-				nr_to_scan, gfp_mask, other_free,
-				other_file, min_adj);
-	rem = global_page_state(NR_ACTIVE_ANON) +
-		global_page_state(NR_ACTIVE_FILE) +
-		global_page_state(NR_INACTIVE_ANON) +
-		global_page_state(NR_INACTIVE_FILE);
-	if (nr_to_scan <= 0 || min_adj == OOM_SCORE_ADJ_MAX + 1) {
+	lowmem_print(3, "lowmem_shrink %d, %x, ofree %d %d, ma %d\n",
+			nr_to_scan, gfp_mask, other_free,
+			other_file, min_adj);
+	/* above every minfree level, there is nothing to look for */
+	if (min_adj == OOM_SCORE_ADJ_MAX + 1) {
 		lowmem_print(5, "lowmem_shrink %d, %x, return %d\n",
 			     nr_to_scan, gfp_mask, rem);
-
-		if (nr_to_scan > 0)
-			mutex_unlock(&scan_mutex);
-
+		mutex_unlock(&scan_mutex);
 		return rem;
 	}
-	selected_oom_adj = min_adj;
 
 	rcu_read_lock();
-	for (tsk = pick_first_task();
-		tsk != pick_last_task();
-		tsk = pick_next_from_adj_tree(tsk)) {
-		struct task_struct *p;
-		int oom_adj;
-
-		if (tsk->flags & PF_KTHREAD)
-			continue;
-
-		/* if task no longer has any memory ignore it */
-		if (test_task_flag(tsk, TIF_MM_RELEASED))
-			continue;
-
-		if (time_before_eq(jiffies, lowmem_deathpending_timeout)) {
-			if (test_task_flag(tsk, TIF_MEMDIE)) {
-				rcu_read_unlock();
-				/* give the system time to free up the memory */
-				if (!same_thread_group(current, tsk))
-					msleep_interruptible(20);
-				else
-					set_tsk_thread_flag(current, TIF_MEMDIE);
-				mutex_unlock(&scan_mutex);
-				return 0;
-			}
-		}
-
-		p = find_lock_task_mm(tsk);
-		if (!p)
-			continue;
-
-		oom_adj = p->signal->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			break;
-		}
-		
-		
-		if (fatal_signal_pending(p) ||
-			((p->flags & PF_EXITING) &&
-			test_tsk_thread_flag(p, TIF_MEMDIE))) {
-			lowmem_print(2, "skip slow dying process %d\n", p->pid);
-			task_unlock(p);
-			continue;
-		}
-		
-		tasksize = get_mm_rss(p->mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
-				break;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
-		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
+	selected = lowmem_select(min_adj, &selected_oom_adj,
+				 &selected_tasksize, &dying);
+	if (dying) {
+		rcu_read_unlock();
+		/* give the system time to free up the memory */
+		if (!test_tsk_thread_flag(current, TIF_MEMDIE))
+			msleep_interruptible(20);
+		mutex_unlock(&scan_mutex);
+		return 0;
 	}
 	if (selected) {
 		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
@@ -364,81 +437,6 @@ static void __exit lowmem_exit(void)
 	unregister_shrinker(&lowmem_shrinker);
 }
 
-DEFINE_SPINLOCK(lmk_lock);
-struct rb_root tasksadj = RB_ROOT;
-void add_2_adj_tree(struct task_struct *task)
-{		struct rb_node **link = &tasksadj.rb_node;
-struct rb_node *parent = NULL;
-struct task_struct *task_entry;
-s64 key = task->signal->oom_adj;
-/*
- * Find the right place in the rbtree:
- */
-spin_lock(&lmk_lock);
-while (*link) {
-	parent = *link;
-	task_entry = rb_entry(parent, struct task_struct, adj_node);
-	if (key < task_entry->signal->oom_adj)
-		link = &parent->rb_right;
-	else
-		link = &parent->rb_left;
-}
-
-rb_link_node(&task->adj_node, parent, link);
-rb_insert_color(&task->adj_node, &tasksadj);
-spin_unlock(&lmk_lock);
-}
-
-void delete_from_adj_tree(struct task_struct *task)
-{
-	spin_lock(&lmk_lock);
-	rb_erase(&task->adj_node, &tasksadj);
-	spin_unlock(&lmk_lock);
-}
-
-
-static struct task_struct *pick_next_from_adj_tree(struct task_struct *task)
-{
-	struct rb_node *next;
-	
-	spin_lock(&lmk_lock);
-	next = rb_next(&task->adj_node);
-	spin_unlock(&lmk_lock);
-	
-	if (!next)
-		return NULL;
-	
-	return rb_entry(next, struct task_struct, adj_node);
-}
-
-static struct task_struct *pick_first_task(void)
-{
-	struct rb_node *left;
-	
-	spin_lock(&lmk_lock);
-	left = rb_first(&tasksadj);
-	spin_unlock(&lmk_lock);
-	
-	if (!left)
-		return NULL;
-	
-	return rb_entry(left, struct task_struct, adj_node);
-}
-
-static struct task_struct *pick_last_task(void)
-{
-	struct rb_node *right;
-	
-	spin_lock(&lmk_lock);
-	right = rb_last(&tasksadj);
-	spin_unlock(&lmk_lock);
-	
-	if (!right)
-		return NULL;
-	
-	return rb_entry(right, struct task_struct, adj_node);
-}
-
 module_param_named(cost, lowmem_shrinker.seeks, int, S_IRUGO | S_IWUSR);
 module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 			 S_IRUGO | S_IWUSR);
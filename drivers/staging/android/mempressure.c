@@ -0,0 +1,254 @@
+/* drivers/staging/android/mempressure.c
+ *
+ * Memory pressure notifications for userspace low memory killers.
+ *
+ * Page reclaim reports how many pages it scanned and how many of them it
+ * managed to reclaim. Every time "window" pages have been scanned, the
+ * share of scanned pages that could not be reclaimed is turned into a
+ * pressure level:
+ *
+ *   low      - reclaim is keeping up, caches are being shrunk
+ *   medium   - at least "medium" percent of the scanned pages stayed
+ *   critical - at least "critical" percent of the scanned pages stayed,
+ *              the system is about to start thrashing or OOM killing
+ *
+ * /dev/mempressure reports those levels. poll() signals POLLIN when a
+ * window at or above the file's level has completed since the last
+ * read(), which then returns the highest level seen in the meantime, as
+ * "low\n", "medium\n" or "critical\n". A file starts at "low"; writing
+ * one of the level names changes it. window, medium and critical are
+ * tunable in /sys/module/mempressure/parameters.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/swap.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include <linux/mempressure.h>
+
+enum mempressure_level {
+	MEMPRESSURE_LOW,
+	MEMPRESSURE_MEDIUM,
+	MEMPRESSURE_CRITICAL,
+	MEMPRESSURE_NR_LEVELS
+};
+
+static const char * const mempressure_names[MEMPRESSURE_NR_LEVELS] = {
+	"low",
+	"medium",
+	"critical",
+};
+
+static unsigned int mempressure_window = SWAP_CLUSTER_MAX * 16;
+static unsigned int mempressure_medium = 60;
+static unsigned int mempressure_critical = 95;
+
+static DEFINE_SPINLOCK(mempressure_lock);
+static DECLARE_WAIT_QUEUE_HEAD(mempressure_wait);
+static unsigned long mempressure_scanned;
+static unsigned long mempressure_reclaimed;
+/* seq[n] counts the windows that ended at level n or above */
+static unsigned long mempressure_seq[MEMPRESSURE_NR_LEVELS];
+
+struct mempressure_reader {
+	enum mempressure_level level;
+	unsigned long seq[MEMPRESSURE_NR_LEVELS];
+};
+
+static enum mempressure_level mempressure_calc_level(unsigned long scanned,
+						     unsigned long reclaimed)
+{
+	unsigned long pressure;
+
+	/* reclaim may free more than it scanned, e.g. with lumpy reclaim */
+	if (reclaimed >= scanned)
+		return MEMPRESSURE_LOW;
+	pressure = (scanned - reclaimed) * 100 / scanned;
+	if (pressure >= mempressure_critical)
+		return MEMPRESSURE_CRITICAL;
+	if (pressure >= mempressure_medium)
+		return MEMPRESSURE_MEDIUM;
+	return MEMPRESSURE_LOW;
+}
+
+/*
+ * Called from shrink_zone() for global reclaim. Kept to a few
+ * additions under a spinlock, the wakeup only happens once per window.
+ */
+void mempressure_report(unsigned long scanned, unsigned long reclaimed)
+{
+	enum mempressure_level level;
+	unsigned long flags;
+	int i;
+
+	if (!scanned)
+		return;
+
+	spin_lock_irqsave(&mempressure_lock, flags);
+	mempressure_scanned += scanned;
+	mempressure_reclaimed += reclaimed;
+	if (mempressure_scanned < mempressure_window) {
+		spin_unlock_irqrestore(&mempressure_lock, flags);
+		return;
+	}
+	level = mempressure_calc_level(mempressure_scanned,
+				       mempressure_reclaimed);
+	mempressure_scanned = 0;
+	mempressure_reclaimed = 0;
+	for (i = 0; i <= level; i++)
+		mempressure_seq[i]++;
+	spin_unlock_irqrestore(&mempressure_lock, flags);
+
+	wake_up_interruptible(&mempressure_wait);
+}
+
+/* The highest level seen by the reader since its last read, or -1 */
+static int mempressure_pending(struct mempressure_reader *reader,
+			       bool consume)
+{
+	unsigned long flags;
+	int level = -1;
+	int i;
+
+	spin_lock_irqsave(&mempressure_lock, flags);
+	for (i = MEMPRESSURE_NR_LEVELS - 1; i >= (int)reader->level; i--) {
+		if (mempressure_seq[i] != reader->seq[i]) {
+			level = i;
+			break;
+		}
+	}
+	if (level >= 0 && consume)
+		memcpy(reader->seq, mempressure_seq, sizeof(reader->seq));
+	spin_unlock_irqrestore(&mempressure_lock, flags);
+	return level;
+}
+
+static ssize_t mempressure_read(struct file *file, char __user *buf,
+				size_t count, loff_t *pos)
+{
+	struct mempressure_reader *reader = file->private_data;
+	const char *name;
+	size_t len;
+	int level;
+	int ret;
+
+	while ((level = mempressure_pending(reader, true)) < 0) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(mempressure_wait,
+				mempressure_pending(reader, false) >= 0);
+		if (ret)
+			return ret;
+	}
+
+	name = mempressure_names[level];
+	len = strlen(name);
+	if (count < len + 1)
+		return -EINVAL;
+	if (copy_to_user(buf, name, len) || put_user('\n', buf + len))
+		return -EFAULT;
+	return len + 1;
+}
+
+static ssize_t mempressure_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *pos)
+{
+	struct mempressure_reader *reader = file->private_data;
+	char kbuf[16];
+	int i;
+
+	if (count >= sizeof(kbuf))
+		return -EINVAL;
+	if (copy_from_user(kbuf, buf, count))
+		return -EFAULT;
+	kbuf[count] = '\0';
+
+	for (i = 0; i < MEMPRESSURE_NR_LEVELS; i++) {
+		if (sysfs_streq(kbuf, mempressure_names[i])) {
+			reader->level = i;
+			return count;
+		}
+	}
+	return -EINVAL;
+}
+
+static unsigned int mempressure_poll(struct file *file, poll_table *wait)
+{
+	struct mempressure_reader *reader = file->private_data;
+
+	poll_wait(file, &mempressure_wait, wait);
+	if (mempressure_pending(reader, false) >= 0)
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+static int mempressure_open(struct inode *inode, struct file *file)
+{
+	struct mempressure_reader *reader;
+	unsigned long flags;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	/* only report pressure from after the open */
+	spin_lock_irqsave(&mempressure_lock, flags);
+	memcpy(reader->seq, mempressure_seq, sizeof(reader->seq));
+	spin_unlock_irqrestore(&mempressure_lock, flags);
+	reader->level = MEMPRESSURE_LOW;
+
+	file->private_data = reader;
+	return nonseekable_open(inode, file);
+}
+
+static int mempressure_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations mempressure_fops = {
+	.owner = THIS_MODULE,
+	.read = mempressure_read,
+	.write = mempressure_write,
+	.poll = mempressure_poll,
+	.open = mempressure_open,
+	.release = mempressure_release,
+	.llseek = no_llseek,
+};
+
+static struct miscdevice mempressure_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "mempressure",
+	.fops = &mempressure_fops,
+};
+
+static int __init mempressure_init(void)
+{
+	return misc_register(&mempressure_misc);
+}
+
+module_param_named(window, mempressure_window, uint, S_IRUGO | S_IWUSR);
+module_param_named(medium, mempressure_medium, uint, S_IRUGO | S_IWUSR);
+module_param_named(critical, mempressure_critical, uint, S_IRUGO | S_IWUSR);
+
+device_initcall(mempressure_init);
+
+MODULE_LICENSE("GPL");
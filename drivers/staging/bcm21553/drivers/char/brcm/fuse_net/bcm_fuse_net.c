@@ -77,6 +77,14 @@ struct wake_lock knet_wake_lock;
 #define BCM_NET_MAX_DATA_LEN       1500 //bytes
 #define BCM_NET_MAX_NUM_PKTS       250 //packets
 
+/**
+   Receive batching. The IPC delivery tasklet only queues the buffer handle
+   and the NAPI poll drains up to BCM_NET_NAPI_WEIGHT of them per run.
+ */
+#define BCM_NET_NAPI_WEIGHT        64  //packets per poll
+#define BCM_NET_RX_RING_SIZE       128 //pending IPC buffers per device, power of 2
+#define BCM_NET_RX_RING_MASK       (BCM_NET_RX_RING_SIZE - 1)
+
 
 typedef enum
 {
@@ -91,6 +99,12 @@ typedef struct
     uint8_t  pdp_context_id;
     unsigned long  ip_addr;
     struct net_device_stats stats;
+    struct napi_struct napi;
+    spinlock_t rx_lock;
+    int rx_enabled;
+    unsigned int rx_head;
+    unsigned int rx_tail;
+    PACKET_BufHandle_t rx_ring[BCM_NET_RX_RING_SIZE];
 }net_drvr_info_t; 
 
 
@@ -173,59 +187,152 @@ static void bcm_fuse_net_fc_cb(RPC_FlowCtrlEvent_t event, unsigned char cid)
 
 
 /**
-   @fn RPC_Result_t bcm_fuse_net_bd_cb(PACKET_InterfaceType_t interfaceType, unsigned char cid, PACKET_BufHandle_t dataBufHandle);
+   @fn static struct sk_buff *bcm_fuse_net_rx_skb(net_drvr_info_t *ndrvr_info_ptr, PACKET_BufHandle_t dataBufHandle);
+
+   Copy an IPC buffer into a new skb. The IPC buffer is left to the caller.
 */
-static RPC_Result_t bcm_fuse_net_bd_cb(PACKET_InterfaceType_t interfaceType, unsigned char cid, PACKET_BufHandle_t dataBufHandle)
+static struct sk_buff *bcm_fuse_net_rx_skb(net_drvr_info_t *ndrvr_info_ptr, PACKET_BufHandle_t dataBufHandle)
 {
-    unsigned long data_len = 0;
-    struct sk_buff *skb = NULL;
-    unsigned char *data_ptr = NULL;
-    net_drvr_info_t *ndrvr_info_ptr = NULL;
-
-    //BNET_DEBUG(DBG_INFO,"%s: receive packet \n", __FUNCTION__);
+    unsigned long data_len;
+    struct sk_buff *skb;
 
     data_len = RPC_PACKET_GetBufferLength(dataBufHandle);
 
-    //BNET_DEBUG(DBG_INFO,"%s: RECVD Buffer Delivery on AP Packet channel, cid[%d] size[%d]!!\n", __FUNCTION__, cid, data_len);
-
-    //ndrvr_info_ptr = &g_net_dev_tbl[0];
-    ndrvr_info_ptr = bcm_fuse_net_device_pdp_lookup(cid);
-    if (ndrvr_info_ptr == NULL)
-    {
-        if (printk_ratelimit())
-            BNET_DEBUG(DBG_ERROR,"%s: bcm_fuse_net_device_pdp_lookup failed\n", __FUNCTION__);
-
-        return RPC_RESULT_ERROR;
-    }
-
-    skb = dev_alloc_skb(data_len);
+    skb = netdev_alloc_skb(ndrvr_info_ptr->dev_ptr, data_len);
     if (skb == NULL)
     {
         if (printk_ratelimit())
-            BNET_DEBUG(DBG_ERROR,"%s: dev_alloc_skb() failed - packet dropped\n", __FUNCTION__);
+            BNET_DEBUG(DBG_ERROR,"%s: netdev_alloc_skb() failed - packet dropped\n", __FUNCTION__);
 
         ndrvr_info_ptr->stats.rx_dropped++;
-        return RPC_RESULT_ERROR;
+        return NULL;
     }
 
-    data_ptr = (unsigned char*)RPC_PACKET_GetBufferData(dataBufHandle);
-    memcpy(skb_put(skb, data_len), data_ptr, data_len);
+    skb_copy_to_linear_data(skb, RPC_PACKET_GetBufferData(dataBufHandle), data_len);
+    skb_put(skb, data_len);
 
-    skb->dev = ndrvr_info_ptr->dev_ptr;
     skb->protocol=htons(ETH_P_IP);
 //    skb->ip_summed = CHECKSUM_UNNECESSARY; /* don't check it */
     skb->pkt_type = PACKET_HOST;
-    ndrvr_info_ptr->dev_ptr->last_rx = jiffies;
-    bcm_fuse_net_last_rx = ndrvr_info_ptr->dev_ptr->last_rx;
 
     ndrvr_info_ptr->stats.rx_packets++;
     ndrvr_info_ptr->stats.rx_bytes += data_len;
 
-    netif_rx(skb);
+    return skb;
+}
 
-    wake_lock_timeout(&knet_wake_lock, msecs_to_jiffies(g_bcmnet_wake_time));
 
-    return RPC_RESULT_OK;
+/**
+   @fn static int bcm_fuse_net_poll(struct napi_struct *napi, int budget);
+*/
+static int bcm_fuse_net_poll(struct napi_struct *napi, int budget)
+{
+    net_drvr_info_t *ndrvr_info_ptr = container_of(napi, net_drvr_info_t, napi);
+    PACKET_BufHandle_t batch[BCM_NET_NAPI_WEIGHT];
+    struct sk_buff *skb;
+    int count, i;
+
+    if (budget > BCM_NET_NAPI_WEIGHT)
+        budget = BCM_NET_NAPI_WEIGHT;
+
+    //take the whole batch with a single lock round trip
+    spin_lock_bh(&ndrvr_info_ptr->rx_lock);
+    count = min_t(int, budget, ndrvr_info_ptr->rx_head - ndrvr_info_ptr->rx_tail);
+    for (i = 0; i < count; i++)
+        batch[i] = ndrvr_info_ptr->rx_ring[ndrvr_info_ptr->rx_tail++ & BCM_NET_RX_RING_MASK];
+    spin_unlock_bh(&ndrvr_info_ptr->rx_lock);
+
+    for (i = 0; i < count; i++)
+    {
+        skb = bcm_fuse_net_rx_skb(ndrvr_info_ptr, batch[i]);
+        RPC_PACKET_FreeBuffer(batch[i]);
+        if (skb)
+            netif_receive_skb(skb);
+    }
+
+    if (count)
+    {
+        ndrvr_info_ptr->dev_ptr->last_rx = jiffies;
+        bcm_fuse_net_last_rx = ndrvr_info_ptr->dev_ptr->last_rx;
+        wake_lock_timeout(&knet_wake_lock, msecs_to_jiffies(g_bcmnet_wake_time));
+    }
+
+    if (count < budget)
+    {
+        napi_complete(napi);
+        //a buffer queued after the ring was sampled found NAPI still scheduled
+        if (ndrvr_info_ptr->rx_head != ndrvr_info_ptr->rx_tail)
+            napi_reschedule(napi);
+    }
+
+    return count;
+}
+
+
+/**
+   @fn static void bcm_fuse_net_rx_drain(net_drvr_info_t *ndrvr_info_ptr);
+
+   Release the IPC buffers still queued for a device that is going down.
+*/
+static void bcm_fuse_net_rx_drain(net_drvr_info_t *ndrvr_info_ptr)
+{
+    spin_lock_bh(&ndrvr_info_ptr->rx_lock);
+    ndrvr_info_ptr->rx_enabled = 0;
+    while (ndrvr_info_ptr->rx_tail != ndrvr_info_ptr->rx_head)
+    {
+        RPC_PACKET_FreeBuffer(ndrvr_info_ptr->rx_ring[ndrvr_info_ptr->rx_tail++ & BCM_NET_RX_RING_MASK]);
+        ndrvr_info_ptr->stats.rx_dropped++;
+    }
+    spin_unlock_bh(&ndrvr_info_ptr->rx_lock);
+}
+
+
+/**
+   @fn RPC_Result_t bcm_fuse_net_bd_cb(PACKET_InterfaceType_t interfaceType, unsigned char cid, PACKET_BufHandle_t dataBufHandle);
+
+   Runs in the IPC tasklet. The buffer is queued for the NAPI poll and kept
+   from the IPC layer (RPC_RESULT_PENDING) until the poll has copied it out.
+   When the ring is full the buffer is dropped and handed back to the IPC layer.
+*/
+static RPC_Result_t bcm_fuse_net_bd_cb(PACKET_InterfaceType_t interfaceType, unsigned char cid, PACKET_BufHandle_t dataBufHandle)
+{
+    net_drvr_info_t *ndrvr_info_ptr = NULL;
+    int queued = 0;
+
+    //BNET_DEBUG(DBG_INFO,"%s: RECVD Buffer Delivery on AP Packet channel, cid[%d] size[%d]!!\n", __FUNCTION__, cid, RPC_PACKET_GetBufferLength(dataBufHandle));
+
+    ndrvr_info_ptr = bcm_fuse_net_device_pdp_lookup(cid);
+    if (ndrvr_info_ptr == NULL)
+    {
+        if (printk_ratelimit())
+            BNET_DEBUG(DBG_ERROR,"%s: bcm_fuse_net_device_pdp_lookup failed\n", __FUNCTION__);
+
+        return RPC_RESULT_ERROR;
+    }
+
+    spin_lock(&ndrvr_info_ptr->rx_lock);
+    if (!ndrvr_info_ptr->rx_enabled)
+    {
+        spin_unlock(&ndrvr_info_ptr->rx_lock);
+        ndrvr_info_ptr->stats.rx_dropped++;
+        return RPC_RESULT_ERROR;
+    }
+    if (ndrvr_info_ptr->rx_head - ndrvr_info_ptr->rx_tail < BCM_NET_RX_RING_SIZE)
+    {
+        ndrvr_info_ptr->rx_ring[ndrvr_info_ptr->rx_head++ & BCM_NET_RX_RING_MASK] = dataBufHandle;
+        queued = 1;
+    }
+    spin_unlock(&ndrvr_info_ptr->rx_lock);
+
+    if (!queued)
+    {
+        //ring full, the poll is behind: drop rather than overtake the queued packets
+        ndrvr_info_ptr->stats.rx_dropped++;
+        return RPC_RESULT_ERROR;
+    }
+
+    napi_schedule(&ndrvr_info_ptr->napi);
+    return RPC_RESULT_PENDING;
 }
 
 
@@ -277,6 +384,11 @@ static int bcm_fuse_net_open(struct net_device *dev)
     spin_unlock_irqrestore(&g_dev_lock, flags);
     BNET_DEBUG(DBG_INFO,"%s: BCM_FUSE_NET_ACTIVATE_PDP: rmnet[%d] pdp_info.cid=%d\n", __FUNCTION__, idx, g_net_dev_tbl[idx].pdp_context_id);
 
+    spin_lock_bh(&g_net_dev_tbl[idx].rx_lock);
+    g_net_dev_tbl[idx].rx_enabled = 1;
+    spin_unlock_bh(&g_net_dev_tbl[idx].rx_lock);
+    napi_enable(&g_net_dev_tbl[idx].napi);
+
     netif_start_queue(dev);
     return 0;
 }
@@ -289,6 +401,8 @@ static int bcm_fuse_net_stop(struct net_device *dev)
     {
         if (g_net_dev_tbl[i].dev_ptr == dev)
         {
+            napi_disable(&g_net_dev_tbl[i].napi);
+            bcm_fuse_net_rx_drain(&g_net_dev_tbl[i]);
             bcm_fuse_net_free_entry(g_net_dev_tbl[i].pdp_context_id);
             BNET_DEBUG(DBG_INFO,"%s: free g_net_dev_tbl[%d].cid:%d\n", __FUNCTION__, i, g_net_dev_tbl[i].pdp_context_id);
             break;
@@ -306,46 +420,27 @@ static int bcm_fuse_net_tx(struct sk_buff *skb, struct net_device *dev)
     void *buff_data_ptr;
     uint8_t pdp_cid = BCM_NET_MAX_PDP_CNTXS;
     PACKET_BufHandle_t buffer;
-    net_drvr_info_t *ndrvr_info_ptr = NULL; //consider for multiple case??
-    int i;
-
-        for (i = 0; i < BCM_NET_MAX_PDP_CNTXS; i++)
-        {
-            if (g_net_dev_tbl[i].dev_ptr == dev)
-            {
-                ndrvr_info_ptr = &g_net_dev_tbl[i];
-                BNET_DEBUG(DBG_TRACE,"%s: g_net_dev_tbl[%d]=0x%x \n", __FUNCTION__, i, (unsigned int)(&g_net_dev_tbl[i]));
-                break;
-            }
-        
-    }
-
-    if (NULL == ndrvr_info_ptr)
-    {
-	BNET_DEBUG(DBG_ERROR,"bcm_fuse_net_tx(), no device found\n");
-        return(-EINVAL);
-    }
+    net_drvr_info_t *ndrvr_info_ptr = *(net_drvr_info_t **)netdev_priv(dev);
 
     if (BCM_NET_MAX_DATA_LEN < skb->len) 
     {
         BNET_DEBUG(DBG_ERROR,"%s: len[%d] exceeds supported len[%d] failed\n", __FUNCTION__, skb->len, BCM_NET_MAX_DATA_LEN);
         ndrvr_info_ptr->stats.tx_errors++;
-        return(-1);
+        goto TX_DROP;
     }
 
     if(0 == skb->len)
     {
         BNET_DEBUG(DBG_ERROR,"%s: len[%d] is zero size failed\n", __FUNCTION__, skb->len);
-        return(-1);
+        goto TX_DROP;
     }
 
-    //pdp_cid = 1;
     pdp_cid = bcm_fuse_net_pdp_id(ndrvr_info_ptr);
     if (BCM_NET_INVALID_PDP_CNTX == pdp_cid)
     {
         BNET_DEBUG(DBG_ERROR,"%s: net device to pdp context id mapping failed\n", __FUNCTION__);
         ndrvr_info_ptr->stats.tx_errors++;
-        return(-1);
+        goto TX_DROP;
     }
 
     //Allocate a buffer
@@ -353,8 +448,8 @@ static int bcm_fuse_net_tx(struct sk_buff *skb, struct net_device *dev)
     if(!buffer) 
     {
         BNET_DEBUG(DBG_ERROR,"%s: Error buffer Handle cid %d\n", __FUNCTION__, pdp_cid);
-        ndrvr_info_ptr->stats.tx_errors++;
-        return(-ENOBUFS);
+        ndrvr_info_ptr->stats.tx_dropped++;
+        goto TX_DROP;
     }
 
     //transfer data from skb to ipc_buffer
@@ -362,12 +457,17 @@ static int bcm_fuse_net_tx(struct sk_buff *skb, struct net_device *dev)
     if (buff_data_ptr == NULL)
     {
         BNET_DEBUG(DBG_ERROR,"%s: RPC_PACKET_GetBufferData() failed\n", __FUNCTION__);
+        RPC_PACKET_FreeBuffer(buffer);
         ndrvr_info_ptr->stats.tx_errors++;
-        return(-ENOBUFS);
+        goto TX_DROP;
     }
 
-    memset(buff_data_ptr, 0, BCM_NET_MAX_DATA_LEN);
-    memcpy(buff_data_ptr, skb->data, skb->len);
+    /**
+      IPC buffers live in the memory shared with the CP, so the payload has
+      to be copied; only skb->len bytes are written, the CP reads no further
+      than the length set below.
+    */
+    skb_copy_bits(skb, 0, buff_data_ptr, skb->len);
 
     RPC_PACKET_SetBufferLength(buffer, skb->len);
 
@@ -387,24 +487,17 @@ static int bcm_fuse_net_tx(struct sk_buff *skb, struct net_device *dev)
 
     wake_lock_timeout(&knet_wake_lock, msecs_to_jiffies(g_bcmnet_wake_time));
 
-    return(0);
+    return NETDEV_TX_OK;
+
+TX_DROP:
+    dev_kfree_skb(skb);
+    return NETDEV_TX_OK;
 }
 
 
 static struct net_device_stats *bcm_fuse_net_stats(struct net_device *dev)
 {
-    net_drvr_info_t *ndrvr_info_ptr = NULL;
-    int i;
-
-    for (i = 0; i < BCM_NET_MAX_PDP_CNTXS; i++)
-    {
-       if (g_net_dev_tbl[i].dev_ptr == dev)
-       {
-           ndrvr_info_ptr = &g_net_dev_tbl[i];
-           //BNET_DEBUG(DBG_INFO,"%s: g_net_dev_tbl[%d]=0x%x \n", __FUNCTION__, i, &g_net_dev_tbl[i]);
-           break;
-       }
-    }
+    net_drvr_info_t *ndrvr_info_ptr = *(net_drvr_info_t **)netdev_priv(dev);
 
     return(&ndrvr_info_ptr->stats);
 }
@@ -473,7 +566,7 @@ static int bcm_fuse_net_attach(unsigned int dev_index)
 
     spin_lock_irqsave(&g_dev_lock, flags);
 
-    //dev_ptr->priv = &g_net_dev_tbl[dev_index]; //from kernel 2.6.29
+    *(net_drvr_info_t **)netdev_priv(dev_ptr) = &g_net_dev_tbl[dev_index];
     g_net_dev_tbl[dev_index].dev_ptr = dev_ptr;
     g_net_dev_tbl[dev_index].entry_stat = EFree;
     g_net_dev_tbl[dev_index].pdp_context_id = BCM_NET_MAX_PDP_CNTXS;
@@ -482,6 +575,9 @@ static int bcm_fuse_net_attach(unsigned int dev_index)
 
     spin_unlock_irqrestore(&g_dev_lock, flags);
 
+    spin_lock_init(&g_net_dev_tbl[dev_index].rx_lock);
+    netif_napi_add(dev_ptr, &g_net_dev_tbl[dev_index].napi, bcm_fuse_net_poll, BCM_NET_NAPI_WEIGHT);
+
     if ((ret = register_netdev(dev_ptr)) != 0)
     {
         BNET_DEBUG(DBG_ERROR,"%s: Error [%d] registering device \"%s\"\n", __FUNCTION__, ret, BCM_NET_DEV_STR);
@@ -14,6 +14,10 @@ the GPL, without Broadcom's express prior written consent.
 #include <linux/broadcom/bmem_wrapper.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/rbtree.h>
+#include <linux/math64.h>
+#include <linux/cma.h>
+#include <asm/cacheflush.h>
 #include "linux/delay.h"
 #include "linux/sched.h"
 #include "asm/current.h"
@@ -22,7 +26,7 @@ the GPL, without Broadcom's express prior written consent.
 #include "bmem.h"
 
 #define BMEM_SW_MINOR 0
-#define BMEM_SW_MAJOR 1
+#define BMEM_SW_MAJOR 2
 #define BMEM_SW_BUILD ((BMEM_SW_MAJOR * 1000) + BMEM_SW_MINOR)
 
 #define PAGE_SHIFT 12
@@ -60,7 +64,16 @@ MODULE_DESCRIPTION("Memory allocation");
 #define KLOG_D(x...) do {} while (0)
 #endif
 
+/*
+ * Every chunk of the carveout, free or used, is on the address ordered
+ * prev/next list (used for coalescing and for the full heap walks) and in
+ * addr_root (used to look a buffer up by its bus address). Free chunks are
+ * additionally kept in free_root, ordered by size and then address, so that
+ * the best fitting free chunk is found in O(log n).
+ */
 typedef struct _chunk{
+    struct rb_node addr_node;
+    struct rb_node free_node;
     unsigned int address;
 #ifdef BMEM_CHECK_OVERRUN
     void *virt_address;
@@ -70,6 +83,7 @@ typedef struct _chunk{
     pid_t pid;
     pid_t tgid;
     bool used;
+    unsigned int map_count;     /* user mappings, the buffer can't be freed */
     struct _chunk* prev;
     struct _chunk* next;
 } chunk;
@@ -77,6 +91,9 @@ typedef struct _chunk{
 static unsigned int openCounter = 1;
 static chunk* memhead = NULL;
 static chunk* memtail = NULL;
+static struct rb_root addr_root = RB_ROOT;
+static struct rb_root free_root = RB_ROOT;
+static struct kmem_cache *chunk_cache;
 static unsigned int chunk_threshold = SMALL_CHUNK_THRESHOLD;
 static unsigned int debug_level = 0;
 static unsigned int stat_level = 0;
@@ -95,6 +112,164 @@ static int bmem_GetFreeMemorySize(void);
 static int bmem_GetUsedMemoryByTgid(pid_t tgid);
 static int FreeMemoryForHandle(BMEM_HDL hdl );
 static void CheckFragmentation(int OnStatus);
+#ifdef BMEM_CHECK_OVERRUN
+static void bmem_check_overrun(chunk* free_hdl);
+#endif
+
+static void bmem_addr_insert(chunk *c)
+{
+    struct rb_node **p = &addr_root.rb_node;
+    struct rb_node *parent = NULL;
+    chunk *entry;
+
+    while (*p) {
+        parent = *p;
+        entry = rb_entry(parent, chunk, addr_node);
+        if (c->address < entry->address)
+            p = &(*p)->rb_left;
+        else
+            p = &(*p)->rb_right;
+    }
+    rb_link_node(&c->addr_node, parent, p);
+    rb_insert_color(&c->addr_node, &addr_root);
+}
+
+static chunk *bmem_addr_search(unsigned int address)
+{
+    struct rb_node *n = addr_root.rb_node;
+    chunk *entry;
+
+    while (n) {
+        entry = rb_entry(n, chunk, addr_node);
+        if (address < entry->address)
+            n = n->rb_left;
+        else if (address > entry->address)
+            n = n->rb_right;
+        else
+            return entry;
+    }
+    return NULL;
+}
+
+static void bmem_free_insert(chunk *c)
+{
+    struct rb_node **p = &free_root.rb_node;
+    struct rb_node *parent = NULL;
+    chunk *entry;
+
+    while (*p) {
+        parent = *p;
+        entry = rb_entry(parent, chunk, free_node);
+        if (c->size < entry->size ||
+            (c->size == entry->size && c->address < entry->address))
+            p = &(*p)->rb_left;
+        else
+            p = &(*p)->rb_right;
+    }
+    rb_link_node(&c->free_node, parent, p);
+    rb_insert_color(&c->free_node, &free_root);
+}
+
+/*
+ * Smallest free chunk that can hold size bytes, lowest address first among
+ * equally sized ones.
+ */
+static chunk *bmem_best_fit(unsigned int size)
+{
+    struct rb_node *n = free_root.rb_node;
+    chunk *entry, *best = NULL;
+
+    while (n) {
+        entry = rb_entry(n, chunk, free_node);
+        if (entry->size >= size) {
+            best = entry;
+            n = n->rb_left;
+        } else {
+            n = n->rb_right;
+        }
+    }
+    return best;
+}
+
+/*
+ * Unlink victim, which has just been merged into a neighbour, from the
+ * chunk list and the address tree.
+ */
+static void bmem_chunk_remove(chunk *victim)
+{
+    if (victim->prev)
+        victim->prev->next = victim->next;
+    else
+        memhead = victim->next;
+    if (victim->next)
+        victim->next->prev = victim->prev;
+    else
+        memtail = victim->prev;
+    rb_erase(&victim->addr_node, &addr_root);
+    kmem_cache_free(chunk_cache, victim);
+}
+
+/*
+ * The pool is shared with the page allocator (CONFIG_CMA), take the pages
+ * of a buffer back before handing it out. Their previous users may have
+ * left dirty lines in the kernel mapping, write them back now rather than
+ * on top of what the hardware puts in the buffer.
+ */
+static int bmem_claim(unsigned int address, unsigned int size)
+{
+#ifdef CONFIG_CMA
+    void *virt = phys_to_virt(address);
+#endif
+    int ret;
+
+    ret = cma_claim(address, size);
+    if (ret) {
+        printk(KERN_ERR "bmem: addr[0x%08x] size[%d] still in use by the system (%d)\n",
+            address, size, ret);
+        return ret;
+    }
+#ifdef CONFIG_CMA
+    dmac_flush_range(virt, virt + size);
+    outer_flush_range(address, address + size);
+#endif
+    return 0;
+}
+
+/*
+ * Return a used chunk to the free tree, merging it with free neighbours.
+ * Returns the resulting free chunk.
+ */
+static chunk *bmem_release_chunk(chunk *head)
+{
+    chunk *prev = head->prev;
+    chunk *next = head->next;
+
+    cma_release(head->address, head->size);
+    head->used = false;
+    head->handle = 0;
+    head->pid = 0;
+    head->tgid = 0;
+    bmem_status.total_used_space -= head->size;
+    bmem_status.total_free_space += head->size;
+    bmem_status.num_buf_used -= 1;
+    bmem_status.num_buf_free += 1;
+
+    if (prev && !prev->used) {
+        rb_erase(&prev->free_node, &free_root);
+        prev->size += head->size;
+        bmem_chunk_remove(head);
+        bmem_status.num_buf_free -= 1;
+        head = prev;
+    }
+    if (next && !next->used) {
+        rb_erase(&next->free_node, &free_root);
+        head->size += next->size;
+        bmem_chunk_remove(next);
+        bmem_status.num_buf_free -= 1;
+    }
+    bmem_free_insert(head);
+    return head;
+}
 
 
 /*
@@ -128,36 +303,77 @@ static int bmem_release(BMEM_HDL hdl)
  * Description : mmap() callback function which will be called by wrapper when the
  *        physical buffer has to be mapped. Wrapper will call this function to identify
  *        whether the physical address is already allocated.
+ *        On success the mapping holds a reference on the buffer, dropped with put().
  */
 static int bmem_mmap(unsigned long size, unsigned long pgoff)
 {
 
-    chunk* head = memhead;
-    while(head != NULL)
-    {
+    chunk* head = bmem_addr_search(pgoff << PAGE_SHIFT);
+
+    /* free chunks are lent to the page allocator, never map them */
+    if ((head == NULL) || !head->used) {
+        return -1;
+    }
 #ifdef BMEM_CHECK_OVERRUN
-        if (((head->address>> PAGE_SHIFT) == pgoff ) && (size == (head->size - PAGE_SIZE)))
+    if (size != (head->size - PAGE_SIZE))
 #else
-        if (((head->address>> PAGE_SHIFT) == pgoff ) && (size == head->size))
+    if (size != head->size)
 #endif
-        {
-            break;
-        }
-        head = head->next;
-    }
-    if(head == NULL){
+    {
         return -1;
     }
 
+    head->map_count++;
     return 0;
 }
 
+/*
+ * bmem_get()
+ * Description : Take another mapping reference on an allocated buffer, for a vma
+ *        that was copied or split from one that holds a reference.
+ */
+static int bmem_get(unsigned long busaddr)
+{
+    chunk* head = bmem_addr_search(busaddr);
+
+    if ((head == NULL) || !head->used) {
+        return -1;
+    }
+    head->map_count++;
+    return 0;
+}
+
+/*
+ * bmem_put()
+ * Description : Drop a mapping reference. A buffer whose owner closed its handle
+ *        while it was still mapped (handle 0) is freed with its last mapping.
+ */
+static void bmem_put(unsigned long busaddr)
+{
+    chunk* head = bmem_addr_search(busaddr);
+
+    if ((head == NULL) || !head->used || !head->map_count) {
+        printk(KERN_ERR "bmem put: addr[0x%08x] is not mapped", (unsigned int)busaddr);
+        return;
+    }
+    if (--head->map_count || head->handle) {
+        return;
+    }
+#ifdef BMEM_CHECK_OVERRUN
+    bmem_check_overrun(head);
+#endif
+    bmem_release_chunk(head);
+    CheckFragmentation(0);
+}
+
 static struct bmem_logic bmem_fops = {
     .AllocMemory = bmem_AllocMemory,
     .FreeMemory = bmem_FreeMemory,
     .open = bmem_open,
     .release = bmem_release,
     .mmap = bmem_mmap,
+    .get = bmem_get,
+    .put = bmem_put,
     .init = bmem_logic_init,
     .cleanup = NULL,
     .GetStatus = bmem_GetStatus,
@@ -177,9 +393,16 @@ int bmem_init(void)
     printk(KERN_DEBUG "bmem_init\n");
     printk(KERN_INFO "bmem sw build: %d \n", BMEM_SW_BUILD);
 
+    chunk_cache = kmem_cache_create("bmem_chunk", sizeof(chunk), 0, 0, NULL);
+    if (chunk_cache == NULL) {
+        printk(KERN_ERR "bmem: chunk cache creation failed\n");
+        return -ENOMEM;
+    }
+
     result = register_bmem_wrapper(&bmem_fops);
     if (result < 0) {
         printk(KERN_ERR "bmem: module not inserted\n");
+        kmem_cache_destroy(chunk_cache);
         return result;
     }
 
@@ -199,9 +422,9 @@ static int bmem_logic_init(unsigned int memory_size,
                 unsigned int phy_start_address)
 #endif
 {
-    memhead = kmalloc(sizeof(chunk),GFP_KERNEL);
+    memhead = kmem_cache_alloc(chunk_cache, GFP_KERNEL);
     if (memhead == NULL) {
-        printk(KERN_ERR "bmem_logic_init: kmalloc failed. bmem driver cannot work\n");
+        printk(KERN_ERR "bmem_logic_init: chunk alloc failed. bmem driver cannot work\n");
         return -1;
     }
     memtail = memhead;
@@ -219,6 +442,10 @@ static int bmem_logic_init(unsigned int memory_size,
     memhead->tgid = 0;
     memhead->prev = NULL;
     memhead->next = NULL;
+    addr_root = RB_ROOT;
+    free_root = RB_ROOT;
+    bmem_addr_insert(memhead);
+    bmem_free_insert(memhead);
     chunk_threshold = SMALL_CHUNK_THRESHOLD;
     stat_level = 0;
 #ifdef BMEM_CHECK_OVERRUN
@@ -246,11 +473,14 @@ void bmem_cleanup(void)
     {
         temp = head;
         head = head->next;
-        kfree(temp);
+        kmem_cache_free(chunk_cache, temp);
     }
     memhead = NULL;
     memtail = NULL;
+    addr_root = RB_ROOT;
+    free_root = RB_ROOT;
     deregister_bmem_wrapper();
+    kmem_cache_destroy(chunk_cache);
 
     printk(KERN_NOTICE "bmem: module removed\n");
 
@@ -262,14 +492,18 @@ module_exit(bmem_cleanup);
 
 /*
  * bmem_AllocMemory()
- * Description : Core allocator routine which will cycle through the buffers we have,
- *        divide the first free buffer which satisfies the size requirement and marks
- *        allocated
+ * Description : Core allocator routine which will pick the smallest free buffer which
+ *        satisfies the size requirement, divide it and mark the piece allocated.
+ *        Small requests are carved from the top of the free buffer and big ones from
+ *        its bottom, so that short lived small buffers do not end up in between
+ *        the big ones.
  */
 static int bmem_AllocMemory(BMEM_HDL hdl, unsigned long *busaddr,
             unsigned int size)
 {
-    chunk* curr = memhead;
+    chunk* curr;
+    chunk* temp = NULL;
+    unsigned int address;
     int direction = 0;
     pid_t pid = current->pid;
     pid_t tgid = current->tgid;
@@ -281,86 +515,86 @@ static int bmem_AllocMemory(BMEM_HDL hdl, unsigned long *busaddr,
 #endif
     if (size <= chunk_threshold) {
         direction = 1;
-        curr = memtail;
     }
 
     *busaddr = 0;
 
-    do
-    {
-        if (curr->used == false)
-        {
-            if(curr->size > size)
-            {
-                chunk* temp = kmalloc(sizeof(chunk),GFP_KERNEL);
-                if (temp == NULL) {
-                    printk(KERN_ERR "bmem_AllocMemory: kmalloc failed. \n");
-                    break;
-                }
-                temp->next = curr->next;
-                temp->prev = curr;
-                curr->next = temp;
-                if (direction == 0) {
-                    temp->address = curr->address + size;
+    curr = bmem_best_fit(size);
+    if (curr == NULL) {
+        goto out;
+    }
+
+    if (curr->size != size) {
+        temp = kmem_cache_alloc(chunk_cache, GFP_KERNEL);
+        if (temp == NULL) {
+            printk(KERN_ERR "bmem_AllocMemory: chunk alloc failed. \n");
+            goto out;
+        }
+    }
+    if (direction == 0) {
+        address = curr->address;
+    } else {
+        address = curr->address + (curr->size - size);
+    }
+    if (bmem_claim(address, size)) {
+        if (temp) {
+            kmem_cache_free(chunk_cache, temp);
+        }
+        goto out;
+    }
+
+    if (temp == NULL) {
+        rb_erase(&curr->free_node, &free_root);
+        bmem_status.num_buf_free -= 1;
+        temp = curr;
+    } else {
+        rb_erase(&curr->free_node, &free_root);
+        temp->next = curr->next;
+        temp->prev = curr;
+        curr->next = temp;
+        if(temp->next) {
+            temp->next->prev = temp;
+        } else {
+            memtail = temp;
+        }
+        if (direction == 0) {
+            /* bottom part is allocated, the remainder stays free */
+            temp->address = curr->address + size;
 #ifdef BMEM_CHECK_OVERRUN
-                    temp->virt_address = curr->virt_address + size;
-                    virt_addr = curr->virt_address;
+            temp->virt_address = curr->virt_address + size;
 #endif
-                    temp->size = curr->size - size;
-                    temp->used = false;
-                    temp->handle = 0;
-                    temp->pid = 0;
-                    temp->tgid = 0;
-                    curr->size = size;
-                    curr->used = true;
-                    curr->handle = (unsigned int)hdl;
-                    curr->pid = pid;
-                    curr->tgid = tgid;
-                    *busaddr = (unsigned long) curr->address;
-                } else {
-                    temp->address = curr->address + (curr->size - size);
+            temp->size = curr->size - size;
+            temp->used = false;
+            temp->handle = 0;
+            temp->pid = 0;
+            temp->tgid = 0;
+            curr->size = size;
+            bmem_addr_insert(temp);
+            bmem_free_insert(temp);
+            temp = curr;
+        } else {
+            /* top part is allocated, the remainder stays free */
+            temp->address = curr->address + (curr->size - size);
 #ifdef BMEM_CHECK_OVERRUN
-                    temp->virt_address = curr->virt_address + (curr->size - size);
-                    virt_addr = temp->virt_address;
+            temp->virt_address = curr->virt_address + (curr->size - size);
 #endif
-                    temp->size = size;
-                    temp->used = true;
-                    temp->handle = (unsigned int)hdl;
-                    temp->pid = pid;
-                    temp->tgid = tgid;
-                    curr->size = curr->size - size;
-                    curr->used = false;
-                    curr->handle = 0;
-                    curr->pid = 0;
-                    curr->tgid = 0;
-                    *busaddr = (unsigned long) temp->address;
-                }
-                if(temp->next) {
-                    temp->next->prev = temp;
-                } else {
-                    memtail = temp;
-                }
-                break;
-            } else if(curr->size == size) {
-                curr->used = true;
-                curr->handle = (unsigned int)hdl;
-                curr->pid = pid;
-                curr->tgid = tgid;
-                *busaddr = (unsigned long) curr->address;
+            temp->size = size;
+            curr->size = curr->size - size;
+            bmem_addr_insert(temp);
+            bmem_free_insert(curr);
+        }
+    }
+    temp->used = true;
+    temp->map_count = 0;
+    temp->handle = (unsigned int)hdl;
+    temp->pid = pid;
+    temp->tgid = tgid;
+    *busaddr = (unsigned long) temp->address;
 #ifdef BMEM_CHECK_OVERRUN
-                virt_addr = curr->virt_address;
+    virt_addr = temp->virt_address;
 #endif
-                bmem_status.num_buf_free -= 1;
-                break;
-            }
-        }
-        if (direction == 0) {
-            curr = curr->next;
-        } else {
-            curr = curr->prev;
-        }
-    }while(curr != 0);
 
+out:
     if (*busaddr == 0) {
         bmem_status.alloc_fail_cnt++;
 #ifdef PRINT_BMEM_HEAP_LIST_ON_ERROR
@@ -443,71 +677,32 @@ static void bmem_check_overrun(chunk* free_hdl)
  */
 static int bmem_FreeMemory(BMEM_HDL hdl, unsigned long *busaddr)
 {
-    chunk* head = memhead;
+    chunk* head;
     int address = *busaddr;
-    unsigned int freed_space = 0;
     pid_t pid = -1;
     pid_t tgid = -1;
 
-    while(head != NULL) {
-        if ( head->address == address) {
+    head = bmem_addr_search(address);
+    if ((head == NULL) || !head->used) {
+        bmem_status.free_fail_cnt++;
+        return -1;
+    }
 #ifdef BMEM_CHECK_OVERRUN
-            bmem_check_overrun(head);
+    bmem_check_overrun(head);
 #endif
-            break;
-        }
-        head = head->next;
+    if (head->handle != (unsigned int)hdl) {
+        printk (KERN_ERR "bmem free: handle[%d] pid[%d] tgid[%d] addr[0x%08x] does not match owner handle[%d]",
+            (unsigned int)hdl, head->pid, head->tgid, address, head->handle);
     }
-    if(head != NULL) {
-        if (head->handle != (unsigned int)hdl) {
-            printk (KERN_ERR "bmem free: handle[%d] pid[%d] tgid[%d] addr[0x%08x] does not match owner handle[%d]",
-                (unsigned int)hdl, head->pid, head->tgid, (int)busaddr, head->handle);
-        }
-        pid = head->pid;
-        tgid = head->tgid;
-        head->used = false;
+    pid = head->pid;
+    tgid = head->tgid;
+    if (head->map_count) {
+        /* the pages go back to the page allocator, so wait for the last bmem_put() */
         head->handle = 0;
-        head->pid = 0;
-        head->tgid = 0;
-        bmem_status.total_used_space -= head->size;
-        bmem_status.total_free_space += head->size;
-        bmem_status.num_buf_free += 1;
-        freed_space += head->size;
-        if(head->prev != NULL ) {
-            if(head->prev->used == false){
-                chunk* prev = head->prev;
-                prev->next = head->next;
-                if(head->next) {
-                    head->next->prev = prev;
-                } else {
-                    memtail = prev;
-                }
-                prev->size += head->size;
-                bmem_status.num_buf_free -= 1;
-                kfree(head);
-                head = prev;
-            }
-        }
-        if(head->next != NULL ) {
-            if(head->next->used == false) {
-                chunk* next = head->next;
-                head->next = next->next;
-                head->size += next->size;
-                if(next->next) {
-                    next->next->prev = head;
-                } else {
-                    memtail = head;
-                }
-                bmem_status.num_buf_free -= 1;
-                kfree(next);
-            }
-        }
     } else {
-        bmem_status.free_fail_cnt++;
-        return -1;
+        bmem_release_chunk(head);
     }
 
-    bmem_status.num_buf_used -= 1;
     bmem_status.free_pass_cnt++;
     bmem_status.max_num_buf_free = MAX(bmem_status.num_buf_free,bmem_status.max_num_buf_free);
     if (debug_level >= DBG_PRN_ALLOC) {
@@ -526,61 +721,24 @@ static int bmem_FreeMemory(BMEM_HDL hdl, unsigned long *busaddr)
 static int FreeMemoryForHandle(BMEM_HDL hdl )
 {
     chunk* head = memhead;
-    unsigned int freed_space = 0;
-    pid_t pid = -1;
-    pid_t tgid = -1;
 
     while(head != NULL)
     {
-        if ( head->handle == (unsigned int)hdl) {
-            pid = head->pid;
-            tgid = head->tgid;
-            head->used = false;
-            head->handle = 0;
-            head->pid = 0;
-            head->tgid = 0;
-
-#ifdef BMEM_CHECK_OVERRUN
-            bmem_check_overrun(head);
-#endif
-            bmem_status.total_used_space -= head->size;
-            bmem_status.total_free_space += head->size;
-            bmem_status.num_buf_used -= 1;
-            bmem_status.num_buf_free += 1;
-            freed_space += head->size;
+        if (head->used && (head->handle == (unsigned int)hdl)) {
             if (debug_level >= DBG_PRN_ALLOC) {
                  KLOG_D("Free(On Close) Handle[%d] pid[%d] tgid[%d] addr[0x%08x] ",
-                    (unsigned int)hdl, pid, tgid, head->address);
-            }
-            if(head->prev != NULL ) {
-                if(head->prev->used == false) {
-                    chunk* prev = head->prev;
-                    prev->next = head->next;
-                    if(head->next) {
-                        head->next->prev = prev;
-                    } else {
-                        memtail = prev;
-                    }
-                    prev->size += head->size;
-                    bmem_status.num_buf_free -= 1;
-                    kfree(head);
-                    head = prev;
-                }
+                    (unsigned int)hdl, head->pid, head->tgid, head->address);
             }
-            if(head->next != NULL ) {
-                if(head->next->used == false) {
-                    chunk* next = head->next;
-                    head->next = next->next;
-                    head->size += next->size;
-                    if(next->next) {
-                        next->next->prev = head;
-                    } else {
-                        memtail = head;
-                    }
-                    bmem_status.num_buf_free -= 1;
-                    kfree(next);
-                }
+            if (head->map_count) {
+                /* still mapped elsewhere, freed by the last bmem_put() */
+                head->handle = 0;
+                head = head->next;
+                continue;
             }
+#ifdef BMEM_CHECK_OVERRUN
+            bmem_check_overrun(head);
+#endif
+            head = bmem_release_chunk(head);
             bmem_status.max_num_buf_free = MAX(bmem_status.num_buf_free,bmem_status.max_num_buf_free);
         }
         head = head->next;
@@ -618,54 +776,55 @@ static int bmem_GetUsedMemoryByTgid(pid_t tgid)
 }
 
 /*
- * GetAvailMemStatus()
- * Description : Routine to identify biggest and smallest continuous free space available
- *        in the heap. Used for collecting fragmenatation statistics. Based on debug/stat level,
- *        this function will print the entire heap status as well.
+ * CheckFragmentation()
+ * Description : Routine to update the biggest and smallest continuous free space
+ *        available in the heap and the fragmentation metric, both read off the free
+ *        tree. Based on debug/stat level, this function will print the entire heap
+ *        status as well.
+ *        frag_percent is the share of the free space which cannot be handed out as
+ *        a single buffer: 0 when all free memory is contiguous, close to 100 when it
+ *        is scattered in small holes.
  */
 static void CheckFragmentation(int OnStatus)
 {
     chunk* curr = memhead;
-    unsigned int biggest_chunk_avlbl = 0;
-    unsigned int smallest_chunk_avlbl = 0x7FFFFFFF;
-    unsigned int print_heap, run_loop = 0;;
+    struct rb_node *n;
+    unsigned int print_heap;
 
     if (OnStatus) {
         print_heap = (stat_level >= STAT_PRN_HEAP);
     }else {
         print_heap = (debug_level >= DBG_PRN_HEAP);
     }
-    if ((debug_level >= DBG_PRN_FRAG) || (stat_level >= STAT_FRAG_CHECK)) {
-        run_loop = 1;
-    }
-    if (run_loop) {
-        if (print_heap) {
-            KLOG_D("memhead[0x%08x] addr[0x%08x], memtail[0x%08x] addr[0x%08x]",
-                (unsigned int)memhead, memhead->address, (unsigned int)memtail, memtail->address);
-        }
+    if (print_heap) {
+        KLOG_D("memhead[0x%08x] addr[0x%08x], memtail[0x%08x] addr[0x%08x]",
+            (unsigned int)memhead, memhead->address, (unsigned int)memtail, memtail->address);
         while(curr != NULL)
         {
-            if (print_heap) {
-                KLOG_D("CURRENT[0x%08x] : addr[0x%08x] size[%d] used[%d] hdl[%d] pid[%d] tgid[%d]",
-                    (unsigned int)curr, (unsigned int)curr->address, curr->size, (unsigned int)curr->used,
-                    curr->handle, curr->pid, curr->tgid);
-            }
-            if (!curr->used)
-            {
-                biggest_chunk_avlbl = MAX(biggest_chunk_avlbl, curr->size);
-                smallest_chunk_avlbl = MIN(smallest_chunk_avlbl, curr->size);
-            }
+            KLOG_D("CURRENT[0x%08x] : addr[0x%08x] size[%d] used[%d] hdl[%d] pid[%d] tgid[%d]",
+                (unsigned int)curr, (unsigned int)curr->address, curr->size, (unsigned int)curr->used,
+                curr->handle, curr->pid, curr->tgid);
             curr = curr->next;
         }
-        bmem_status.biggest_chunk_avlbl = biggest_chunk_avlbl;
-        bmem_status.smallest_chunk_avlbl = smallest_chunk_avlbl;
-        bmem_status.max_fragmented_size = MAX(bmem_status.max_fragmented_size,
-            (bmem_status.total_free_space - bmem_status.biggest_chunk_avlbl));
-        if (debug_level >= DBG_PRN_FRAG) {
-            KLOG_D("Frag Size[%d] : free space[%d] biggest free chunk[%d]",
-                (bmem_status.total_free_space - bmem_status.biggest_chunk_avlbl),
-                bmem_status.total_free_space, bmem_status.biggest_chunk_avlbl);
-        }
+    }
+
+    n = rb_last(&free_root);
+    bmem_status.biggest_chunk_avlbl = n ? rb_entry(n, chunk, free_node)->size : 0;
+    n = rb_first(&free_root);
+    bmem_status.smallest_chunk_avlbl = n ? rb_entry(n, chunk, free_node)->size : 0x7FFFFFFF;
+    bmem_status.max_fragmented_size = MAX(bmem_status.max_fragmented_size,
+        (bmem_status.total_free_space - bmem_status.biggest_chunk_avlbl));
+    if (bmem_status.total_free_space) {
+        bmem_status.frag_percent = 100 - div_u64((u64)bmem_status.biggest_chunk_avlbl * 100,
+            bmem_status.total_free_space);
+    } else {
+        bmem_status.frag_percent = 0;
+    }
+    if (debug_level >= DBG_PRN_FRAG) {
+        KLOG_D("Frag Size[%d] : free space[%d] biggest free chunk[%d] frag[%d%%]",
+            (bmem_status.total_free_space - bmem_status.biggest_chunk_avlbl),
+            bmem_status.total_free_space, bmem_status.biggest_chunk_avlbl,
+            bmem_status.frag_percent);
     }
 }
 
@@ -14,6 +14,8 @@ the GPL, without Broadcom's express prior written consent.
 #include <linux/broadcom/bcm_gememalloc_wrapper.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/cma.h>
+#include <asm/cacheflush.h>
 
 #include <cfg_global.h>
 /* Our header */
@@ -152,6 +154,18 @@ void gememalloc_cleanup(void)
 module_init(gememalloc_init);
 module_exit(gememalloc_cleanup);
 
+/* The pool may be lent to the page allocator, see mm/cma.c */
+static int ClaimMemory(unsigned int address, unsigned int size)
+{
+	if (cma_claim(address, size))
+		return -1;
+#ifdef CONFIG_CMA
+	dmac_flush_range(phys_to_virt(address), phys_to_virt(address) + size);
+	outer_flush_range(address, address + size);
+#endif
+	return 0;
+}
+
 /* Cycle through the buffers we have, give the first free one */
 static int AllocateMemory(GEMEMALLOC_HDL hdl, unsigned long *busaddr,
 			unsigned int size)
@@ -159,14 +173,28 @@ static int AllocateMemory(GEMEMALLOC_HDL hdl, unsigned long *busaddr,
 
     chunk* curr = memhead;
 	*busaddr = 0;
+	size = PAGE_ALIGN(size);
 
     do
     {
-        if (curr->used == false)
+        if (curr->used == false && curr->size >= size)
         {
+            if (ClaimMemory(curr->address, size))
+            {
+                /* pinned pages in this one, try the next free buffer */
+                printk(KERN_ERR "GEMEMALLOC: 0x%08x still in use by the system\n",
+                       curr->address);
+                curr = curr->next;
+                continue;
+            }
             if(curr->size > size)
             {
                 chunk* temp = kmalloc(sizeof(chunk),GFP_KERNEL);
+                if (!temp)
+                {
+                    cma_release(curr->address, size);
+                    break;
+                }
                 temp->next = curr->next;
                 temp->prev = curr;
                 curr->next = temp;
@@ -216,6 +244,7 @@ static int FreeMemoryForHandle(GEMEMALLOC_HDL hdl )
         {
 			chunk* prev = head->prev;
 			chunk* next = head->next;
+			cma_release(head->address, head->size);
 			head->used = false;
 			head->handle = 0;
 
@@ -275,6 +304,7 @@ static int FreeMemory(GEMEMALLOC_HDL hdl, unsigned long *busaddr)
     }
     if(head != NULL)
 		{
+		cma_release(head->address, head->size);
 		head->used = false;
 		head->handle = 0;
 		if(head->prev != NULL )
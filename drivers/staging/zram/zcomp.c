@@ -0,0 +1,280 @@
+/*
+ * Compression stream pool for zram
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/err.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+
+#include "zcomp.h"
+#include "zcomp_lzo.h"
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+#include "zcomp_lz4.h"
+#endif
+#ifdef CONFIG_ZRAM_CRYPTO_COMPRESS
+#include "zcomp_crypto.h"
+#endif
+
+static struct zcomp_backend *backends[] = {
+	&zcomp_lzo,
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+	&zcomp_lz4,
+#endif
+	NULL
+};
+
+static struct zcomp_backend *find_backend(const char *compress)
+{
+	int i = 0;
+	while (backends[i]) {
+		if (sysfs_streq(compress, backends[i]->name))
+			break;
+		i++;
+	}
+	if (backends[i])
+		return backends[i];
+#ifdef CONFIG_ZRAM_CRYPTO_COMPRESS
+	if (zcomp_crypto_available(compress))
+		return &zcomp_crypto;
+#endif
+	return NULL;
+}
+
+static void zcomp_strm_free(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	if (zstrm->private)
+		comp->backend->destroy(zstrm->private);
+	free_pages((unsigned long)zstrm->buffer, 1);
+	kfree(zstrm);
+}
+
+/*
+ * Allocate a new stream. The compression buffer is two pages
+ * because a compressor may emit more than PAGE_SIZE bytes for
+ * incompressible input.
+ */
+static struct zcomp_strm *zcomp_strm_alloc(struct zcomp *comp, gfp_t flags)
+{
+	struct zcomp_strm *zstrm = kmalloc(sizeof(*zstrm), flags);
+	if (!zstrm)
+		return NULL;
+
+	zstrm->private = comp->backend->create(comp->name, flags);
+	zstrm->buffer = (void *)__get_free_pages(flags | __GFP_ZERO, 1);
+	if (!zstrm->private || !zstrm->buffer) {
+		zcomp_strm_free(comp, zstrm);
+		return NULL;
+	}
+	return zstrm;
+}
+
+/*
+ * Get an idle stream or allocate a new one. Sleeps when the pool is
+ * at max_strm and every stream is busy, or when memory is too tight
+ * to allocate another one; there is always at least one stream.
+ */
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	while (1) {
+		spin_lock(&comp->strm_lock);
+		if (!list_empty(&comp->idle_strm)) {
+			zstrm = list_entry(comp->idle_strm.next,
+					struct zcomp_strm, list);
+			list_del(&zstrm->list);
+			spin_unlock(&comp->strm_lock);
+			return zstrm;
+		}
+		/* zstrm can't be allocated, wait for an idle one */
+		if (comp->avail_strm >= comp->max_strm) {
+			spin_unlock(&comp->strm_lock);
+			wait_event(comp->strm_wait,
+					!list_empty(&comp->idle_strm));
+			continue;
+		}
+		/* allocate a new zstrm stream */
+		comp->avail_strm++;
+		spin_unlock(&comp->strm_lock);
+
+		/* We are on the swap-out path, so don't recurse into I/O */
+		zstrm = zcomp_strm_alloc(comp, GFP_NOIO | __GFP_NOWARN);
+		if (zstrm)
+			break;
+
+		spin_lock(&comp->strm_lock);
+		comp->avail_strm--;
+		spin_unlock(&comp->strm_lock);
+		wait_event(comp->strm_wait, !list_empty(&comp->idle_strm));
+	}
+	return zstrm;
+}
+
+/* put back or destroy zcomp_strm */
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	spin_lock(&comp->strm_lock);
+	if (comp->avail_strm <= comp->max_strm) {
+		list_add(&zstrm->list, &comp->idle_strm);
+		spin_unlock(&comp->strm_lock);
+		wake_up(&comp->strm_wait);
+		return;
+	}
+
+	comp->avail_strm--;
+	spin_unlock(&comp->strm_lock);
+	zcomp_strm_free(comp, zstrm);
+}
+
+/* change max_strm limit, freeing idle streams above the new limit */
+int zcomp_set_max_streams(struct zcomp *comp, int num_strm)
+{
+	struct zcomp_strm *zstrm;
+
+	if (num_strm < 1)
+		return -EINVAL;
+
+	spin_lock(&comp->strm_lock);
+	comp->max_strm = num_strm;
+	while (comp->avail_strm > num_strm &&
+			!list_empty(&comp->idle_strm)) {
+		zstrm = list_entry(comp->idle_strm.next,
+				struct zcomp_strm, list);
+		list_del(&zstrm->list);
+		comp->avail_strm--;
+		spin_unlock(&comp->strm_lock);
+		zcomp_strm_free(comp, zstrm);
+		spin_lock(&comp->strm_lock);
+	}
+	spin_unlock(&comp->strm_lock);
+	return 0;
+}
+
+/*
+ * Compress one page from src into zstrm->buffer; the compressed
+ * length is returned in dst_len.
+ */
+int zcomp_compress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t *dst_len)
+{
+	return comp->backend->compress(src, zstrm->buffer, dst_len,
+			zstrm->private);
+}
+
+/*
+ * Most backends decompress without working memory, so readers only
+ * take a stream, which may sleep, when the backend needs one. Call
+ * this before entering atomic context and pass the result on to
+ * zcomp_decompress() and zcomp_decompress_end().
+ */
+struct zcomp_strm *zcomp_decompress_begin(struct zcomp *comp)
+{
+	if (!comp->backend->stateful_decompress)
+		return NULL;
+	return zcomp_strm_find(comp);
+}
+
+void zcomp_decompress_end(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	if (zstrm)
+		zcomp_strm_release(comp, zstrm);
+}
+
+int zcomp_decompress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t src_len, unsigned char *dst)
+{
+	return comp->backend->decompress(src, src_len, dst,
+			zstrm ? zstrm->private : NULL);
+}
+
+/* show available compressors, with the selected one in brackets */
+ssize_t zcomp_available_show(const char *comp, char *buf)
+{
+	bool known = false;
+	ssize_t sz = 0;
+	int i = 0;
+
+	while (backends[i]) {
+		if (!strcmp(comp, backends[i]->name)) {
+			known = true;
+			sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+					"[%s] ", backends[i]->name);
+		} else {
+			sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+					"%s ", backends[i]->name);
+		}
+		i++;
+	}
+	/* a crypto API algorithm has been selected */
+	if (!known)
+		sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2, "[%s] ", comp);
+	sz += scnprintf(buf + sz, PAGE_SIZE - sz, "\n");
+	return sz;
+}
+
+bool zcomp_available_algorithm(const char *comp)
+{
+	return find_backend(comp) != NULL;
+}
+
+void zcomp_destroy(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	while (!list_empty(&comp->idle_strm)) {
+		zstrm = list_entry(comp->idle_strm.next,
+				struct zcomp_strm, list);
+		list_del(&zstrm->list);
+		zcomp_strm_free(comp, zstrm);
+	}
+	kfree(comp);
+}
+
+/*
+ * Create a stream pool for the 'compress' algorithm with room for
+ * max_strm concurrent writers.
+ * One stream is allocated up front so that a writer can always make
+ * progress, even when no memory is left for additional streams.
+ */
+struct zcomp *zcomp_create(const char *compress, int max_strm)
+{
+	struct zcomp *comp;
+	struct zcomp_backend *backend;
+	struct zcomp_strm *zstrm;
+
+	backend = find_backend(compress);
+	if (!backend)
+		return ERR_PTR(-EINVAL);
+
+	comp = kmalloc(sizeof(*comp), GFP_KERNEL);
+	if (!comp)
+		return ERR_PTR(-ENOMEM);
+
+	comp->backend = backend;
+	strlcpy(comp->name, compress, sizeof(comp->name));
+
+	spin_lock_init(&comp->strm_lock);
+	INIT_LIST_HEAD(&comp->idle_strm);
+	init_waitqueue_head(&comp->strm_wait);
+	comp->max_strm = max_strm;
+
+	zstrm = zcomp_strm_alloc(comp, GFP_KERNEL);
+	if (!zstrm) {
+		kfree(comp);
+		return ERR_PTR(-ENOMEM);
+	}
+	list_add(&zstrm->list, &comp->idle_strm);
+	comp->avail_strm = 1;
+
+	return comp;
+}
@@ -0,0 +1,91 @@
+/*
+ * Compression stream pool for zram
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZCOMP_H_
+#define _ZCOMP_H_
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+/* Long enough for any crypto API algorithm name */
+#define ZCOMP_NAME_LEN 64
+
+struct zcomp_strm {
+	/* compression/decompression buffer */
+	void *buffer;
+	/* compressor working memory */
+	void *private;
+	/* used in the idle stream list */
+	struct list_head list;
+};
+
+/* static compression backend */
+struct zcomp_backend {
+	int (*compress)(const unsigned char *src, unsigned char *dst,
+			size_t *dst_len, void *private);
+
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, void *private);
+
+	void *(*create)(const char *name, gfp_t flags);
+	void (*destroy)(void *private);
+
+	/*
+	 * decompress() uses the stream's private data, so a reader must
+	 * hold a stream too. Otherwise decompress() is passed NULL and
+	 * readers never touch the stream pool.
+	 */
+	bool stateful_decompress;
+
+	const char *name;
+};
+
+/*
+ * A pool of compression streams. A writer grabs an idle stream, or
+ * allocates a new one while fewer than max_strm exist, or sleeps
+ * until some other writer releases one.
+ */
+struct zcomp {
+	spinlock_t strm_lock;
+	/* list of idle streams */
+	struct list_head idle_strm;
+	/* number of allocated (idle + busy) streams */
+	int avail_strm;
+	/* upper bound on avail_strm */
+	int max_strm;
+	wait_queue_head_t strm_wait;
+
+	struct zcomp_backend *backend;
+	/* algorithm name, which differs from backend->name for crypto */
+	char name[ZCOMP_NAME_LEN];
+};
+
+ssize_t zcomp_available_show(const char *comp, char *buf);
+bool zcomp_available_algorithm(const char *comp);
+
+struct zcomp *zcomp_create(const char *comp, int max_strm);
+void zcomp_destroy(struct zcomp *comp);
+
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp);
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm);
+int zcomp_set_max_streams(struct zcomp *comp, int num_strm);
+
+int zcomp_compress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t *dst_len);
+
+struct zcomp_strm *zcomp_decompress_begin(struct zcomp *comp);
+void zcomp_decompress_end(struct zcomp *comp, struct zcomp_strm *zstrm);
+int zcomp_decompress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t src_len, unsigned char *dst);
+
+#endif /* _ZCOMP_H_ */
@@ -0,0 +1,82 @@
+/*
+ * Crypto API compression backend for zram
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#include <linux/kernel.h>
+#include <linux/err.h>
+#include <linux/crypto.h>
+
+#include "zcomp_crypto.h"
+
+/*
+ * Any compression algorithm registered with the crypto API ("deflate",
+ * ...) can back a zram device. A crypto_comp transform keeps state
+ * for decompression as well, so every stream owns its own tfm.
+ */
+static void *zcomp_crypto_create(const char *name, gfp_t flags)
+{
+	struct crypto_comp *tfm;
+
+	/*
+	 * crypto_alloc_comp() has no gfp argument and always allocates
+	 * with GFP_KERNEL. Extra streams are created on the swap-out
+	 * path with GFP_NOIO, so refuse those; zcomp_strm_find() then
+	 * waits for an idle stream, and the first one is created at
+	 * init time where GFP_KERNEL is fine.
+	 */
+	if ((flags & GFP_KERNEL) != GFP_KERNEL)
+		return NULL;
+
+	tfm = crypto_alloc_comp(name, 0, 0);
+
+	return IS_ERR(tfm) ? NULL : tfm;
+}
+
+static void zcomp_crypto_destroy(void *private)
+{
+	crypto_free_comp(private);
+}
+
+static int zcomp_crypto_compress(const unsigned char *src, unsigned char *dst,
+		size_t *dst_len, void *private)
+{
+	/* zcomp stream buffers are two pages long */
+	unsigned int dlen = 2 * PAGE_SIZE;
+	int ret;
+
+	ret = crypto_comp_compress(private, src, PAGE_SIZE, dst, &dlen);
+	*dst_len = dlen;
+	return ret;
+}
+
+static int zcomp_crypto_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, void *private)
+{
+	unsigned int dlen = PAGE_SIZE;
+	int ret;
+
+	ret = crypto_comp_decompress(private, src, src_len, dst, &dlen);
+	if (!ret && dlen != PAGE_SIZE)
+		ret = -EINVAL;
+	return ret;
+}
+
+bool zcomp_crypto_available(const char *name)
+{
+	return crypto_has_comp(name, 0, 0);
+}
+
+struct zcomp_backend zcomp_crypto = {
+	.compress = zcomp_crypto_compress,
+	.decompress = zcomp_crypto_decompress,
+	.create = zcomp_crypto_create,
+	.destroy = zcomp_crypto_destroy,
+	.stateful_decompress = true,
+	.name = "crypto",
+};
@@ -0,0 +1,48 @@
+/*
+ * LZO compression backend for zram
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/lzo.h>
+
+#include "zcomp_lzo.h"
+
+static void *zcomp_lzo_create(const char *name, gfp_t flags)
+{
+	return kzalloc(LZO1X_MEM_COMPRESS, flags);
+}
+
+static void zcomp_lzo_destroy(void *private)
+{
+	kfree(private);
+}
+
+static int zcomp_lzo_compress(const unsigned char *src, unsigned char *dst,
+		size_t *dst_len, void *private)
+{
+	int ret = lzo1x_1_compress(src, PAGE_SIZE, dst, dst_len, private);
+	return ret == LZO_E_OK ? 0 : ret;
+}
+
+static int zcomp_lzo_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, void *private)
+{
+	size_t dst_len = PAGE_SIZE;
+	int ret = lzo1x_decompress_safe(src, src_len, dst, &dst_len);
+	return ret == LZO_E_OK ? 0 : ret;
+}
+
+struct zcomp_backend zcomp_lzo = {
+	.compress = zcomp_lzo_compress,
+	.decompress = zcomp_lzo_decompress,
+	.create = zcomp_lzo_create,
+	.destroy = zcomp_lzo_destroy,
+	.name = "lzo",
+};
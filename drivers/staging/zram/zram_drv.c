@@ -23,14 +23,15 @@
 #include <linux/kernel.h>
 #include <linux/bio.h>
 #include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
+#include <linux/err.h>
 #include <linux/vmalloc.h>
 #include <linux/ratelimit.h>
 
@@ -46,6 +47,8 @@ static struct zram *zram_devices;
  */
 #define ALLOC_ERROR_LOG_RATE_MS 1000
 
+static const char *default_compressor = "lzo";
+
 /* Module params (documentation at end) */
 static unsigned int num_devices = 1;
 
@@ -111,7 +114,17 @@ static ssize_t zero_pages_show(struct device *dev,
 {
 	struct zram *zram = dev_to_zram(dev);
 
-	return sprintf(buf, "%u\n", zram->stats.pages_zero);
+	return sprintf(buf, "%llu\n",
+			(u64)atomic64_read(&zram->stats.pages_zero));
+}
+
+static ssize_t same_pages_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+			(u64)atomic64_read(&zram->stats.pages_same));
 }
 
 static ssize_t orig_data_size_show(struct device *dev,
@@ -120,7 +133,7 @@ static ssize_t orig_data_size_show(struct device *dev,
 	struct zram *zram = dev_to_zram(dev);
 
 	return sprintf(buf, "%llu\n",
-		(u64)(zram->stats.pages_stored) << PAGE_SHIFT);
+		(u64)atomic64_read(&zram->stats.pages_stored) << PAGE_SHIFT);
 }
 
 static ssize_t compr_data_size_show(struct device *dev,
@@ -147,22 +160,128 @@ static ssize_t mem_used_total_show(struct device *dev,
 	return sprintf(buf, "%llu\n", val);
 }
 
+static ssize_t max_comp_streams_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	int val;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	val = zram->max_comp_streams;
+	up_read(&zram->init_lock);
+
+	return sprintf(buf, "%d\n", val);
+}
+
+static ssize_t max_comp_streams_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned long num;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = strict_strtoul(buf, 10, &num);
+	if (ret)
+		return ret;
+
+	if (num < 1 || num > INT_MAX)
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		ret = zcomp_set_max_streams(zram->comp, num);
+		if (ret) {
+			up_write(&zram->init_lock);
+			return ret;
+		}
+	}
+	zram->max_comp_streams = num;
+	up_write(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t comp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	size_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	sz = zcomp_available_show(zram->compressor, buf);
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+static ssize_t comp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	char compressor[ZCOMP_NAME_LEN];
+	struct zram *zram = dev_to_zram(dev);
+
+	strlcpy(compressor, buf, sizeof(compressor));
+	/* ignore trailing newline */
+	strim(compressor);
+
+	if (!zcomp_available_algorithm(compressor))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change algorithm for initialized device\n");
+		return -EBUSY;
+	}
+	strlcpy(zram->compressor, compressor, sizeof(zram->compressor));
+	up_write(&zram->init_lock);
+	return len;
+}
+
+/*
+ * Per-slot locking: ZRAM_ACCESS in table[index].value is a bit
+ * spinlock protecting the handle, size and flags of that slot, so
+ * that I/O to different indices never contends.
+ */
+static void zram_lock_slot(struct zram_meta *meta, u32 index)
+{
+	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+}
+
+static void zram_unlock_slot(struct zram_meta *meta, u32 index)
+{
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+}
+
 static int zram_test_flag(struct zram_meta *meta, u32 index,
 			enum zram_pageflags flag)
 {
-	return meta->table[index].flags & BIT(flag);
+	return meta->table[index].value & BIT(flag);
 }
 
 static void zram_set_flag(struct zram_meta *meta, u32 index,
 			enum zram_pageflags flag)
 {
-	meta->table[index].flags |= BIT(flag);
+	meta->table[index].value |= BIT(flag);
 }
 
 static void zram_clear_flag(struct zram_meta *meta, u32 index,
 			enum zram_pageflags flag)
 {
-	meta->table[index].flags &= ~BIT(flag);
+	meta->table[index].value &= ~BIT(flag);
+}
+
+static size_t zram_get_obj_size(struct zram_meta *meta, u32 index)
+{
+	return meta->table[index].value & (BIT(ZRAM_FLAG_SHIFT) - 1);
+}
+
+static void zram_set_obj_size(struct zram_meta *meta,
+					u32 index, size_t size)
+{
+	unsigned long flags = meta->table[index].value >> ZRAM_FLAG_SHIFT;
+
+	meta->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
 }
 
 static inline int is_partial_io(struct bio_vec *bvec)
@@ -197,8 +316,6 @@ static inline int valid_io_request(struct zram *zram, struct bio *bio)
 static void zram_meta_free(struct zram_meta *meta)
 {
 	zs_destroy_pool(meta->mem_pool);
-	kfree(meta->compress_workmem);
-	free_pages((unsigned long)meta->compress_buffer, 1);
 	vfree(meta->table);
 	kfree(meta);
 }
@@ -210,22 +327,11 @@ static struct zram_meta *zram_meta_alloc(u64 disksize)
 	if (!meta)
 		goto out;
 
-	meta->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!meta->compress_workmem)
-		goto free_meta;
-
-	meta->compress_buffer =
-		(void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
-	if (!meta->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		goto free_workmem;
-	}
-
 	num_pages = disksize >> PAGE_SHIFT;
 	meta->table = vmalloc(num_pages * sizeof(*meta->table));
 	if (!meta->table) {
 		pr_err("Error allocating zram address table\n");
-		goto free_buffer;
+		goto free_meta;
 	}
 	memset(meta->table, 0, num_pages * sizeof(*meta->table));
 
@@ -240,10 +346,6 @@ static struct zram_meta *zram_meta_alloc(u64 disksize)
 
 free_table:
 	vfree(meta->table);
-free_buffer:
-	free_pages((unsigned long)meta->compress_buffer, 1);
-free_workmem:
-	kfree(meta->compress_workmem);
 free_meta:
 	kfree(meta);
 	meta = NULL;
@@ -258,92 +360,283 @@ static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
 	*offset = (*offset + bvec->bv_len) % PAGE_SIZE;
 }
 
-static int page_zero_filled(void *ptr)
+/*
+ * Check whether the page is one word repeated, returning that word in
+ * 'element'. Comparing the last word first rejects most ordinary pages
+ * without walking them.
+ */
+static int page_same_filled(void *ptr, unsigned long *element)
 {
-	unsigned int pos;
+	unsigned int pos, last_pos = PAGE_SIZE / sizeof(unsigned long) - 1;
 	unsigned long *page;
+	unsigned long val;
 
 	page = (unsigned long *)ptr;
+	val = page[0];
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	if (val != page[last_pos])
+		return 0;
+
+	for (pos = 1; pos < last_pos; pos++) {
+		if (val != page[pos])
 			return 0;
 	}
 
+	*element = val;
 	return 1;
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+static void zram_fill_page(void *ptr, unsigned int len, unsigned long value)
+{
+	unsigned int i;
+	unsigned long *page = ptr;
+
+	if (likely(value == 0)) {
+		memset(ptr, 0, len);
+	} else {
+		for (i = 0; i < len / sizeof(*page); i++)
+			page[i] = value;
+	}
+}
+
+static void handle_same_page(struct bio_vec *bvec, unsigned long element)
 {
 	struct page *page = bvec->bv_page;
 	void *user_mem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	if (is_partial_io(bvec))
-		memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
-	else
-		clear_page(user_mem);
+	zram_fill_page(user_mem + bvec->bv_offset, bvec->bv_len, element);
 	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+static bool zram_wb_enabled(struct zram *zram)
+{
+	return zram->backing_dev != NULL;
+}
+
+static void reset_bdev(struct zram *zram)
+{
+	if (!zram_wb_enabled(zram))
+		return;
+
+	close_bdev_exclusive(zram->backing_dev, FMODE_READ | FMODE_WRITE);
+	zram->backing_dev = NULL;
+	kfree(zram->backing_dev_path);
+	zram->backing_dev_path = NULL;
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+	zram->nr_pages = 0;
+}
+
+static ssize_t backing_dev_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	ssize_t ret;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	if (!zram_wb_enabled(zram))
+		ret = sprintf(buf, "none\n");
+	else
+		ret = sprintf(buf, "%s\n", zram->backing_dev_path);
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	char *path;
+	struct block_device *bdev;
+	unsigned long nr_pages, *bitmap = NULL;
+	size_t bitmap_sz;
+	int err;
+	struct zram *zram = dev_to_zram(dev);
+
+	path = kstrndup(buf, PATH_MAX, GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+	/* ignore trailing newline */
+	strim(path);
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		pr_info("Can't setup backing device for initialized device\n");
+		err = -EBUSY;
+		goto out;
+	}
+
+	bdev = open_bdev_exclusive(path, FMODE_READ | FMODE_WRITE, zram);
+	if (IS_ERR(bdev)) {
+		err = PTR_ERR(bdev);
+		goto out;
+	}
+
+	nr_pages = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	/* block 0 is never allocated, it means "no block" */
+	if (nr_pages < 2) {
+		err = -EINVAL;
+		goto out_close;
+	}
+	bitmap_sz = BITS_TO_LONGS(nr_pages) * sizeof(long);
+	bitmap = vmalloc(bitmap_sz);
+	if (!bitmap) {
+		err = -ENOMEM;
+		goto out_close;
+	}
+	memset(bitmap, 0, bitmap_sz);
+
+	err = set_blocksize(bdev, PAGE_SIZE);
+	if (err)
+		goto out_close;
+
+	reset_bdev(zram);
+
+	zram->backing_dev = bdev;
+	zram->backing_dev_path = path;
+	zram->bitmap = bitmap;
+	zram->nr_pages = nr_pages;
+	up_write(&zram->init_lock);
+
+	pr_info("setup backing device %s\n", path);
+	return len;
+
+out_close:
+	vfree(bitmap);
+	close_bdev_exclusive(bdev, FMODE_READ | FMODE_WRITE);
+out:
+	up_write(&zram->init_lock);
+	kfree(path);
+	return err;
+}
+
+static unsigned long alloc_block_bdev(struct zram *zram)
+{
+	unsigned long blk_idx = 1;
+retry:
+	/* skip 0 bit to confuse zram.handle = 0 */
+	blk_idx = find_next_zero_bit(zram->bitmap, zram->nr_pages, blk_idx);
+	if (blk_idx == zram->nr_pages)
+		return 0;
+
+	if (test_and_set_bit(blk_idx, zram->bitmap))
+		goto retry;
+
+	atomic64_inc(&zram->stats.bd_count);
+	return blk_idx;
+}
+
+static void free_block_bdev(struct zram *zram, unsigned long blk_idx)
+{
+	int was_set;
+
+	was_set = test_and_clear_bit(blk_idx, zram->bitmap);
+	WARN_ON_ONCE(!was_set);
+	atomic64_dec(&zram->stats.bd_count);
+}
+#else
+static inline void reset_bdev(struct zram *zram) {};
+static inline void free_block_bdev(struct zram *zram, unsigned long blk_idx) {};
+#endif
+
+/*
+ * To protect concurrent access to the same index entry,
+ * caller should hold this table index entry's bit_spinlock to
+ * indicate this index entry is accessing.
+ */
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	struct zram_meta *meta = zram->meta;
 	unsigned long handle = meta->table[index].handle;
-	u16 size = meta->table[index].size;
+	size_t size = zram_get_obj_size(meta, index);
 
-	if (unlikely(!handle)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(meta, index, ZRAM_ZERO)) {
-			zram_clear_flag(meta, index, ZRAM_ZERO);
-			zram->stats.pages_zero--;
-		}
+	/* Any change of the slot cancels its idle state and writeback */
+	zram_clear_flag(meta, index, ZRAM_IDLE);
+	zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		zram_clear_flag(meta, index, ZRAM_WB);
+		free_block_bdev(zram, meta->table[index].element);
+		meta->table[index].element = 0;
 		return;
 	}
 
+	/*
+	 * No memory is allocated for same element filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(meta, index, ZRAM_SAME)) {
+		zram_clear_flag(meta, index, ZRAM_SAME);
+		if (!meta->table[index].element)
+			atomic64_dec(&zram->stats.pages_zero);
+		atomic64_dec(&zram->stats.pages_same);
+		meta->table[index].element = 0;
+		return;
+	}
+
+	if (unlikely(!handle))
+		return;
+
 	if (unlikely(size > max_zpage_size))
-		zram->stats.bad_compress--;
+		atomic64_dec(&zram->stats.bad_compress);
 
 	zs_free(meta->mem_pool, handle);
 
 	if (size <= PAGE_SIZE / 2)
-		zram->stats.good_compress--;
+		atomic64_dec(&zram->stats.good_compress);
 
-	atomic64_sub(meta->table[index].size, &zram->stats.compr_size);
-	zram->stats.pages_stored--;
+	atomic64_sub(size, &zram->stats.compr_size);
+	atomic64_dec(&zram->stats.pages_stored);
 
 	meta->table[index].handle = 0;
-	meta->table[index].size = 0;
+	zram_set_obj_size(meta, index, 0);
 }
 
-static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
+/*
+ * 'mem' may be a kmap_atomic() mapping, so the caller must have
+ * obtained 'zstrm' from zcomp_decompress_begin() beforehand.
+ */
+static int zram_decompress_page(struct zram *zram, struct zcomp_strm *zstrm,
+				char *mem, u32 index)
 {
-	int ret = LZO_E_OK;
-	size_t clen = PAGE_SIZE;
+	int ret = 0;
 	unsigned char *cmem;
 	struct zram_meta *meta = zram->meta;
-	unsigned long handle = meta->table[index].handle;
+	unsigned long handle;
+	size_t size;
 
-	if (!handle || zram_test_flag(meta, index, ZRAM_ZERO)) {
-		clear_page(mem);
+	zram_lock_slot(meta, index);
+	/* Written back meanwhile; the caller has to read the backing device */
+	if (unlikely(zram_test_flag(meta, index, ZRAM_WB))) {
+		zram_unlock_slot(meta, index);
+		return -EAGAIN;
+	}
+
+	handle = meta->table[index].handle;
+	size = zram_get_obj_size(meta, index);
+
+	if (!handle || zram_test_flag(meta, index, ZRAM_SAME)) {
+		unsigned long element = meta->table[index].element;
+
+		zram_unlock_slot(meta, index);
+		zram_fill_page(mem, PAGE_SIZE, element);
 		return 0;
 	}
 
 	cmem = zs_map_object(meta->mem_pool, handle, ZS_MM_RO);
-	if (meta->table[index].size == PAGE_SIZE)
+	if (size == PAGE_SIZE)
 		copy_page(mem, cmem);
 	else
-		ret = lzo1x_decompress_safe(cmem, meta->table[index].size,
-						mem, &clen);
+		ret = zcomp_decompress(zram->comp, zstrm, cmem, size, mem);
 	zs_unmap_object(meta->mem_pool, handle);
+	zram_unlock_slot(meta, index);
 
 	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
 		atomic64_inc(&zram->stats.failed_reads);
 		return ret;
@@ -352,25 +645,309 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	return 0;
 }
 
-static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
+#ifdef CONFIG_ZRAM_WRITEBACK
+static void zram_bdev_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+/* Synchronously read or write one page at block 'blk_idx' */
+static int zram_bdev_rw(struct zram *zram, struct page *page,
+			unsigned long blk_idx, int rw)
+{
+	struct completion done;
+	struct bio *bio;
+	int ret;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_sector = blk_idx * (PAGE_SIZE >> SECTOR_SHIFT);
+	bio->bi_bdev = zram->backing_dev;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	init_completion(&done);
+	bio->bi_private = &done;
+	bio->bi_end_io = zram_bdev_end_io;
+	submit_bio(rw, bio);
+	wait_for_completion(&done);
+
+	ret = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+
+	if (rw & WRITE)
+		atomic64_inc(&zram->stats.bd_writes);
+	else
+		atomic64_inc(&zram->stats.bd_reads);
+	return ret;
+}
+
+/*
+ * Read a written back slot into 'mem', which must not be an atomic
+ * mapping. Returns -EAGAIN if the slot is no longer on the backing
+ * device.
+ */
+static int zram_read_from_bdev(struct zram *zram, char *mem, u32 index)
+{
+	struct zram_meta *meta = zram->meta;
+	unsigned long blk_idx;
+	struct page *page;
+	void *src;
+	int ret;
+
+	zram_lock_slot(meta, index);
+	if (!zram_test_flag(meta, index, ZRAM_WB)) {
+		zram_unlock_slot(meta, index);
+		return -EAGAIN;
+	}
+	blk_idx = meta->table[index].element;
+	zram_unlock_slot(meta, index);
+
+	page = alloc_page(GFP_NOIO);
+	if (!page)
+		return -ENOMEM;
+
+	ret = zram_bdev_rw(zram, page, blk_idx, READ_SYNC);
+	if (!ret) {
+		src = kmap_atomic(page, KM_USER0);
+		memcpy(mem, src, PAGE_SIZE);
+		kunmap_atomic(src, KM_USER0);
+	}
+	__free_page(page);
+	return ret;
+}
+
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	unsigned long nr_pages, index;
+
+	if (!sysfs_streq(buf, "all"))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!zram->init_done) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		zram_lock_slot(meta, index);
+		if (meta->table[index].handle &&
+				!zram_test_flag(meta, index, ZRAM_SAME) &&
+				!zram_test_flag(meta, index, ZRAM_WB))
+			zram_set_flag(meta, index, ZRAM_IDLE);
+		zram_unlock_slot(meta, index);
+	}
+	up_read(&zram->init_lock);
+
+	return len;
+}
+
+#define HUGE_WRITEBACK 1
+#define IDLE_WRITEBACK 2
+
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	unsigned long nr_pages, index, blk_idx;
+	struct zcomp_strm *zstrm;
+	struct page *page;
+	void *mem;
+	ssize_t ret = len;
+	int mode, err;
+
+	if (sysfs_streq(buf, "idle"))
+		mode = IDLE_WRITEBACK;
+	else if (sysfs_streq(buf, "huge"))
+		mode = HUGE_WRITEBACK;
+	else
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!zram->init_done) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	if (!zram_wb_enabled(zram)) {
+		ret = -ENODEV;
+		goto release_init_lock;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		zram_lock_slot(meta, index);
+		if (!meta->table[index].handle ||
+				zram_test_flag(meta, index, ZRAM_SAME) ||
+				zram_test_flag(meta, index, ZRAM_WB) ||
+				zram_test_flag(meta, index, ZRAM_UNDER_WB))
+			goto next;
+		if (mode == IDLE_WRITEBACK &&
+				!zram_test_flag(meta, index, ZRAM_IDLE))
+			goto next;
+		if (mode == HUGE_WRITEBACK &&
+				zram_get_obj_size(meta, index) != PAGE_SIZE)
+			goto next;
+		/*
+		 * A write or free of the slot clears ZRAM_UNDER_WB, which
+		 * tells us below to drop the block we wrote.
+		 */
+		zram_set_flag(meta, index, ZRAM_UNDER_WB);
+		zram_unlock_slot(meta, index);
+
+		blk_idx = alloc_block_bdev(zram);
+		if (!blk_idx) {
+			ret = -ENOSPC;
+			zram_lock_slot(meta, index);
+			zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+			zram_unlock_slot(meta, index);
+			break;
+		}
+
+		zstrm = zcomp_decompress_begin(zram->comp);
+		mem = kmap_atomic(page, KM_USER0);
+		err = zram_decompress_page(zram, zstrm, mem, index);
+		kunmap_atomic(mem, KM_USER0);
+		zcomp_decompress_end(zram->comp, zstrm);
+
+		if (!err)
+			err = zram_bdev_rw(zram, page, blk_idx, WRITE_SYNC);
+
+		zram_lock_slot(meta, index);
+		/* The slot changed meanwhile; keep the new content in memory */
+		if (err || !zram_test_flag(meta, index, ZRAM_UNDER_WB) ||
+				(mode == IDLE_WRITEBACK &&
+				 !zram_test_flag(meta, index, ZRAM_IDLE))) {
+			zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+			zram_unlock_slot(meta, index);
+			free_block_bdev(zram, blk_idx);
+			if (err) {
+				ret = err;
+				break;
+			}
+			continue;
+		}
+
+		zram_free_page(zram, index);
+		zram_set_flag(meta, index, ZRAM_WB);
+		meta->table[index].element = blk_idx;
+next:
+		zram_unlock_slot(meta, index);
+	}
+
+	__free_page(page);
+release_init_lock:
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+static ssize_t bd_count_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+			(u64)atomic64_read(&zram->stats.bd_count));
+}
+
+static ssize_t bd_reads_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+			(u64)atomic64_read(&zram->stats.bd_reads));
+}
+
+static ssize_t bd_writes_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+			(u64)atomic64_read(&zram->stats.bd_writes));
+}
+#else
+static inline int zram_read_from_bdev(struct zram *zram, char *mem, u32 index)
+{
+	return -EIO;
+}
+#endif
+
+static int zram_bvec_read_from_bdev(struct zram *zram, struct bio_vec *bvec,
+				    u32 index, int offset)
+{
+	struct page *page = bvec->bv_page;
+	unsigned char *user_mem, *uncmem;
+	int ret;
+
+	uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
+	if (!uncmem)
+		return -ENOMEM;
+
+	ret = zram_read_from_bdev(zram, uncmem, index);
+	if (!ret) {
+		user_mem = kmap_atomic(page, KM_USER0);
+		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
+				bvec->bv_len);
+		kunmap_atomic(user_mem, KM_USER0);
+		flush_dcache_page(page);
+	}
+	kfree(uncmem);
+	return ret;
+}
+
+static int __zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 			  u32 index, int offset, struct bio *bio)
 {
 	int ret;
 	struct page *page;
 	unsigned char *user_mem, *uncmem = NULL;
 	struct zram_meta *meta = zram->meta;
+	struct zcomp_strm *zstrm;
 	page = bvec->bv_page;
 
+	zram_lock_slot(meta, index);
+	zram_clear_flag(meta, index, ZRAM_IDLE);
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		zram_unlock_slot(meta, index);
+		return zram_bvec_read_from_bdev(zram, bvec, index, offset);
+	}
+
 	if (unlikely(!meta->table[index].handle) ||
-			zram_test_flag(meta, index, ZRAM_ZERO)) {
-		handle_zero_page(bvec);
+			zram_test_flag(meta, index, ZRAM_SAME)) {
+		unsigned long element = meta->table[index].element;
+
+		zram_unlock_slot(meta, index);
+		handle_same_page(bvec, element);
 		return 0;
 	}
+	zram_unlock_slot(meta, index);
 
 	if (is_partial_io(bvec))
 		/* Use  a temporary buffer to decompress the page */
 		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
 
+	zstrm = zcomp_decompress_begin(zram->comp);
 	user_mem = kmap_atomic(page, KM_USER0);
 	if (!is_partial_io(bvec))
 		uncmem = user_mem;
@@ -381,9 +958,9 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 		goto out_cleanup;
 	}
 
-	ret = zram_decompress_page(zram, uncmem, index);
+	ret = zram_decompress_page(zram, zstrm, uncmem, index);
 	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK))
+	if (unlikely(ret))
 		goto out_cleanup;
 
 	if (is_partial_io(bvec))
@@ -394,11 +971,25 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	ret = 0;
 out_cleanup:
 	kunmap_atomic(user_mem, KM_USER0);
+	zcomp_decompress_end(zram->comp, zstrm);
 	if (is_partial_io(bvec))
 		kfree(uncmem);
 	return ret;
 }
 
+static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
+			  u32 index, int offset, struct bio *bio)
+{
+	int ret;
+
+	/* -EAGAIN: the slot was written back while we looked at it */
+	do {
+		ret = __zram_bvec_read(zram, bvec, index, offset, bio);
+	} while (ret == -EAGAIN);
+
+	return ret;
+}
+
 static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			   int offset)
 {
@@ -408,10 +999,11 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	struct page *page;
 	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
 	struct zram_meta *meta = zram->meta;
+	struct zcomp_strm *zstrm = NULL;
+	unsigned long element;
 	static unsigned long zram_rs_time;
 
 	page = bvec->bv_page;
-	src = meta->compress_buffer;
 
 	if (is_partial_io(bvec)) {
 		/*
@@ -423,11 +1015,17 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			ret = -ENOMEM;
 			goto out;
 		}
-		ret = zram_decompress_page(zram, uncmem, index);
+		zstrm = zcomp_decompress_begin(zram->comp);
+		ret = zram_decompress_page(zram, zstrm, uncmem, index);
+		zcomp_decompress_end(zram->comp, zstrm);
+		zstrm = NULL;
+		if (ret == -EAGAIN)
+			ret = zram_read_from_bdev(zram, uncmem, index);
 		if (ret)
 			goto out;
 	}
 
+	zstrm = zcomp_strm_find(zram->comp);
 	user_mem = kmap_atomic(page, KM_USER0);
 
 	if (is_partial_io(bvec)) {
@@ -439,27 +1037,24 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		uncmem = user_mem;
 	}
 
-	if (page_zero_filled(uncmem)) {
-		kunmap_atomic(user_mem, KM_USER0);
+	if (page_same_filled(uncmem, &element)) {
+		if (user_mem)
+			kunmap_atomic(user_mem, KM_USER0);
 		/* Free memory associated with this sector now. */
+		zram_lock_slot(meta, index);
 		zram_free_page(zram, index);
+		zram_set_flag(meta, index, ZRAM_SAME);
+		meta->table[index].element = element;
+		zram_unlock_slot(meta, index);
 
-		zram->stats.pages_zero++;
-		zram_set_flag(meta, index, ZRAM_ZERO);
+		atomic64_inc(&zram->stats.pages_same);
+		if (!element)
+			atomic64_inc(&zram->stats.pages_zero);
 		ret = 0;
 		goto out;
 	}
 
-	/*
-	 * zram_slot_free_notify could miss free so that let's
-	 * double check.
-	 */
-	if (unlikely(meta->table[index].handle ||
-			zram_test_flag(meta, index, ZRAM_ZERO)))
-		zram_free_page(zram, index);
-
-	ret = lzo1x_1_compress(uncmem, PAGE_SIZE, src, &clen,
-			       meta->compress_workmem);
+	ret = zcomp_compress(zram->comp, zstrm, uncmem, &clen);
 
 	if (!is_partial_io(bvec)) {
 		kunmap_atomic(user_mem, KM_USER0);
@@ -467,13 +1062,13 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		uncmem = NULL;
 	}
 
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Compression failed! err=%d\n", ret);
 		goto out;
 	}
 
+	src = zstrm->buffer;
 	if (unlikely(clen > max_zpage_size)) {
-		zram->stats.bad_compress++;
 		clen = PAGE_SIZE;
 		src = NULL;
 		if (is_partial_io(bvec))
@@ -499,24 +1094,32 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		memcpy(cmem, src, clen);
 	}
 
+	zcomp_strm_release(zram->comp, zstrm);
+	zstrm = NULL;
 	zs_unmap_object(meta->mem_pool, handle);
 
 	/*
 	 * Free memory associated with this sector
 	 * before overwriting unused sectors.
 	 */
+	zram_lock_slot(meta, index);
 	zram_free_page(zram, index);
 
 	meta->table[index].handle = handle;
-	meta->table[index].size = clen;
+	zram_set_obj_size(meta, index, clen);
+	zram_unlock_slot(meta, index);
 
 	/* Update stats */
 	atomic64_add(clen, &zram->stats.compr_size);
-	zram->stats.pages_stored++;
-	if (clen <= PAGE_SIZE / 2)
-		zram->stats.good_compress++;
+	atomic64_inc(&zram->stats.pages_stored);
+	if (clen == PAGE_SIZE)
+		atomic64_inc(&zram->stats.bad_compress);
+	else if (clen <= PAGE_SIZE / 2)
+		atomic64_inc(&zram->stats.good_compress);
 
 out:
+	if (zstrm)
+		zcomp_strm_release(zram->comp, zstrm);
 	if (is_partial_io(bvec))
 		kfree(uncmem);
 
@@ -525,36 +1128,15 @@ out:
 	return ret;
 }
 
-static void handle_pending_slot_free(struct zram *zram)
-{
-	struct zram_slot_free *free_rq;
-
-	spin_lock(&zram->slot_free_lock);
-	while (zram->slot_free_rq) {
-		free_rq = zram->slot_free_rq;
-		zram->slot_free_rq = free_rq->next;
-		zram_free_page(zram, free_rq->index);
-		kfree(free_rq);
-	}
-	spin_unlock(&zram->slot_free_lock);
-}
-
 static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 			int offset, struct bio *bio, int rw)
 {
 	int ret;
 
-	if (rw == READ) {
-		down_read(&zram->lock);
-		handle_pending_slot_free(zram);
+	if (rw == READ)
 		ret = zram_bvec_read(zram, bvec, index, offset, bio);
-		up_read(&zram->lock);
-	} else {
-		down_write(&zram->lock);
-		handle_pending_slot_free(zram);
+	else
 		ret = zram_bvec_write(zram, bvec, index, offset);
-		up_write(&zram->lock);
-	}
 
 	return ret;
 }
@@ -564,10 +1146,9 @@ static void zram_reset_device(struct zram *zram, bool reset_capacity)
 	size_t index;
 	struct zram_meta *meta;
 
-	flush_work(&zram->free_work);
-
 	down_write(&zram->init_lock);
 	if (!zram->init_done) {
+		reset_bdev(zram);
 		up_write(&zram->init_lock);
 		return;
 	}
@@ -578,14 +1159,18 @@ static void zram_reset_device(struct zram *zram, bool reset_capacity)
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
 		unsigned long handle = meta->table[index].handle;
-		if (!handle)
+		if (!handle || zram_test_flag(meta, index, ZRAM_SAME) ||
+				zram_test_flag(meta, index, ZRAM_WB))
 			continue;
 
 		zs_free(meta->mem_pool, handle);
 	}
 
+	zcomp_destroy(zram->comp);
+	zram->comp = NULL;
 	zram_meta_free(zram->meta);
 	zram->meta = NULL;
+	reset_bdev(zram);
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
@@ -595,7 +1180,8 @@ static void zram_reset_device(struct zram *zram, bool reset_capacity)
 	up_write(&zram->init_lock);
 }
 
-static void zram_init_device(struct zram *zram, struct zram_meta *meta)
+static void zram_init_device(struct zram *zram, struct zram_meta *meta,
+			     struct zcomp *comp)
 {
 	if (zram->disksize > 2 * (totalram_pages << PAGE_SHIFT)) {
 		pr_info(
@@ -615,6 +1201,7 @@ static void zram_init_device(struct zram *zram, struct zram_meta *meta)
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
 	zram->meta = meta;
+	zram->comp = comp;
 	zram->init_done = 1;
 
 	pr_debug("Initialization done!\n");
@@ -625,7 +1212,9 @@ static ssize_t disksize_store(struct device *dev,
 {
 	u64 disksize;
 	struct zram_meta *meta;
+	struct zcomp *comp;
 	struct zram *zram = dev_to_zram(dev);
+	int err;
 
 	disksize = memparse(buf, NULL);
 	if (!disksize)
@@ -633,20 +1222,35 @@ static ssize_t disksize_store(struct device *dev,
 
 	disksize = PAGE_ALIGN(disksize);
 	meta = zram_meta_alloc(disksize);
+	if (!meta)
+		return -ENOMEM;
+
 	down_write(&zram->init_lock);
 	if (zram->init_done) {
-		up_write(&zram->init_lock);
-		zram_meta_free(meta);
 		pr_info("Cannot change disksize for initialized device\n");
-		return -EBUSY;
+		err = -EBUSY;
+		goto out_free_meta;
+	}
+
+	comp = zcomp_create(zram->compressor, zram->max_comp_streams);
+	if (IS_ERR(comp)) {
+		pr_info("Cannot initialise %s compressing backend\n",
+				zram->compressor);
+		err = PTR_ERR(comp);
+		goto out_free_meta;
 	}
 
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
-	zram_init_device(zram, meta);
+	zram_init_device(zram, meta, comp);
 	up_write(&zram->init_lock);
 
 	return len;
+
+out_free_meta:
+	up_write(&zram->init_lock);
+	zram_meta_free(meta);
+	return err;
 }
 
 static ssize_t reset_store(struct device *dev,
@@ -761,40 +1365,19 @@ error:
 	return 0;
 }
 
-static void zram_slot_free(struct work_struct *work)
-{
-	struct zram *zram;
-
-	zram = container_of(work, struct zram, free_work);
-	down_write(&zram->lock);
-	handle_pending_slot_free(zram);
-	up_write(&zram->lock);
-}
-
-static void add_slot_free(struct zram *zram, struct zram_slot_free *free_rq)
-{
-	spin_lock(&zram->slot_free_lock);
-	free_rq->next = zram->slot_free_rq;
-	zram->slot_free_rq = free_rq;
-	spin_unlock(&zram->slot_free_lock);
-}
-
 static void zram_slot_free_notify(struct block_device *bdev,
 				unsigned long index)
 {
 	struct zram *zram;
-	struct zram_slot_free *free_rq;
+	struct zram_meta *meta;
 
 	zram = bdev->bd_disk->private_data;
-	atomic64_inc(&zram->stats.notify_free);
-
-	free_rq = kmalloc(sizeof(struct zram_slot_free), GFP_ATOMIC);
-	if (!free_rq)
-		return;
+	meta = zram->meta;
 
-	free_rq->index = index;
-	add_slot_free(zram, free_rq);
-	schedule_work(&zram->free_work);
+	zram_lock_slot(meta, index);
+	zram_free_page(zram, index);
+	zram_unlock_slot(meta, index);
+	atomic64_inc(&zram->stats.notify_free);
 }
 
 static const struct block_device_operations zram_devops = {
@@ -811,9 +1394,23 @@ static DEVICE_ATTR(num_writes, S_IRUGO, num_writes_show, NULL);
 static DEVICE_ATTR(invalid_io, S_IRUGO, invalid_io_show, NULL);
 static DEVICE_ATTR(notify_free, S_IRUGO, notify_free_show, NULL);
 static DEVICE_ATTR(zero_pages, S_IRUGO, zero_pages_show, NULL);
+static DEVICE_ATTR(same_pages, S_IRUGO, same_pages_show, NULL);
 static DEVICE_ATTR(orig_data_size, S_IRUGO, orig_data_size_show, NULL);
 static DEVICE_ATTR(compr_data_size, S_IRUGO, compr_data_size_show, NULL);
 static DEVICE_ATTR(mem_used_total, S_IRUGO, mem_used_total_show, NULL);
+static DEVICE_ATTR(max_comp_streams, S_IRUGO | S_IWUSR,
+		max_comp_streams_show, max_comp_streams_store);
+static DEVICE_ATTR(comp_algorithm, S_IRUGO | S_IWUSR,
+		comp_algorithm_show, comp_algorithm_store);
+#ifdef CONFIG_ZRAM_WRITEBACK
+static DEVICE_ATTR(backing_dev, S_IRUGO | S_IWUSR,
+		backing_dev_show, backing_dev_store);
+static DEVICE_ATTR(idle, S_IWUSR, NULL, idle_store);
+static DEVICE_ATTR(writeback, S_IWUSR, NULL, writeback_store);
+static DEVICE_ATTR(bd_count, S_IRUGO, bd_count_show, NULL);
+static DEVICE_ATTR(bd_reads, S_IRUGO, bd_reads_show, NULL);
+static DEVICE_ATTR(bd_writes, S_IRUGO, bd_writes_show, NULL);
+#endif
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
@@ -824,9 +1421,20 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_invalid_io.attr,
 	&dev_attr_notify_free.attr,
 	&dev_attr_zero_pages.attr,
+	&dev_attr_same_pages.attr,
 	&dev_attr_orig_data_size.attr,
 	&dev_attr_compr_data_size.attr,
 	&dev_attr_mem_used_total.attr,
+	&dev_attr_max_comp_streams.attr,
+	&dev_attr_comp_algorithm.attr,
+#ifdef CONFIG_ZRAM_WRITEBACK
+	&dev_attr_backing_dev.attr,
+	&dev_attr_idle.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_bd_count.attr,
+	&dev_attr_bd_reads.attr,
+	&dev_attr_bd_writes.attr,
+#endif
 	NULL,
 };
 
@@ -838,13 +1446,8 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = -ENOMEM;
 
-	init_rwsem(&zram->lock);
 	init_rwsem(&zram->init_lock);
 
-	INIT_WORK(&zram->free_work, zram_slot_free);
-	spin_lock_init(&zram->slot_free_lock);
-	zram->slot_free_rq = NULL;
-
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
 		pr_err("Error allocating disk queue for device %d\n",
@@ -893,6 +1496,8 @@ static int create_device(struct zram *zram, int device_id)
 	}
 
 	zram->init_done = 0;
+	zram->max_comp_streams = num_online_cpus();
+	strlcpy(zram->compressor, default_compressor, sizeof(zram->compressor));
 	return 0;
 
 out_free_disk:
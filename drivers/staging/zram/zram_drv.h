@@ -19,6 +19,7 @@
 #include <linux/mutex.h>
 
 #include "../zsmalloc/zsmalloc.h"
+#include "zcomp.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -51,10 +52,27 @@ static const size_t max_zpage_size = PAGE_SIZE / 10 * 9;
 #define ZRAM_SECTOR_PER_LOGICAL_BLOCK	\
 	(1 << (ZRAM_LOGICAL_BLOCK_SHIFT - SECTOR_SHIFT))
 
-/* Flags for zram pages (table[page_no].flags) */
+/*
+ * The lower ZRAM_FLAG_SHIFT bits of table.value hold the object size
+ * (excluding header); the higher bits hold the zram_pageflags.
+ */
+#define ZRAM_FLAG_SHIFT 24
+
+/* Flags for zram pages (table[page_no].value) */
 enum zram_pageflags {
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/*
+	 * Page consists entirely of one repeated word, which is kept in
+	 * table.element instead of a zsmalloc object.
+	 */
+	ZRAM_SAME = ZRAM_FLAG_SHIFT,
+	/* Slot lock bit, held while the table entry is read or changed */
+	ZRAM_ACCESS,
+	/* Page lives on the backing device, at block table.element */
+	ZRAM_WB,
+	/* Page is being written to the backing device */
+	ZRAM_UNDER_WB,
+	/* Page was not accessed since it was last marked idle */
+	ZRAM_IDLE,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -63,15 +81,16 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	unsigned long handle;
-	u16 size;	/* object size (excluding header) */
-	u8 count;	/* object ref count (not yet used) */
-	u8 flags;
-} __aligned(4);
+	union {
+		unsigned long handle;
+		unsigned long element;	/* ZRAM_SAME pattern or ZRAM_WB block */
+	};
+	unsigned long value;
+};
 
 /*
- * All 64bit fields should only be manipulated by 64bit atomic accessors.
- * All modifications to 32bit counter should be protected by zram->lock.
+ * All stats are updated without zram-wide locking, so every counter
+ * must only be manipulated by 64bit atomic accessors.
  */
 struct zram_stats {
 	atomic64_t compr_size;	/* compressed size of pages stored */
@@ -81,32 +100,26 @@ struct zram_stats {
 	atomic64_t failed_writes;	/* can happen when memory is too low */
 	atomic64_t invalid_io;	/* non-page-aligned I/O requests */
 	atomic64_t notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 bad_compress;	/* % of pages with compression ratio>=75% */
+	atomic64_t pages_zero;		/* no. of zero filled pages */
+	atomic64_t pages_same;		/* no. of same-filled pages, incl. zero */
+	atomic64_t pages_stored;	/* no. of pages currently stored */
+	atomic64_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic64_t bad_compress;	/* % of pages with compression ratio>=75% */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	atomic64_t bd_count;		/* no. of pages in backing device */
+	atomic64_t bd_reads;		/* no. of reads from backing device */
+	atomic64_t bd_writes;		/* no. of writes to backing device */
+#endif
 };
 
 struct zram_meta {
-	void *compress_workmem;
-	void *compress_buffer;
 	struct table *table;
 	struct zs_pool *mem_pool;
 };
 
-struct zram_slot_free {
-	unsigned long index;
-	struct zram_slot_free *next;
-};
-
 struct zram {
 	struct zram_meta *meta;
-	struct rw_semaphore lock; /* protect compression buffers, table,
-				   * 32bit stat counters against concurrent
-				   * notifications, reads and writes */
-
-	struct work_struct free_work;  /* handle pending free request */
-	struct zram_slot_free *slot_free_rq; /* list head of free request */
+	struct zcomp *comp;
 
 	struct request_queue *queue;
 	struct gendisk *disk;
@@ -118,7 +131,16 @@ struct zram {
 	 * we can store in a disk.
 	 */
 	u64 disksize;	/* bytes */
-	spinlock_t slot_free_lock;
+	int max_comp_streams;
+	char compressor[ZCOMP_NAME_LEN];
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* backing device for incompressible and idle pages */
+	struct block_device *backing_dev;
+	char *backing_dev_path;
+	/* allocated blocks of backing_dev, one bit per page */
+	unsigned long *bitmap;
+	unsigned long nr_pages;
+#endif
 
 	struct zram_stats stats;
 };
@@ -623,6 +623,7 @@ static void bmem_print_status(void)
 	KLOG_V("\t%-30s: %d ", "Smallest Buffer Available", bmem_status.smallest_chunk_avlbl);
 	KLOG_V("\t%-30s: %d ", "Max Num Holes occured", bmem_status.max_num_buf_free);
 	KLOG_V("\t%-30s: %d ", "Max Fragmented", bmem_status.max_fragmented_size);
+	KLOG_V("\t%-30s: %d ", "Fragmentation Percent", bmem_status.frag_percent);
 
 	KLOG_V("  %-30s: ", "Error Info");
 	KLOG_V("\t%-30s: %d ", "Allocate Failures", bmem_status.alloc_fail_cnt);
@@ -714,6 +715,7 @@ static int bmem_proc_get_status(char *page, char **start,
 	BMEM_PROC_PRINT_D("Smallest Buffer Available", bmem_status.smallest_chunk_avlbl);
 	BMEM_PROC_PRINT_D("Max Num Holes occured", bmem_status.max_num_buf_free);
 	BMEM_PROC_PRINT_D("Max Fragmented", bmem_status.max_fragmented_size);
+	BMEM_PROC_PRINT_D("Fragmentation Percent", bmem_status.frag_percent);
 
 	BMEM_PROC_PRINT_HDR("Error Info");
 	BMEM_PROC_PRINT_D("Allocate Failures", bmem_status.alloc_fail_cnt);
@@ -1432,6 +1434,34 @@ static int bmem_wrapper_release(struct inode *inode, struct file *filp)
 	return r;
 }
 
+/*
+ * bmem_vma_open() / bmem_vma_close()
+ * Description : Every vma mapping a buffer holds a reference on it, so that the
+ *		buffer is not freed (and its pages handed to the page allocator)
+ *		while user space can still reach it.
+ */
+static void bmem_vma_open(struct vm_area_struct *vma)
+{
+	unsigned long busaddr = (unsigned long)vma->vm_private_data;
+
+	down(&bmem_sem);
+	if (logic.get(busaddr))
+		KLOG_E("vma open for unallocated addr[0x%08x]", (int)busaddr);
+	up(&bmem_sem);
+}
+
+static void bmem_vma_close(struct vm_area_struct *vma)
+{
+	down(&bmem_sem);
+	logic.put((unsigned long)vma->vm_private_data);
+	up(&bmem_sem);
+}
+
+static const struct vm_operations_struct bmem_vm_ops = {
+	.open = bmem_vma_open,
+	.close = bmem_vma_close,
+};
+
 /*
  * bmem_wrapper_mmap()
  * Description : mmap() implementation of the bmem driver
@@ -1476,8 +1506,14 @@ static int bmem_wrapper_mmap(struct file *file,
 				    vma->vm_end - vma->vm_start, vma->vm_page_prot)) {
 			KLOG_E("acquire mmap failed: pgoff[0x%08x] virt[0x%08x] size[0x%08x]",
 				(int)vma->vm_pgoff, (int)vma->vm_start, (int)(vma->vm_end - vma->vm_start));
+			down(&bmem_sem);
+			logic.put(vma->vm_pgoff << PAGE_SHIFT);
+			up(&bmem_sem);
 			return -EAGAIN;
 		}
+		/* logic.mmap() took the reference, bmem_vma_close() drops it */
+		vma->vm_private_data = (void *)(vma->vm_pgoff << PAGE_SHIFT);
+		vma->vm_ops = &bmem_vm_ops;
 		KLOG_V("acquire mmap passed: pgoff[0x%08x] virt[0x%08x] size[0x%08x]",
 			(int)vma->vm_pgoff, (int)vma->vm_start, (int)(vma->vm_end - vma->vm_start));
 	} else if (is_mmap_for_pmem_interface(file, vma)) {
@@ -1530,15 +1566,27 @@ static int bmem_wrapper_mmap(struct file *file,
 			vma->vm_page_prot = pgprot_cached(vma->vm_page_prot);
 			KLOG_V("set page tables in cached mode \n");
 		}
+		down(&bmem_sem);
+		r = logic.get(busAddress);
+		up(&bmem_sem);
+		if (r) {
+			KLOG_E("pmem mmap of freed buffer: addr[0x%08x]", (int)busAddress);
+			return -EINVAL;
+		}
 		if (io_remap_pfn_range(vma,
 					vma->vm_start,
 					vma->vm_pgoff,
 					size, vma->vm_page_prot)) {
 			KLOG_E("pmem mmap failed: pgoff[0x%08x] virt[0x%08x] size[0x%08x]",
 				(int)vma->vm_pgoff, (int)vma->vm_start, (int)size);
+			down(&bmem_sem);
+			logic.put(busAddress);
+			up(&bmem_sem);
 			/* TODO: Free up allocated memory ??*/
 			return -EAGAIN;
 		}
+		vma->vm_private_data = (void *)busAddress;
+		vma->vm_ops = &bmem_vm_ops;
 		KLOG_V("pmem mmap passed: pgoff[0x%08x] virt[0x%08x] size[0x%08x]",
 			(int)vma->vm_pgoff, (int)vma->vm_start, (int)size);
 		r = 0;
@@ -30,6 +30,7 @@
 #include <linux/dma-mapping.h>
 #include <linux/ioport.h>
 #include <linux/list.h>
+#include <linux/mutex.h>
 /* for current pid */
 #include <linux/sched.h>
 
@@ -85,7 +86,8 @@ static int gememalloc_major = BCM_GEMEMALLOC_MAJOR;
 
 static struct list_head heap_list;
 
-static DEFINE_SPINLOCK(mem_lock);
+/* a mutex: claiming a buffer back from the page allocator sleeps */
+static DEFINE_MUTEX(mem_lock);
 
 static struct gememalloc_logic logic;
 
@@ -147,7 +149,7 @@ static int gememalloc_wrapper_ioctl(struct inode *inode, struct file *filp,
 
 			pr_debug(KERN_DEBUG
 				 "gememalloc_wrapper: ALLOC BUFFER\n");
-			spin_lock(&mem_lock);
+			mutex_lock(&mem_lock);
 
 			__copy_from_user(&memparams, (const void *)arg,
 					 sizeof(memparams));
@@ -160,7 +162,7 @@ static int gememalloc_wrapper_ioctl(struct inode *inode, struct file *filp,
 			__copy_to_user((void *)arg, &memparams,
 				       sizeof(memparams));
 
-			spin_unlock(&mem_lock);
+			mutex_unlock(&mem_lock);
 		}
 		break;
 	case GEMEMALLOC_WRAP_RELEASE_BUFFER:
@@ -169,11 +171,11 @@ static int gememalloc_wrapper_ioctl(struct inode *inode, struct file *filp,
 			unsigned long busaddr;
 			pr_debug(KERN_DEBUG
 				 "gememalloc_wrapper: RELEASE BUFFER\n");
-			spin_lock(&mem_lock);
+			mutex_lock(&mem_lock);
 			__get_user(busaddr, (unsigned long *)arg);
 			result = logic.FreeMemory(filp->private_data, &busaddr);
 
-			spin_unlock(&mem_lock);
+			mutex_unlock(&mem_lock);
 		}
 		break;
 	case GEMEMALLOC_WRAP_COPY_BUFFER:
@@ -273,9 +275,9 @@ static int gememalloc_wrapper_open(struct inode *inode, struct file *filp)
 {
 	int r;
 
-	spin_lock(&mem_lock);
+	mutex_lock(&mem_lock);
 	r = logic.open(&filp->private_data);
-	spin_unlock(&mem_lock);
+	mutex_unlock(&mem_lock);
 
 	pr_debug(KERN_DEBUG "gememalloc_wrapper_open\n");
 
@@ -287,10 +289,10 @@ static int gememalloc_wrapper_release(struct inode *inode, struct file *filp)
 
 	int r;
 
-	spin_lock(&mem_lock);
+	mutex_lock(&mem_lock);
 	r = logic.release(filp->private_data);
 	filp->private_data = NULL;
-	spin_unlock(&mem_lock);
+	mutex_unlock(&mem_lock);
 
 	pr_debug(KERN_DEBUG "gememalloc_wrapper_release\n");
 
@@ -889,8 +889,8 @@ static int de_thread(struct task_struct *tsk)
 		transfer_pid(leader, tsk, PIDTYPE_SID);
 
 		list_replace_rcu(&leader->tasks, &tsk->tasks);
-		delete_from_adj_tree(leader);
-		add_2_adj_tree(tsk);
+		lowmem_adj_del(leader);
+		lowmem_adj_add(tsk);
 		list_replace_init(&leader->sibling, &tsk->sibling);
 
 		tsk->group_leader = tsk;
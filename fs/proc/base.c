@@ -1047,12 +1047,10 @@ static ssize_t oom_adjust_write(struct file *file, const char __user *buf,
 	}
 
 	task->signal->oom_adj = oom_adjust;
+	lowmem_adj_update(task);
 
 	unlock_task_sighand(task, &flags);
 	put_task_struct(task);
-	
-	delete_from_adj_tree(task);
-	add_2_adj_tree(task);
 
 	return count;
 }
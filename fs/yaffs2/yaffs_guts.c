@@ -1099,18 +1099,22 @@ static void yaffs_SoftDeleteFile(yaffs_Object *obj)
 	    obj->variantType == YAFFS_OBJECT_TYPE_FILE && !obj->softDeleted) {
 		if (obj->nDataChunks <= 0) {
 			/* Empty file with no duplicate object headers, just delete it immediately */
+			yaffs_LockObjectData(obj);
 			yaffs_FreeTnode(obj->myDev,
 					obj->variant.fileVariant.top);
 			obj->variant.fileVariant.top = NULL;
+			yaffs_UnlockObjectData(obj);
 			T(YAFFS_TRACE_TRACING,
 			  (TSTR("yaffs: Deleting empty file %d" TENDSTR),
 			   obj->objectId));
 			yaffs_DoGenericObjectDeletion(obj);
 		} else {
+			yaffs_LockObjectData(obj);
 			yaffs_SoftDeleteWorker(obj,
 					       obj->variant.fileVariant.top,
 					       obj->variant.fileVariant.
 					       topLevel, 0);
+			yaffs_UnlockObjectData(obj);
 			obj->softDeleted = 1;
 		}
 	}
@@ -1235,6 +1239,7 @@ static yaffs_Object *yaffs_AllocateEmptyObject(yaffs_Device *dev)
 		obj->myDev = dev;
 		obj->hdrChunk = 0;
 		obj->variantType = YAFFS_OBJECT_TYPE_UNKNOWN;
+		yaffs_InitObjectDataLock(obj);
 		YINIT_LIST_HEAD(&(obj->hardLinks));
 		YINIT_LIST_HEAD(&(obj->hashLink));
 		YINIT_LIST_HEAD(&obj->siblings);
@@ -2336,10 +2341,12 @@ static int yaffs_GarbageCollectBlock(yaffs_Device *dev, int block,
 			    yaffs_FindObjectByNumber(dev,
 						     dev->gcCleanupList[i]);
 			if (object) {
+				yaffs_LockObjectData(object);
 				yaffs_FreeTnode(dev,
 						object->variant.fileVariant.
 						top);
 				object->variant.fileVariant.top = NULL;
+				yaffs_UnlockObjectData(object);
 				T(YAFFS_TRACE_GC,
 				  (TSTR
 				   ("yaffs: About to finally delete object %d"
@@ -2509,6 +2516,8 @@ static unsigned yaffs_FindBlockForGarbageCollection(yaffs_Device *dev,
 		dev->nGCBlocks++;
 		if(background)
 			dev->backgroundGCs++;
+		else
+			dev->foregroundGCs++;
 
 		dev->gcDirtiest = 0;
 		dev->gcPagesInUse = 0;
@@ -2719,8 +2728,8 @@ static int yaffs_FindAndDeleteChunkInFile(yaffs_Object *in, int chunkInInode,
 }
 
 
-int yaffs_PutChunkIntoFile(yaffs_Object *in, int chunkInInode,
-			        int chunkInNAND, int inScan)
+static int yaffs_DoPutChunkIntoFile(yaffs_Object *in, int chunkInInode,
+				int chunkInNAND, int inScan)
 {
 	/* NB inScan is zero unless scanning.
 	 * For forward scanning, inScan is > 0;
@@ -2847,6 +2856,22 @@ int yaffs_PutChunkIntoFile(yaffs_Object *in, int chunkInInode,
 	return YAFFS_OK;
 }
 
+int yaffs_PutChunkIntoFile(yaffs_Object *in, int chunkInInode,
+			        int chunkInNAND, int inScan)
+{
+	int retVal;
+
+	/* The chunk this replaces is only deleted by the caller, after this
+	 * returns, so unlocked readers never see a chunk that has gone.
+	 */
+	yaffs_LockObjectData(in);
+	retVal = yaffs_DoPutChunkIntoFile(in, chunkInInode, chunkInNAND,
+					inScan);
+	yaffs_UnlockObjectData(in);
+
+	return retVal;
+}
+
 static int yaffs_ReadChunkDataFromObject(yaffs_Object *in, int chunkInInode,
 					__u8 *buffer)
 {
@@ -3526,6 +3551,81 @@ int yaffs_ReadDataFromFile(yaffs_Object *in, __u8 *buffer, loff_t offset,
 	return nDone;
 }
 
+/* Like yaffs_FindChunkCache(), without touching the cache statistics */
+static int yaffs_ChunkMayBeCached(const yaffs_Object *obj, int chunkId)
+{
+	yaffs_Device *dev = obj->myDev;
+	int i;
+
+	for (i = 0; i < dev->param.nShortOpCaches; i++) {
+		if (dev->srCache[i].object == obj &&
+		    dev->srCache[i].chunkId == chunkId)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * yaffs_ReadDataFromFileUnlocked() reads whole chunks of a file without
+ * the device lock, so reading one file doesn't wait for writes, gc and
+ * directory operations elsewhere on the device. The chunk map of the file
+ * is held steady by its data lock instead: every change to the map takes
+ * that lock, and chunks are only deleted after they have been dropped
+ * from the map, so every chunk found stays valid while the lock is held.
+ *
+ * The caller must keep writes out of the range being read, as the page
+ * lock does in Linux. A dirty short op cache entry for a chunk then can't
+ * appear during the read, nor go away before its flush has updated the
+ * map, which needs the data lock; a stale cache match just sends the
+ * chunk to the locked path.
+ *
+ * Reading stops at the first chunk that needs more than that: a partial
+ * chunk, a cached one, one that needs reading tags (inband tags or chunk
+ * groups) or one that reported an ECC problem, which is handled and
+ * counted under the device lock. Returns the number of bytes read; the
+ * caller reads the rest with yaffs_ReadDataFromFile().
+ */
+int yaffs_ReadDataFromFileUnlocked(yaffs_Object *in, __u8 *buffer,
+				loff_t offset, int nBytes)
+{
+	yaffs_Device *dev = in->myDev;
+	int chunk;
+	__u32 start;
+	int chunkInNAND;
+	int nDone = 0;
+
+	if (!dev->param.isYaffs2 || dev->param.inbandTags ||
+	    dev->chunkGroupSize != 1 || !dev->param.readChunkWithTagsFromNAND)
+		return 0;
+
+	yaffs_LockObjectDataShared(in);
+
+	while (nBytes - nDone >= dev->nDataBytesPerChunk) {
+		yaffs_AddrToChunk(dev, offset, &chunk, &start);
+		chunk++;
+
+		if (start || yaffs_ChunkMayBeCached(in, chunk))
+			break;
+
+		chunkInNAND = yaffs_FindChunkInFile(in, chunk, NULL);
+
+		if (chunkInNAND < 0)
+			memset(buffer, 0, dev->nDataBytesPerChunk);
+		else if (dev->param.readChunkWithTagsFromNAND(dev,
+				chunkInNAND - dev->chunkOffset,
+				buffer, NULL) != YAFFS_OK)
+			break;
+
+		offset += dev->nDataBytesPerChunk;
+		buffer += dev->nDataBytesPerChunk;
+		nDone += dev->nDataBytesPerChunk;
+	}
+
+	yaffs_UnlockObjectDataShared(in);
+
+	return nDone;
+}
+
 int yaffs_DoWriteDataToFile(yaffs_Object *in, const __u8 *buffer, loff_t offset,
 			int nBytes, int writeThrough)
 {
@@ -3763,7 +3863,9 @@ void yaffs_ResizeDown( yaffs_Object *obj, loff_t newSize)
 
 	yaffs_AddrToChunk(dev, newSize, &newFullChunks, &newSizeOfPartialChunk);
 
+	yaffs_LockObjectData(obj);
 	yaffs_PruneResizedChunks(obj, newSize);
+	yaffs_UnlockObjectData(obj);
 
 	if (newSizeOfPartialChunk != 0) {
 		int lastChunk = 1 + newFullChunks;
@@ -3782,7 +3884,9 @@ void yaffs_ResizeDown( yaffs_Object *obj, loff_t newSize)
 
 	obj->variant.fileVariant.fileSize = newSize;
 
+	yaffs_LockObjectData(obj);
 	yaffs_PruneFileStructure(dev, &obj->variant.fileVariant);
+	yaffs_UnlockObjectData(obj);
 }
 
 
@@ -3958,8 +4062,10 @@ int yaffs_DeleteFile(yaffs_Object *in)
 		return deleted ? YAFFS_OK : YAFFS_FAIL;
 	} else {
 		/* The file has no data chunks so we toss it immediately */
+		yaffs_LockObjectData(in);
 		yaffs_FreeTnode(in->myDev, in->variant.fileVariant.top);
 		in->variant.fileVariant.top = NULL;
+		yaffs_UnlockObjectData(in);
 		yaffs_DoGenericObjectDeletion(in);
 
 		return YAFFS_OK;
@@ -5270,6 +5376,7 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 	dev->passiveGCs = 0;
 	dev->oldestDirtyGCs = 0;
 	dev->backgroundGCs = 0;
+	dev->foregroundGCs = 0;
 	dev->gcBlockFinder = 0;
 	dev->bufferedBlock = -1;
 	dev->doingBufferedBlockRewrite = 0;
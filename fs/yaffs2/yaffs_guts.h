@@ -464,6 +464,12 @@ struct yaffs_ObjectStruct {
 
 	void *myInode;
 
+	/* Guards the chunk map (tnode tree) of a file for readers that run
+	 * without the device lock, see yaffs_ReadDataFromFileUnlocked().
+	 * Changes to the map are made holding the device lock and this.
+	 */
+	YAFFS_OBJ_LOCK_T dataLock;
+
 	yaffs_ObjectType variantType;
 
 	yaffs_ObjectVariant variant;
@@ -575,6 +581,13 @@ struct yaffs_DeviceParamStruct {
 	int (*markNANDBlockBad) (struct yaffs_DeviceStruct *dev, int blockNo);
 	int (*queryNANDBlock) (struct yaffs_DeviceStruct *dev, int blockNo,
 			       yaffs_BlockState *state, __u32 *sequenceNumber);
+	/* Optional: read the tags of nChunks consecutive chunks in one go.
+	 * Used by the scan. If not set, or if it fails, the tags are read
+	 * one chunk at a time with readChunkWithTagsFromNAND.
+	 */
+	int (*readTagsFromNAND) (struct yaffs_DeviceStruct *dev,
+				 int chunkInNAND, int nChunks,
+				 yaffs_ExtendedTags *tags);
 #endif
 
 	/* The removeObjectCallback function must be supplied by OS flavours that
@@ -759,6 +772,7 @@ struct yaffs_DeviceStruct {
 	__u32 oldestDirtyGCs;
 	__u32 nGCBlocks;
 	__u32 backgroundGCs;
+	__u32 foregroundGCs;
 	__u32 nRetriedWrites;
 	__u32 nRetiredBlocks;
 	__u32 eccFixed;
@@ -855,6 +869,8 @@ int yaffs_GetAttributes(yaffs_Object *obj, struct iattr *attr);
 /* File operations */
 int yaffs_ReadDataFromFile(yaffs_Object *obj, __u8 *buffer, loff_t offset,
 				int nBytes);
+int yaffs_ReadDataFromFileUnlocked(yaffs_Object *obj, __u8 *buffer,
+				loff_t offset, int nBytes);
 int yaffs_WriteDataToFile(yaffs_Object *obj, const __u8 *buffer, loff_t offset,
 				int nBytes, int writeThrough);
 int yaffs_ResizeFile(yaffs_Object *obj, loff_t newSize);
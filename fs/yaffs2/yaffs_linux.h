@@ -16,6 +16,8 @@
 #ifndef __YAFFS_LINUX_H__
 #define __YAFFS_LINUX_H__
 
+#include <linux/mutex.h>
+
 #include "devextras.h"
 #include "yportenv.h"
 
@@ -25,10 +27,24 @@ struct yaffs_LinuxContext {
 	struct super_block * superBlock;
 	struct task_struct *bgThread; /* Background thread for this device */
 	int bgRunning;
-        struct semaphore grossLock;     /* Gross locking semaphore */
+	struct mutex grossLock;		/* Device lock: held around everything
+					 * in the guts except unlocked file
+					 * data reads, which take the object's
+					 * dataLock instead.
+					 */
 	__u8 *spareBuffer;      /* For mtdif2 use. Don't know the size of the buffer
 				 * at compile time so we have to allocate it.
 				 */
+	__u8 *tagsBuffer;	/* oob of a whole block for batched tag reads
+				 * by the mount scan. Freed once mounted.
+				 */
+	unsigned long lastDirty; /* jiffies of the last change to the fs */
+	unsigned long lastForeground; /* jiffies of the last fs operation not
+				       * done by the background thread
+				       */
+	unsigned bgGCBackoffs;	/* Background gc passes put off because of
+				 * foreground activity.
+				 */
 	struct ylist_head searchContexts;
 	void (*putSuperFunc)(struct super_block *sb);
 
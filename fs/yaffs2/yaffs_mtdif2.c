@@ -193,6 +193,85 @@ int nandmtd2_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 		return YAFFS_FAIL;
 }
 
+/* Reads the tags of nChunks consecutive chunks with a single oob-only
+ * read_oob call. With MTD_OOB_AUTO the free oob bytes of each page follow
+ * each other in the buffer, mtd->oobavail bytes per page.
+ */
+int nandmtd2_ReadTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
+			      int nChunks, yaffs_ExtendedTags *tags)
+{
+#if (MTD_VERSION_CODE > MTD_VERSION(2, 6, 17))
+	struct mtd_info *mtd = yaffs_DeviceToMtd(dev);
+	struct yaffs_LinuxContext *lc = yaffs_DeviceToLC(dev);
+	struct mtd_oob_ops ops;
+	int retval;
+	int i;
+
+	loff_t addr = ((loff_t) chunkInNAND) * dev->param.totalBytesPerChunk;
+
+	yaffs_PackedTags2 pt;
+
+	int packed_tags_size = dev->param.noTagsECC ? sizeof(pt.t) : sizeof(pt);
+	void * packed_tags_ptr = dev->param.noTagsECC ? (void *) &pt.t: (void *)&pt;
+
+	T(YAFFS_TRACE_MTD,
+	  (TSTR
+	   ("nandmtd2_ReadTagsFromNAND chunk %d count %d"
+	    TENDSTR), chunkInNAND, nChunks));
+
+	if (dev->param.inbandTags || !lc->tagsBuffer ||
+	    nChunks > dev->param.nChunksPerBlock ||
+	    mtd->oobavail < packed_tags_size)
+		return YAFFS_FAIL;
+
+	memset(&ops, 0, sizeof(ops));
+	ops.mode = MTD_OOB_AUTO;
+	ops.ooblen = nChunks * mtd->oobavail;
+	ops.oobbuf = lc->tagsBuffer;
+	retval = mtd->read_oob(mtd, addr, &ops);
+
+	if (retval || ops.oobretlen != ops.ooblen)
+		return YAFFS_FAIL;
+
+	for (i = 0; i < nChunks; i++) {
+		memcpy(packed_tags_ptr, lc->tagsBuffer + i * mtd->oobavail,
+			packed_tags_size);
+		yaffs_UnpackTags2(&tags[i], &pt, !dev->param.noTagsECC);
+	}
+
+	return YAFFS_OK;
+#else
+	return YAFFS_FAIL;
+#endif
+}
+
+/* Checks that the MTD driver reads the oob of several pages with one
+ * read_oob call and reports how much it read, as
+ * nandmtd2_ReadTagsFromNAND relies on. Some drivers emulating large
+ * pages only fill in the first page and leave oobretlen alone.
+ * buffer must hold the oob of two pages.
+ */
+int nandmtd2_CanReadTagsFromNAND(struct mtd_info *mtd, __u8 *buffer)
+{
+#if (MTD_VERSION_CODE > MTD_VERSION(2, 6, 17))
+	struct mtd_oob_ops ops;
+
+	if (!mtd->read_oob || mtd->oobavail == 0 ||
+	    mtd->erasesize < 2 * mtd->writesize)
+		return 0;
+
+	memset(&ops, 0, sizeof(ops));
+	ops.mode = MTD_OOB_AUTO;
+	ops.ooblen = 2 * mtd->oobavail;
+	ops.oobbuf = buffer;
+
+	return mtd->read_oob(mtd, 0, &ops) == 0 &&
+		ops.oobretlen == ops.ooblen;
+#else
+	return 0;
+#endif
+}
+
 int nandmtd2_MarkNANDBlockBad(struct yaffs_DeviceStruct *dev, int blockNo)
 {
 	struct mtd_info *mtd = yaffs_DeviceToMtd(dev);
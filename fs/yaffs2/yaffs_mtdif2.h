@@ -17,11 +17,17 @@
 #define __YAFFS_MTDIF2_H__
 
 #include "yaffs_guts.h"
+
+struct mtd_info;
+
 int nandmtd2_WriteChunkWithTagsToNAND(yaffs_Device *dev, int chunkInNAND,
 				const __u8 *data,
 				const yaffs_ExtendedTags *tags);
 int nandmtd2_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 				__u8 *data, yaffs_ExtendedTags *tags);
+int nandmtd2_ReadTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
+				int nChunks, yaffs_ExtendedTags *tags);
+int nandmtd2_CanReadTagsFromNAND(struct mtd_info *mtd, __u8 *buffer);
 int nandmtd2_MarkNANDBlockBad(struct yaffs_DeviceStruct *dev, int blockNo);
 int nandmtd2_QueryNANDBlock(struct yaffs_DeviceStruct *dev, int blockNo,
 			yaffs_BlockState *state, __u32 *sequenceNumber);
@@ -51,6 +51,44 @@ int yaffs_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 	return result;
 }
 
+/*
+ * Read the tags of nChunks consecutive chunks into tags[]. The driver's
+ * batched read is used when it has one. Otherwise, or if the batch fails,
+ * the chunks are read one by one, so each chunk gets the same result it
+ * would get from yaffs_ReadChunkWithTagsFromNAND.
+ */
+int yaffs_ReadTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
+					int nChunks,
+					yaffs_ExtendedTags *tags)
+{
+	int result = YAFFS_OK;
+	int i;
+
+	if (dev->param.readTagsFromNAND &&
+	    dev->param.readTagsFromNAND(dev, chunkInNAND - dev->chunkOffset,
+					nChunks, tags) == YAFFS_OK) {
+		dev->nPageReads += nChunks;
+
+		for (i = 0; i < nChunks; i++) {
+			if (tags[i].eccResult > YAFFS_ECC_RESULT_NO_ERROR) {
+				yaffs_BlockInfo *bi;
+				bi = yaffs_GetBlockInfo(dev,
+					(chunkInNAND + i)/dev->param.nChunksPerBlock);
+				yaffs_HandleChunkError(dev, bi);
+			}
+		}
+		return YAFFS_OK;
+	}
+
+	for (i = 0; i < nChunks; i++) {
+		if (yaffs_ReadChunkWithTagsFromNAND(dev, chunkInNAND + i,
+					NULL, &tags[i]) != YAFFS_OK)
+			result = YAFFS_FAIL;
+	}
+
+	return result;
+}
+
 int yaffs_WriteChunkWithTagsToNAND(yaffs_Device *dev,
 						   int chunkInNAND,
 						   const __u8 *buffer,
@@ -177,6 +177,8 @@ unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
 unsigned int yaffs_auto_checkpoint = 1;
 unsigned int yaffs_gc_control = 1;
 unsigned int yaffs_bg_enable = 1;
+unsigned int yaffs_idle_checkpoint = 30; /* seconds, 0 = never */
+unsigned int yaffs_bg_gc_idle_ms = 500;
 
 /* Module Parameters */
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 5, 0))
@@ -185,6 +187,8 @@ module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
 module_param(yaffs_gc_control, uint, 0644);
 module_param(yaffs_bg_enable, uint, 0644);
+module_param(yaffs_idle_checkpoint, uint, 0644);
+module_param(yaffs_bg_gc_idle_ms, uint, 0644);
 #else
 MODULE_PARM(yaffs_traceMask, "i");
 MODULE_PARM(yaffs_wr_attempts, "i");
@@ -513,15 +517,21 @@ static unsigned yaffs_gc_control_callback(yaffs_Device *dev)
                 	                                                                                          	
 static void yaffs_GrossLock(yaffs_Device *dev)
 {
+	struct yaffs_LinuxContext *lc = yaffs_DeviceToLC(dev);
+
 	T(YAFFS_TRACE_LOCK, (TSTR("yaffs locking %p\n"), current));
-	down(&(yaffs_DeviceToLC(dev)->grossLock));
+	mutex_lock(&(lc->grossLock));
 	T(YAFFS_TRACE_LOCK, (TSTR("yaffs locked %p\n"), current));
+
+	/* Lets the background gc tell when the device is idle */
+	if (current != lc->bgThread)
+		lc->lastForeground = jiffies;
 }
 
 static void yaffs_GrossUnlock(yaffs_Device *dev)
 {
 	T(YAFFS_TRACE_LOCK, (TSTR("yaffs unlocking %p\n"), current));
-	up(&(yaffs_DeviceToLC(dev)->grossLock));
+	mutex_unlock(&(yaffs_DeviceToLC(dev)->grossLock));
 }
 
 #ifdef YAFFS_COMPILE_EXPORTFS
@@ -990,7 +1000,9 @@ static int yaffs_readpage_nolock(struct file *f, struct page *pg)
 
 	yaffs_Object *obj;
 	unsigned char *pg_buf;
-	int ret;
+	loff_t pos = ((loff_t) pg->index) << PAGE_CACHE_SHIFT;
+	int nRead;
+	int ret = 0;
 
 	yaffs_Device *dev;
 
@@ -1013,13 +1025,22 @@ static int yaffs_readpage_nolock(struct file *f, struct page *pg)
 	pg_buf = kmap(pg);
 	/* FIXME: Can kmap fail? */
 
-	yaffs_GrossLock(dev);
-
-	ret = yaffs_ReadDataFromFile(obj, pg_buf,
-				pg->index << PAGE_CACHE_SHIFT,
+	/*
+	 * Whole chunks can be read without the device lock; the page lock
+	 * keeps writers to this page out. Anything else is read under it.
+	 */
+	nRead = yaffs_ReadDataFromFileUnlocked(obj, pg_buf, pos,
 				PAGE_CACHE_SIZE);
 
-	yaffs_GrossUnlock(dev);
+	if (nRead < PAGE_CACHE_SIZE) {
+		yaffs_GrossLock(dev);
+
+		ret = yaffs_ReadDataFromFile(obj, pg_buf + nRead,
+					pos + nRead,
+					PAGE_CACHE_SIZE - nRead);
+
+		yaffs_GrossUnlock(dev);
+	}
 
 	if (ret >= 0)
 		ret = 0;
@@ -1518,18 +1539,7 @@ static ssize_t yaffs_hold_space(struct file *f)
 
 static void yaffs_release_space(struct file *f)
 {
-	yaffs_Object *obj;
-	yaffs_Device *dev;
-
-
-	obj = yaffs_DentryToObject(f->f_dentry);
-
-	dev = obj->myDev;
-
-	yaffs_GrossLock(dev);
-
-
-	yaffs_GrossUnlock(dev);
+	/* Nothing is reserved by yaffs_hold_space(), so nothing to do */
 }
 
 
@@ -2319,7 +2329,9 @@ static int yaffs_BackgroundThread(void *data)
 	unsigned long next_dir_update = now;
 	unsigned long next_gc = now;
 	unsigned long expires;
+	unsigned long idle_until;
 	unsigned int urgency;
+	int checkpoint_now;
 
 	int gcResult;
 	struct timer_list timer;
@@ -2352,8 +2364,21 @@ static int yaffs_BackgroundThread(void *data)
 		}
 
 		if(time_after(now,next_gc) && yaffs_bg_enable){
-			if(!dev->isCheckpointed){
-				urgency = yaffs_bg_gc_urgency(dev);
+			urgency = yaffs_bg_gc_urgency(dev);
+			idle_until = context->lastForeground +
+				msecs_to_jiffies(yaffs_bg_gc_idle_ms);
+
+			if(!dev->isCheckpointed && urgency < 2 &&
+				time_before(now, idle_until)){
+				/*
+				 * Someone is using the fs. Unless we are
+				 * running out of erased blocks, leave the
+				 * flash to them and look again once it has
+				 * been quiet for a while.
+				 */
+				context->bgGCBackoffs++;
+				next_gc = idle_until;
+			} else if(!dev->isCheckpointed){
 				gcResult = yaffs_BackgroundGarbageCollect(dev, urgency);
 				if(urgency > 1)
 					next_gc = now + HZ/20+1;
@@ -2367,7 +2392,19 @@ static int yaffs_BackgroundThread(void *data)
 				*/
 				next_gc = next_dir_update;
 		}
+
+		/* Once nothing has changed for a while, write a checkpoint
+		 * so that the next mount can skip the scan even if the
+		 * device is not unmounted cleanly.
+		 */
+		checkpoint_now = yaffs_idle_checkpoint &&
+			!dev->isCheckpointed && !dev->readOnly &&
+			time_after(now, context->lastDirty +
+					yaffs_idle_checkpoint * HZ);
 		yaffs_GrossUnlock(dev);
+
+		if (checkpoint_now)
+			yaffs_do_sync_fs(context->superBlock, 1);
 #if 1
 		expires = next_dir_update;
 		if (time_before(next_gc,expires))
@@ -2598,6 +2635,7 @@ static void yaffs_MarkSuperBlockDirty(yaffs_Device *dev)
 	T(YAFFS_TRACE_OS, (TSTR("yaffs_MarkSuperBlockDirty() sb = %p\n"), sb));
 	if (sb)
 		sb->s_dirt = 1;
+	yaffs_DeviceToLC(dev)->lastDirty = jiffies;
 }
 
 typedef struct {
@@ -2969,6 +3007,13 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 17))
 		param->totalBytesPerChunk = mtd->writesize;
 		param->nChunksPerBlock = mtd->erasesize / mtd->writesize;
+		yaffs_DeviceToLC(dev)->tagsBuffer =
+			YMALLOC(param->nChunksPerBlock * mtd->oobavail);
+		/* batched tag reads only where the driver can do them */
+		if (yaffs_DeviceToLC(dev)->tagsBuffer &&
+		    nandmtd2_CanReadTagsFromNAND(mtd,
+				yaffs_DeviceToLC(dev)->tagsBuffer))
+			param->readTagsFromNAND = nandmtd2_ReadTagsFromNAND;
 #else
 		param->totalBytesPerChunk = mtd->oobblock;
 		param->nChunksPerBlock = mtd->erasesize / mtd->oobblock;
@@ -3035,12 +3080,19 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
         YINIT_LIST_HEAD(&(yaffs_DeviceToLC(dev)->searchContexts));
         param->removeObjectCallback = yaffs_RemoveObjectCallback;
 
-	init_MUTEX(&(yaffs_DeviceToLC(dev)->grossLock));
+	mutex_init(&(yaffs_DeviceToLC(dev)->grossLock));
 
 	yaffs_GrossLock(dev);
 
 	err = yaffs_GutsInitialise(dev);
 
+	/* The batched tag reads are only used by the scan */
+	if (context->tagsBuffer) {
+		YFREE(context->tagsBuffer);
+		context->tagsBuffer = NULL;
+	}
+	context->lastDirty = jiffies;
+
 	T(YAFFS_TRACE_OS,
 	  (TSTR("yaffs_read_super: guts initialised %s\n"),
 	   (err == YAFFS_OK) ? "OK" : "FAILED"));
@@ -3227,6 +3279,9 @@ static char *yaffs_dump_dev_part1(char *buf, yaffs_Device * dev)
 	buf += sprintf(buf, "oldestDirtyGCs..... %u\n", dev->oldestDirtyGCs);
 	buf += sprintf(buf, "nGCBlocks.......... %u\n", dev->nGCBlocks);
 	buf += sprintf(buf, "backgroundGCs...... %u\n", dev->backgroundGCs);
+	buf += sprintf(buf, "foregroundGCs...... %u\n", dev->foregroundGCs);
+	buf += sprintf(buf, "bgGCBackoffs....... %u\n",
+			yaffs_DeviceToLC(dev)->bgGCBackoffs);
 	buf += sprintf(buf, "nRetriedWrites..... %u\n", dev->nRetriedWrites);
 	buf += sprintf(buf, "nRetireBlocks...... %u\n", dev->nRetiredBlocks);
 	buf += sprintf(buf, "eccFixed........... %u\n", dev->eccFixed);
@@ -942,6 +942,7 @@ int yaffs2_ScanBackwards(yaffs_Device *dev)
 
 	yaffs_BlockIndex *blockIndex = NULL;
 	int altBlockIndex = 0;
+	yaffs_ExtendedTags *blockTags = NULL;
 
 	T(YAFFS_TRACE_SCAN,
 	  (TSTR
@@ -964,6 +965,11 @@ int yaffs2_ScanBackwards(yaffs_Device *dev)
 		return YAFFS_FAIL;
 	}
 
+	/* Tags of the block being scanned. Without it we fall back to
+	 * reading the tags a chunk at a time.
+	 */
+	blockTags = YMALLOC(dev->param.nChunksPerBlock * sizeof(yaffs_ExtendedTags));
+
 	dev->blocksInCheckpoint = 0;
 
 	chunkData = yaffs_GetTempBuffer(dev, __LINE__);
@@ -1063,6 +1069,13 @@ int yaffs2_ScanBackwards(yaffs_Device *dev)
 
 		deleted = 0;
 
+		/* Read all the tags of the block in one batch */
+		if (blockTags &&
+		    (state == YAFFS_BLOCK_STATE_NEEDS_SCANNING ||
+		     state == YAFFS_BLOCK_STATE_ALLOCATING))
+			yaffs_ReadTagsFromNAND(dev, blk * dev->param.nChunksPerBlock,
+					dev->param.nChunksPerBlock, blockTags);
+
 		/* For each chunk in each block that needs scanning.... */
 		foundChunksInBlock = 0;
 		for (c = dev->param.nChunksPerBlock - 1;
@@ -1075,8 +1088,11 @@ int yaffs2_ScanBackwards(yaffs_Device *dev)
 
 			chunk = blk * dev->param.nChunksPerBlock + c;
 
-			result = yaffs_ReadChunkWithTagsFromNAND(dev, chunk, NULL,
-							&tags);
+			if (blockTags)
+				tags = blockTags[c];
+			else
+				result = yaffs_ReadChunkWithTagsFromNAND(dev, chunk, NULL,
+								&tags);
 
 			/* Let's have a good look at this chunk... */
 
@@ -1521,6 +1537,9 @@ int yaffs2_ScanBackwards(yaffs_Device *dev)
 	else
 		YFREE(blockIndex);
 
+	if (blockTags)
+		YFREE(blockTags);
+
 	/* Ok, we've done all the scanning.
 	 * Fix up the hard link chains.
 	 * We should now have scanned all the objects, now it's time to add these
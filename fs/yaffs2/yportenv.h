@@ -44,6 +44,7 @@
 
 #include <linux/kernel.h>
 #include <linux/mm.h>
+#include <linux/rwsem.h>
 #include <linux/sched.h>
 #include <linux/string.h>
 #include <linux/slab.h>
@@ -76,6 +77,14 @@
 #define YYIELD() schedule()
 #define Y_DUMP_STACK() dump_stack()
 
+/* Per object lock on the chunk map of a file, see yaffs_ObjectStruct */
+#define YAFFS_OBJ_LOCK_T struct rw_semaphore
+#define yaffs_InitObjectDataLock(obj)	init_rwsem(&(obj)->dataLock)
+#define yaffs_LockObjectData(obj)	down_write(&(obj)->dataLock)
+#define yaffs_UnlockObjectData(obj)	up_write(&(obj)->dataLock)
+#define yaffs_LockObjectDataShared(obj)	down_read(&(obj)->dataLock)
+#define yaffs_UnlockObjectDataShared(obj) up_read(&(obj)->dataLock)
+
 #define YAFFS_ROOT_MODE			0755
 #define YAFFS_LOSTNFOUND_MODE		0700
 
@@ -154,6 +163,16 @@
 
 #endif
 
+#ifndef YAFFS_OBJ_LOCK_T
+/* Single threaded environments don't need the object data lock */
+#define YAFFS_OBJ_LOCK_T int
+#define yaffs_InitObjectDataLock(obj)	do { } while (0)
+#define yaffs_LockObjectData(obj)	do { } while (0)
+#define yaffs_UnlockObjectData(obj)	do { } while (0)
+#define yaffs_LockObjectDataShared(obj)	do { } while (0)
+#define yaffs_UnlockObjectDataShared(obj) do { } while (0)
+#endif
+
 #if defined(CONFIG_YAFFS_DIRECT) || defined(CONFIG_YAFFS_WINCE)
 
 #ifdef CONFIG_YAFFSFS_PROVIDE_VALUES
@@ -61,6 +61,8 @@ typedef struct {
 	unsigned int alloc_fail_cnt;
 	unsigned int free_pass_cnt;
 	unsigned int free_fail_cnt;
+	/* percentage of the free space not in the biggest free buffer */
+	unsigned int frag_percent;
 } bmem_status_t;
 
 typedef struct {
@@ -75,6 +77,9 @@ struct bmem_logic {
 	int (*open)(BMEM_HDL *hdlp);
 	int (*release)(BMEM_HDL hdl);
 	int (*mmap)(unsigned long size, unsigned long pgoff);
+	/* mapping references, a mapped buffer is never freed */
+	int (*get)(unsigned long busaddr);
+	void (*put)(unsigned long busaddr);
 #ifdef BMEM_CHECK_OVERRUN
 	int (*init)(unsigned int memory_size, unsigned int phy_start_address, void *virt_start_address);
 #else
@@ -0,0 +1,32 @@
+#ifndef _LINUX_CMA_H
+#define _LINUX_CMA_H
+
+#include <linux/types.h>
+#include <linux/errno.h>
+
+/*
+ * Contiguous memory areas: driver carveouts reserved at boot which the page
+ * allocator may use for movable pages until the driver claims a buffer in
+ * them, see mm/cma.c.
+ */
+#ifdef CONFIG_CMA
+extern int cma_declare_area(phys_addr_t base, unsigned long size);
+extern int cma_claim(phys_addr_t base, unsigned long size);
+extern void cma_release(phys_addr_t base, unsigned long size);
+#else
+static inline int cma_declare_area(phys_addr_t base, unsigned long size)
+{
+	return -ENOSYS;
+}
+
+static inline int cma_claim(phys_addr_t base, unsigned long size)
+{
+	return 0;
+}
+
+static inline void cma_release(phys_addr_t base, unsigned long size)
+{
+}
+#endif
+
+#endif /* _LINUX_CMA_H */
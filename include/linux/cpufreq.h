@@ -196,6 +196,29 @@ extern int __cpufreq_driver_getavg(struct cpufreq_policy *policy,
 int cpufreq_register_governor(struct cpufreq_governor *governor);
 void cpufreq_unregister_governor(struct cpufreq_governor *governor);
 
+/*
+ * The decision logic of a governor, detached from its timers and load
+ * measurement so recorded load can be replayed through it offline (see
+ * drivers/cpufreq/cpufreq_replay.c). ->init() prepares @state_size bytes
+ * of private state and returns the sampling period in microseconds.
+ * ->sample() is passed the load of the last period in percent of
+ * policy->cur and returns the frequency the governor would request
+ * (setting *relation), or 0 to stay at policy->cur.
+ */
+struct cpufreq_gov_model {
+	const char	*name;
+	size_t		state_size;
+	unsigned int	(*init)(void *state, struct cpufreq_policy *policy);
+	unsigned int	(*sample)(void *state, struct cpufreq_policy *policy,
+				  unsigned int load, unsigned int *relation);
+	struct list_head	model_list;
+};
+
+int cpufreq_register_gov_model(struct cpufreq_gov_model *model);
+void cpufreq_unregister_gov_model(struct cpufreq_gov_model *model);
+int cpufreq_for_each_gov_model(int (*fn)(struct cpufreq_gov_model *model,
+					 void *data), void *data);
+
 int lock_policy_rwsem_read(int cpu);
 int lock_policy_rwsem_write(int cpu);
 void unlock_policy_rwsem_read(int cpu);
@@ -375,6 +398,9 @@ extern struct cpufreq_governor cpufreq_gov_ondemand;
 #elif defined(CONFIG_CPU_FREQ_DEFAULT_GOV_CONSERVATIVE)
 extern struct cpufreq_governor cpufreq_gov_conservative;
 #define CPUFREQ_DEFAULT_GOVERNOR	(&cpufreq_gov_conservative)
+#elif defined(CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL)
+extern struct cpufreq_governor cpufreq_gov_schedutil;
+#define CPUFREQ_DEFAULT_GOVERNOR	(&cpufreq_gov_schedutil)
 #elif defined(CONFIG_CPU_FREQ_DEFAULT_GOV_BCM21553)
 extern struct cpufreq_governor cpufreq_gov_bcm;
 #define CPUFREQ_DEFAULT_GOVERNOR (&cpufreq_gov_bcm)
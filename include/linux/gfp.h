@@ -319,6 +319,13 @@ extern unsigned long get_zeroed_page(gfp_t gfp_mask);
 void *alloc_pages_exact(size_t size, gfp_t gfp_mask);
 void free_pages_exact(void *virt, size_t size);
 
+#ifdef CONFIG_CMA
+/* The below functions must be run on a range from a single zone. */
+extern int alloc_contig_range(unsigned long start, unsigned long end);
+extern void free_contig_range(unsigned long pfn, unsigned long nr_pages);
+extern void init_cma_reserved_pageblock(struct page *page);
+#endif
+
 #define __get_free_page(gfp_mask) \
 		__get_free_pages((gfp_mask), 0)
 
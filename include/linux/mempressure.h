@@ -0,0 +1,17 @@
+#ifndef _LINUX_MEMPRESSURE_H
+#define _LINUX_MEMPRESSURE_H
+
+/*
+ * Reclaim efficiency reporting for the Android memory pressure device,
+ * see drivers/staging/android/mempressure.c.
+ */
+#ifdef CONFIG_ANDROID_MEM_PRESSURE
+extern void mempressure_report(unsigned long scanned, unsigned long reclaimed);
+#else
+static inline void mempressure_report(unsigned long scanned,
+				      unsigned long reclaimed)
+{
+}
+#endif
+
+#endif /* _LINUX_MEMPRESSURE_H */
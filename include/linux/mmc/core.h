@@ -10,6 +10,7 @@
 
 #include <linux/interrupt.h>
 #include <linux/device.h>
+#include <linux/completion.h>
 
 struct request;
 struct mmc_data;
@@ -115,6 +116,7 @@ struct mmc_data {
 
 	unsigned int		sg_len;		/* size of scatter list */
 	struct scatterlist	*sg;		/* I/O scatter list */
+	s32			host_cookie;	/* host private data */
 };
 
 struct mmc_request {
@@ -124,11 +126,24 @@ struct mmc_request {
 
 	void			*done_data;	/* completion data */
 	void			(*done)(struct mmc_request *);/* completion function */
+	struct completion	completion;	/* used by mmc_start_req() */
 };
 
 struct mmc_host;
 struct mmc_card;
 
+/*
+ * A request handed to mmc_start_req(). err_check() is called once the
+ * request has completed and returns 0 if it went fine.
+ */
+struct mmc_async_req {
+	struct mmc_request	*mrq;
+	int (*err_check) (struct mmc_card *, struct mmc_async_req *);
+};
+
+extern struct mmc_async_req *mmc_start_req(struct mmc_host *,
+					   struct mmc_async_req *, int *);
+
 extern void mmc_wait_for_req(struct mmc_host *, struct mmc_request *);
 extern int mmc_wait_for_cmd(struct mmc_host *, struct mmc_command *, int);
 extern int mmc_wait_for_app_cmd(struct mmc_host *, struct mmc_card *,
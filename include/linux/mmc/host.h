@@ -82,6 +82,17 @@ struct mmc_host_ops {
 	 */
 	int (*enable)(struct mmc_host *host);
 	int (*disable)(struct mmc_host *host, int lazy);
+	/*
+	 * Optional. 'pre_req' prepares a request, e.g. maps its buffers for
+	 * DMA, while the previous request may still be running. 'post_req'
+	 * undoes that once the request is done, also possibly while the
+	 * next one is running. 'err' is non-zero if the request was
+	 * prepared but never started. Both are called from process context.
+	 */
+	void	(*post_req)(struct mmc_host *host, struct mmc_request *req,
+			    int err);
+	void	(*pre_req)(struct mmc_host *host, struct mmc_request *req,
+			   bool is_first_req);
 	void	(*request)(struct mmc_host *host, struct mmc_request *req);
 	/*
 	 * Avoid calling these three functions too often or in a "fast path",
@@ -192,6 +203,8 @@ struct mmc_host {
 
 	struct mmc_card		*card;		/* device attached to this host */
 
+	struct mmc_async_req	*areq;		/* request started by mmc_start_req */
+
 	wait_queue_head_t	wq;
 	struct task_struct	*claimer;	/* task that has host claimed */
 	int			claim_cnt;	/* "claim" nesting count */
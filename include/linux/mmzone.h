@@ -40,8 +40,21 @@
 #define MIGRATE_MOVABLE       2
 #define MIGRATE_PCPTYPES      3 /* the number of types on the pcp lists */
 #define MIGRATE_RESERVE       3
+#ifdef CONFIG_CMA
+/*
+ * Pageblocks of a contiguous memory area. Only movable allocations fall
+ * back to them and their type is never changed, so that the owning driver
+ * can always migrate the pages out again, see mm/cma.c.
+ */
+#define MIGRATE_CMA           4
+#define MIGRATE_ISOLATE       5 /* can't allocate from here */
+#define MIGRATE_TYPES         6
+#define is_migrate_cma(migratetype) unlikely((migratetype) == MIGRATE_CMA)
+#else
 #define MIGRATE_ISOLATE       4 /* can't allocate from here */
 #define MIGRATE_TYPES         5
+#define is_migrate_cma(migratetype) false
+#endif
 
 #define for_each_migratetype_order(order, type) \
 	for (order = 0; order < MAX_ORDER; order++) \
@@ -104,6 +117,7 @@ enum zone_stat_item {
 	NR_ISOLATED_ANON,	/* Temporary isolated pages from anon lru */
 	NR_ISOLATED_FILE,	/* Temporary isolated pages from file lru */
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
+	NR_FREE_CMA_PAGES,	/* free pages in MIGRATE_CMA pageblocks */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -4,10 +4,67 @@
 /* For now we just replace the xt_owner.
 * FIXME: make iptables aware of qtaguid. */
 #include <linux/netfilter/xt_owner.h>
+#include <linux/ioctl.h>
+#include <linux/types.h>
 
 #define XT_QTAGUID_UID XT_OWNER_UID
 #define XT_QTAGUID_GID XT_OWNER_GID
 #define XT_QTAGUID_SOCKET XT_OWNER_SOCKET
 #define xt_qtaguid_match_info xt_owner_match_info
 
+/*
+ * Binary stats export, an ioctl on /dev/xt_qtaguid.
+ *
+ * Returns the same tag stats as /proc/net/xt_qtaguid/stats, one entry per
+ * {iface, acct_tag, uid}, with all the counter sets. Pass generation 0 to
+ * get every entry, or the generation returned by a previous call to only
+ * get the entries that changed since then. Entries deleted in the
+ * meantime are not reported.
+ *
+ * count is the number of entries that fit at entries on input, and the
+ * number of entries returned on output. If they did not all fit, the
+ * ioctl fails with ENOSPC, sets count to the number of entries needed and
+ * leaves the generation alone.
+ */
+#define QTAGUID_STATS_VERSION 1
+
+#define QTAGUID_IFNAMSIZ 16
+#define QTAGUID_COUNTER_SETS 2
+
+enum {
+	QTAGUID_STATS_TX,
+	QTAGUID_STATS_RX,
+	QTAGUID_STATS_DIRECTIONS
+};
+
+enum {
+	QTAGUID_STATS_TCP,
+	QTAGUID_STATS_UDP,
+	QTAGUID_STATS_OTHER,
+	QTAGUID_STATS_PROTOS
+};
+
+struct qtaguid_stats_counters {
+	__u64 bytes;
+	__u64 packets;
+};
+
+struct qtaguid_stats_entry {
+	char iface[QTAGUID_IFNAMSIZ];
+	__u32 acct_tag;
+	__u32 uid;
+	struct qtaguid_stats_counters
+		counters[QTAGUID_COUNTER_SETS][QTAGUID_STATS_DIRECTIONS]
+			[QTAGUID_STATS_PROTOS];
+};
+
+struct qtaguid_stats_req {
+	__u32 version;		/* QTAGUID_STATS_VERSION */
+	__u32 count;		/* in: room at entries, out: entries */
+	__u64 generation;	/* in: 0 or from a previous call */
+	__u64 entries;		/* struct qtaguid_stats_entry __user * */
+};
+
+#define QTAGUID_IOC_GET_STATS _IOWR('q', 0x40, struct qtaguid_stats_req)
+
 #endif /* _XT_QTAGUID_MATCH_H */
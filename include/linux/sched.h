@@ -308,6 +308,20 @@ extern void trap_init(void);
 extern void update_process_times(int user);
 extern void scheduler_tick(void);
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Utilization callback for cpufreq governors that follow the scheduler.
+ * @util is the recent busy fraction of @cpu on a 0..@max scale.
+ */
+struct update_util_data {
+	void (*func)(struct update_util_data *data, int cpu,
+		     unsigned long util, unsigned long max);
+};
+
+extern void cpufreq_set_update_util_data(int cpu,
+					 struct update_util_data *data);
+#endif
+
 extern void sched_show_task(struct task_struct *p);
 
 #ifdef CONFIG_DETECT_SOFTLOCKUP
@@ -1223,7 +1237,9 @@ struct task_struct {
 #endif
 
 	struct list_head tasks;
-	struct rb_node adj_node;
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	struct hlist_node adj_node;	/* lowmemorykiller oom_adj bucket */
+#endif
 	struct plist_node pushable_tasks;
 
 	struct mm_struct *mm, *active_mm;
@@ -1552,8 +1568,15 @@ static inline struct pid *task_tgid(struct task_struct *task)
 	return task->group_leader->pids[PIDTYPE_PID].pid;
 }
 
-extern void add_2_adj_tree(struct task_struct *task);
-extern void delete_from_adj_tree(struct task_struct *task);
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+extern void lowmem_adj_add(struct task_struct *task);
+extern void lowmem_adj_del(struct task_struct *task);
+extern void lowmem_adj_update(struct task_struct *task);
+#else
+static inline void lowmem_adj_add(struct task_struct *task) { }
+static inline void lowmem_adj_del(struct task_struct *task) { }
+static inline void lowmem_adj_update(struct task_struct *task) { }
+#endif
 
 /*
  * Without tasklist or rcu lock it is not safe to dereference
@@ -496,6 +496,14 @@ struct rq {
 
 	atomic_t nr_iowait;
 
+#ifdef CONFIG_CPU_FREQ
+	/* busy time average for cpufreq, see update_rq_util() */
+	u64 util_stamp;
+	u64 util_busy;
+	unsigned long util_avg;
+	int util_pending;
+#endif
+
 #ifdef CONFIG_SMP
 	struct root_domain *rd;
 	struct sched_domain *sd;
@@ -1293,6 +1301,94 @@ static void sched_avg_update(struct rq *rq)
 }
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Length of the window update_rq_util() measures busy time over.
+ */
+#define UTIL_WINDOW_NS		((s64)TICK_NSEC)
+
+static DEFINE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_set_update_util_data - set the utilization callback of a cpu
+ * @cpu: cpu to report utilization of
+ * @data: callback, or NULL to stop reporting
+ *
+ * The callback runs from the tick and from wakeups, without rq->lock held
+ * but with preemption disabled. After clearing it the caller must wait
+ * for synchronize_sched() before freeing @data.
+ */
+void cpufreq_set_update_util_data(int cpu, struct update_util_data *data)
+{
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), data);
+}
+EXPORT_SYMBOL_GPL(cpufreq_set_update_util_data);
+
+/*
+ * Account @busy nanoseconds of task execution and, once a window has
+ * passed, fold the busy fraction of that window into rq->util_avg.
+ * A higher value is taken at once so bursts are seen immediately, a
+ * lower one only pulls the average down by half per window.
+ */
+static void update_rq_util(struct rq *rq, u64 busy)
+{
+	u64 delta = rq->clock_task - rq->util_stamp;
+	unsigned long util, avg;
+	u64 windows;
+
+	rq->util_busy += busy;
+	if ((s64)delta < UTIL_WINDOW_NS)
+		return;
+
+	util = div64_u64(rq->util_busy << SCHED_LOAD_SHIFT, delta);
+	if (util > SCHED_LOAD_SCALE)
+		util = SCHED_LOAD_SCALE;
+
+	/* windows we slept through count as idle ones */
+	windows = div64_u64(delta, UTIL_WINDOW_NS);
+	avg = rq->util_avg;
+	if (windows > 1)
+		avg >>= min_t(u64, windows - 1, SCHED_LOAD_SHIFT);
+
+	if (util >= avg)
+		rq->util_avg = util;
+	else
+		rq->util_avg = (avg + util) >> 1;
+
+	rq->util_busy = 0;
+	rq->util_stamp = rq->clock_task;
+	rq->util_pending = 1;
+}
+
+/*
+ * Hand a new rq->util_avg to the cpufreq governor, if one is listening.
+ * Called after rq->lock is dropped so the governor may wake its thread.
+ */
+static void cpufreq_update_util(struct rq *rq)
+{
+	struct update_util_data *data;
+	int cpu = cpu_of(rq);
+
+	if (!rq->util_pending || !xchg(&rq->util_pending, 0))
+		return;
+
+	rcu_read_lock_sched();
+	data = rcu_dereference_sched(per_cpu(cpufreq_update_util_data, cpu));
+	if (data)
+		data->func(data, cpu, ACCESS_ONCE(rq->util_avg),
+			   SCHED_LOAD_SCALE);
+	rcu_read_unlock_sched();
+}
+#else
+static inline void update_rq_util(struct rq *rq, u64 busy)
+{
+}
+
+static inline void cpufreq_update_util(struct rq *rq)
+{
+}
+#endif /* CONFIG_CPU_FREQ */
+
 #if BITS_PER_LONG == 32
 # define WMULT_CONST	(~0UL)
 #else
@@ -1957,6 +2053,7 @@ static void enqueue_task(struct rq *rq, struct task_struct *p, int flags)
 	sched_info_queued(p);
 	p->sched_class->enqueue_task(rq, p, flags);
 	p->se.on_rq = 1;
+	update_rq_util(rq, 0);
 }
 
 static void dequeue_task(struct rq *rq, struct task_struct *p, int flags)
@@ -2488,6 +2585,7 @@ out_running:
 #endif
 out:
 	task_rq_unlock(rq, &flags);
+	cpufreq_update_util(rq);
 	put_cpu();
 
 	return success;
@@ -2657,6 +2755,7 @@ void wake_up_new_task(struct task_struct *p, unsigned long clone_flags)
 		p->sched_class->task_woken(rq, p);
 #endif
 	task_rq_unlock(rq, &flags);
+	cpufreq_update_util(rq);
 	put_cpu();
 }
 
@@ -3653,8 +3752,11 @@ void scheduler_tick(void)
 	update_rq_clock(rq);
 	update_cpu_load(rq);
 	curr->sched_class->task_tick(rq, curr, 0);
+	update_rq_util(rq, 0);
 	raw_spin_unlock(&rq->lock);
 
+	cpufreq_update_util(rq);
+
 	perf_event_task_tick(curr);
 
 #ifdef CONFIG_SMP
@@ -537,6 +537,10 @@ static void update_curr(struct cfs_rq *cfs_rq)
 	__update_curr(cfs_rq, curr, delta_exec);
 	curr->exec_start = now;
 
+	/* group entities carry their children's time up to the root */
+	if (cfs_rq == &rq_of(cfs_rq)->cfs)
+		update_rq_util(rq_of(cfs_rq), delta_exec);
+
 	if (entity_is_task(curr)) {
 		struct task_struct *curtask = task_of(curr);
 
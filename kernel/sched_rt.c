@@ -622,6 +622,7 @@ static void update_curr_rt(struct rq *rq)
 	cpuacct_charge(curr, delta_exec);
 
 	sched_rt_avg_update(rq, delta_exec);
+	update_rq_util(rq, delta_exec);
 
 	if (!rt_bandwidth_enabled())
 		return;
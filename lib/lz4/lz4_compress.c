@@ -0,0 +1,132 @@
+/*
+ * LZ4 - Fast LZ compression algorithm
+ *
+ * LZ4 format: Copyright (C) 2011-2012, Yann Collet.
+ * BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ *
+ * This is a compact greedy compressor producing the standard LZ4 block
+ * format, tuned for page sized inputs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline unsigned char *lz4_put_length(unsigned char *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = (unsigned char)len;
+	return op;
+}
+
+static inline unsigned char *lz4_put_literals(unsigned char *op,
+		unsigned char *token, const unsigned char *anchor, size_t lit)
+{
+	if (lit >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = lz4_put_length(op, lit - RUN_MASK);
+	} else {
+		*token = lit << ML_BITS;
+	}
+	memcpy(op, anchor, lit);
+	return op + lit;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	u32 *hashtable = wrkmem;
+	const unsigned char *ip = src;
+	const unsigned char *anchor = src;
+	const unsigned char *const iend = src + src_len;
+	const unsigned char *const mflimit = iend - MFLIMIT;
+	const unsigned char *const matchlimit = iend - LASTLITERALS;
+	unsigned char *op = dst;
+	unsigned char *token;
+
+	if (src_len < MINLENGTH)
+		goto last_literals;
+
+	memset(hashtable, 0, HASHTABLESIZE * sizeof(*hashtable));
+	ip++;
+
+	while (ip <= mflimit) {
+		const unsigned char *ref;
+		const unsigned char *start;
+		unsigned int searchmatchnb = 1U << SKIPSTRENGTH;
+		size_t len;
+		u32 h;
+
+		/* Find a match */
+		for (;;) {
+			h = HASH_VALUE(ip);
+			ref = src + hashtable[h];
+			hashtable[h] = ip - src;
+			if (ip - ref <= MAX_DISTANCE && ref < ip &&
+					A32(ref) == A32(ip))
+				break;
+			ip += searchmatchnb++ >> SKIPSTRENGTH;
+			if (ip > mflimit)
+				goto last_literals;
+		}
+
+		/* Catch up */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		/* Encode literal length and literals */
+		token = op++;
+		op = lz4_put_literals(op, token, anchor, ip - anchor);
+
+		/* Encode offset */
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		/* Count match length */
+		start = ip;
+		ip += MINMATCH;
+		ref += MINMATCH;
+		while (ip < matchlimit && *ip == *ref) {
+			ip++;
+			ref++;
+		}
+
+		/* Encode match length */
+		len = ip - start - MINMATCH;
+		if (len >= ML_MASK) {
+			*token |= ML_MASK;
+			op = lz4_put_length(op, len - ML_MASK);
+		} else {
+			*token |= len;
+		}
+
+		anchor = ip;
+
+		/* Fill the table with a position inside the match */
+		if (ip <= mflimit)
+			hashtable[HASH_VALUE(ip - 2)] = ip - 2 - src;
+	}
+
+last_literals:
+	/* Encode last literals */
+	token = op++;
+	op = lz4_put_literals(op, token, anchor, iend - anchor);
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("LZ4 compressor");
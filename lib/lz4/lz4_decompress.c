@@ -0,0 +1,108 @@
+/*
+ * LZ4 Decompressor for Linux kernel
+ *
+ * LZ4 format: Copyright (C) 2011-2012, Yann Collet.
+ * BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/*
+ * Read an extended length: a run of 255 bytes terminated by a byte
+ * below 255. Returns -1 if the input ends first.
+ */
+static inline int lz4_get_length(const unsigned char **ipp,
+		const unsigned char *iend, size_t *len)
+{
+	const unsigned char *ip = *ipp;
+	unsigned int s;
+
+	do {
+		if (unlikely(ip >= iend))
+			return -1;
+		s = *ip++;
+		*len += s;
+	} while (s == 255);
+
+	*ipp = ip;
+	return 0;
+}
+
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len)
+{
+	const unsigned char *ip = src;
+	const unsigned char *const iend = src + src_len;
+	unsigned char *op = dest;
+	unsigned char *const oend = dest + *dest_len;
+
+	while (ip < iend) {
+		const unsigned char *ref;
+		unsigned int token;
+		size_t length, offset;
+
+		/* get runlength */
+		token = *ip++;
+		length = token >> ML_BITS;
+		if (length == RUN_MASK && lz4_get_length(&ip, iend, &length))
+			goto _output_error;
+
+		/* copy literals */
+		if (unlikely(length > (size_t)(iend - ip) ||
+				length > (size_t)(oend - op)))
+			goto _output_error;
+		memcpy(op, ip, length);
+		op += length;
+		ip += length;
+
+		/* the last sequence has no match part */
+		if (ip == iend)
+			break;
+
+		/* get offset */
+		if (unlikely(iend - ip < 2))
+			goto _output_error;
+		offset = A16(ip);
+		ip += 2;
+		if (unlikely(offset == 0 || offset > (size_t)(op - dest)))
+			goto _output_error;
+		ref = op - offset;
+
+		/* get matchlength */
+		length = token & ML_MASK;
+		if (length == ML_MASK && lz4_get_length(&ip, iend, &length))
+			goto _output_error;
+		length += MINMATCH;
+		if (unlikely(length > (size_t)(oend - op)))
+			goto _output_error;
+
+		/* copy repeated sequence; it may overlap the output */
+		if (offset >= length) {
+			memcpy(op, ref, length);
+			op += length;
+		} else {
+			while (length--)
+				*op++ = *ref++;
+		}
+	}
+
+	*dest_len = op - dest;
+	return 0;
+
+_output_error:
+	return -1;
+}
+EXPORT_SYMBOL_GPL(lz4_decompress_unknownoutputsize);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
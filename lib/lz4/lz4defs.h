@@ -0,0 +1,42 @@
+/*
+ * lz4defs.h -- architecture specific defines
+ *
+ * LZ4 format: Copyright (C) 2011-2012, Yann Collet.
+ * BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Architecture-specific macros
+ */
+#define A32(p) get_unaligned((const u32 *)(p))
+#define A16(p) get_unaligned_le16(p)
+
+#define COPYLENGTH 8
+#define ML_BITS  4
+#define ML_MASK  ((1U << ML_BITS) - 1)
+#define RUN_BITS (8 - ML_BITS)
+#define RUN_MASK ((1U << RUN_BITS) - 1)
+#define MINMATCH 4
+#define MAX_DISTANCE ((1 << 16) - 1)
+
+/*
+ * A match must start at least MFLIMIT bytes before the end of the
+ * input, and the last LASTLITERALS bytes are always literals.
+ */
+#define LASTLITERALS 5
+#define MFLIMIT (COPYLENGTH + MINMATCH)
+#define MINLENGTH (MFLIMIT + 1)
+
+/*
+ * Compressor hash table: HASH_LOG bits, one u32 input offset per entry.
+ * Skip ahead faster over data that does not seem to compress.
+ */
+#define HASH_LOG 12
+#define HASHTABLESIZE (1 << HASH_LOG)
+#define HASH_VALUE(p) \
+	((A32(p) * 2654435761U) >> ((MINMATCH * 8) - HASH_LOG))
+#define SKIPSTRENGTH 6
@@ -27,6 +27,8 @@
 #include <linux/personality.h>
 #include <linux/bitops.h>
 #include <linux/mutex.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
 #include <linux/shmem_fs.h>
 #include <linux/ashmem.h>
 
@@ -37,12 +39,13 @@
 /*
  * ashmem_area - anonymous shared memory area
  * Lifecycle: From our parent file's open() until its release()
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its own `mutex'
  * Big Note: Mappings do NOT pin this structure; it dies on close()
  */
 struct ashmem_area {
 	char name[ASHMEM_FULL_NAME_LEN];/* optional name for /proc/pid/maps */
-	struct list_head unpinned_list;	/* list of all ashmem areas */
+	struct rb_root unpinned_root;	/* unpinned ranges, by pgstart */
+	struct mutex mutex;		/* protects this area and its ranges */
 	struct file *file;		/* the shmem-based backing file */
 	size_t size;			/* size of the mapping, in bytes */
 	unsigned long prot_mask;	/* allowed prot bits, as vm_flags */
@@ -51,29 +54,37 @@ struct ashmem_area {
 /*
  * ashmem_range - represents an interval of unpinned (evictable) pages
  * Lifecycle: From unpin to pin
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its area's `mutex'; the LRU entry and, while the
+ * range is on the LRU, its bounds also by `ashmem_lru_lock'
+ *
+ * The unpinned ranges of an area never overlap, so ordering them by
+ * pgstart orders them by pgend as well and the tree is an interval tree.
  */
 struct ashmem_range {
 	struct list_head lru;		/* entry in LRU list */
-	struct list_head unpinned;	/* entry in its area's unpinned list */
+	struct rb_node node;		/* entry in its area's unpinned tree */
 	struct ashmem_area *asma;	/* associated area */
 	size_t pgstart;			/* starting page, inclusive */
 	size_t pgend;			/* ending page, inclusive */
 	unsigned int purged;		/* ASHMEM_NOT or ASHMEM_WAS_PURGED */
 };
 
-/* LRU list of unpinned pages, protected by ashmem_mutex */
+/* LRU list of unpinned pages, protected by ashmem_lru_lock */
 static LIST_HEAD(ashmem_lru_list);
 
-/* Count of pages on our LRU list, protected by ashmem_mutex */
+/* Count of pages on our LRU list, protected by ashmem_lru_lock */
 static unsigned long lru_count;
 
 /*
- * ashmem_mutex - protects the list of and each individual ashmem_area
+ * ashmem_lru_lock - protects the LRU list and count
+ *
+ * Lock Ordering: asma->mutex -> ashmem_lru_lock
+ *		  asma->mutex -> i_mutex -> i_alloc_sem
  *
- * Lock Ordering: ashmex_mutex -> i_mutex -> i_alloc_sem
+ * The shrinker finds its ranges under ashmem_lru_lock and only trylocks
+ * their area, then drops ashmem_lru_lock to truncate.
  */
-static DEFINE_MUTEX(ashmem_mutex);
+static DEFINE_SPINLOCK(ashmem_lru_lock);
 
 static struct kmem_cache *ashmem_area_cachep __read_mostly;
 static struct kmem_cache *ashmem_range_cachep __read_mostly;
@@ -90,13 +101,6 @@ static struct kmem_cache *ashmem_range_cachep __read_mostly;
 #define page_range_subsumed_by_range(range, start, end) \
   (((range)->pgstart <= (start)) && ((range)->pgend >= (end)))
 
-#define page_in_range(range, page) \
- (((range)->pgstart <= (page)) && ((range)->pgend >= (page)))
-
-#define page_range_in_range(range, start, end) \
-  (page_in_range(range, start) || page_in_range(range, end) || \
-   page_range_subsumes_range(range, start, end))
-
 #define range_before_page(range, page) \
   ((range)->pgend < (page))
 
@@ -104,31 +108,73 @@ static struct kmem_cache *ashmem_range_cachep __read_mostly;
 
 static inline void lru_add(struct ashmem_range *range)
 {
+	spin_lock(&ashmem_lru_lock);
 	list_add_tail(&range->lru, &ashmem_lru_list);
 	lru_count += range_size(range);
+	spin_unlock(&ashmem_lru_lock);
 }
 
-static inline void lru_del(struct ashmem_range *range)
+/* Caller must hold ashmem_lru_lock. */
+static inline void __lru_del(struct ashmem_range *range)
 {
 	list_del(&range->lru);
 	lru_count -= range_size(range);
 }
 
+static inline void lru_del(struct ashmem_range *range)
+{
+	spin_lock(&ashmem_lru_lock);
+	__lru_del(range);
+	spin_unlock(&ashmem_lru_lock);
+}
+
+/*
+ * range_lookup - find the lowest unpinned range ending at or after 'page'
+ *
+ * Caller must hold asma->mutex.
+ */
+static struct ashmem_range *range_lookup(struct ashmem_area *asma, size_t page)
+{
+	struct rb_node *node = asma->unpinned_root.rb_node;
+	struct ashmem_range *range, *found = NULL;
+
+	while (node) {
+		range = rb_entry(node, struct ashmem_range, node);
+		if (range_before_page(range, page)) {
+			node = node->rb_right;
+		} else {
+			found = range;
+			node = node->rb_left;
+		}
+	}
+
+	return found;
+}
+
+static inline struct ashmem_range *range_next(struct ashmem_range *range)
+{
+	struct rb_node *node = rb_next(&range->node);
+
+	return node ? rb_entry(node, struct ashmem_range, node) : NULL;
+}
+
 /*
  * range_alloc - allocate and initialize a new ashmem_range structure
  *
  * 'asma' - associated ashmem_area
- * 'prev_range' - the previous ashmem_range in the sorted asma->unpinned list
  * 'purged' - initial purge value (ASMEM_NOT_PURGED or ASHMEM_WAS_PURGED)
  * 'start' - starting page, inclusive
  * 'end' - ending page, inclusive
  *
- * Caller must hold ashmem_mutex.
+ * The new range must not overlap any of the area's unpinned ranges.
+ *
+ * Caller must hold asma->mutex.
  */
-static int range_alloc(struct ashmem_area *asma,
-		       struct ashmem_range *prev_range, unsigned int purged,
+static int range_alloc(struct ashmem_area *asma, unsigned int purged,
 		       size_t start, size_t end)
 {
+	struct rb_node **p = &asma->unpinned_root.rb_node;
+	struct rb_node *parent = NULL;
 	struct ashmem_range *range;
 
 	range = kmem_cache_zalloc(ashmem_range_cachep, GFP_KERNEL);
@@ -140,7 +186,15 @@ static int range_alloc(struct ashmem_area *asma,
 	range->pgend = end;
 	range->purged = purged;
 
-	list_add_tail(&range->unpinned, &prev_range->unpinned);
+	while (*p) {
+		parent = *p;
+		if (start < rb_entry(parent, struct ashmem_range, node)->pgstart)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&range->node, parent, p);
+	rb_insert_color(&range->node, &asma->unpinned_root);
 
 	if (range_on_lru(range))
 		lru_add(range);
@@ -148,9 +202,14 @@ static int range_alloc(struct ashmem_area *asma,
 	return 0;
 }
 
+/*
+ * range_del - remove a range from its area and the LRU and free it
+ *
+ * Caller must hold asma->mutex.
+ */
 static void range_del(struct ashmem_range *range)
 {
-	list_del(&range->unpinned);
+	rb_erase(&range->node, &range->asma->unpinned_root);
 	if (range_on_lru(range))
 		lru_del(range);
 	kmem_cache_free(ashmem_range_cachep, range);
@@ -159,18 +218,27 @@ static void range_del(struct ashmem_range *range)
 /*
  * range_shrink - shrinks a range
  *
- * Caller must hold ashmem_mutex.
+ * Shrinking keeps the range clear of its neighbours, so its position in
+ * the tree stays valid.
+ *
+ * Caller must hold asma->mutex.
  */
 static inline void range_shrink(struct ashmem_range *range,
 				size_t start, size_t end)
 {
 	size_t pre = range_size(range);
 
+	if (!range_on_lru(range)) {
+		range->pgstart = start;
+		range->pgend = end;
+		return;
+	}
+
+	spin_lock(&ashmem_lru_lock);
 	range->pgstart = start;
 	range->pgend = end;
-
-	if (range_on_lru(range))
-		lru_count -= pre - range_size(range);
+	lru_count -= pre - range_size(range);
+	spin_unlock(&ashmem_lru_lock);
 }
 
 static int ashmem_open(struct inode *inode, struct file *file)
@@ -186,7 +254,8 @@ static int ashmem_open(struct inode *inode, struct file *file)
 	if (unlikely(!asma))
 		return -ENOMEM;
 
-	INIT_LIST_HEAD(&asma->unpinned_list);
+	asma->unpinned_root = RB_ROOT;
+	mutex_init(&asma->mutex);
 	memcpy(asma->name, ASHMEM_NAME_PREFIX, ASHMEM_NAME_PREFIX_LEN);
 	asma->prot_mask = PROT_MASK;
 	file->private_data = asma;
@@ -197,12 +266,12 @@ static int ashmem_open(struct inode *inode, struct file *file)
 static int ashmem_release(struct inode *ignored, struct file *file)
 {
 	struct ashmem_area *asma = file->private_data;
-	struct ashmem_range *range, *next;
+	struct rb_node *node;
 
-	mutex_lock(&ashmem_mutex);
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned)
-		range_del(range);
-	mutex_unlock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
+	while ((node = rb_first(&asma->unpinned_root)) != NULL)
+		range_del(rb_entry(node, struct ashmem_range, node));
+	mutex_unlock(&asma->mutex);
 
 	if (asma->file)
 		fput(asma->file);
@@ -217,7 +286,7 @@ static ssize_t ashmem_read(struct file *file, char __user *buf,
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* If size is not set, or set to 0, always return EOF. */
 	if (asma->size == 0) {
@@ -238,7 +307,7 @@ static ssize_t ashmem_read(struct file *file, char __user *buf,
 	asma->file->f_pos = *pos;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -247,7 +316,7 @@ static loff_t ashmem_llseek(struct file *file, loff_t offset, int origin)
 	struct ashmem_area *asma = file->private_data;
 	int ret;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	if (asma->size == 0) {
 		ret = -EINVAL;
@@ -268,7 +337,7 @@ static loff_t ashmem_llseek(struct file *file, loff_t offset, int origin)
 	file->f_pos = asma->file->f_pos;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -285,7 +354,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* user needs to SET_SIZE before mapping */
 	if (unlikely(!asma->size)) {
@@ -328,7 +397,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	vma->vm_flags |= VM_CAN_NONLINEAR;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -349,7 +418,8 @@ out:
  */
 static int ashmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 {
-	struct ashmem_range *range, *next;
+	struct ashmem_range *range;
+	unsigned long skipped = 0;
 
 	/* We might recurse into filesystem code, so bail out if necessary */
 	if (nr_to_scan && !(gfp_mask & __GFP_FS))
@@ -357,22 +427,46 @@ static int ashmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 	if (!nr_to_scan)
 		return lru_count;
 
-	if (!mutex_trylock(&ashmem_mutex))
-	 return -1;
-	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
-		struct inode *inode = range->asma->file->f_dentry->d_inode;
-		loff_t start = range->pgstart * PAGE_SIZE;
-		loff_t end = (range->pgend + 1) * PAGE_SIZE - 1;
+	spin_lock(&ashmem_lru_lock);
+	while (nr_to_scan > 0 && skipped < lru_count) {
+		struct ashmem_area *asma;
+		struct inode *inode;
+		loff_t start, end;
 
-		vmtruncate_range(inode, start, end);
-		range->purged = ASHMEM_WAS_PURGED;
-		lru_del(range);
+		range = list_first_entry(&ashmem_lru_list, struct ashmem_range,
+					 lru);
+		asma = range->asma;
 
+		/*
+		 * The area is being pinned, unpinned or truncated by someone
+		 * else; it is in use, so treat it as recently unpinned.
+		 */
+		if (!mutex_trylock(&asma->mutex)) {
+			list_move_tail(&range->lru, &ashmem_lru_list);
+			skipped += range_size(range);
+			continue;
+		}
+
+		/*
+		 * With the area locked the range can't be pinned or freed, and
+		 * off the LRU no other shrinker will pick it, so truncate it
+		 * without holding up everyone else's unpin and shrink.
+		 */
+		__lru_del(range);
+		range->purged = ASHMEM_WAS_PURGED;
 		nr_to_scan -= range_size(range);
-		if (nr_to_scan <= 0)
-			break;
+
+		inode = asma->file->f_dentry->d_inode;
+		start = range->pgstart * PAGE_SIZE;
+		end = (range->pgend + 1) * PAGE_SIZE - 1;
+		spin_unlock(&ashmem_lru_lock);
+
+		vmtruncate_range(inode, start, end);
+		mutex_unlock(&asma->mutex);
+
+		spin_lock(&ashmem_lru_lock);
 	}
-	mutex_unlock(&ashmem_mutex);
+	spin_unlock(&ashmem_lru_lock);
 
 	return lru_count;
 }
@@ -386,7 +480,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* the user can only remove, not add, protection bits */
 	if (unlikely((asma->prot_mask & prot) != prot)) {
@@ -401,7 +495,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 	asma->prot_mask = prot;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -409,7 +503,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* cannot change an existing mapping's name */
 	if (unlikely(asma->file)) {
@@ -423,7 +517,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 	asma->name[ASHMEM_FULL_NAME_LEN-1] = '\0';
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -432,7 +526,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 	if (asma->name[ASHMEM_NAME_PREFIX_LEN] != '\0') {
 		size_t len;
 
@@ -449,7 +543,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 					  sizeof(ASHMEM_NAME_DEF))))
 			ret = -EFAULT;
 	}
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -458,17 +552,18 @@ static int get_name(struct ashmem_area *asma, void __user *name)
  * ashmem_pin - pin the given ashmem region, returning whether it was
  * previously purged (ASHMEM_WAS_PURGED) or not (ASHMEM_NOT_PURGED).
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
 	struct ashmem_range *range, *next;
 	int ret = ASHMEM_NOT_PURGED;
+	size_t old_end;
 
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned) {
-		/* moved past last applicable page; we can short circuit */
-		if (range_before_page(range, pgstart))
-			break;
+	/* visit only the ranges overlapping [pgstart, pgend], lowest first */
+	for (range = range_lookup(asma, pgstart);
+	     range && range->pgstart <= pgend; range = next) {
+		next = range_next(range);
 
 		/*
 		 * The user can ask us to pin pages that span multiple ranges,
@@ -485,37 +580,35 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 		 *    so we have to update one side of the range and then
 		 *    create a new range for the other side.
 		 */
-		if (page_range_in_range(range, pgstart, pgend)) {
-			ret |= range->purged;
-
-			/* Case #1: Easy. Just nuke the whole thing. */
-			if (page_range_subsumes_range(range, pgstart, pgend)) {
-				range_del(range);
-				continue;
-			}
-
-			/* Case #2: We overlap from the start, so adjust it */
-			if (range->pgstart >= pgstart) {
-				range_shrink(range, pgend + 1, range->pgend);
-				continue;
-			}
-
-			/* Case #3: We overlap from the rear, so adjust it */
-			if (range->pgend <= pgend) {
-				range_shrink(range, range->pgstart, pgstart-1);
-				continue;
-			}
-
-			/*
-			 * Case #4: We eat a chunk out of the middle. A bit
-			 * more complicated, we allocate a new range for the
-			 * second half and adjust the first chunk's endpoint.
-			 */
-			range_alloc(asma, range, range->purged,
-				    pgend + 1, range->pgend);
-			range_shrink(range, range->pgstart, pgstart - 1);
-			break;
+		ret |= range->purged;
+
+		/* Case #1: Easy. Just nuke the whole thing. */
+		if (page_range_subsumes_range(range, pgstart, pgend)) {
+			range_del(range);
+			continue;
 		}
+
+		/* Case #2: We overlap from the start, so adjust it */
+		if (range->pgstart >= pgstart) {
+			range_shrink(range, pgend + 1, range->pgend);
+			continue;
+		}
+
+		/* Case #3: We overlap from the rear, so adjust it */
+		if (range->pgend <= pgend) {
+			range_shrink(range, range->pgstart, pgstart-1);
+			continue;
+		}
+
+		/*
+		 * Case #4: We eat a chunk out of the middle. A bit
+		 * more complicated, we shrink the range to the first half
+		 * and allocate a new range for the second half.
+		 */
+		old_end = range->pgend;
+		range_shrink(range, range->pgstart, pgstart - 1);
+		range_alloc(asma, range->purged, pgend + 1, old_end);
+		break;
 	}
 
 	return ret;
@@ -524,59 +617,48 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 /*
  * ashmem_unpin - unpin the given range of pages. Returns zero on success.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_unpin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
 	struct ashmem_range *range, *next;
 	unsigned int purged = ASHMEM_NOT_PURGED;
 
-restart:
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned) {
-		/* short circuit: this is our insertion point */
-		if (range_before_page(range, pgstart))
-			break;
+	for (range = range_lookup(asma, pgstart);
+	     range && range->pgstart <= pgend; range = next) {
+		next = range_next(range);
 
 		/*
 		 * The user can ask us to unpin pages that are already entirely
-		 * or partially pinned. We handle those two cases here.
+		 * or partially unpinned. We handle those two cases here.
 		 */
 		if (page_range_subsumed_by_range(range, pgstart, pgend))
 			return 0;
-		if (page_range_in_range(range, pgstart, pgend)) {
-			pgstart = min_t(size_t, range->pgstart, pgstart),
-			pgend = max_t(size_t, range->pgend, pgend);
-			purged |= range->purged;
-			range_del(range);
-			goto restart;
-		}
+
+		pgstart = min_t(size_t, range->pgstart, pgstart);
+		pgend = max_t(size_t, range->pgend, pgend);
+		purged |= range->purged;
+		range_del(range);
 	}
 
-	return range_alloc(asma, range, purged, pgstart, pgend);
+	return range_alloc(asma, purged, pgstart, pgend);
 }
 
 /*
  * ashmem_get_pin_status - Returns ASHMEM_IS_UNPINNED if _any_ pages in the
  * given interval are unpinned and ASHMEM_IS_PINNED otherwise.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_get_pin_status(struct ashmem_area *asma, size_t pgstart,
 				 size_t pgend)
 {
-	struct ashmem_range *range;
-	int ret = ASHMEM_IS_PINNED;
-
-	list_for_each_entry(range, &asma->unpinned_list, unpinned) {
-		if (range_before_page(range, pgstart))
-			break;
-		if (page_range_in_range(range, pgstart, pgend)) {
-			ret = ASHMEM_IS_UNPINNED;
-			break;
-		}
-	}
+	struct ashmem_range *range = range_lookup(asma, pgstart);
 
-	return ret;
+	if (range && range->pgstart <= pgend)
+		return ASHMEM_IS_UNPINNED;
+
+	return ASHMEM_IS_PINNED;
 }
 
 static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
@@ -608,7 +690,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 	pgstart = pin.offset / PAGE_SIZE;
 	pgend = pgstart + (pin.len / PAGE_SIZE) - 1;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	switch (cmd) {
 	case ASHMEM_PIN:
@@ -622,7 +704,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 		break;
 	}
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -641,10 +723,12 @@ static long ashmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		break;
 	case ASHMEM_SET_SIZE:
 		ret = -EINVAL;
+		mutex_lock(&asma->mutex);
 		if (!asma->file) {
 			ret = 0;
 			asma->size = (size_t) arg;
 		}
+		mutex_unlock(&asma->mutex);
 		break;
 	case ASHMEM_GET_SIZE:
 		ret = asma->size;
@@ -0,0 +1,186 @@
+/*
+ * linux/mm/cma.c
+ *
+ * Contiguous memory areas shared with the page allocator.
+ *
+ * The multimedia carveouts (bmem, gememalloc, pmem) are reserved at boot
+ * like before and registered here with cma_declare_area(). Once the page
+ * allocator is up, their pageblocks are freed to it as MIGRATE_CMA, which
+ * only movable allocations fall back to. The drivers keep placing buffers
+ * in their carveout with their own allocators and call cma_claim() on
+ * each buffer before handing it out, which migrates whatever the page
+ * allocator put there, and cma_release() when the buffer is freed.
+ *
+ * Only the part of an area aligned to pageblocks is shared, the head and
+ * tail stay reserved and claims on them succeed without doing anything.
+ */
+
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/pfn.h>
+#include <linux/cma.h>
+#include <linux/delay.h>
+#include <linux/swap.h>
+
+#define MAX_CMA_AREAS	4
+
+/*
+ * Pages under writeback or I/O, or briefly pinned by get_user_pages(),
+ * can't be migrated right away but usually can a little later. A claim
+ * that fails on such pages is retried a few times before giving up.
+ */
+#define CMA_CLAIM_RETRIES	5
+#define CMA_CLAIM_RETRY_MS	20
+
+struct cma_area {
+	unsigned long base_pfn;		/* shared part, pageblock aligned */
+	unsigned long end_pfn;
+};
+
+static struct cma_area cma_areas[MAX_CMA_AREAS];
+static unsigned int cma_area_count;
+/* claims of neighbouring buffers isolate the same pageblocks */
+static DEFINE_MUTEX(cma_mutex);
+
+static unsigned long cma_align(void)
+{
+	return max_t(unsigned long, MAX_ORDER_NR_PAGES, pageblock_nr_pages);
+}
+
+/*
+ * Register [base, base + size) as a contiguous memory area. The memory
+ * must have been reserved already, e.g. with reserve_bootmem(), and this
+ * has to be called before the initcalls run.
+ */
+int __init cma_declare_area(phys_addr_t base, unsigned long size)
+{
+	unsigned long align = cma_align();
+	unsigned long start = ALIGN(PFN_UP(base), align);
+	unsigned long end = PFN_DOWN(base + size) & ~(align - 1);
+
+	if (cma_area_count == MAX_CMA_AREAS)
+		return -ENOSPC;
+	if (start >= end) {
+		pr_warning("cma: area at 0x%08lx is too small to share\n",
+			   (unsigned long)base);
+		return -EINVAL;
+	}
+
+	cma_areas[cma_area_count].base_pfn = start;
+	cma_areas[cma_area_count].end_pfn = end;
+	cma_area_count++;
+	return 0;
+}
+
+static int __init cma_activate_area(struct cma_area *area)
+{
+	unsigned long pfn;
+	struct zone *zone;
+
+	/* alloc_contig_range() works on a single zone */
+	zone = page_zone(pfn_to_page(area->base_pfn));
+	for (pfn = area->base_pfn; pfn < area->end_pfn; pfn++) {
+		if (!pfn_valid(pfn) || page_zone(pfn_to_page(pfn)) != zone)
+			return -EINVAL;
+	}
+
+	for (pfn = area->base_pfn; pfn < area->end_pfn;
+	     pfn += pageblock_nr_pages)
+		init_cma_reserved_pageblock(pfn_to_page(pfn));
+	return 0;
+}
+
+static int __init cma_init_reserved_areas(void)
+{
+	struct cma_area *area;
+	unsigned int i;
+
+	for (i = 0; i < cma_area_count; i++) {
+		area = &cma_areas[i];
+		if (cma_activate_area(area)) {
+			pr_err("cma: area at pfn 0x%lx spans zones, "
+			       "keeping it reserved\n", area->base_pfn);
+			area->end_pfn = area->base_pfn;
+			continue;
+		}
+		pr_info("cma: sharing %lu KiB at 0x%08lx\n",
+			(area->end_pfn - area->base_pfn) << (PAGE_SHIFT - 10),
+			(unsigned long)PFN_PHYS(area->base_pfn));
+	}
+	return 0;
+}
+core_initcall(cma_init_reserved_areas);
+
+/* Clip [*start, *end) to the shared part of the area it lies in */
+static int cma_clip(unsigned long *start, unsigned long *end)
+{
+	struct cma_area *area;
+	unsigned int i;
+
+	for (i = 0; i < cma_area_count; i++) {
+		area = &cma_areas[i];
+		if (*start < area->end_pfn && *end > area->base_pfn) {
+			*start = max(*start, area->base_pfn);
+			*end = min(*end, area->end_pfn);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * cma_claim() - take a buffer of a contiguous memory area for a device
+ * @base:	physical address of the buffer
+ * @size:	size of the buffer
+ *
+ * Moves the pages the page allocator lent out of the buffer. The buffer
+ * may have stale lines in the kernel's cached mapping afterwards, which
+ * the caller has to clean before a device writes to it. May sleep.
+ * Returns 0, or -EBUSY when some page stayed pinned and could not be
+ * moved even after a few retries.
+ */
+int cma_claim(phys_addr_t base, unsigned long size)
+{
+	unsigned long start = PFN_DOWN(base);
+	unsigned long end = PFN_UP(base + size);
+	int tries = 0;
+	int ret;
+
+	if (!cma_clip(&start, &end))
+		return 0;
+
+	for (;;) {
+		mutex_lock(&cma_mutex);
+		ret = alloc_contig_range(start, end);
+		mutex_unlock(&cma_mutex);
+		if (ret != -EBUSY || ++tries > CMA_CLAIM_RETRIES)
+			break;
+		lru_add_drain_all();
+		msleep(CMA_CLAIM_RETRY_MS);
+	}
+	if (ret)
+		pr_debug("cma: claiming pfns 0x%lx-0x%lx failed: %d\n",
+			 start, end, ret);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(cma_claim);
+
+/**
+ * cma_release() - give a claimed buffer back to the page allocator
+ * @base:	physical address of the buffer
+ * @size:	size of the buffer
+ */
+void cma_release(phys_addr_t base, unsigned long size)
+{
+	unsigned long start = PFN_DOWN(base);
+	unsigned long end = PFN_UP(base + size);
+
+	if (!cma_clip(&start, &end))
+		return;
+
+	free_contig_range(start, end - start);
+}
+EXPORT_SYMBOL_GPL(cma_release);
@@ -45,6 +45,8 @@
 #include <linux/backing-dev.h>
 #include <linux/fault-inject.h>
 #include <linux/page-isolation.h>
+#include <linux/migrate.h>
+#include <linux/mm_inline.h>
 #include <linux/page_cgroup.h>
 #include <linux/debugobjects.h>
 #include <linux/kmemleak.h>
@@ -628,12 +630,28 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 		} while (list_empty(list));
 
 		do {
+			int mt;
+
 			page = list_entry(list->prev, struct page, lru);
 			/* must delete as __free_one_page list manipulates */
 			list_del(&page->lru);
-			/* MIGRATE_MOVABLE list may include MIGRATE_RESERVEs */
-			__free_one_page(page, zone, 0, page_private(page));
-			trace_mm_page_pcpu_drain(page, 0, page_private(page));
+			/*
+			 * MIGRATE_MOVABLE list may include MIGRATE_RESERVEs
+			 * and MIGRATE_CMAs. A CMA pageblock may have been
+			 * isolated since the page was freed, keep the page
+			 * off the allocatable lists then.
+			 */
+			mt = page_private(page);
+			if (is_migrate_cma(mt)) {
+				if (get_pageblock_migratetype(page) ==
+				    MIGRATE_ISOLATE)
+					mt = MIGRATE_ISOLATE;
+				else
+					__inc_zone_page_state(page,
+							NR_FREE_CMA_PAGES);
+			}
+			__free_one_page(page, zone, 0, mt);
+			trace_mm_page_pcpu_drain(page, 0, mt);
 		} while (--to_free && --batch_free && !list_empty(list));
 	}
 	__mod_zone_page_state(zone, NR_FREE_PAGES, count);
@@ -649,6 +667,8 @@ static void free_one_page(struct zone *zone, struct page *page, int order,
 
 	__free_one_page(page, zone, order, migratetype);
 	__mod_zone_page_state(zone, NR_FREE_PAGES, 1 << order);
+	if (is_migrate_cma(migratetype))
+		__mod_zone_page_state(zone, NR_FREE_CMA_PAGES, 1 << order);
 	spin_unlock(&zone->lock);
 }
 
@@ -833,11 +853,21 @@ struct page *__rmqueue_smallest(struct zone *zone, unsigned int order,
  * This array describes the order lists are fallen back to when
  * the free lists for the desirable migrate type are depleted
  */
-static int fallbacks[MIGRATE_TYPES][MIGRATE_TYPES-1] = {
-	[MIGRATE_UNMOVABLE]   = { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE,   MIGRATE_RESERVE },
-	[MIGRATE_RECLAIMABLE] = { MIGRATE_UNMOVABLE,   MIGRATE_MOVABLE,   MIGRATE_RESERVE },
-	[MIGRATE_MOVABLE]     = { MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
-	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE,     MIGRATE_RESERVE,   MIGRATE_RESERVE }, /* Never used */
+/*
+ * Each row is terminated by MIGRATE_RESERVE. MIGRATE_CMA is only ever a
+ * fallback for movable allocations, and the first one so that CMA areas
+ * take movable pages before other pageblocks get mixed.
+ */
+static int fallbacks[MIGRATE_TYPES][4] = {
+	[MIGRATE_UNMOVABLE]   = { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE,     MIGRATE_RESERVE },
+	[MIGRATE_RECLAIMABLE] = { MIGRATE_UNMOVABLE,   MIGRATE_MOVABLE,     MIGRATE_RESERVE },
+#ifdef CONFIG_CMA
+	[MIGRATE_MOVABLE]     = { MIGRATE_CMA,         MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
+	[MIGRATE_CMA]         = { MIGRATE_RESERVE }, /* Never used */
+#else
+	[MIGRATE_MOVABLE]     = { MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE,   MIGRATE_RESERVE },
+#endif
+	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE }, /* Never used */
 };
 
 /*
@@ -933,12 +963,12 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 	/* Find the largest possible block of pages in the other list */
 	for (current_order = MAX_ORDER-1; current_order >= order;
 						--current_order) {
-		for (i = 0; i < MIGRATE_TYPES - 1; i++) {
+		for (i = 0;; i++) {
 			migratetype = fallbacks[start_migratetype][i];
 
 			/* MIGRATE_RESERVE handled later if necessary */
 			if (migratetype == MIGRATE_RESERVE)
-				continue;
+				break;
 
 			area = &(zone->free_area[current_order]);
 			if (list_empty(&area->free_list[migratetype]))
@@ -952,11 +982,14 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			 * If breaking a large block of pages, move all free
 			 * pages to the preferred allocation list. If falling
 			 * back for a reclaimable kernel allocation, be more
-			 * agressive about taking ownership of free pages
+			 * agressive about taking ownership of free pages.
+			 * MIGRATE_CMA pageblocks are never taken over, the
+			 * pages are lent to the movable allocation only.
 			 */
-			if (unlikely(current_order >= (pageblock_order >> 1)) ||
+			if (!is_migrate_cma(migratetype) &&
+			    (unlikely(current_order >= (pageblock_order >> 1)) ||
 					start_migratetype == MIGRATE_RECLAIMABLE ||
-					page_group_by_mobility_disabled) {
+					page_group_by_mobility_disabled)) {
 				unsigned long pages;
 				pages = move_freepages_block(zone, page,
 								start_migratetype);
@@ -975,7 +1008,8 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			rmv_page_order(page);
 
 			/* Take ownership for orders >= pageblock_order */
-			if (current_order >= pageblock_order)
+			if (current_order >= pageblock_order &&
+			    !is_migrate_cma(migratetype))
 				change_pageblock_range(page, current_order,
 							start_migratetype);
 
@@ -1035,6 +1069,8 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 	spin_lock(&zone->lock);
 	for (i = 0; i < count; ++i) {
 		struct page *page = __rmqueue(zone, order, migratetype);
+		int mt = migratetype;
+
 		if (unlikely(page == NULL))
 			break;
 
@@ -1051,7 +1087,16 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 			list_add(&page->lru, list);
 		else
 			list_add_tail(&page->lru, list);
-		set_page_private(page, migratetype);
+		/*
+		 * Pages borrowed from a CMA pageblock must go back to it when
+		 * the pcp list is drained.
+		 */
+		if (is_migrate_cma(get_pageblock_migratetype(page))) {
+			mt = MIGRATE_CMA;
+			__mod_zone_page_state(zone, NR_FREE_CMA_PAGES,
+					      -(1 << order));
+		}
+		set_page_private(page, mt);
 		list = &page->lru;
 	}
 	__mod_zone_page_state(zone, NR_FREE_PAGES, -(i << order));
@@ -1257,11 +1302,13 @@ int split_free_page(struct page *page)
 	unsigned int order;
 	unsigned long watermark;
 	struct zone *zone;
+	int mt;
 
 	BUG_ON(!PageBuddy(page));
 
 	zone = page_zone(page);
 	order = page_order(page);
+	mt = get_pageblock_migratetype(page);
 
 	/* Obey watermarks as if the page was being allocated */
 	watermark = low_wmark_pages(zone) + (1 << order);
@@ -1273,12 +1320,15 @@ int split_free_page(struct page *page)
 	zone->free_area[order].nr_free--;
 	rmv_page_order(page);
 	__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+	if (is_migrate_cma(mt))
+		__mod_zone_page_state(zone, NR_FREE_CMA_PAGES,
+				      -(1UL << order));
 
 	/* Split into individual pages */
 	set_page_refcounted(page);
 	split_page(page, order);
 
-	if (order >= pageblock_order - 1) {
+	if (order >= pageblock_order - 1 && !is_migrate_cma(mt)) {
 		struct page *endpage = page + (1 << order) - 1;
 		for (; page < endpage; page += pageblock_nr_pages)
 			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
@@ -1340,6 +1390,9 @@ again:
 		}
 		spin_lock_irqsave(&zone->lock, flags);
 		page = __rmqueue(zone, order, migratetype);
+		if (page && is_migrate_cma(get_pageblock_migratetype(page)))
+			__mod_zone_page_state(zone, NR_FREE_CMA_PAGES,
+					      -(1 << order));
 		spin_unlock(&zone->lock);
 		if (!page)
 			goto failed;
@@ -1372,6 +1425,7 @@ failed:
 #define ALLOC_HARDER		0x10 /* try to alloc harder */
 #define ALLOC_HIGH		0x20 /* __GFP_HIGH set */
 #define ALLOC_CPUSET		0x40 /* check for correct cpuset */
+#define ALLOC_CMA		0x80 /* may use MIGRATE_CMA pageblocks */
 
 #ifdef CONFIG_FAIL_PAGE_ALLOC
 
@@ -1480,6 +1534,9 @@ static bool __zone_watermark_ok(struct zone *z, int order, unsigned long mark,
 	int o;
 
 	free_pages -= (1 << order) + 1;
+	/* Free CMA pages only help allocations that may fall back to them */
+	if (!(alloc_flags & ALLOC_CMA))
+		free_pages -= zone_page_state(z, NR_FREE_CMA_PAGES);
 	if (alloc_flags & ALLOC_HIGH)
 		min -= min / 2;
 	if (alloc_flags & ALLOC_HARDER)
@@ -1989,6 +2046,9 @@ gfp_to_alloc_flags(gfp_t gfp_mask)
 			alloc_flags |= ALLOC_NO_WATERMARKS;
 	}
 
+	if (allocflags_to_migratetype(gfp_mask) == MIGRATE_MOVABLE)
+		alloc_flags |= ALLOC_CMA;
+
 	return alloc_flags;
 }
 
@@ -2148,6 +2208,7 @@ __alloc_pages_nodemask(gfp_t gfp_mask, unsigned int order,
 	struct zone *preferred_zone;
 	struct page *page;
 	int migratetype = allocflags_to_migratetype(gfp_mask);
+	int alloc_flags = ALLOC_WMARK_LOW|ALLOC_CPUSET;
 
 	gfp_mask &= gfp_allowed_mask;
 
@@ -2175,8 +2236,10 @@ __alloc_pages_nodemask(gfp_t gfp_mask, unsigned int order,
 	}
 
 	/* First allocation attempt */
+	if (migratetype == MIGRATE_MOVABLE)
+		alloc_flags |= ALLOC_CMA;
 	page = get_page_from_freelist(gfp_mask|__GFP_HARDWALL, nodemask, order,
-			zonelist, high_zoneidx, ALLOC_WMARK_LOW|ALLOC_CPUSET,
+			zonelist, high_zoneidx, alloc_flags,
 			preferred_zone, migratetype);
 	if (unlikely(!page))
 		page = __alloc_pages_slowpath(gfp_mask, order,
@@ -5336,12 +5399,14 @@ int set_migratetype_isolate(struct page *page)
 	int notifier_ret;
 	int ret = -EBUSY;
 	int zone_idx;
+	int migratetype;
 
 	zone = page_zone(page);
 	zone_idx = zone_idx(zone);
 
 	spin_lock_irqsave(&zone->lock, flags);
-	if (get_pageblock_migratetype(page) == MIGRATE_MOVABLE ||
+	migratetype = get_pageblock_migratetype(page);
+	if (migratetype == MIGRATE_MOVABLE || is_migrate_cma(migratetype) ||
 	    zone_idx == ZONE_MOVABLE) {
 		ret = 0;
 		goto out;
@@ -5384,8 +5449,12 @@ int set_migratetype_isolate(struct page *page)
 
 out:
 	if (!ret) {
+		unsigned long moved;
+
 		set_pageblock_migratetype(page, MIGRATE_ISOLATE);
-		move_freepages_block(zone, page, MIGRATE_ISOLATE);
+		moved = move_freepages_block(zone, page, MIGRATE_ISOLATE);
+		if (is_migrate_cma(migratetype))
+			__mod_zone_page_state(zone, NR_FREE_CMA_PAGES, -moved);
 	}
 
 	spin_unlock_irqrestore(&zone->lock, flags);
@@ -5394,20 +5463,234 @@ out:
 	return ret;
 }
 
-void unset_migratetype_isolate(struct page *page)
+void unset_migratetype_isolate(struct page *page, int migratetype)
 {
 	struct zone *zone;
 	unsigned long flags;
+	unsigned long moved;
 	zone = page_zone(page);
 	spin_lock_irqsave(&zone->lock, flags);
 	if (get_pageblock_migratetype(page) != MIGRATE_ISOLATE)
 		goto out;
-	set_pageblock_migratetype(page, MIGRATE_MOVABLE);
-	move_freepages_block(zone, page, MIGRATE_MOVABLE);
+	set_pageblock_migratetype(page, migratetype);
+	moved = move_freepages_block(zone, page, migratetype);
+	if (is_migrate_cma(migratetype))
+		__mod_zone_page_state(zone, NR_FREE_CMA_PAGES, moved);
 out:
 	spin_unlock_irqrestore(&zone->lock, flags);
 }
 
+#ifdef CONFIG_CMA
+/*
+ * Hand a pageblock of memory reserved at boot over to the buddy allocator
+ * as MIGRATE_CMA, see mm/cma.c.
+ */
+void __init init_cma_reserved_pageblock(struct page *page)
+{
+	unsigned i = pageblock_nr_pages;
+	struct page *p = page;
+
+	do {
+		__ClearPageReserved(p);
+		set_page_count(p, 0);
+	} while (++p, --i);
+
+	set_page_refcounted(page);
+	set_pageblock_migratetype(page, MIGRATE_CMA);
+	__free_pages(page, pageblock_order);
+	totalram_pages += pageblock_nr_pages;
+}
+
+static struct page *
+cma_migrate_alloc(struct page *page, unsigned long private, int **x)
+{
+	/* the range being claimed is isolated, so this lands elsewhere */
+	return alloc_page(GFP_HIGHUSER_MOVABLE);
+}
+
+#define NR_CMA_MIGRATE_AT_ONCE	(SWAP_CLUSTER_MAX)
+#define NR_CMA_MIGRATE_RETRIES	5
+
+/*
+ * Migrate everything that is in use in [start, end) out of the range. The
+ * range must be isolated already so that nothing is allocated from it
+ * again. Only pages on the LRU can be moved, anything else that is still
+ * busy after a few passes fails the range with -EBUSY.
+ */
+static int __alloc_contig_migrate_range(unsigned long start,
+					unsigned long end)
+{
+	unsigned long pfn;
+	struct page *page;
+	unsigned int order;
+	int tries = 0;
+	int nr, busy, ret;
+	LIST_HEAD(source);
+
+	/* pages sitting in the pagevecs are not on the LRU yet */
+	migrate_prep();
+
+	while (tries++ < NR_CMA_MIGRATE_RETRIES) {
+		busy = 0;
+		for (pfn = start; pfn < end; ) {
+			nr = 0;
+			for (; pfn < end && nr < NR_CMA_MIGRATE_AT_ONCE; pfn++) {
+				if (!pfn_valid_within(pfn))
+					continue;
+				page = pfn_to_page(pfn);
+				if (PageBuddy(page)) {
+					/* racy, the order is only a hint */
+					order = page_order(page);
+					if (order < MAX_ORDER)
+						pfn += (1UL << order) - 1;
+					continue;
+				}
+				if (!page_count(page))
+					continue;
+				if (isolate_lru_page(page)) {
+					busy++;
+					continue;
+				}
+				list_add_tail(&page->lru, &source);
+				inc_zone_page_state(page, NR_ISOLATED_ANON +
+						    page_is_file_cache(page));
+				nr++;
+			}
+			if (fatal_signal_pending(current)) {
+				putback_lru_pages(&source);
+				return -EINTR;
+			}
+			if (list_empty(&source))
+				continue;
+			/* returns the number of pages left behind */
+			ret = migrate_pages(&source, cma_migrate_alloc, 0, 0);
+			if (ret < 0)
+				return ret;
+			busy += ret;
+		}
+		if (!busy)
+			return 0;
+		/* let the holders of the remaining pages drop them */
+		lru_add_drain_all();
+		drain_all_pages();
+		congestion_wait(BLK_RW_ASYNC, HZ/50);
+	}
+	return -EBUSY;
+}
+
+/*
+ * Take the now free pages of [start, end) out of the buddy allocator as
+ * order 0 pages. start must be the head of a free buddy page, the last one
+ * may extend past end, the pfn it ends at is returned. On failure the
+ * pages taken so far are given back and 0 is returned.
+ */
+static unsigned long __isolate_contig_free_range(unsigned long start,
+						 unsigned long end)
+{
+	struct zone *zone = page_zone(pfn_to_page(start));
+	unsigned long flags;
+	unsigned long pfn = start;
+	unsigned int order;
+	struct page *page;
+
+	spin_lock_irqsave(&zone->lock, flags);
+	while (pfn < end) {
+		page = pfn_to_page(pfn);
+		if (!PageBuddy(page))
+			break;
+		order = page_order(page);
+		list_del(&page->lru);
+		zone->free_area[order].nr_free--;
+		rmv_page_order(page);
+		__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+		set_page_refcounted(page);
+		split_page(page, order);
+		pfn += 1 << order;
+	}
+	spin_unlock_irqrestore(&zone->lock, flags);
+
+	if (pfn < end) {
+		free_contig_range(start, pfn - start);
+		return 0;
+	}
+	return pfn;
+}
+
+/**
+ * alloc_contig_range() -- allocate a range of MIGRATE_CMA pages
+ * @start:	first pfn of the range
+ * @end:	pfn one past the range
+ *
+ * Migrates whatever the page allocator placed in the range and takes the
+ * pages for the caller, each with a reference count of one. The range has
+ * to lie in MIGRATE_CMA pageblocks of a single zone, and callers claiming
+ * ranges that share a pageblock must be serialized. Returns 0, or -EBUSY
+ * when some page could not be moved out, in which case nothing is taken.
+ */
+int alloc_contig_range(unsigned long start, unsigned long end)
+{
+	unsigned long align = max_t(unsigned long, MAX_ORDER_NR_PAGES,
+				    pageblock_nr_pages);
+	unsigned long iso_start = start & ~(align - 1);
+	unsigned long iso_end = ALIGN(end, align);
+	unsigned long outer_start, outer_end;
+	unsigned int order;
+	int ret;
+
+	ret = start_isolate_page_range(iso_start, iso_end, MIGRATE_CMA);
+	if (ret)
+		return ret;
+
+	ret = __alloc_contig_migrate_range(start, end);
+	if (ret)
+		goto done;
+
+	/*
+	 * Pages freed by the migration may still be on the pcp lists, and
+	 * start may be in the middle of a free buddy page.
+	 */
+	lru_add_drain_all();
+	drain_all_pages();
+
+	order = 0;
+	outer_start = start;
+	while (!PageBuddy(pfn_to_page(outer_start))) {
+		if (++order >= MAX_ORDER) {
+			ret = -EBUSY;
+			goto done;
+		}
+		outer_start &= ~0UL << order;
+	}
+	/* the buddy page found below start must also cover it */
+	if (outer_start + (1UL << page_order(pfn_to_page(outer_start))) <= start) {
+		ret = -EBUSY;
+		goto done;
+	}
+
+	outer_end = __isolate_contig_free_range(outer_start, end);
+	if (!outer_end) {
+		ret = -EBUSY;
+		goto done;
+	}
+
+	/* give back what the buddy pages at either end brought in */
+	if (start != outer_start)
+		free_contig_range(outer_start, start - outer_start);
+	if (end != outer_end)
+		free_contig_range(end, outer_end - end);
+
+done:
+	undo_isolate_page_range(iso_start, iso_end, MIGRATE_CMA);
+	return ret;
+}
+
+void free_contig_range(unsigned long pfn, unsigned long nr_pages)
+{
+	for (; nr_pages--; pfn++)
+		__free_page(pfn_to_page(pfn));
+}
+#endif
+
 #ifdef CONFIG_MEMORY_HOTREMOVE
 /*
  * All pages in the range must be isolated before calling this.
@@ -15,17 +15,20 @@
 #define DEBUG
 
 #include <linux/file.h>
+#include <linux/hash.h>
 #include <linux/inetdevice.h>
 #include <linux/module.h>
 #include <linux/netfilter/x_tables.h>
 #include <linux/netfilter/xt_qtaguid.h>
 #include <linux/ratelimit.h>
+#include <linux/rculist.h>
 #include <linux/skbuff.h>
 #include <linux/workqueue.h>
 #include <net/addrconf.h>
 #include <net/sock.h>
 #include <net/tcp.h>
 #include <net/udp.h>
+#include <asm/uaccess.h>
 
 #if defined(CONFIG_IP6_NF_IPTABLES) || defined(CONFIG_IP6_NF_IPTABLES_MODULE)
 #include <linux/netfilter_ipv6/ip6_tables.h>
@@ -159,6 +162,10 @@ static struct proc_dir_entry *iface_stat_fmt_procfile;
  * qtudev_open()
  *   uid_tag_data_tree_lock
  *
+ * qtudev_get_stats()
+ *   iface_stat_list_lock
+ *     struct iface_stat->tag_stat_list_lock
+ *
  * qtudev_release()
  *   sock_tag_data_list_lock
  *     uid_tag_data_tree_lock
@@ -186,17 +193,26 @@ static struct proc_dir_entry *iface_stat_fmt_procfile;
  *     iface_stat_list_lock
  *
  * qtaguid_mt()
+ *   iface_stat_update_from_skb()
+ *     rcu_read_lock_bh()
+ *       (iface_stat_list)
  *   account_for_uid()
  *     if_tag_stat_update()
- *       get_sock_stat()
- *         sock_tag_list_lock
- *       struct iface_stat->tag_stat_list_lock
+ *       rcu_read_lock_bh()
+ *         get_sock_tag()
+ *           (sock_tag_hash)
+ *           sock_tag_seq
  *         tag_stat_update()
+ *           (struct iface_stat->tag_stat_hash)
  *           get_active_counter_set()
- *             tag_counter_set_list_lock
- *         tag_stat_update()
- *           get_active_counter_set()
- *             tag_counter_set_list_lock
+ *             (tag_counter_set_hash)
+ *         struct iface_stat->tag_stat_list_lock
+ *           tag_stat_update()
+ *
+ * The per packet path only takes tag_stat_list_lock to create a tag_stat.
+ * Everything it looks up locklessly is unlinked under its lock and freed
+ * with call_rcu_bh(); the counters it updates are per cpu, see
+ * struct data_counters_pcpu. iface_stat entries are never freed.
  *
  *
  * qtaguid_ctrl_parse()
@@ -225,9 +241,12 @@ static LIST_HEAD(iface_stat_list);
 static DEFINE_SPINLOCK(iface_stat_list_lock);
 
 static struct rb_root sock_tag_tree = RB_ROOT;
+static struct hlist_head sock_tag_hash[SOCK_TAG_HASH_SIZE];
 static DEFINE_SPINLOCK(sock_tag_list_lock);
+/* Lets get_sock_tag() read a sock_tag.tag that is being retagged */
+static seqcount_t sock_tag_seq = SEQCNT_ZERO;
 
-static struct rb_root tag_counter_set_tree = RB_ROOT;
+static struct hlist_head tag_counter_set_hash[TAG_COUNTER_SET_HASH_SIZE];
 static DEFINE_SPINLOCK(tag_counter_set_list_lock);
 
 static struct rb_root uid_tag_data_tree = RB_ROOT;
@@ -237,6 +256,12 @@ static struct rb_root proc_qtu_data_tree = RB_ROOT;
 /* No proc_qtu_data_tree_lock; use uid_tag_data_tree_lock */
 
 static struct qtaguid_event_counts qtu_events;
+
+/*
+ * Generation for the binary stats export. Each export moves it on, and
+ * tag_stat_update() stamps the tag_stats it touches with it.
+ */
+static atomic_long_t qtu_stats_gen = ATOMIC_LONG_INIT(1);
 /*----------------------------------------------*/
 static bool can_manipulate_uids(void)
 {
@@ -333,20 +358,79 @@ static struct tag_stat *tag_stat_tree_search(struct rb_root *root, tag_t tag)
 	return rb_entry(&node->node, struct tag_stat, tn.node);
 }
 
-static void tag_counter_set_tree_insert(struct tag_counter_set *data,
-					struct rb_root *root)
+/* Returns the first tag_stat with a tag >= the given one, or NULL. */
+static struct rb_node *tag_stat_tree_lower_bound(struct rb_root *root,
+						 tag_t tag)
 {
-	tag_node_tree_insert(&data->tn, root);
+	struct rb_node *node = root->rb_node;
+	struct rb_node *res = NULL;
+
+	while (node) {
+		struct tag_node *data = rb_entry(node, struct tag_node, node);
+		if (tag_compare(tag, data->tag) <= 0) {
+			res = node;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+	return res;
 }
 
-static struct tag_counter_set *tag_counter_set_tree_search(struct rb_root *root,
-							   tag_t tag)
+static struct hlist_head *tag_stat_hash_head(struct iface_stat *iface_entry,
+					     tag_t tag)
 {
-	struct tag_node *node = tag_node_tree_search(root, tag);
-	if (!node)
-		return NULL;
-	return rb_entry(&node->node, struct tag_counter_set, tn.node);
+	return &iface_entry->tag_stat_hash[hash_64(tag, TAG_STAT_HASH_BITS)];
+}
 
+/*
+ * Caller must hold iface_entry->tag_stat_list_lock or rcu_read_lock_bh().
+ */
+static struct tag_stat *tag_stat_hash_search(struct iface_stat *iface_entry,
+					     tag_t tag)
+{
+	struct tag_stat *ts_entry;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry_rcu(ts_entry, pos,
+				 tag_stat_hash_head(iface_entry, tag),
+				 hash_node) {
+		if (ts_entry->tn.tag == tag)
+			return ts_entry;
+	}
+	return NULL;
+}
+
+static void tag_stat_free_rcu(struct rcu_head *head)
+{
+	struct tag_stat *ts_entry = container_of(head, struct tag_stat, rcu);
+
+	kfree(ts_entry->counters);
+	kfree(ts_entry);
+}
+
+static struct hlist_head *tag_counter_set_hash_head(tag_t tag)
+{
+	return &tag_counter_set_hash[hash_64(tag, TAG_COUNTER_SET_HASH_BITS)];
+}
+
+/* Caller must hold tag_counter_set_list_lock or rcu_read_lock_bh(). */
+static struct tag_counter_set *tag_counter_set_search(tag_t tag)
+{
+	struct tag_counter_set *tcs;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry_rcu(tcs, pos, tag_counter_set_hash_head(tag),
+				 hash_node) {
+		if (tcs->tag == tag)
+			return tcs;
+	}
+	return NULL;
+}
+
+static void tag_counter_set_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct tag_counter_set, rcu));
 }
 
 static void tag_ref_tree_insert(struct tag_ref *data, struct rb_root *root)
@@ -402,6 +486,20 @@ static void sock_tag_tree_insert(struct sock_tag *data, struct rb_root *root)
 	rb_insert_color(&data->sock_node, root);
 }
 
+static struct hlist_head *sock_tag_hash_head(const struct sock *sk)
+{
+	return &sock_tag_hash[hash_ptr((void *)sk, SOCK_TAG_HASH_BITS)];
+}
+
+static void sock_tag_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct sock_tag, rcu));
+}
+
+/*
+ * The entries must already be off the sock_tag_hash. Only their memory
+ * waits for the per packet readers, the socket is released right away.
+ */
 static void sock_tag_tree_erase(struct rb_root *st_to_free_tree)
 {
 	struct rb_node *node;
@@ -418,7 +516,7 @@ static void sock_tag_tree_erase(struct rb_root *st_to_free_tree)
 			 get_uid_from_tag(st_entry->tag));
 		rb_erase(&st_entry->sock_node, st_to_free_tree);
 		sockfd_put(st_entry->socket);
-		kfree(st_entry);
+		call_rcu_bh(&st_entry->rcu, sock_tag_free_rcu);
 	}
 }
 
@@ -729,6 +827,7 @@ static int read_proc_bool(char *page, char **start, off_t off,
 	return len;
 }
 
+/* Caller must hold rcu_read_lock_bh() */
 static int get_active_counter_set(tag_t tag)
 {
 	int active_set = 0;
@@ -739,17 +838,16 @@ static int get_active_counter_set(tag_t tag)
 		 tag, get_uid_from_tag(tag));
 	/* For now we only handle UID tags for active sets */
 	tag = get_utag_from_tag(tag);
-	spin_lock_bh(&tag_counter_set_list_lock);
-	tcs = tag_counter_set_tree_search(&tag_counter_set_tree, tag);
+	tcs = tag_counter_set_search(tag);
 	if (tcs)
-		active_set = tcs->active_set;
-	spin_unlock_bh(&tag_counter_set_list_lock);
+		active_set = ACCESS_ONCE(tcs->active_set);
 	return active_set;
 }
 
 /*
  * Find the entry for tracking the specified interface.
- * Caller must hold iface_stat_list_lock
+ * Caller must hold iface_stat_list_lock or rcu_read_lock_bh().
+ * iface_stat entries are never freed.
  */
 static struct iface_stat *get_iface_entry(const char *ifname)
 {
@@ -762,7 +860,7 @@ static struct iface_stat *get_iface_entry(const char *ifname)
 	}
 
 	/* Iterate over interfaces */
-	list_for_each_entry(iface_entry, &iface_stat_list, list) {
+	list_for_each_entry_rcu(iface_entry, &iface_stat_list, list) {
 		if (!strcmp(ifname, iface_entry->ifname))
 			goto done;
 	}
@@ -789,9 +887,10 @@ static int pp_iface_stat_line(bool header, char *outp,
 			       "tx_other_bytes tx_other_packets\n"
 			);
 	} else {
-		struct data_counters *cnts;
+		struct data_counters totals;
+		struct data_counters *cnts = &totals;
 		int cnt_set = 0;   /* We only use one set for the device */
-		cnts = &iface_entry->totals_via_skb;
+		dc_fold(iface_entry->totals_via_skb, &totals);
 		len = snprintf(
 			outp, char_count,
 			"%s "
@@ -982,6 +1081,15 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 		kfree(new_iface);
 		return NULL;
 	}
+	new_iface->totals_via_skb = kzalloc(
+		nr_cpu_ids * sizeof(*new_iface->totals_via_skb), GFP_ATOMIC);
+	if (new_iface->totals_via_skb == NULL) {
+		pr_err("qtaguid: iface_stat: create(%s): "
+		       "counters alloc failed\n", net_dev->name);
+		kfree(new_iface->ifname);
+		kfree(new_iface);
+		return NULL;
+	}
 	spin_lock_init(&new_iface->tag_stat_list_lock);
 	new_iface->tag_stat_tree = RB_ROOT;
 	_iface_stat_set_active(new_iface, net_dev, true);
@@ -995,6 +1103,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 		pr_err("qtaguid: iface_stat: create(%s): "
 		       "work alloc failed\n", new_iface->ifname);
 		_iface_stat_set_active(new_iface, net_dev, false);
+		kfree(new_iface->totals_via_skb);
 		kfree(new_iface->ifname);
 		kfree(new_iface);
 		return NULL;
@@ -1002,7 +1111,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 	isw->iface_entry = new_iface;
 	INIT_WORK(&isw->iface_work, iface_create_proc_worker);
 	schedule_work(&isw->iface_work);
-	list_add(&new_iface->list, &iface_stat_list);
+	list_add_rcu(&new_iface->list, &iface_stat_list);
 	return new_iface;
 }
 
@@ -1183,16 +1292,30 @@ static struct sock_tag *get_sock_stat_nl(const struct sock *sk)
 	return sock_tag_tree_search(&sock_tag_tree, sk);
 }
 
-static struct sock_tag *get_sock_stat(const struct sock *sk)
+/*
+ * Lockless lookup of the tag for a sock, for the per packet path.
+ * Caller must hold rcu_read_lock_bh().
+ */
+static bool get_sock_tag(const struct sock *sk, tag_t *tag)
 {
 	struct sock_tag *sock_tag_entry;
-	MT_DEBUG("qtaguid: get_sock_stat(sk=%p)\n", sk);
+	struct hlist_node *pos;
+	unsigned int seq;
+
+	MT_DEBUG("qtaguid: get_sock_tag(sk=%p)\n", sk);
 	if (!sk)
-		return NULL;
-	spin_lock_bh(&sock_tag_list_lock);
-	sock_tag_entry = get_sock_stat_nl(sk);
-	spin_unlock_bh(&sock_tag_list_lock);
-	return sock_tag_entry;
+		return false;
+	hlist_for_each_entry_rcu(sock_tag_entry, pos, sock_tag_hash_head(sk),
+				 hash_node) {
+		if (sock_tag_entry->sk != sk)
+			continue;
+		do {
+			seq = read_seqcount_begin(&sock_tag_seq);
+			*tag = sock_tag_entry->tag;
+		} while (read_seqcount_retry(&sock_tag_seq, seq));
+		return true;
+	}
+	return false;
 }
 
 static int ipx_proto(const struct sk_buff *skb,
@@ -1216,10 +1339,15 @@ static int ipx_proto(const struct sk_buff *skb,
 	return tproto;
 }
 
+/* Caller must have bottom halves disabled. */
 static void
-data_counters_update(struct data_counters *dc, int set,
+data_counters_update(struct data_counters_pcpu *pcpu, int set,
 		     enum ifs_tx_rx direction, int proto, int bytes)
 {
+	struct data_counters_pcpu *this = &pcpu[smp_processor_id()];
+	struct data_counters *dc = &this->counters;
+
+	write_seqcount_begin(&this->seq);
 	switch (proto) {
 	case IPPROTO_TCP:
 		dc_add_byte_packets(dc, set, direction, IFS_TCP, bytes, 1);
@@ -1233,6 +1361,7 @@ data_counters_update(struct data_counters *dc, int set,
 				    1);
 		break;
 	}
+	write_seqcount_end(&this->seq);
 }
 
 /*
@@ -1334,46 +1463,55 @@ static void iface_stat_update_from_skb(const struct sk_buff *skb,
 			 par->family, proto);
 	}
 
-	spin_lock_bh(&iface_stat_list_lock);
+	rcu_read_lock_bh();
 	entry = get_iface_entry(el_dev->name);
 	if (entry == NULL) {
 		IF_DEBUG("qtaguid: iface_stat: %s(%s): not tracked\n",
 			 __func__, el_dev->name);
-		spin_unlock_bh(&iface_stat_list_lock);
+		rcu_read_unlock_bh();
 		return;
 	}
 
 	IF_DEBUG("qtaguid: %s(%s): entry=%p\n", __func__,
 		 el_dev->name, entry);
 
-	data_counters_update(&entry->totals_via_skb, 0, direction, proto,
+	data_counters_update(entry->totals_via_skb, 0, direction, proto,
 			     bytes);
-	spin_unlock_bh(&iface_stat_list_lock);
+	rcu_read_unlock_bh();
 }
 
+/* Caller must hold rcu_read_lock_bh() */
 static void tag_stat_update(struct tag_stat *tag_entry,
 			enum ifs_tx_rx direction, int proto, int bytes)
 {
 	int active_set;
+	unsigned long gen = atomic_long_read(&qtu_stats_gen);
+
+	/* Only dirty the cache line once per generation */
+	if (tag_entry->gen != gen)
+		tag_entry->gen = gen;
+	if (tag_entry->parent && tag_entry->parent->gen != gen)
+		tag_entry->parent->gen = gen;
 	active_set = get_active_counter_set(tag_entry->tn.tag);
 	MT_DEBUG("qtaguid: tag_stat_update(tag=0x%llx (uid=%u) set=%d "
 		 "dir=%d proto=%d bytes=%d)\n",
 		 tag_entry->tn.tag, get_uid_from_tag(tag_entry->tn.tag),
 		 active_set, direction, proto, bytes);
-	data_counters_update(&tag_entry->counters, active_set, direction,
+	data_counters_update(tag_entry->counters, active_set, direction,
 			     proto, bytes);
-	if (tag_entry->parent_counters)
-		data_counters_update(tag_entry->parent_counters, active_set,
+	if (tag_entry->parent)
+		data_counters_update(tag_entry->parent->counters, active_set,
 				     direction, proto, bytes);
 }
 
 /*
  * Create a new entry for tracking the specified {acct_tag,uid_tag} within
- * the interface.
+ * the interface. parent is the {0,uid_tag} entry that also gets charged,
+ * if any; it is set before the entry is visible to lockless readers.
  * iface_entry->tag_stat_list_lock should be held.
  */
 static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
-					   tag_t tag)
+					   tag_t tag, struct tag_stat *parent)
 {
 	struct tag_stat *new_tag_stat_entry = NULL;
 	IF_DEBUG("qtaguid: iface_stat: %s(): ife=%p tag=0x%llx"
@@ -1384,8 +1522,19 @@ static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
 		pr_err("qtaguid: iface_stat: tag stat alloc failed\n");
 		goto done;
 	}
+	new_tag_stat_entry->counters = kzalloc(
+		nr_cpu_ids * sizeof(*new_tag_stat_entry->counters), GFP_ATOMIC);
+	if (!new_tag_stat_entry->counters) {
+		pr_err("qtaguid: iface_stat: tag stat counters alloc failed\n");
+		kfree(new_tag_stat_entry);
+		new_tag_stat_entry = NULL;
+		goto done;
+	}
 	new_tag_stat_entry->tn.tag = tag;
+	new_tag_stat_entry->parent = parent;
 	tag_stat_tree_insert(new_tag_stat_entry, &iface_entry->tag_stat_tree);
+	hlist_add_head_rcu(&new_tag_stat_entry->hash_node,
+			   tag_stat_hash_head(iface_entry, tag));
 done:
 	return new_tag_stat_entry;
 }
@@ -1397,8 +1546,7 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	struct tag_stat *tag_stat_entry;
 	tag_t tag, acct_tag;
 	tag_t uid_tag;
-	struct data_counters *uid_tag_counters;
-	struct sock_tag *sock_tag_entry;
+	struct tag_stat *uid_tag_stat;
 	struct iface_stat *iface_entry;
 	struct tag_stat *new_tag_stat = NULL;
 	MT_DEBUG("qtaguid: if_tag_stat_update(ifname=%s "
@@ -1406,15 +1554,18 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		 ifname, uid, sk, direction, proto, bytes);
 
 
-	spin_lock_bh(&iface_stat_list_lock);
+	/*
+	 * Nothing below takes a global lock unless a tag_stat has to be
+	 * created. Anything we find stays around until rcu_read_unlock_bh().
+	 */
+	rcu_read_lock_bh();
 	iface_entry = get_iface_entry(ifname);
 	if (!iface_entry) {
-		spin_unlock_bh(&iface_stat_list_lock);
+		rcu_read_unlock_bh();
 		pr_err_ratelimited("qtaguid: iface_stat: stat_update() "
 				   "%s not found\n", ifname);
 		return;
 	}
-	spin_unlock_bh(&iface_stat_list_lock);
 	/* It is ok to process data when an iface_entry is inactive */
 
 	MT_DEBUG("qtaguid: iface_stat: stat_update() dev=%s entry=%p\n",
@@ -1424,9 +1575,7 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	 * Look for a tagged sock.
 	 * It will have an acct_uid.
 	 */
-	sock_tag_entry = get_sock_stat(sk);
-	if (sock_tag_entry) {
-		tag = sock_tag_entry->tag;
+	if (get_sock_tag(sk, &tag)) {
 		acct_tag = get_atag_from_tag(tag);
 		uid_tag = get_utag_from_tag(tag);
 	} else {
@@ -1437,21 +1586,27 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	MT_DEBUG("qtaguid: iface_stat: stat_update(): "
 		 " looking for tag=0x%llx (uid=%u) in ife=%p\n",
 		 tag, get_uid_from_tag(tag), iface_entry);
-	/* Loop over tag list under this interface for {acct_tag,uid_tag} */
-	spin_lock_bh(&iface_entry->tag_stat_list_lock);
-
-	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
-					      tag);
+	/* Look for {acct_tag,uid_tag} under this interface */
+	tag_stat_entry = tag_stat_hash_search(iface_entry, tag);
 	if (tag_stat_entry) {
 		/*
 		 * Updating the {acct_tag, uid_tag} entry handles both stats:
 		 * {0, uid_tag} will also get updated.
 		 */
 		tag_stat_update(tag_stat_entry, direction, proto, bytes);
-		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+		rcu_read_unlock_bh();
 		return;
 	}
 
+	spin_lock_bh(&iface_entry->tag_stat_list_lock);
+	/* Another cpu might have created it since we looked */
+	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
+					      tag);
+	if (tag_stat_entry) {
+		tag_stat_update(tag_stat_entry, direction, proto, bytes);
+		goto unlock;
+	}
+
 	/* Loop over tag list under this interface for {0,uid_tag} */
 	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
 					      uid_tag);
@@ -1461,20 +1616,20 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		 * No parent counters. So
 		 *  - No {0, uid_tag} stats and no {acc_tag, uid_tag} stats.
 		 */
-		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag);
+		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag, NULL);
 		if (!new_tag_stat)
 			goto unlock;
-		uid_tag_counters = &new_tag_stat->counters;
+		uid_tag_stat = new_tag_stat;
 	} else {
-		uid_tag_counters = &tag_stat_entry->counters;
+		uid_tag_stat = tag_stat_entry;
 	}
 
 	if (acct_tag) {
 		/* Create the child {acct_tag, uid_tag} and hook up parent. */
-		new_tag_stat = create_if_tag_stat(iface_entry, tag);
+		new_tag_stat = create_if_tag_stat(iface_entry, tag,
+						  uid_tag_stat);
 		if (!new_tag_stat)
 			goto unlock;
-		new_tag_stat->parent_counters = uid_tag_counters;
 	} else {
 		/*
 		 * For new_tag_stat to be still NULL here would require:
@@ -1489,6 +1644,7 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	tag_stat_update(new_tag_stat, direction, proto, bytes);
 unlock:
 	spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+	rcu_read_unlock_bh();
 }
 
 static int iface_netdev_event_handler(struct notifier_block *nb,
@@ -2105,6 +2261,7 @@ static int ctrl_cmd_delete(const char *input)
 
 		if (!acct_tag || st_entry->tag == tag) {
 			rb_erase(&st_entry->sock_node, &sock_tag_tree);
+			hlist_del_rcu(&st_entry->hash_node);
 			/* Can't sockfd_put() within spinlock, do it later. */
 			sock_tag_tree_insert(st_entry, &st_to_free_tree);
 			tr_entry = lookup_tag_ref(st_entry->tag, NULL);
@@ -2128,16 +2285,16 @@ static int ctrl_cmd_delete(const char *input)
 	/* Delete tag counter-sets */
 	spin_lock_bh(&tag_counter_set_list_lock);
 	/* Counter sets are only on the uid tag, not full tag */
-	tcs_entry = tag_counter_set_tree_search(&tag_counter_set_tree, tag);
+	tcs_entry = tag_counter_set_search(tag);
 	if (tcs_entry) {
 		CT_DEBUG("qtaguid: ctrl_delete(%s): "
 			 "erase tcs: tag=0x%llx (uid=%u) set=%d\n",
 			 input,
-			 tcs_entry->tn.tag,
-			 get_uid_from_tag(tcs_entry->tn.tag),
+			 tcs_entry->tag,
+			 get_uid_from_tag(tcs_entry->tag),
 			 tcs_entry->active_set);
-		rb_erase(&tcs_entry->tn.node, &tag_counter_set_tree);
-		kfree(tcs_entry);
+		hlist_del_rcu(&tcs_entry->hash_node);
+		call_rcu_bh(&tcs_entry->rcu, tag_counter_set_free_rcu);
 	}
 	spin_unlock_bh(&tag_counter_set_list_lock);
 
@@ -2168,7 +2325,8 @@ static int ctrl_cmd_delete(const char *input)
 					 entry_uid);
 				rb_erase(&ts_entry->tn.node,
 					 &iface_entry->tag_stat_tree);
-				kfree(ts_entry);
+				hlist_del_rcu(&ts_entry->hash_node);
+				call_rcu_bh(&ts_entry->rcu, tag_stat_free_rcu);
 			}
 		}
 		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
@@ -2238,7 +2396,7 @@ static int ctrl_cmd_counter_set(const char *input)
 
 	tag = make_tag_from_uid(uid);
 	spin_lock_bh(&tag_counter_set_list_lock);
-	tcs = tag_counter_set_tree_search(&tag_counter_set_tree, tag);
+	tcs = tag_counter_set_search(tag);
 	if (!tcs) {
 		tcs = kzalloc(sizeof(*tcs), GFP_ATOMIC);
 		if (!tcs) {
@@ -2249,8 +2407,10 @@ static int ctrl_cmd_counter_set(const char *input)
 			res = -ENOMEM;
 			goto err;
 		}
-		tcs->tn.tag = tag;
-		tag_counter_set_tree_insert(tcs, &tag_counter_set_tree);
+		tcs->tag = tag;
+		tcs->active_set = counter_set;
+		hlist_add_head_rcu(&tcs->hash_node,
+				   tag_counter_set_hash_head(tag));
 		CT_DEBUG("qtaguid: ctrl_counterset(%s): added tcs tag=0x%llx "
 			 "(uid=%u) set=%d\n",
 			 input, tag, get_uid_from_tag(tag), counter_set);
@@ -2352,7 +2512,9 @@ static int ctrl_cmd_tag(const char *input)
 		BUG_ON(IS_ERR_OR_NULL(prev_tag_ref_entry));
 		BUG_ON(prev_tag_ref_entry->num_sock_tags <= 0);
 		prev_tag_ref_entry->num_sock_tags--;
+		write_seqcount_begin(&sock_tag_seq);
 		sock_tag_entry->tag = full_tag;
+		write_seqcount_end(&sock_tag_seq);
 	} else {
 		CT_DEBUG("qtaguid: ctrl_tag(%s): newtag for sk=%p\n",
 			 input, el_socket->sk);
@@ -2392,6 +2554,8 @@ static int ctrl_cmd_tag(const char *input)
 		spin_unlock_bh(&uid_tag_data_tree_lock);
 
 		sock_tag_tree_insert(sock_tag_entry, &sock_tag_tree);
+		hlist_add_head_rcu(&sock_tag_entry->hash_node,
+				   sock_tag_hash_head(sock_tag_entry->sk));
 		atomic64_inc(&qtu_events.sockets_tagged);
 	}
 	spin_unlock_bh(&sock_tag_list_lock);
@@ -2458,6 +2622,7 @@ static int ctrl_cmd_untag(const char *input)
 	 * so it can do whatever it wants to it.
 	 */
 	rb_erase(&sock_tag_entry->sock_node, &sock_tag_tree);
+	hlist_del_rcu(&sock_tag_entry->hash_node);
 
 	tag_ref_entry = lookup_tag_ref(sock_tag_entry->tag, &utd_entry);
 	BUG_ON(!tag_ref_entry);
@@ -2494,7 +2659,7 @@ static int ctrl_cmd_untag(const char *input)
 		 atomic_long_read(&el_socket->file->f_count) - 1);
 	sockfd_put(el_socket);
 
-	kfree(sock_tag_entry);
+	call_rcu_bh(&sock_tag_entry->rcu, sock_tag_free_rcu);
 	atomic64_inc(&qtu_events.sockets_untagged);
 
 	return 0;
@@ -2581,7 +2746,8 @@ struct proc_print_info {
 static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 {
 	int len;
-	struct data_counters *cnts;
+	struct data_counters counters;
+	struct data_counters *cnts = &counters;
 
 	if (!ppi->item_index) {
 		if (ppi->item_index++ < ppi->items_to_skip)
@@ -2613,7 +2779,7 @@ static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 		}
 		if (ppi->item_index++ < ppi->items_to_skip)
 			return 0;
-		cnts = &ppi->ts_entry->counters;
+		dc_fold(ppi->ts_entry->counters, &counters);
 		len = snprintf(
 			ppi->outp, ppi->char_count,
 			"%d %s 0x%llx %u %u "
@@ -2861,6 +3027,7 @@ static int qtudev_release(struct inode *inode, struct file *file)
 		free_tag_ref_from_utd_entry(tr, utd_entry);
 
 		rb_erase(&st_entry->sock_node, &sock_tag_tree);
+		hlist_del_rcu(&st_entry->hash_node);
 		list_del(&st_entry->list);
 		/* Can't sockfd_put() within spinlock, do it later. */
 		sock_tag_tree_insert(st_entry, &st_to_free_tree);
@@ -2891,11 +3058,135 @@ static int qtudev_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
+#define QTU_STATS_CHUNK (PAGE_SIZE / sizeof(struct qtaguid_stats_entry))
+
+/*
+ * Binary version of qtaguid_stats_proc_read(), see QTAGUID_IOC_GET_STATS.
+ * Tag stats are gathered a page at a time under iface_stat_list_lock and
+ * tag_stat_list_lock, and copied out once both are dropped.
+ */
+static long qtudev_get_stats(void __user *arg)
+{
+	struct qtaguid_stats_req req;
+	struct qtaguid_stats_entry __user *uentries;
+	struct qtaguid_stats_entry *chunk, *entry;
+	struct iface_stat *iface_entry;
+	struct tag_stat *ts_entry;
+	struct data_counters counters;
+	struct rb_node *node;
+	unsigned long since, gen;
+	unsigned int filled, needed = 0, n;
+	tag_t tag, next_tag;
+	uid_t stat_uid;
+	long res = 0;
+
+	BUILD_BUG_ON(sizeof(entry->counters) != sizeof(counters.bpc));
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+	if (req.version != QTAGUID_STATS_VERSION)
+		return -EINVAL;
+	uentries = (struct qtaguid_stats_entry __user *)(unsigned long)
+		req.entries;
+	since = req.generation;
+
+	chunk = kmalloc(QTU_STATS_CHUNK * sizeof(*chunk), GFP_KERNEL);
+	if (!chunk)
+		return -ENOMEM;
+
+	/* Updates that race with the walk are returned again next time */
+	gen = atomic_long_inc_return(&qtu_stats_gen) - 1;
+
+	/*
+	 * iface_stat entries are never unlinked or freed, so the walk can
+	 * pick up from iface_entry after the lock was dropped for a copy.
+	 */
+	spin_lock_bh(&iface_stat_list_lock);
+	list_for_each_entry(iface_entry, &iface_stat_list, list) {
+		if (unlikely(module_passive))
+			break;
+		next_tag = 0;
+		do {
+			filled = 0;
+			spin_lock_bh(&iface_entry->tag_stat_list_lock);
+			node = tag_stat_tree_lower_bound(
+				&iface_entry->tag_stat_tree, next_tag);
+			for (; node && filled < QTU_STATS_CHUNK;
+			     node = rb_next(node)) {
+				ts_entry = rb_entry(node, struct tag_stat,
+						    tn.node);
+				tag = ts_entry->tn.tag;
+				stat_uid = get_uid_from_tag(tag);
+				if (since && (long)(ts_entry->gen - since) < 0)
+					continue;
+				/* Same rule as pp_stats_line() */
+				if (get_atag_from_tag(tag)
+				    && !can_read_other_uid_stats(stat_uid))
+					continue;
+				entry = &chunk[filled++];
+				/* No stale heap after the name or in padding */
+				memset(entry, 0, sizeof(*entry));
+				strlcpy(entry->iface, iface_entry->ifname,
+					sizeof(entry->iface));
+				entry->acct_tag = get_atag_from_tag(tag) >> 32;
+				entry->uid = stat_uid;
+				dc_fold(ts_entry->counters, &counters);
+				memcpy(entry->counters, counters.bpc,
+				       sizeof(entry->counters));
+			}
+			if (node)
+				next_tag = rb_entry(node, struct tag_stat,
+						    tn.node)->tn.tag;
+			spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+
+			/* Past the end of the user's buffer we only count */
+			if (needed < req.count) {
+				n = min(filled, req.count - needed);
+				spin_unlock_bh(&iface_stat_list_lock);
+				if (copy_to_user(uentries + needed, chunk,
+						 n * sizeof(*chunk))) {
+					res = -EFAULT;
+					goto out;
+				}
+				spin_lock_bh(&iface_stat_list_lock);
+			}
+			needed += filled;
+		} while (node);
+	}
+	spin_unlock_bh(&iface_stat_list_lock);
+
+	if (needed > req.count)
+		res = -ENOSPC;
+	else
+		req.generation = gen;
+	req.count = needed;
+	if (copy_to_user(arg, &req, sizeof(req)))
+		res = -EFAULT;
+	CT_DEBUG("qtaguid: %s(): since=%lu gen=%lu entries=%u res=%ld\n",
+		 __func__, since, gen, needed, res);
+out:
+	kfree(chunk);
+	return res;
+}
+
+static long qtudev_ioctl(struct file *file, unsigned int cmd,
+			 unsigned long arg)
+{
+	switch (cmd) {
+	case QTAGUID_IOC_GET_STATS:
+		return qtudev_get_stats((void __user *)arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
 /*------------------------------------------*/
 static const struct file_operations qtudev_fops = {
 	.owner = THIS_MODULE,
 	.open = qtudev_open,
 	.release = qtudev_release,
+	.unlocked_ioctl = qtudev_ioctl,
+	.compat_ioctl = qtudev_ioctl,
 };
 
 static struct miscdevice qtu_device = {
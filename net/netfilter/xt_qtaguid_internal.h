@@ -11,8 +11,14 @@
 #define __XT_QTAGUID_INTERNAL_H__
 
 #include <linux/types.h>
+#include <linux/cache.h>
+#include <linux/cpumask.h>
+#include <linux/list.h>
 #include <linux/rbtree.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
 #include <linux/spinlock_types.h>
+#include <linux/string.h>
 #include <linux/workqueue.h>
 
 /* Iface handling */
@@ -197,6 +203,38 @@ static inline uint64_t dc_sum_packets(struct data_counters *counters,
 		+ counters->bpc[set][direction][IFS_PROTO_OTHER].packets;
 }
 
+/*
+ * The per packet path only ever touches the copy belonging to the cpu it
+ * runs on, with bottom halves disabled. Readers fold all the copies, and
+ * use the seqcount to get consistent 64bit values on 32bit machines.
+ */
+struct data_counters_pcpu {
+	seqcount_t seq;
+	struct data_counters counters;
+} ____cacheline_aligned_in_smp;
+
+/* Sum the per cpu copies into *sum. */
+static inline void dc_fold(const struct data_counters_pcpu *pcpu,
+			   struct data_counters *sum)
+{
+	const struct data_counters_pcpu *this;
+	struct data_counters snap;
+	uint64_t *dst = (uint64_t *)sum->bpc;
+	uint64_t *src = (uint64_t *)snap.bpc;
+	unsigned int seq;
+	int cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		this = &pcpu[cpu];
+		do {
+			seq = read_seqcount_begin(&this->seq);
+			snap = this->counters;
+		} while (read_seqcount_retry(&this->seq, seq));
+		for (i = 0; i < sizeof(snap) / sizeof(uint64_t); i++)
+			dst[i] += src[i];
+	}
+}
 
 /* Generic X based nodes used as a base for rb_tree ops */
 struct tag_node {
@@ -204,14 +242,23 @@ struct tag_node {
 	tag_t tag;
 };
 
+#define TAG_STAT_HASH_BITS 6
+#define TAG_STAT_HASH_SIZE (1 << TAG_STAT_HASH_BITS)
+
 struct tag_stat {
 	struct tag_node tn;
-	struct data_counters counters;
+	/* For lockless lookups from the per packet path */
+	struct hlist_node hash_node;
+	struct rcu_head rcu;
+	/* One entry per possible cpu */
+	struct data_counters_pcpu *counters;
 	/*
 	 * If this tag is acct_tag based, we need to count against the
 	 * matching parent uid_tag.
 	 */
-	struct data_counters *parent_counters;
+	struct tag_stat *parent;
+	/* qtu_stats_gen at the last update, for the binary stats export */
+	unsigned long gen;
 };
 
 struct iface_stat {
@@ -222,7 +269,8 @@ struct iface_stat {
 	struct net_device *net_dev;
 
 	struct byte_packet_counters totals_via_dev[IFS_MAX_DIRECTIONS];
-	struct data_counters totals_via_skb;
+	/* One entry per possible cpu */
+	struct data_counters_pcpu *totals_via_skb;
 	/*
 	 * We keep the last_known, because some devices reset their counters
 	 * just before NETDEV_UP, while some will reset just before
@@ -237,7 +285,9 @@ struct iface_stat {
 
 	struct proc_dir_entry *proc_ptr;
 
+	/* The tree is ordered for the stats output, the hash is for lookups */
 	struct rb_root tag_stat_tree;
+	struct hlist_head tag_stat_hash[TAG_STAT_HASH_SIZE];
 	spinlock_t tag_stat_list_lock;
 };
 
@@ -253,8 +303,14 @@ struct iface_stat_work {
  * This is the tag against which tag_stat.counters will be billed.
  * These structs need to be looked up by sock and pid.
  */
+#define SOCK_TAG_HASH_BITS 8
+#define SOCK_TAG_HASH_SIZE (1 << SOCK_TAG_HASH_BITS)
+
 struct sock_tag {
 	struct rb_node sock_node;
+	/* For lockless lookups by sk from the per packet path */
+	struct hlist_node hash_node;
+	struct rcu_head rcu;
 	struct sock *sk;  /* Only used as a number, never dereferenced */
 	/* The socket is needed for sockfd_put() */
 	struct socket *socket;
@@ -298,8 +354,13 @@ struct qtaguid_event_counts {
 };
 
 /* Track the set active_set for the given tag. */
+#define TAG_COUNTER_SET_HASH_BITS 6
+#define TAG_COUNTER_SET_HASH_SIZE (1 << TAG_COUNTER_SET_HASH_BITS)
+
 struct tag_counter_set {
-	struct tag_node tn;
+	struct hlist_node hash_node;
+	struct rcu_head rcu;
+	tag_t tag;
 	int active_set;
 };
 
@@ -153,7 +153,7 @@ char *pp_tag_stat(struct tag_stat *ts)
 {
 	char *tn_str;
 	char *counters_str;
-	char *parent_counters_str;
+	struct data_counters counters;
 	char *res;
 
 	if (!ts) {
@@ -162,15 +162,14 @@ char *pp_tag_stat(struct tag_stat *ts)
 		return res;
 	}
 	tn_str = pp_tag_node(&ts->tn);
-	counters_str = pp_data_counters(&ts->counters, true);
-	parent_counters_str = pp_data_counters(ts->parent_counters, false);
+	dc_fold(ts->counters, &counters);
+	counters_str = pp_data_counters(&counters, true);
 	res = kasprintf(GFP_ATOMIC,
-			"tag_stat@%p{%s, counters=%s, parent_counters=%s}",
-			ts, tn_str, counters_str, parent_counters_str);
+			"tag_stat@%p{%s, counters=%s, parent=tag_stat@%p}",
+			ts, tn_str, counters_str, ts->parent);
 	_bug_on_err_or_null(res);
 	kfree(tn_str);
 	kfree(counters_str);
-	kfree(parent_counters_str);
 	return res;
 }
 
@@ -180,7 +179,10 @@ char *pp_iface_stat(struct iface_stat *is)
 	if (!is) {
 		res = kasprintf(GFP_ATOMIC, "iface_stat@null{}");
 	} else {
-		struct data_counters *cnts = &is->totals_via_skb;
+		struct data_counters totals;
+		struct data_counters *cnts = &totals;
+
+		dc_fold(is->totals_via_skb, &totals);
 		res = kasprintf(GFP_ATOMIC, "iface_stat@%p{"
 				"list=list_head{...}, "
 				"ifname=%s, "